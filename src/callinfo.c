@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    callinfo.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the Call-Info parser
+ *
+ *  DEC112 Call-Info values look like
+ *  <urn:dec112:uid:<kind>:<value>:service.dec112.at>;purpose=dec112-...
+ *  Every value is scanned once in place; the results point into the
+ *  received message, so nothing is copied or allocated.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "callinfo.h"
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * callinfo_is(ptr, len, kind)
+ * returns 1 if ptr/len equals kind
+ */
+static int callinfo_is(const char *ptr, int len, const char *kind) {
+
+  return ((int)strlen(kind) == len) && !memcmp(ptr, kind, len);
+}
+
+/*
+ * callinfo_value(*val, ci)
+ * parses one Call-Info value
+ */
+static void callinfo_value(const pj_str_t *val, p_callinfo_t ci) {
+  const char *p;
+  const char *end;
+  const char *kind;
+  const char *v;
+  int ulen;
+  int mtype;
+
+  p = val->ptr;
+  end = val->ptr + val->slen;
+  ulen = strlen(CALLINFO_URN);
+
+  while ((p < end) && (*p != '<'))
+    p++;
+  if ((end - p <= ulen) || memcmp(p + 1, CALLINFO_URN, ulen))
+    return;
+
+  kind = p + 1 + ulen;
+  for (p = kind; (p < end) && (*p != ':') && (*p != '>'); p++)
+    ;
+  if ((p == end) || (*p != ':'))
+    return;
+  for (v = ++p; (p < end) && (*p != ':') && (*p != '>'); p++)
+    ;
+
+  if (callinfo_is(kind, v - 1 - kind, CALLINFO_CALLID)) {
+    ci->cid.ptr = (char *)v;
+    ci->cid.slen = p - v;
+  } else if (callinfo_is(kind, v - 1 - kind, CALLINFO_MSGID)) {
+    ci->mid.ptr = (char *)v;
+    ci->mid.slen = p - v;
+  } else if (callinfo_is(kind, v - 1 - kind, CALLINFO_MSGTYPE) && (p > v)) {
+    for (mtype = 0; (v < p) && (*v >= '0') && (*v <= '9'); v++)
+      mtype = mtype * 10 + (*v - '0');
+    if (v == p)
+      ci->mtype = mtype;
+  }
+}
+
+/*
+ * callinfo_parse(msg, ci)
+ * fills ci from the Call-Info and X-DEC112-Seq headers of msg
+ */
+void callinfo_parse(pjsip_msg *msg, p_callinfo_t ci) {
+  pjsip_generic_string_hdr *hdr;
+  pj_str_t hdr_name;
+  const char *p;
+  const char *end;
+
+  ci->cid.ptr = NULL;
+  ci->cid.slen = 0;
+  ci->mid.ptr = NULL;
+  ci->mid.slen = 0;
+  ci->mtype = -1;
+  ci->seq = 0;
+
+  hdr_name = pj_str("Call-Info");
+  hdr = (pjsip_generic_string_hdr *)pjsip_msg_find_hdr_by_name(msg, &hdr_name,
+                                                               NULL);
+  while (hdr) {
+    callinfo_value(&hdr->hvalue, ci);
+    hdr = (pjsip_generic_string_hdr *)pjsip_msg_find_hdr_by_name(
+        msg, &hdr_name, hdr->next);
+  }
+
+  hdr_name = pj_str(SEQ_HDR);
+  hdr = (pjsip_generic_string_hdr *)pjsip_msg_find_hdr_by_name(msg, &hdr_name,
+                                                               NULL);
+  if (hdr) {
+    end = hdr->hvalue.ptr + hdr->hvalue.slen;
+    for (p = hdr->hvalue.ptr; (p < end) && (*p >= '0') && (*p <= '9'); p++)
+      ci->seq = ci->seq * 10 + (*p - '0');
+  }
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    callinfo.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief callinfo.c header file
+ */
+
+#ifndef CALLINFO_H_INCLUDED
+#define CALLINFO_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <pjsua-lib/pjsua.h>
+#include <string.h>
+
+#include "seq.h"
+
+/******************************************************************** DEFINE */
+
+#define CALLINFO_URN "urn:dec112:uid:"
+#define CALLINFO_CALLID "callid"
+#define CALLINFO_MSGID "msgid"
+#define CALLINFO_MSGTYPE "msgtype"
+
+#define CALLINFO_MSGTYPE_CLOSE 19
+
+/******************************************************************* TYPEDEF */
+
+/* DEC112 Call-Info values (and the sequence number), pointing into the
+ * received message */
+typedef struct callinfo {
+  pj_str_t cid; /* dec112-CallId, slen 0 if missing */
+  pj_str_t mid; /* dec112-MessageId, slen 0 if missing */
+  int mtype;    /* dec112-MessageTyp, -1 if missing */
+  uint64_t seq; /* X-DEC112-Seq, 0 if missing */
+} s_callinfo_t, *p_callinfo_t;
+
+/*************************************************************** PROTOTYPES */
+
+void callinfo_parse(pjsip_msg *msg, p_callinfo_t ci);
+
+#endif // CALLINFO_H_INCLUDED
@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    calls.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the call-setup rate function definitions
+ *
+ *  Places INVITE sessions at a constant rate, each carrying the DEC112
+ *  Call-Info and Geolocation headers and the PIDF-LO next to the SDP, and
+ *  hangs them up after a hold time drawn from a distribution. There is no
+ *  sound device and calls are not connected to the conference bridge; with
+ *  VAD off the streams send RTP silence. Setup latency (INVITE -> 18x and
+ *  INVITE -> 200) and the number of calls up at the same time are
+ *  reported. With --sessions, chat sessions run alongside over the same
+ *  account, so voice and text load reach the ESRP together.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "calls.h"
+
+/******************************************************************* TYPEDEF */
+
+/* one placed call, user data of the pjsua call */
+typedef struct calls_call {
+  uint64_t inv_ns; /* INVITE sent */
+  uint64_t bye_ms; /* hangup due, set once answered */
+  int ringing;
+  int answered;
+  int hangup; /* BYE sent by us */
+  int done;   /* disconnected, main thread frees it */
+} s_calls_call_t, *p_calls_call_t;
+
+/******************************************************************* GLOBALS */
+
+static int calls_on = 0;
+static unsigned calls_seed;
+static p_calls_call_t calls_tab[PJSUA_MAX_CALLS];
+static s_calls_stats_t calls_st;
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * calls_hold_parse(cfg, spec)
+ * sets the hold time distribution in seconds: <s>, fixed:<s>,
+ * uniform:<min>:<max> or exp:<mean>
+ */
+int calls_hold_parse(p_calls_cfg_t cfg, const char *spec) {
+  char *end;
+
+  if (!strncmp(spec, "fixed:", 6)) {
+    cfg->hold = CALLS_FIXED;
+    cfg->hold_min = atof(spec + 6);
+  } else if (!strncmp(spec, "uniform:", 8)) {
+    cfg->hold = CALLS_UNIFORM;
+    cfg->hold_min = strtod(spec + 8, &end);
+    if (*end != ':')
+      return -1;
+    cfg->hold_max = atof(end + 1);
+    if (cfg->hold_max < cfg->hold_min)
+      return -1;
+  } else if (!strncmp(spec, "exp:", 4)) {
+    cfg->hold = CALLS_EXP;
+    cfg->hold_mean = atof(spec + 4);
+    if (cfg->hold_mean <= 0)
+      return -1;
+  } else {
+    cfg->hold = CALLS_FIXED;
+    cfg->hold_min = atof(spec);
+  }
+
+  return (cfg->hold_min < 0) ? -1 : 0;
+}
+
+/*
+ * calls_hold_ms(cfg)
+ * draws the next hold time
+ */
+static uint64_t calls_hold_ms(p_calls_cfg_t cfg) {
+  double u;
+
+  u = (rand_r(&calls_seed) + 1.0) / ((double)RAND_MAX + 2.0);
+
+  switch (cfg->hold) {
+  case CALLS_UNIFORM:
+    return (cfg->hold_min + u * (cfg->hold_max - cfg->hold_min)) * 1000;
+  case CALLS_EXP:
+    return -cfg->hold_mean * log(u) * 1000;
+  default:
+    return cfg->hold_min * 1000;
+  }
+}
+
+/*
+ * calls_config(cfg, media_cfg)
+ * all call slots of pjsua, and silence frames instead of no RTP at all;
+ * call before pjsua_init()
+ */
+void calls_config(pjsua_config *cfg, pjsua_media_config *media_cfg) {
+
+  cfg->max_calls = PJSUA_MAX_CALLS;
+  media_cfg->no_vad = 1;
+}
+
+/*
+ * calls_active()
+ * returns 1 while calls_run() places calls
+ */
+int calls_active(void) { return __atomic_load_n(&calls_on, __ATOMIC_ACQUIRE); }
+
+/*
+ * calls_on_state(call_id)
+ * follows a placed call, runs in a pjsua worker thread
+ */
+void calls_on_state(pjsua_call_id call_id) {
+  pjsua_call_info ci;
+  p_calls_call_t c;
+  uint64_t now;
+  int active;
+
+  if (!calls_active() || !(c = pjsua_call_get_user_data(call_id)) ||
+      (pjsua_call_get_info(call_id, &ci) != PJ_SUCCESS))
+    return;
+
+  now = stats_now_ns();
+  switch (ci.state) {
+  case PJSIP_INV_STATE_EARLY:
+    if (!c->ringing) {
+      c->ringing = 1;
+      STAT_INC(calls_st.ringing);
+      hist_record(&calls_st.ring, (now - c->inv_ns) / 1000);
+    }
+    break;
+  case PJSIP_INV_STATE_CONNECTING:
+  case PJSIP_INV_STATE_CONFIRMED:
+    if (!c->answered) {
+      STAT_INC(calls_st.answered);
+      hist_record(&calls_st.answer, (now - c->inv_ns) / 1000);
+      active = __atomic_add_fetch(&calls_st.active, 1, __ATOMIC_RELAXED);
+      if (active > __atomic_load_n(&calls_st.peak, __ATOMIC_RELAXED))
+        __atomic_store_n(&calls_st.peak, active, __ATOMIC_RELAXED);
+      __atomic_store_n(&c->answered, 1, __ATOMIC_RELEASE);
+    }
+    break;
+  case PJSIP_INV_STATE_DISCONNECTED:
+    if (c->answered) {
+      __atomic_sub_fetch(&calls_st.active, 1, __ATOMIC_RELAXED);
+      if (!__atomic_load_n(&c->hangup, __ATOMIC_ACQUIRE))
+        STAT_INC(calls_st.dropped);
+    } else {
+      STAT_INC(calls_st.failed);
+      if ((ci.last_status == SIP_CODE_BUSY_HERE) || (ci.last_status == 600))
+        STAT_INC(calls_st.busy);
+      else if (ci.last_status == SIP_CODE_UNAVAILABLE)
+        STAT_INC(calls_st.unavailable);
+    }
+    pjsua_call_set_user_data(call_id, NULL);
+    __atomic_store_n(&c->done, 1, __ATOMIC_RELEASE);
+    break;
+  default:
+    break;
+  }
+}
+
+/*
+ * calls_place(acc_id, uri, urn)
+ * sends one INVITE with the DEC112 headers and the PIDF-LO
+ */
+static void calls_place(pjsua_acc_id acc_id, pj_str_t *uri, pj_str_t *urn) {
+  pjsua_call_setting opt;
+  pjsua_msg_data msg_data;
+  pjsua_call_id call_id;
+  p_calls_call_t c;
+  pj_pool_t *pool;
+  pj_status_t status;
+
+  c = (p_calls_call_t)calloc(1, sizeof(s_calls_call_t));
+  pool = pjsua_pool_create("call", BUFFER_2048, BUFFER_2048);
+  if (!c || !pool) {
+    STAT_INC(calls_st.refused);
+    free(c);
+    if (pool)
+      pj_pool_release(pool);
+    return;
+  }
+
+  pjsua_call_setting_default(&opt);
+  opt.aud_cnt = 1;
+  opt.vid_cnt = 0;
+  pjsua_msg_data_init(&msg_data);
+  dec112_msg_data(&msg_data, pool, NULL, -1);
+  if (urn->slen > 0)
+    msg_data.target_uri = *urn;
+
+  c->inv_ns = stats_now_ns();
+  status = pjsua_call_make_call(acc_id, uri, &opt, c, &msg_data, &call_id);
+  pj_pool_release(pool);
+  if (status != PJ_SUCCESS) {
+    STAT_INC(calls_st.refused);
+    free(c);
+    return;
+  }
+
+  STAT_INC(calls_st.placed);
+  /* the previous call on that slot is done */
+  free(calls_tab[call_id]);
+  calls_tab[call_id] = c;
+}
+
+/*
+ * calls_sweep(cfg, now_ms)
+ * hangs up calls whose hold time is over and frees finished ones; returns
+ * number of calls still up or setting up
+ */
+static int calls_sweep(p_calls_cfg_t cfg, uint64_t now_ms) {
+  p_calls_call_t c;
+  int cnt;
+  int i;
+
+  cnt = 0;
+  for (i = 0; i < PJSUA_MAX_CALLS; i++) {
+    if (!(c = calls_tab[i]))
+      continue;
+    if (__atomic_load_n(&c->done, __ATOMIC_ACQUIRE)) {
+      free(c);
+      calls_tab[i] = NULL;
+      continue;
+    }
+    cnt++;
+    if (!__atomic_load_n(&c->answered, __ATOMIC_ACQUIRE) || c->hangup)
+      continue;
+    if (c->bye_ms == 0)
+      c->bye_ms = now_ms + calls_hold_ms(cfg);
+    if (now_ms >= c->bye_ms) {
+      __atomic_store_n(&c->hangup, 1, __ATOMIC_RELEASE);
+      pjsua_call_hangup(i, 0, NULL, NULL);
+    }
+  }
+
+  return cnt;
+}
+
+/*
+ * calls_print(fh, elapsed_s)
+ * prints the call counters and the setup latencies
+ */
+static void calls_print(FILE *fh, double elapsed_s) {
+
+  fprintf(fh,
+          "\n##### calls: placed=%lu (%.1f/s) refused=%lu ringing=%lu "
+          "answered=%lu failed=%lu busy=%lu unavailable=%lu dropped=%lu "
+          "peak=%i of %i slots #####\n",
+          (unsigned long)calls_st.placed,
+          (elapsed_s > 0) ? calls_st.placed / elapsed_s : 0.0,
+          (unsigned long)calls_st.refused, (unsigned long)calls_st.ringing,
+          (unsigned long)calls_st.answered, (unsigned long)calls_st.failed,
+          (unsigned long)calls_st.busy, (unsigned long)calls_st.unavailable,
+          (unsigned long)calls_st.dropped, calls_st.peak, PJSUA_MAX_CALLS);
+  hist_print(fh, "ringing", &calls_st.ring);
+  hist_print(fh, "answer", &calls_st.answer);
+}
+
+/*
+ * calls_run(*acc_id, cfg, *uri, *urn)
+ * places calls for the configured duration; sessions of the session table,
+ * if any, chat at the same time
+ */
+int calls_run(pjsua_acc_id *acc_id, p_calls_cfg_t cfg, pj_str_t *uri,
+              pj_str_t *urn) {
+  s_fsm_cfg_t fcfg;
+  uint64_t start;
+  uint64_t now;
+  uint64_t next_report;
+  uint64_t end;
+  uint64_t due;
+  int up;
+
+  if (cfg->cps <= 0)
+    return -1;
+
+  /* null media, nothing is played or recorded */
+  pjsua_set_null_snd_dev();
+
+  memset(&calls_st, 0, sizeof(calls_st));
+  memset(calls_tab, 0, sizeof(calls_tab));
+  calls_seed = loop_seed((unsigned)getpid() ^ (unsigned)time(NULL));
+  __atomic_store_n(&calls_on, 1, __ATOMIC_RELEASE);
+
+  if (session_count() > 0) {
+    memset(&fcfg, 0, sizeof(fcfg));
+    fcfg.acc_id = *acc_id;
+    fcfg.uri = *uri;
+    fcfg.urn = *urn;
+    fcfg.msgs = cfg->msgs;
+    fcfg.interval_ms = cfg->interval_ms;
+    fcfg.cycles = 0;
+    if (fsm_start(&fcfg) != 0)
+      return -1;
+  }
+
+  printf("\n##### calls: %.1f calls/s for %u s, %i chat sessions #####\n\n",
+         cfg->cps, cfg->duration_s, session_count());
+
+  start = stats_now_ns() / 1000000;
+  end = start + (uint64_t)cfg->duration_s * 1000;
+  next_report = start + FSM_REPORT_MS;
+  for (now = start; now < end; now = stats_now_ns() / 1000000) {
+    /* calls owed at the target rate, no catching up after a stall */
+    due = (uint64_t)((now - start) * cfg->cps / 1000.0) + 1;
+    if (due > calls_st.placed + calls_st.refused + PJSUA_MAX_CALLS)
+      due = calls_st.placed + calls_st.refused + 1;
+    while (calls_st.placed + calls_st.refused < due)
+      calls_place(*acc_id, uri, urn);
+
+    up = calls_sweep(cfg, now);
+    if (now >= next_report) {
+      printf("calls t=%lus placed=%lu up=%i active=%i answered=%lu "
+             "failed=%lu refused=%lu\n",
+             (unsigned long)(now - start) / 1000,
+             (unsigned long)STAT_GET(calls_st.placed), up,
+             STAT_GET(calls_st.active),
+             (unsigned long)STAT_GET(calls_st.answered),
+             (unsigned long)STAT_GET(calls_st.failed),
+             (unsigned long)STAT_GET(calls_st.refused));
+      fflush(stdout);
+      next_report += FSM_REPORT_MS;
+    }
+    loop_sleep(CALLS_POLL_MS);
+  }
+
+  if (session_count() > 0)
+    fsm_stop();
+
+  /* calls still up are ended now */
+  for (up = 0; up < PJSUA_MAX_CALLS; up++) {
+    if (calls_tab[up] && !calls_tab[up]->done) {
+      __atomic_store_n(&calls_tab[up]->hangup, 1, __ATOMIC_RELEASE);
+      pjsua_call_hangup(up, 0, NULL, NULL);
+    }
+  }
+  end = stats_now_ns() / 1000000 + CALLS_DRAIN_S * 1000;
+  while ((calls_sweep(cfg, 0) > 0) && (stats_now_ns() / 1000000 < end))
+    loop_sleep(CALLS_POLL_MS * 10);
+
+  calls_print(stdout, (now - start) / 1000.0);
+  if (session_count() > 0)
+    stats_print(stdout, &stats);
+
+  __atomic_store_n(&calls_on, 0, __ATOMIC_RELEASE);
+  for (up = 0; up < PJSUA_MAX_CALLS; up++) {
+    free(calls_tab[up]);
+    calls_tab[up] = NULL;
+  }
+
+  return (calls_st.failed > 0) ? 1 : 0;
+}
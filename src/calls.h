@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    calls.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief calls.c header file (INVITE call-setup rate)
+ */
+
+#ifndef CALLS_H_INCLUDED
+#define CALLS_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <math.h>
+
+#include "fsm.h"
+#include "functions.h"
+
+/******************************************************************** DEFINE */
+
+#define CALLS_DURATION_S 60 /* calls are placed for that long */
+#define CALLS_HOLD_S 30     /* default hold time */
+#define CALLS_DRAIN_S 10    /* wait for the last BYEs */
+#define CALLS_POLL_MS 10
+
+/* hold time distributions, same syntax as --size */
+#define CALLS_FIXED 0   /* fixed:<s> */
+#define CALLS_UNIFORM 1 /* uniform:<min>:<max> */
+#define CALLS_EXP 2     /* exp:<mean> */
+
+/******************************************************************* TYPEDEF */
+
+typedef struct calls_cfg {
+  double cps;           /* new calls per second */
+  unsigned duration_s;  /* calls are placed for that long */
+  int hold;             /* hold time distribution */
+  double hold_min;      /* seconds, fixed and uniform */
+  double hold_max;      /* seconds, uniform */
+  double hold_mean;     /* seconds, exp */
+  unsigned msgs;        /* chat messages of concurrent sessions */
+  unsigned interval_ms; /* gap between chat messages */
+} s_calls_cfg_t, *p_calls_cfg_t;
+
+/* call counters, updated from the pjsua callbacks */
+typedef struct calls_stats {
+  uint64_t placed;      /* INVITE sent */
+  uint64_t refused;     /* no free call slot or pjsua error */
+  uint64_t ringing;     /* 18x received */
+  uint64_t answered;    /* 200 received */
+  uint64_t failed;      /* final non-2xx response or no response */
+  uint64_t busy;        /* 486 or 600 */
+  uint64_t unavailable; /* 503 */
+  uint64_t dropped;     /* ended by the remote side before the hold time */
+  int active;           /* answered and not yet disconnected */
+  int peak;             /* highest active */
+  s_hist_t ring;        /* INVITE -> first 18x */
+  s_hist_t answer;      /* INVITE -> 200 */
+} s_calls_stats_t, *p_calls_stats_t;
+
+/*************************************************************** PROTOTYPES */
+
+int calls_hold_parse(p_calls_cfg_t cfg, const char *spec);
+void calls_config(pjsua_config *cfg, pjsua_media_config *media_cfg);
+int calls_active(void);
+void calls_on_state(pjsua_call_id call_id);
+int calls_run(pjsua_acc_id *acc_id, p_calls_cfg_t cfg, pj_str_t *uri,
+              pj_str_t *urn);
+
+#endif // CALLS_H_INCLUDED
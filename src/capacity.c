@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    capacity.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the capacity search function definitions
+ *
+ *  The load is the number of chatting sessions, each sending a chat
+ *  message every interval. Starting with one session the load doubles
+ *  while a step stays within the SLA (reply latency p99, timeouts, failed
+ *  and rejected requests); after the first violation the highest passing
+ *  load is narrowed down by bisection. Every step waits until the number
+ *  of active sessions settled and then measures one window on counter and
+ *  histogram deltas.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "capacity.h"
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * capacity_active()
+ * returns number of sessions not retired
+ */
+static int capacity_active(void) { return session_count() - fsm_done(); }
+
+/*
+ * capacity_settle(n, cfg)
+ * launches or drains sessions until n are active and their start messages
+ * had time to complete
+ */
+static void capacity_settle(int n, p_capacity_cfg_t cfg) {
+  uint64_t end;
+  int active;
+
+  active = capacity_active();
+  if (n > active)
+    fsm_add(n - active);
+  else if (n < active)
+    fsm_drain(active - n); /* retire after their current cycle */
+
+  end = stats_now_ns() / 1000000 + (uint64_t)(cfg->msgs + 2) * cfg->interval_ms;
+  while ((capacity_active() != n) && (stats_now_ns() / 1000000 < end))
+    loop_sleep(CAPACITY_POLL_MS);
+  loop_sleep(2 * cfg->interval_ms);
+}
+
+/*
+ * capacity_measure(n, cfg, step)
+ * measures one window at n sessions and checks it against the SLA
+ */
+static void capacity_measure(int n, p_capacity_cfg_t cfg,
+                             p_capacity_step_t step) {
+  /* too large for the stack, only the main thread measures */
+  static s_stats_t s0[1];
+  static s_stats_t s1[1];
+  static s_hist_t h[1];
+  uint64_t tx;
+  uint64_t err;
+  int i;
+
+  memcpy(s0, &stats, sizeof(s_stats_t));
+  loop_sleep(cfg->window_s * 1000);
+  memcpy(s1, &stats, sizeof(s_stats_t));
+
+  /* replies of this window only */
+  h->cnt = s1->rtt.cnt - s0->rtt.cnt;
+  h->sum = s1->rtt.sum - s0->rtt.sum;
+  h->max = s1->rtt.max; /* process wide, only caps the quantiles */
+  for (i = 0; i < HIST_BUCKETS; i++)
+    h->b[i] = s1->rtt.b[i] - s0->rtt.b[i];
+
+  tx = s1->tx - s0->tx;
+  step->sessions = n;
+  step->offered = n * 1000.0 / cfg->interval_ms;
+  step->achieved = (double)tx / cfg->window_s;
+  step->p50_ms = hist_quantile(h, 0.50) / 1000.0;
+  step->p99_ms = hist_quantile(h, 0.99) / 1000.0;
+  err = (s1->tx_fail - s0->tx_fail) + (s1->tx_err - s0->tx_err);
+  step->timeout_pct = tx ? 100.0 * (s1->timeout - s0->timeout) / tx : 100;
+  step->error_pct = tx ? 100.0 * err / tx : 100;
+  step->pass = (h->cnt > 0) && (step->p99_ms <= cfg->p99_ms) &&
+               (step->timeout_pct <= cfg->timeout_pct) &&
+               (step->error_pct <= cfg->error_pct);
+}
+
+/*
+ * capacity_print(fh, step)
+ * prints one load level
+ */
+static void capacity_print(FILE *fh, p_capacity_step_t step) {
+
+  fprintf(fh, "%8i %10.1f %10.1f %9.1f %9.1f %8.2f%% %8.2f%%  %s\n",
+          step->sessions, step->offered, step->achieved, step->p50_ms,
+          step->p99_ms, step->timeout_pct, step->error_pct,
+          step->pass ? "pass" : "FAIL");
+  fflush(fh);
+}
+
+/*
+ * capacity_run(*acc_id, cfg, *uri, *urn)
+ * searches the highest load within the SLA; returns the number of
+ * sessions found or -1
+ */
+int capacity_run(pjsua_acc_id *acc_id, p_capacity_cfg_t cfg, pj_str_t *uri,
+                 pj_str_t *urn) {
+  s_capacity_step_t step[CAPACITY_MAX_STEPS];
+  s_capacity_step_t tmp;
+  s_fsm_cfg_t fcfg;
+  int cnt;
+  int lo;
+  int hi;
+  int n;
+  int i;
+  int j;
+
+  memset(&fcfg, 0, sizeof(fcfg));
+  fcfg.acc_id = *acc_id;
+  fcfg.uri = *uri;
+  fcfg.urn = *urn;
+  fcfg.msgs = cfg->msgs;
+  fcfg.interval_ms = cfg->interval_ms;
+  fcfg.cycles = 0;
+  fcfg.manual = 1;
+  if (fsm_start(&fcfg) != 0)
+    return -1;
+
+  printf("\n##### capacity search: up to %i sessions, p99 <= %.1f ms, "
+         "timeouts <= %.2f%%, errors <= %.2f%% #####\n\n",
+         session_count(), cfg->p99_ms, cfg->timeout_pct, cfg->error_pct);
+  printf("sessions    offered   achieved   p50(ms)   p99(ms)  timeout"
+         "     error\n");
+
+  /* lo passed, hi failed (or is beyond the session table) */
+  lo = 0;
+  hi = session_count() + 1;
+  cnt = 0;
+  n = 1;
+  while (cnt < CAPACITY_MAX_STEPS) {
+    capacity_settle(n, cfg);
+    capacity_measure(n, cfg, &step[cnt]);
+    capacity_print(stdout, &step[cnt]);
+
+    if (step[cnt].pass)
+      lo = n;
+    else
+      hi = n;
+    cnt++;
+
+    if ((lo == session_count()) ||
+        ((hi <= session_count()) && (hi - lo <= 1 + lo * CAPACITY_PRECISION)))
+      break;
+    if (hi > session_count())
+      n = (2 * n < session_count()) ? 2 * n : session_count();
+    else
+      n = (lo + hi) / 2;
+  }
+  fsm_stop();
+
+  /* latency curve, ordered by load */
+  for (i = 1; i < cnt; i++) {
+    tmp = step[i];
+    for (j = i; (j > 0) && (step[j - 1].sessions > tmp.sessions); j--)
+      step[j] = step[j - 1];
+    step[j] = tmp;
+  }
+  printf("\n##### latency curve #####\n\n");
+  printf("sessions    offered   achieved   p50(ms)   p99(ms)  timeout"
+         "     error\n");
+  for (i = 0; i < cnt; i++)
+    capacity_print(stdout, &step[i]);
+
+  if (lo == 0) {
+    conf->ret = conf->ret | ERR_TMR;
+    printf("\n##### capacity: SLA not met with a single session #####\n");
+  } else {
+    printf("\n##### capacity: %i sessions, %.1f msgs/s%s #####\n", lo,
+           lo * 1000.0 / cfg->interval_ms,
+           (lo == session_count()) ? " (session table exhausted)" : "");
+  }
+  stats_print(stdout, &stats);
+
+  return lo;
+}
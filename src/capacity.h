@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    capacity.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief capacity.c header file (adaptive capacity search)
+ */
+
+#ifndef CAPACITY_H_INCLUDED
+#define CAPACITY_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include "fsm.h"
+#include "functions.h"
+
+/******************************************************************** DEFINE */
+
+#define CAPACITY_WINDOW_S 10    /* measurement per step */
+#define CAPACITY_TIMEOUT_PCT 1  /* default SLA, requests without reply */
+#define CAPACITY_ERROR_PCT 1    /* default SLA, failed and rejected */
+#define CAPACITY_PRECISION 0.05 /* search ends within 5% of the result */
+#define CAPACITY_MAX_STEPS 64
+#define CAPACITY_POLL_MS 100
+
+/******************************************************************* TYPEDEF */
+
+typedef struct capacity_cfg {
+  double p99_ms;        /* SLA: reply latency p99 */
+  double timeout_pct;   /* SLA: requests without reply */
+  double error_pct;     /* SLA: send errors and non-2xx responses */
+  unsigned window_s;    /* measurement per step */
+  unsigned msgs;        /* chat messages per cycle */
+  unsigned interval_ms; /* gap between chat messages */
+} s_capacity_cfg_t, *p_capacity_cfg_t;
+
+/* one measured load level */
+typedef struct capacity_step {
+  int sessions;
+  double offered;  /* chat messages per second */
+  double achieved; /* MESSAGE requests per second */
+  double p50_ms;
+  double p99_ms;
+  double timeout_pct;
+  double error_pct;
+  int pass;
+} s_capacity_step_t, *p_capacity_step_t;
+
+/*************************************************************** PROTOTYPES */
+
+int capacity_run(pjsua_acc_id *acc_id, p_capacity_cfg_t cfg, pj_str_t *uri,
+                 pj_str_t *urn);
+
+#endif // CAPACITY_H_INCLUDED
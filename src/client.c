@@ -0,0 +1,1268 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    client.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the libpjchat session API
+ *
+ *  Brings up pjsua, the configuration, the DEC112 ids and the account once
+ *  per process and drives chat sessions of the session table on request:
+ *  start (21), chat messages (22), stop (23) and waiting for replies. The
+ *  pjchat modes run through client_run(), the command line only parses
+ *  its arguments; test programs link libpjchat.a instead of spawning
+ *  pjchat for every test. Calls may come from any thread.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "client.h"
+#include "corpus.h"
+#include "ctl.h"
+#include "dash.h"
+#include "dist.h"
+#include "fsm.h"
+#include "httpd.h"
+#include "impair.h"
+#include "matrix.h"
+#include "proxy.h"
+#include "reg.h"
+#include "replay.h"
+#include "stream.h"
+#include "tls.h"
+#include "trace.h"
+
+/******************************************************************* TYPEDEF */
+
+/* one received body, queued until client_expect() takes it */
+typedef struct client_msg {
+  struct client_msg *next;
+  int len;
+  char body[];
+} s_client_msg_t, *p_client_msg_t;
+
+/* replies not yet taken by client_expect(), oldest first */
+typedef struct client_box {
+  p_client_msg_t head;
+  p_client_msg_t tail;
+  int unread;
+} s_client_box_t, *p_client_box_t;
+
+/******************************************************************* GLOBALS */
+
+static int client_on = 0;
+static s_client_cb_t client_cb;
+static pj_pool_t *client_pool = NULL;
+static pjsua_acc_id client_acc = PJSUA_INVALID_ID;
+static p_client_box_t client_box = NULL;
+static pthread_mutex_t client_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * client_callbacks(cfg)
+ * sets the pjsua callbacks of functions.c
+ */
+void client_callbacks(pjsua_config *cfg) {
+
+  cfg->cb.on_incoming_call = &on_incoming_call;
+  cfg->cb.on_call_media_state = &on_call_media_state;
+  cfg->cb.on_call_state = &on_call_state;
+  cfg->cb.on_pager2 = &on_pager2;
+  cfg->cb.on_pager_status2 = &on_pager_status2;
+  cfg->cb.on_reg_state = &on_reg;
+  cfg->cb.on_reg_state2 = &reg_on_reg_state2;
+  cfg->cb.on_transport_state = &reg_on_transport_state;
+}
+
+/*
+ * client_dup(pool, str)
+ * copies str to pool, NULL if out of memory
+ */
+static char *client_dup(pj_pool_t *pool, const char *str) {
+  char *p;
+
+  p = (char *)pj_pool_alloc(pool, strlen(str) + 1);
+  if (p)
+    memcpy(p, str, strlen(str) + 1);
+
+  return p;
+}
+
+/*
+ * client_ids(pool)
+ * creates call id, device id, SIP URI and subscriber info url of conf;
+ * returns -1 if out of memory
+ */
+int client_ids(pj_pool_t *pool) {
+  char tmp[BUFFER_512 + 1];
+  char rnd[36 + 1];
+  char *tmpres;
+  char *res;
+  char *api;
+  size_t len;
+
+  /* create unique call id */
+  rand_str(rnd, 36);
+  snprintf(
+      tmp, BUFFER_512,
+      "<urn:dec112:uid:callid:%s:service.dec112.at>;purpose=" DEC112_CALLID,
+      rnd);
+  if ((conf->cid = client_dup(pool, tmp)) == NULL)
+    return -1;
+
+  PJ_LOG(3, (THIS_FILE, DEC112_CALLID " \n%s", conf->cid));
+
+  /* create unique device id */
+  snprintf(
+      tmp, BUFFER_512,
+      "<urn:dec112:uid:deviceid:%s:service.dec112.at>;purpose=" DEC112_DEVID,
+      conf->device);
+  if ((conf->did = client_dup(pool, tmp)) == NULL)
+    return -1;
+
+  PJ_LOG(3, (THIS_FILE, DEC112_DEVID " \n%s", conf->did));
+
+  /* create sip uri */
+  len = strlen("sip:") + strlen(conf->user) + strlen("@") +
+        strlen(conf->domain) + 1;
+  conf->uri = (char *)pj_pool_alloc(pool, len * sizeof(char));
+  if (conf->uri == NULL)
+    return -1;
+  snprintf(conf->uri, len, "sip:%s@%s", conf->user, conf->domain);
+
+  PJ_LOG(3, (THIS_FILE, "dec112 SIP URI \n%s", conf->uri));
+
+  /* create id derference url */
+  api = url_encode(conf->api);
+  tmpres = replace_str(conf->ref, "${device_id}", conf->device);
+  res = replace_str(tmpres, "${api_key}", api);
+  free(tmpres);
+  snprintf(tmp, BUFFER_512, "<%s>;purpose=" DEC112_SUBINF, res);
+  free(res);
+  free(api);
+  if ((conf->url = client_dup(pool, tmp)) == NULL)
+    return -1;
+
+  PJ_LOG(3, (THIS_FILE, "dec112-SubscriberInfo \n%s", conf->url));
+
+  return 0;
+}
+
+/*
+ * client_identity(idx, pool)
+ * switches conf->user to identity idx of the configured range (users): the
+ * number at the end of user counts up by idx, without one idx is appended.
+ * call before client_ids(); returns 1 if no range is configured, -1 if idx
+ * is outside the range
+ */
+int client_identity(int idx, pj_pool_t *pool) {
+  unsigned long num;
+  size_t digits;
+  size_t len;
+  char *user;
+
+  if (conf->users <= 0)
+    return 1;
+  if ((idx < 0) || (idx >= conf->users))
+    return -1;
+
+  len = strlen(conf->user);
+  digits = 0;
+  while ((digits < len) && (digits < 9) &&
+         isdigit((unsigned char)conf->user[len - 1 - digits]))
+    digits++;
+
+  user = (char *)pj_pool_alloc(pool, len + 12);
+  if (user == NULL)
+    return -1;
+  if (digits > 0) {
+    num = strtoul(&conf->user[len - digits], NULL, 10) + idx;
+    snprintf(user, len + 12, "%.*s%0*lu", (int)(len - digits), conf->user,
+             (int)digits, num);
+  } else {
+    snprintf(user, len + 12, "%s%i", conf->user, idx);
+  }
+  conf->user = user;
+
+  PJ_LOG(3, (THIS_FILE, "identity %i of %i: %s\n", idx, conf->users, user));
+
+  return 0;
+}
+
+/*
+ * client_account(acc_cfg)
+ * sets identity and digest credentials of the account
+ */
+void client_account(pjsua_acc_config *acc_cfg) {
+
+  acc_cfg->id = pj_str(conf->uri);
+  acc_cfg->cred_count = 1;
+  acc_cfg->cred_info[0].realm = pj_str(conf->domain);
+  acc_cfg->cred_info[0].scheme = pj_str("digest");
+  acc_cfg->cred_info[0].username = pj_str(conf->user);
+  acc_cfg->cred_info[0].data_type = PJSIP_CRED_DATA_PLAIN_PASSWD;
+  acc_cfg->cred_info[0].data = pj_str(conf->passwd);
+}
+
+/*
+ * client_proxy(*acc_cfg, idx, pool)
+ * outbound proxy and registrar of account idx, the domain itself when no
+ * proxy is configured
+ */
+void client_proxy(pjsua_acc_config *acc_cfg, int idx, pj_pool_t *pool) {
+  char *uri;
+
+  if (proxy_init(idx, pool) >= 0) {
+    acc_cfg->proxy_cnt = 1;
+    acc_cfg->proxy[0] = pj_str((char *)proxy_uri());
+    acc_cfg->reg_uri = pj_str((char *)proxy_uri());
+    return;
+  }
+
+  acc_cfg->proxy_cnt = 0;
+  uri = pj_pool_alloc(pool, strlen(conf->domain) + 5);
+  sprintf(uri, "sip:%s", conf->domain);
+  acc_cfg->reg_uri = pj_str(uri);
+}
+
+/*
+ * client_active()
+ * returns 1 between client_create() and client_destroy()
+ */
+int client_active(void) {
+  return __atomic_load_n(&client_on, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * client_on_reg(up)
+ * registration state changed, called from on_reg()
+ */
+void client_on_reg(int up) {
+
+  if (client_active() && client_cb.on_reg)
+    client_cb.on_reg(up, client_cb.user);
+}
+
+/*
+ * client_box_pop(box)
+ * takes the oldest body off a mailbox, call with client_lock held
+ */
+static p_client_msg_t client_box_pop(p_client_box_t box) {
+  p_client_msg_t msg;
+
+  if (!(msg = box->head))
+    return NULL;
+  box->head = msg->next;
+  if (!box->head)
+    box->tail = NULL;
+  box->unread--;
+
+  return msg;
+}
+
+/*
+ * client_box_clear(box)
+ * drops all bodies of a mailbox, call with client_lock held
+ */
+static void client_box_clear(p_client_box_t box) {
+
+  while (box->head)
+    free(client_box_pop(box));
+}
+
+/*
+ * client_on_message(sess, *body, mtype)
+ * queues the body for client_expect(), called from on_pager2()
+ */
+void client_on_message(p_session_t sess, const pj_str_t *body, int mtype) {
+  p_client_box_t box;
+  p_client_msg_t msg;
+
+  if (!client_active())
+    return;
+
+  box = &client_box[sess->idx];
+  msg = (p_client_msg_t)malloc(sizeof(s_client_msg_t) + body->slen + 1);
+  if (msg) {
+    msg->next = NULL;
+    msg->len = body->slen;
+    memcpy(msg->body, body->ptr, body->slen);
+    msg->body[body->slen] = '\0';
+    pthread_mutex_lock(&client_lock);
+    /* nobody is reading, keep the newest */
+    if (box->unread >= CLIENT_BOX_MAX)
+      free(client_box_pop(box));
+    if (box->tail)
+      box->tail->next = msg;
+    else
+      box->head = msg;
+    box->tail = msg;
+    box->unread++;
+    pthread_mutex_unlock(&client_lock);
+  } else {
+    PJ_LOG(2, (THIS_FILE, "session %i: message dropped, malloc failed\n",
+               sess->idx));
+  }
+
+  if (client_cb.on_message)
+    client_cb.on_message(sess->idx, body->ptr, body->slen, mtype,
+                         client_cb.user);
+}
+
+/*
+ * client_on_status(sess, status)
+ * a MESSAGE of a session was rejected, called from on_pager_status2()
+ */
+void client_on_status(p_session_t sess, int status) {
+
+  if (client_active() && sess && client_cb.on_status)
+    client_cb.on_status(sess->idx, status, client_cb.user);
+}
+
+/*
+ * client_thread()
+ * registers a thread of the caller with pjlib
+ */
+static void client_thread(void) {
+  static __thread pj_thread_desc desc;
+  pj_thread_t *th;
+
+  if (!pj_thread_is_registered())
+    pj_thread_register("client", desc, &th);
+}
+
+/*
+ * client_session(idx)
+ * returns session idx if the client is up
+ */
+static p_session_t client_session(int idx) {
+
+  if (!client_active() || (idx < 0) || (idx >= session_count()))
+    return NULL;
+  client_thread();
+
+  return session_get(idx);
+}
+
+/*
+ * client_create(opts, cb)
+ * starts pjsua, reads the configuration and registers; cb may be NULL.
+ * returns -1 on error, pjsua is destroyed again then
+ */
+int client_create(p_client_opts_t opts, p_client_cb_t cb) {
+  pjsua_config cfg;
+  pjsua_logging_config log_cfg;
+  pjsua_media_config media_cfg;
+  pjsua_transport_config tcfg;
+  pjsua_acc_config acc_cfg;
+  s_reg_cfg_t rcfg;
+  const char *file;
+
+  if (client_active() || (opts->sessions < 1))
+    return -1;
+
+  file = opts->cfg ? opts->cfg : CFG_FILE;
+  if (access(file, R_OK) != 0) {
+    PJ_LOG(1, (THIS_FILE, "cannot read config %s\n", file));
+    return -1;
+  }
+
+  if (pjsua_create() != PJ_SUCCESS)
+    return -1;
+  client_pool = pjsua_pool_create("client", BACKEND_POOL_INITIAL_SIZE,
+                                  BACKEND_POOL_INCREMENT);
+  if (!client_pool)
+    goto fail;
+
+  if ((conf = readConf((char *)file, client_pool)) == NULL)
+    goto fail;
+  conf->xhd = opts->xhdr;
+  conf->reply = NULL;
+  conf->ret = ERR_NON;
+  conf->country = (char *)(opts->country ? opts->country : "AT");
+
+  pjsua_config_default(&cfg);
+  client_callbacks(&cfg);
+  if (opts->threads > 0)
+    cfg.thread_cnt = opts->threads;
+  pjsua_media_config_default(&media_cfg);
+  pjsua_logging_config_default(&log_cfg);
+  log_cfg.console_level = conf->dbg;
+  if (pjsua_init(&cfg, &log_cfg, &media_cfg) != PJ_SUCCESS)
+    goto fail;
+
+  pjsua_transport_config_default(&tcfg);
+  if (opts->tls) {
+    tcfg.port = SIP_PORT + 1;
+    tls_apply(&tcfg.tls_setting, client_pool);
+    if (tls_start() != 0)
+      goto fail;
+  }
+  if ((pjsua_transport_create(opts->tls ? PJSIP_TRANSPORT_TLS
+                                        : PJSIP_TRANSPORT_TCP,
+                              &tcfg, NULL) != PJ_SUCCESS) ||
+      (pjsua_start() != PJ_SUCCESS) || (client_ids(client_pool) != 0) ||
+      (session_table_create(0, opts->sessions, client_pool) != 0))
+    goto fail;
+
+  client_box = (p_client_box_t)calloc(opts->sessions, sizeof(s_client_box_t));
+  if (!client_box)
+    goto fail;
+  if (cb)
+    client_cb = *cb;
+  else
+    memset(&client_cb, 0, sizeof(client_cb));
+  __atomic_store_n(&client_on, 1, __ATOMIC_RELEASE);
+
+  pjsua_acc_config_default(&acc_cfg);
+  client_account(&acc_cfg);
+  client_proxy(&acc_cfg, 0, client_pool);
+  memset(&rcfg, 0, sizeof(rcfg));
+  reg_init(&rcfg);
+  reg_account(&acc_cfg);
+  if (pjsua_acc_add(&acc_cfg, PJ_TRUE, &client_acc) != PJ_SUCCESS) {
+    client_destroy();
+    return -1;
+  }
+
+  return 0;
+
+fail:
+  PJ_LOG(1, (THIS_FILE, "cannot create client\n"));
+  free(client_box);
+  client_box = NULL;
+  session_table_destroy();
+  pjsua_destroy();
+  client_pool = NULL;
+  conf = NULL;
+  memset(&stats, 0, sizeof(stats));
+
+  return -1;
+}
+
+/*
+ * client_wait_registered(timeout_ms)
+ * returns 0 once the account is registered, -1 on timeout
+ */
+int client_wait_registered(unsigned timeout_ms) {
+  uint64_t end;
+
+  if (!client_active())
+    return -1;
+  client_thread();
+
+  end = stats_now_ns() / 1000000 + timeout_ms;
+  while (!conf->reg) {
+    if (stats_now_ns() / 1000000 >= end)
+      return -1;
+    loop_sleep(CLIENT_POLL_MS);
+  }
+
+  return 0;
+}
+
+/*
+ * client_start(idx, uri, urn, text)
+ * starts the chat of session idx with a start message (21) to uri; urn
+ * may be NULL
+ */
+int client_start(int idx, const char *uri, const char *urn, const char *text) {
+  p_session_t sess;
+  pj_str_t t;
+  pj_str_t u;
+  pj_str_t n;
+
+  if (!(sess = client_session(idx)) || !uri)
+    return -1;
+
+  /* a new chat, replies of the previous one are dropped */
+  session_reset(sess);
+  pthread_mutex_lock(&client_lock);
+  client_box_clear(&client_box[idx]);
+  pthread_mutex_unlock(&client_lock);
+
+  t = pj_str((char *)(text ? text : ""));
+  u = pj_str((char *)uri);
+  n.ptr = (char *)urn;
+  n.slen = urn ? strlen(urn) : 0;
+
+  return (send_dec112_msg(&client_acc, sess, &t, &u, &n, 21) == PJ_SUCCESS)
+             ? 0
+             : -1;
+}
+
+/*
+ * client_chat(idx, text, mtype)
+ * sends a chat (22) or stop (23) message to the Reply-To of session idx
+ */
+static int client_chat(int idx, const char *text, int mtype) {
+  p_session_t sess;
+  char *reply;
+  pj_str_t t;
+  pj_str_t rto;
+
+  if (!(sess = client_session(idx)) ||
+      !(reply = __atomic_load_n(&sess->reply, __ATOMIC_ACQUIRE)))
+    return -1;
+
+  t = pj_str((char *)(text ? text : ""));
+  rto = pj_str(reply);
+
+  return (send_dec112_msg(&client_acc, sess, &t, &rto, &rto, mtype) ==
+          PJ_SUCCESS)
+             ? 0
+             : -1;
+}
+
+/*
+ * client_send(idx, text)
+ * sends a chat message; the session must have received a Reply-To
+ */
+int client_send(int idx, const char *text) {
+  return client_chat(idx, text, 22);
+}
+
+/*
+ * client_stop(idx, text)
+ * ends the chat of session idx with a stop message (23)
+ */
+int client_stop(int idx, const char *text) {
+  return client_chat(idx, text, 23);
+}
+
+/*
+ * client_expect(idx, timeout_ms, buf, len)
+ * waits for the oldest unread message to session idx and copies its body
+ * to buf; returns the body length, -1 on timeout
+ */
+int client_expect(int idx, unsigned timeout_ms, char *buf, int len) {
+  p_client_box_t box;
+  p_client_msg_t msg;
+  uint64_t end;
+  int n;
+
+  if (!client_session(idx))
+    return -1;
+
+  box = &client_box[idx];
+  end = stats_now_ns() / 1000000 + timeout_ms;
+  for (;;) {
+    pthread_mutex_lock(&client_lock);
+    msg = client_box_pop(box);
+    pthread_mutex_unlock(&client_lock);
+    if (msg) {
+      n = msg->len;
+      if (buf && (len > 0)) {
+        memcpy(buf, msg->body, (n < len) ? n : len - 1);
+        buf[(n < len) ? n : len - 1] = '\0';
+      }
+      free(msg);
+      return n;
+    }
+    if (stats_now_ns() / 1000000 >= end)
+      return -1;
+    loop_sleep(CLIENT_POLL_MS);
+  }
+}
+
+/*
+ * client_session_stats(idx, *tx, *rx, *err)
+ * messages sent, received and rejected by session idx
+ */
+int client_session_stats(int idx, uint64_t *tx, uint64_t *rx,
+                         uint64_t *err) {
+  p_session_t sess;
+
+  if (!(sess = client_session(idx)))
+    return -1;
+
+  *tx = STAT_GET(sess->tx);
+  *rx = STAT_GET(sess->rx);
+  *err = STAT_GET(sess->err);
+
+  return 0;
+}
+
+/*
+ * client_stats(st)
+ * copies the process wide counters
+ */
+void client_stats(p_stats_t st) { memcpy(st, &stats, sizeof(s_stats_t)); }
+
+/*
+ * client_destroy()
+ * unregisters and shuts pjsua down
+ */
+void client_destroy(void) {
+  int i;
+
+  if (!__atomic_exchange_n(&client_on, 0, __ATOMIC_ACQ_REL))
+    return;
+  client_thread();
+
+  reg_stop();
+  if (client_acc != PJSUA_INVALID_ID)
+    pjsua_acc_del(client_acc);
+  client_acc = PJSUA_INVALID_ID;
+
+  pthread_mutex_lock(&client_lock);
+  for (i = 0; client_box && (i < session_count()); i++)
+    client_box_clear(&client_box[i]);
+  pthread_mutex_unlock(&client_lock);
+  free(client_box);
+  client_box = NULL;
+
+  session_table_destroy();
+  pjsua_destroy();
+  client_pool = NULL;
+  conf = NULL;
+  memset(&stats, 0, sizeof(stats));
+}
+
+/*
+ * client_run_default(run)
+ * sets the defaults of the pjchat command line
+ */
+void client_run_default(p_client_run_t run) {
+
+  memset(run, 0, sizeof(s_client_run_t));
+  run->sessions = 1;
+  run->procs = 1;
+  run->trace_mb = TRACE_DEFAULT_MB;
+  run->speed = 1.0;
+  run->inflight = STREAM_INFLIGHT;
+  run->impair_port = IMPAIR_PORT;
+  run->soak.sample_s = SOAK_SAMPLE_S;
+  run->soak.limit_kb_h = SOAK_LIMIT_KB_H;
+  run->cap.timeout_pct = CAPACITY_TIMEOUT_PCT;
+  run->cap.error_pct = CAPACITY_ERROR_PCT;
+  run->cap.window_s = CAPACITY_WINDOW_S;
+  run->calls.duration_s = CALLS_DURATION_S;
+  run->calls.hold_min = CALLS_HOLD_S;
+  run->shard.idx = -1;
+}
+
+/*
+ * client_fail(title, status)
+ * logs why a run cannot go on; returns -1
+ */
+static int client_fail(const char *title, pj_status_t status) {
+
+  pjsua_perror(THIS_FILE, title, status);
+
+  return -1;
+}
+
+/*
+ * client_note(pool, stop)
+ * start or stop text with name, phone and local time of the caller
+ */
+static char *client_note(pj_pool_t *pool, int stop) {
+  char tmp[BUFFER_512 + 1];
+  char tmptime[BUFFER_128 + 1];
+  time_t ltime;
+  struct tm *info;
+
+  // 02/24/2020, 10:26:01 PM
+  time(&ltime);
+  info = localtime(&ltime);
+  strftime(tmptime, BUFFER_128, "%m/%d/%Y, %I:%M:%S %p", info);
+  if (stop)
+    snprintf(tmp, BUFFER_512, STOP_MESSAGE,
+             conf->surname ? conf->surname : USER_SURNAME,
+             conf->given ? conf->given : USER_GIVEN,
+             conf->phone ? conf->phone : USER_PHONE, tmptime);
+  else
+    snprintf(tmp, BUFFER_512, START_MESSAGE,
+             conf->surname ? conf->surname : USER_SURNAME,
+             conf->given ? conf->given : USER_GIVEN,
+             conf->phone ? conf->phone : USER_PHONE, tmptime, conf->lat,
+             conf->lon);
+
+  return client_dup(pool, tmp);
+}
+
+/*
+ * client_run_stack(run, pool, job, acc_id)
+ * initializes and starts pjsua, joins the coordinator and adds the
+ * account; returns -1 on error
+ */
+static int client_run_stack(p_client_run_t run, pj_pool_t *pool,
+                            p_dist_job_t job, pjsua_acc_id *acc_id) {
+  pjsua_config cfg;
+  pjsua_logging_config log_cfg;
+  pjsua_media_config media_cfg;
+  pjsua_transport_config tcfg;
+  pjsua_acc_config acc_cfg;
+  s_impair_prof_t imp;
+  pj_status_t status;
+  uint64_t t0;
+  int off;
+  int ret;
+
+  /* workers of --procs use ports of their own */
+  off = (run->shard.idx > 0) ? run->shard.idx : 0;
+
+  pjsua_config_default(&cfg);
+  client_callbacks(&cfg);
+  if (run->threads > 0)
+    cfg.thread_cnt = run->threads;
+  pjsua_media_config_default(&media_cfg);
+  if (run->deterministic)
+    loop_config(&cfg, &media_cfg);
+  if (run->calls.cps > 0)
+    calls_config(&cfg, &media_cfg);
+
+  pjsua_logging_config_default(&log_cfg);
+  log_cfg.console_level = conf->dbg;
+  /* the binary trace replaces verbose message logging */
+  if (run->trace)
+    log_cfg.msg_logging = PJ_FALSE;
+
+  status = pjsua_init(&cfg, &log_cfg, &media_cfg);
+  if (status != PJ_SUCCESS)
+    return client_fail("error in pjsua_init()", status);
+  if (run->deterministic)
+    loop_init(run->seed);
+
+  if (run->trace) {
+    if (trace_open(run->trace, run->trace_mb * 1024 * 1024) != 0)
+      return client_fail("error opening trace file", -1);
+    status = trace_start(pjsua_get_pjsip_endpt());
+    if (status != PJ_SUCCESS)
+      return client_fail("error registering trace module", status);
+  }
+
+  pjsua_transport_config_default(&tcfg);
+  if (run->tls) {
+    tcfg.port = SIP_PORT + 1 + off;
+    tls_apply(&tcfg.tls_setting, pool);
+    if (tls_start() != 0)
+      return client_fail("error registering TLS module", -1);
+  }
+  status = pjsua_transport_create(run->tls ? PJSIP_TRANSPORT_TLS
+                                           : PJSIP_TRANSPORT_TCP,
+                                  &tcfg, NULL);
+  if (status != PJ_SUCCESS)
+    return client_fail("error creating transport", status);
+
+  /* initialization is done, now start pjsua */
+  status = pjsua_start();
+  if (status != PJ_SUCCESS)
+    return client_fail("error starting pjsua", status);
+
+  /* distributed run, the agent index selects the identity */
+  if (run->agent && (dist_agent_join(run->agent, job) != 0))
+    return client_fail("error joining coordinator", -1);
+
+  /* agents and workers register with an identity of their own */
+  if (run->agent || (run->shard.idx >= 0)) {
+    ret = client_identity(run->agent ? job->agent : run->shard.idx, pool);
+    if (ret < 0)
+      return client_fail("agent or worker index outside the users range",
+                         -1);
+    if (ret > 0)
+      PJ_LOG(2, (THIS_FILE, "no users range, all register as %s\n",
+                 conf->user));
+  }
+  shard_start(&run->shard);
+
+  t0 = STAGE_START();
+
+  /* call id, device id, SIP URI and subscriber info url */
+  if (client_ids(pool) != 0)
+    return client_fail("malloc failed", -1);
+
+  STAGE_STOP(STAGE_CONFIG, t0);
+
+  /* headers point to our own server instead of carrying the documents */
+  if (run->reference && (httpd_start(run->reference, off, pool) != 0))
+    return client_fail("error starting HTTP server", -1);
+
+  /* register to SIP server by creating SIP account. */
+  pjsua_acc_config_default(&acc_cfg);
+  client_account(&acc_cfg);
+  /* one of the configured proxies, workers and agents spread over them */
+  client_proxy(&acc_cfg, run->agent ? job->agent : off, pool);
+  /* the relay is the outbound proxy, the registrar stays the same */
+  if (run->impair) {
+    if (!proxy_uri())
+      return client_fail("impairment relay needs a proxy", -1);
+    if ((impair_profile(&imp, run->impair) != 0) ||
+        (impair_start(proxy_uri(), run->impair_port + off, &imp) != 0))
+      return client_fail("error starting impairment relay", -1);
+    acc_cfg.proxy[0] = pj_str((char *)impair_uri());
+  }
+  /* retries with backoff, see reg.c */
+  reg_init(&run->reg);
+  reg_account(&acc_cfg);
+
+  status = pjsua_acc_add(&acc_cfg, PJ_TRUE, acc_id);
+  if (status != PJ_SUCCESS)
+    return client_fail("error adding account", status);
+
+  return 0;
+}
+
+/*
+ * client_run_chat(run, pool, acc_id, uri, urn)
+ * single chat: automatic (-a), from a file (-t) or typed on stdin;
+ * returns -1 on error
+ */
+static int client_run_chat(p_client_run_t run, pj_pool_t *pool,
+                           pjsua_acc_id *acc_id, pj_str_t *uri,
+                           pj_str_t *urn) {
+  pj_status_t status;
+  pj_str_t text;
+  pj_str_t gen;
+  char *body;
+  char *line = NULL;
+  size_t linesize = 0;
+  ssize_t characters;
+  FILE *fd;
+  int cnt;
+  int i;
+
+  text = pj_str((char *)"Ping");
+  if (run->country) {
+    if ((body = client_note(pool, 0)) == NULL)
+      return client_fail("malloc failed", -1);
+    text = pj_str(body);
+  }
+
+  /* send first message */
+  if (!run->txt)
+    conf->val = 1;
+  conf->req = 0;
+  status = send_dec112_msg(acc_id, NULL, &text, uri, urn, 21);
+  /* wait for first response message or timeout */
+  cnt = 0;
+  while ((cnt < TIMEOUT_CNT) && (!conf->reply)) {
+    loop_sleep(TIMEOUT_MS);
+    cnt++;
+  }
+
+  if (cnt == TIMEOUT_CNT)
+    PJ_LOG(2, (THIS_FILE, "timeout on first request message\n"));
+
+  if (!conf->reply) {
+    conf->ret = conf->ret | ERR_MSG;
+    PJ_LOG(2, (THIS_FILE, "Reply-To header missing.\n"));
+    return 0;
+  }
+
+  *uri = pj_str(conf->reply);
+  *urn = pj_str(conf->reply);
+
+  if (run->automsg && !run->txt) {
+    for (i = 2; i <= run->msgs; i++) {
+      loop_sleep(run->interval_s * 1000);
+      conf->req = 0;
+      if (corpus_active() && (body = corpus_text(corpus_size(), i))) {
+        /* generated body instead of the fixed text */
+        printf("\t#### %i -> %i bytes ####\n", i, (int)strlen(body));
+        gen = pj_str(body);
+        status = send_dec112_msg(acc_id, NULL, &gen, uri, urn, 22);
+        free(body);
+      } else {
+        printf("\t#### %i -> %s ####\n", i, text.ptr);
+        status = send_dec112_msg(acc_id, NULL, &text, uri, urn, 22);
+      }
+      PJ_LOG(3, (THIS_FILE, "message sent with status %i\n", status));
+    }
+    if (run->msgs > 1)
+      loop_sleep(run->interval_s * 1000);
+    conf->req = 0;
+    status = send_dec112_msg(acc_id, NULL, &text, uri, urn, 23);
+
+    PJ_LOG(2, (THIS_FILE, "exiting with (%i) ...\n", status));
+  } else if (!run->automsg && run->txt) {
+    if ((fd = fopen(run->txt, "r")) == NULL) {
+      PJ_LOG(2, (THIS_FILE, "Error opening file: %s\n", run->txt));
+      return -1;
+    }
+    while (getline(&line, &linesize, fd) > 0) {
+      text.ptr = line;
+      text.slen = strlen(line);
+      PJ_LOG(4, (THIS_FILE, "message from file: %.*s\n", (int)text.slen,
+                 text.ptr));
+      if (text.slen > 2) {
+        if (text.ptr[text.slen - 2] == '*') {
+          conf->val = 1;
+          text.ptr[text.slen - 2] = ' ';
+        }
+        printf("\t#### -> %.*s\n", (int)text.slen, text.ptr);
+        conf->req = 0;
+        status = send_dec112_msg(acc_id, NULL, &text, uri, urn, 22);
+        PJ_LOG(3, (THIS_FILE, "message sent with status %i\n", status));
+        cnt = 0;
+        while ((cnt < TIMEOUT_CNT) && (!conf->req)) {
+          loop_sleep(TIMEOUT_MS);
+          cnt++;
+        }
+        if (cnt == TIMEOUT_CNT) {
+          conf->ret = conf->ret | ERR_TMR;
+          PJ_LOG(3, (THIS_FILE, "timeout on remote message request\n"));
+        }
+      }
+    }
+
+    fclose(fd);
+    free(line);
+
+    if ((body = client_note(pool, 1)) == NULL)
+      return client_fail("malloc failed", -1);
+    text = pj_str(body);
+    status = send_dec112_msg(acc_id, NULL, &text, uri, urn, 23);
+    PJ_LOG(3, (THIS_FILE, "message sent with status %i\n", status));
+  } else {
+    printf("\n##### Type messages followed by RETURN or use 'exit' to "
+           "unregister #####\n\n");
+    fflush(stdout);
+
+    /* wait until user sends "exit" to quit. */
+    for (;;) {
+      /* getline() grows the same buffer as needed */
+      characters = getline(&line, &linesize, stdin);
+
+      PJ_LOG(3, (THIS_FILE, "sending %i characters ... \n", (int)characters));
+
+      if ((conf->reg == 0) && !reg_recovering(*acc_id)) {
+        PJ_LOG(2, (THIS_FILE, "remote close ... exiting ...\n"));
+        break;
+      }
+      /* end of input ends the chat like "exit" */
+      if ((characters < 0) || strstr(line, "exit")) {
+        text = pj_str((characters < 0) ? (char *)"exit" : line);
+        if (run->country) {
+          if ((body = client_note(pool, 1)) == NULL) {
+            free(line);
+            return client_fail("malloc failed", -1);
+          }
+          text = pj_str(body);
+        }
+        status = send_dec112_msg(acc_id, NULL, &text, uri, urn, 23);
+        PJ_LOG(2, (THIS_FILE, "exiting with (%i) ...\n", status));
+        break;
+      }
+      text = pj_str(line);
+      status = send_dec112_msg(acc_id, NULL, &text, uri, urn, 22);
+    }
+    free(line);
+  }
+
+  return 0;
+}
+
+/*
+ * client_run_mode(run, pool, acc_id, job, uri, urn)
+ * prepares the session table and runs the selected mode once registered;
+ * returns -1 on error
+ */
+static int client_run_mode(p_client_run_t run, pj_pool_t *pool,
+                           pjsua_acc_id *acc_id, p_dist_job_t job,
+                           pj_str_t *uri, pj_str_t *urn) {
+  p_replay_t rp;
+  s_matrix_cfg_t mtx;
+  s_fsm_cfg_t fcfg;
+  unsigned swp_min;
+  unsigned swp_max;
+  unsigned swp_fac;
+  unsigned msgs;
+  unsigned gap_ms;
+  int cnt;
+
+  msgs = (run->msgs > 0) ? run->msgs : FSM_MSGS;
+  gap_ms = (run->interval_s > 0) ? run->interval_s * 1000 : FSM_INTERVAL_MS;
+  swp_fac = CORPUS_SWEEP_FACTOR;
+
+  if (run->replay) {
+    /* replay a recorded session on run->sessions sessions */
+    rp = replay_load(run->replay, pool);
+    if (!rp || (run->sessions < 1) ||
+        (session_table_create(run->base, run->sessions, pool) != 0))
+      return client_fail("error preparing replay", -1);
+    replay_run(acc_id, rp, run->speed, uri, urn);
+  } else if (run->stream) {
+    /* lines piped in by another process */
+    if ((run->sessions < 1) ||
+        (session_table_create(run->base, run->sessions, pool) != 0))
+      return client_fail("error preparing stream", -1);
+    if (stream_run(acc_id, run->stream, run->inflight, uri, urn) < 0)
+      return client_fail("error opening stream", -1);
+  } else if (run->soak.duration_s > 0) {
+    /* chat for hours and watch memory */
+    run->soak.msgs = (run->msgs > 0) ? run->msgs : SOAK_MSGS;
+    run->soak.interval_s =
+        (run->interval_s > 0) ? run->interval_s : SOAK_INTERVAL_S;
+    run->soak.pool = pool;
+    if ((run->sessions < 1) || (run->soak.sample_s < 1) ||
+        (session_table_create(run->base, run->sessions, pool) != 0))
+      return client_fail("error preparing soak test", -1);
+    soak_run(acc_id, &run->soak, uri, urn);
+  } else if (run->sweep) {
+    /* one run per body size, see corpus.c */
+    if ((sscanf(run->sweep, "%u:%u:%u", &swp_min, &swp_max, &swp_fac) < 2) ||
+        (run->sessions < 1) ||
+        (session_table_create(run->base, run->sessions, pool) != 0))
+      return client_fail("error preparing size sweep", -1);
+    if (corpus_sweep(acc_id, swp_min, swp_max, swp_fac, msgs, gap_ms, uri,
+                     urn) < 0)
+      return client_fail("invalid size sweep", -1);
+  } else if (run->cap.p99_ms > 0) {
+    /* highest load within the SLA, on up to run->sessions sessions */
+    run->cap.msgs = msgs;
+    run->cap.interval_ms = gap_ms;
+    if ((run->sessions < 1) || (run->cap.window_s < 1) ||
+        (session_table_create(run->base, run->sessions, pool) != 0))
+      return client_fail("error preparing capacity search", -1);
+    capacity_run(acc_id, &run->cap, uri, urn);
+  } else if (run->matrix) {
+    /* every combination of the -r, -u, -c and -t lists, one session each */
+    mtx.msgs = msgs;
+    mtx.interval_ms = gap_ms;
+    mtx.parallel = run->sessions_set ? run->sessions : 0;
+    if (((cnt = matrix_create(run->uri, run->urn, run->country, run->txt,
+                              pool)) < 1) ||
+        (session_table_create(run->base, cnt, pool) != 0))
+      return client_fail("error preparing matrix", -1);
+    matrix_run(acc_id, &mtx);
+  } else if (run->calls.cps > 0) {
+    /* INVITEs at a constant rate, chats on the sessions alongside */
+    run->calls.msgs = msgs;
+    run->calls.interval_ms = gap_ms;
+    if ((run->calls.duration_s < 1) ||
+        (run->sessions_set &&
+         ((run->sessions < 1) ||
+          (session_table_create(run->base, run->sessions, pool) != 0))))
+      return client_fail("error preparing call load", -1);
+    if (calls_run(acc_id, &run->calls, uri, urn) > 0)
+      conf->ret = conf->ret | ERR_MSG;
+  } else if (run->profile) {
+    /* session arrivals follow the load profile of the config file */
+    cnt = run->sessions_set ? run->sessions : PROFILE_SESSIONS;
+    if (!conf->prof || (cnt < 1) ||
+        (session_table_create(run->base, cnt, pool) != 0))
+      return client_fail("error preparing load profile", -1);
+    /* every agent or worker offers its share of the profile rates */
+    profile_run(acc_id, conf->prof,
+                1.0 / (run->agent ? job->agents : run->procs), msgs, gap_ms,
+                uri, urn);
+  } else if (run->sessions_set) {
+    /* concurrent automatic chats, one state machine per session */
+    memset(&fcfg, 0, sizeof(fcfg));
+    fcfg.acc_id = *acc_id;
+    fcfg.uri = *uri;
+    fcfg.urn = *urn;
+    fcfg.msgs = msgs;
+    fcfg.interval_ms = gap_ms;
+    fcfg.cycles = 1;
+    if ((run->sessions < 1) ||
+        (session_table_create(run->base, run->sessions, pool) != 0))
+      return client_fail("error preparing sessions", -1);
+    fsm_run(&fcfg);
+  } else {
+    return client_run_chat(run, pool, acc_id, uri, urn);
+  }
+
+  return 0;
+}
+
+/*
+ * client_run_stop(run)
+ * stops the helper threads of a run and prints their statistics
+ */
+static void client_run_stop(p_client_run_t run) {
+
+  dash_stop();
+  ctl_stop();
+  httpd_stop();
+  if (run->reference)
+    httpd_print(stdout);
+  impair_stop();
+  if (run->impair)
+    impair_print(stdout);
+  reg_stop();
+  reg_print(stdout);
+  tls_print(stdout);
+  proxy_close();
+  if (conf->proxies && (conf->proxies->cnt > 1))
+    proxy_print(stdout, conf->proxies->p, conf->proxies->cnt);
+  seq_print(stdout);
+  flow_print(stdout);
+  /* session based modes print the stages with their statistics */
+  if (session_count() == 0)
+    stats_print_stages(stdout, &stats);
+}
+
+/*
+ * client_run(run)
+ * runs one pjchat mode from pjsua_create() to pjsua_destroy(), not while
+ * a client_create() client is up; returns the ERR_ flags of the run or -1
+ * if it could not be set up
+ */
+int client_run(p_client_run_t run) {
+  s_dist_job_t job;
+  pjsua_acc_id acc_id;
+  pj_status_t status;
+  pj_pool_t *pool;
+  pj_str_t uri;
+  pj_str_t urn;
+  const char *file;
+  int cnt;
+  int ret;
+
+  if (client_active())
+    return -1;
+
+  memset(&job, 0, sizeof(job));
+  uri.ptr = NULL;
+  uri.slen = 0;
+  urn = uri;
+
+  /* create pjsua first! */
+  status = pjsua_create();
+  if (status != PJ_SUCCESS)
+    return client_fail("error in pjsua_create()", status);
+  /* create pjsua pool */
+  pool = pjsua_pool_create("psip", BACKEND_POOL_INITIAL_SIZE,
+                           BACKEND_POOL_INCREMENT);
+  if (!pool) {
+    client_fail("error in pjsua_pool_create()", -1);
+    goto fail;
+  }
+
+  file = run->cfg ? run->cfg : CFG_FILE;
+  PJ_LOG(3, (THIS_FILE, "reading config from %s\n", file));
+  if ((conf = readConf((char *)file, pool)) == NULL) {
+    client_fail("cannot read config", -1);
+    goto fail;
+  }
+  conf->xhd = run->xhdr;
+  conf->reply = NULL;
+  conf->ret = ERR_NON;
+
+  /* handshake benchmark only needs the TLS settings of the config */
+  if (run->tls_bench > 0) {
+    ret = tls_bench(run->tls_bench);
+    pjsua_destroy();
+    conf = NULL;
+    return ret;
+  }
+
+  /* if argument is specified, it's got to be a valid SIP URL */
+  if (run->uri && !run->matrix) {
+    status = pjsua_verify_url(run->uri);
+    if (status != PJ_SUCCESS) {
+      client_fail("invalid URL in argv", status);
+      goto fail;
+    }
+  }
+  /* in matrix mode -c is a list, see matrix.c */
+  conf->country = (run->country && !run->matrix) ? run->country : "AT";
+
+  if (client_run_stack(run, pool, &job, &acc_id) != 0)
+    goto fail;
+
+  if (run->uri) {
+    uri = pj_str(run->uri);
+    /* if urn is specified, use urn */
+    if (run->urn)
+      urn = pj_str(run->urn);
+    /* wait for registration or timeout*/
+    cnt = 0;
+    while ((cnt < TIMEOUT_CNT) && (conf->reg == 0)) {
+      loop_sleep(TIMEOUT_MS);
+      cnt++;
+    }
+
+    if (cnt == TIMEOUT_CNT)
+      PJ_LOG(2, (THIS_FILE, "timeout on registration request\n"));
+
+    if (conf->reg == 0) {
+      conf->ret = conf->ret | ERR_REG;
+      PJ_LOG(2, (THIS_FILE, "Registration failed.\n"));
+    }
+  }
+
+  if (run->agent) {
+    /* the coordinator assigns the session range */
+    if (dist_agent_ready(conf->reg, &job) != 0) {
+      client_fail("error joining coordinator", -1);
+      goto fail;
+    }
+    run->base = job.base;
+    run->sessions = job.sessions;
+    dist_agent_wait(&job);
+  }
+
+  if (run->control && (ctl_start(run->control, run->profile) != 0)) {
+    client_fail("error creating control socket", -1);
+    goto fail;
+  }
+
+  /* workers of --procs leave the terminal to the parent */
+  if (run->dashboard && (run->shard.idx < 0) && (dash_start(run->uri) != 0)) {
+    client_fail("error starting dashboard", -1);
+    goto fail;
+  }
+
+  if ((conf->reg == 1) &&
+      (client_run_mode(run, pool, &acc_id, &job, &uri, &urn) != 0))
+    goto fail;
+
+  client_run_stop(run);
+
+  ret = conf->ret;
+
+  if (run->agent)
+    dist_agent_report(ret);
+
+  if (run->shard.idx >= 0)
+    shard_report(&run->shard, ret);
+
+  /* destroy pjsua */
+  free(conf->reply);
+  session_table_destroy();
+  pj_pool_release(pool);
+  pjsua_destroy();
+  trace_close();
+  conf = NULL;
+
+  return ret;
+
+fail:
+  dash_stop();
+  ctl_stop();
+  httpd_stop();
+  impair_stop();
+  reg_stop();
+  session_table_destroy();
+  pjsua_destroy();
+  trace_close();
+  conf = NULL;
+
+  return -1;
+}
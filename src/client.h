@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    client.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief client.c header file (libpjchat session API)
+ *
+ *  Public interface of libpjchat.a: one pjsua stack and registration per
+ *  process, any number of chat sessions on it.
+ *
+ *    s_client_opts_t opts = {"config.yml", 10};
+ *    client_create(&opts, NULL);
+ *    client_wait_registered(32000);
+ *    client_start(0, "sip:555@dects.dec112.eu", NULL, "start");
+ *    client_expect(0, 5000, buf, sizeof(buf));
+ *    client_send(0, "hello");
+ *    client_expect(0, 5000, buf, sizeof(buf));
+ *    client_stop(0, "bye");
+ *    client_destroy();
+ *
+ *  client_run() runs one of the pjchat modes (single chat, replay, soak,
+ *  sessions, profile, sweep, capacity, matrix, calls, stream) to the end;
+ *  the command line only parses and checks its arguments.
+ */
+
+#ifndef CLIENT_H_INCLUDED
+#define CLIENT_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <pthread.h>
+
+#include "calls.h"
+#include "capacity.h"
+#include "functions.h"
+#include "reg.h"
+#include "shard.h"
+#include "soak.h"
+#include "stats.h"
+
+/******************************************************************** DEFINE */
+
+#define CLIENT_POLL_MS 10   /* client_expect() and registration polling */
+#define CLIENT_BOX_MAX 1024 /* unread bodies per session, oldest dropped */
+
+/******************************************************************* TYPEDEF */
+
+typedef struct client_opts {
+  const char *cfg;     /* config file, NULL for CFG_FILE */
+  int sessions;        /* session slots, 0..sessions-1 */
+  int tls;             /* TLS transport instead of TCP */
+  int threads;         /* pjsua worker threads, 0 for the default */
+  int xhdr;            /* add the X-DEC112-Test header */
+  const char *country; /* vCard country, NULL for AT */
+} s_client_opts_t, *p_client_opts_t;
+
+/* called from pjsua worker threads, keep them short */
+typedef struct client_cb {
+  void (*on_reg)(int up, void *user);
+  void (*on_message)(int idx, const char *body, int len, int mtype,
+                     void *user);
+  void (*on_status)(int idx, int status, void *user); /* non-2xx only */
+  void *user;
+} s_client_cb_t, *p_client_cb_t;
+
+/* one pjchat run, client_run_default() fills in the defaults */
+typedef struct client_run {
+  const char *cfg;   /* -f, NULL for CFG_FILE */
+  char *uri;         /* -r, comma separated list in matrix mode */
+  char *urn;         /* -u */
+  char *country;     /* -c, also adds the start and stop texts */
+  char *txt;         /* -t, messages from a file */
+  int automsg;       /* -a */
+  int tls;           /* -s */
+  int xhdr;          /* -x */
+  int msgs;          /* -n, 0 for the mode default */
+  int interval_s;    /* -i */
+  int sessions;      /* --sessions */
+  int sessions_set;  /* --sessions was given */
+  int base;          /* first global session index */
+  int threads;       /* pjsua worker threads, 0 for the default */
+  int procs;         /* --procs, the rates of --profile are shared */
+  int profile;       /* --profile */
+  int matrix;        /* --matrix */
+  int dashboard;     /* --dashboard */
+  int deterministic; /* --deterministic */
+  unsigned seed;
+  int tls_bench;     /* --tls-bench handshakes, 0 for none */
+  char *trace;       /* --trace file */
+  size_t trace_mb;
+  char *replay;      /* --replay file */
+  double speed;
+  char *stream;      /* --stream file or - */
+  int inflight;
+  char *sweep;       /* --sweep min:max[:factor] */
+  char *agent;       /* --agent host:port of the coordinator */
+  char *control;     /* --control socket */
+  char *reference;   /* --by-reference base url */
+  char *impair;      /* --impair profile */
+  int impair_port;
+  s_soak_cfg_t soak;
+  s_capacity_cfg_t cap;
+  s_calls_cfg_t calls;
+  s_reg_cfg_t reg;
+  s_shard_t shard;   /* shard.idx >= 0 in a worker of --procs */
+} s_client_run_t, *p_client_run_t;
+
+/*************************************************************** PROTOTYPES */
+
+int client_create(p_client_opts_t opts, p_client_cb_t cb);
+int client_wait_registered(unsigned timeout_ms);
+int client_start(int idx, const char *uri, const char *urn, const char *text);
+int client_send(int idx, const char *text);
+int client_stop(int idx, const char *text);
+int client_expect(int idx, unsigned timeout_ms, char *buf, int len);
+int client_session_stats(int idx, uint64_t *tx, uint64_t *rx,
+                         uint64_t *err);
+void client_stats(p_stats_t st);
+void client_destroy(void);
+void client_run_default(p_client_run_t run);
+int client_run(p_client_run_t run);
+
+/* shared with the pjchat command line */
+void client_callbacks(pjsua_config *cfg);
+int client_identity(int idx, pj_pool_t *pool);
+int client_ids(pj_pool_t *pool);
+void client_account(pjsua_acc_config *acc_cfg);
+void client_proxy(pjsua_acc_config *acc_cfg, int idx, pj_pool_t *pool);
+int client_active(void);
+void client_on_reg(int up);
+void client_on_message(p_session_t sess, const pj_str_t *body, int mtype);
+void client_on_status(p_session_t sess, int status);
+
+#endif // CLIENT_H_INCLUDED
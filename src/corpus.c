@@ -0,0 +1,409 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    corpus.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the message corpus generator function definitions
+ *
+ *  Chat message bodies of a configurable size distribution are built from
+ *  a small emergency vocabulary, optionally mixed with multi byte UTF-8
+ *  characters; a body is always valid UTF-8 of exactly the drawn size.
+ *  The generator feeds the automatic modes, writes replay files and
+ *  drives a size sweep that reports throughput and reply latency per size.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "corpus.h"
+#include "fsm.h"
+
+/******************************************************************** DEFINE */
+
+#define CORPUS_MAX_STEPS 64
+
+/******************************************************************* TYPEDEF */
+
+/* result of one sweep step */
+typedef struct corpus_step {
+  unsigned size;
+  uint64_t tx;
+  uint64_t tx_fail;
+  uint64_t timeout;
+  double body_bs;
+  double wire_bs;
+  double p50;
+  double p99;
+} s_corpus_step_t, *p_corpus_step_t;
+
+/******************************************************************* GLOBALS */
+
+static s_corpus_t corpus;
+static int corpus_on = 0;
+static unsigned corpus_seq = 0;
+static uint64_t corpus_body = 0; /* generated body bytes */
+static uint64_t corpus_wire = 0; /* MESSAGE requests on the wire */
+
+static const char *corpus_words[] = {
+    "help",     "emergency", "accident", "street",  "injured", "ambulance",
+    "fire",     "police",    "please",   "hurry",   "car",     "house",
+    "smoke",    "breathing", "location", "near",    "bridge",  "station",
+    "child",    "water",     "bleeding", "trapped", "unconscious", NULL};
+
+/* 2, 3 and 4 byte sequences: a-umlaut, o-umlaut, u-umlaut, sharp s,
+ * euro sign, CJK "help", ambulance and siren emoji */
+static const char *corpus_mb[] = {
+    "\xc3\xa4", "\xc3\xb6", "\xc3\xbc", "\xc3\x9f", "\xe2\x82\xac",
+    "\xe6\x95\x91\xe5\x91\xbd", "\xf0\x9f\x9a\x91", "\xf0\x9f\x9a\xa8",
+    NULL};
+
+static pj_status_t corpus_on_tx(pjsip_tx_data *tdata);
+
+/* counts the printed size of outgoing MESSAGE requests */
+static pjsip_module mod_corpus = {
+    NULL,
+    NULL,                                  /* prev, next */
+    {"mod-pjchat-corpus", 17},             /* name */
+    -1,                                    /* id */
+    PJSIP_MOD_PRIORITY_TRANSPORT_LAYER - 1, /* priority */
+    NULL,                                  /* load() */
+    NULL,                                  /* start() */
+    NULL,                                  /* stop() */
+    NULL,                                  /* unload() */
+    NULL,                                  /* on_rx_request() */
+    NULL,                                  /* on_rx_response() */
+    &corpus_on_tx,                         /* on_tx_request() */
+    NULL,                                  /* on_tx_response() */
+    NULL,                                  /* on_tsx_state() */
+};
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * corpus_rand(x)
+ * xorshift step, callers keep the state on their stack
+ */
+static uint32_t corpus_rand(uint32_t *x) {
+
+  *x ^= *x << 13;
+  *x ^= *x >> 17;
+  *x ^= *x << 5;
+
+  return *x;
+}
+
+/*
+ * corpus_parse(spec, utf8)
+ * sets the size distribution: <n>, fixed:<n>, uniform:<min>:<max>,
+ * exp:<mean> or list:<n>,<n>,...
+ */
+int corpus_parse(const char *spec, int utf8) {
+  const char *p;
+  char *end;
+
+  memset(&corpus, 0, sizeof(corpus));
+  corpus.utf8 = utf8;
+
+  if (!strncmp(spec, "fixed:", 6)) {
+    corpus.dist = CORPUS_FIXED;
+    corpus.min = strtoul(spec + 6, NULL, 10);
+  } else if (!strncmp(spec, "uniform:", 8)) {
+    corpus.dist = CORPUS_UNIFORM;
+    corpus.min = strtoul(spec + 8, &end, 10);
+    if (*end != ':')
+      return -1;
+    corpus.max = strtoul(end + 1, NULL, 10);
+    if (corpus.max < corpus.min)
+      return -1;
+  } else if (!strncmp(spec, "exp:", 4)) {
+    corpus.dist = CORPUS_EXP;
+    corpus.mean = atof(spec + 4);
+    if (corpus.mean < 1)
+      return -1;
+  } else if (!strncmp(spec, "list:", 5)) {
+    corpus.dist = CORPUS_LIST;
+    for (p = spec + 5; *p && (corpus.cnt < CORPUS_MAX_LIST); p = end) {
+      corpus.list[corpus.cnt++] = strtoul(p, &end, 10);
+      if (end == p)
+        return -1;
+      if (*end == ',')
+        end++;
+    }
+    if (corpus.cnt == 0)
+      return -1;
+  } else {
+    corpus.dist = CORPUS_FIXED;
+    corpus.min = strtoul(spec, NULL, 10);
+  }
+
+  if ((corpus.dist == CORPUS_FIXED) && (corpus.min < 1))
+    return -1;
+
+  corpus_on = 1;
+
+  return 0;
+}
+
+/*
+ * corpus_active()
+ * returns 1 if generated bodies replace the fixed texts
+ */
+int corpus_active(void) { return corpus_on; }
+
+/*
+ * corpus_size()
+ * draws the next body size; safe to call from any thread
+ */
+unsigned corpus_size(void) {
+  unsigned seq;
+  uint32_t x;
+  double u;
+  double v;
+
+  seq = __atomic_fetch_add(&corpus_seq, 1, __ATOMIC_RELAXED);
+  x = seq * 2654435761u ^ 0x9e3779b9u;
+  if (x == 0)
+    x = 1;
+
+  switch (corpus.dist) {
+  case CORPUS_UNIFORM:
+    return corpus.min + corpus_rand(&x) % (corpus.max - corpus.min + 1);
+  case CORPUS_EXP:
+    u = (corpus_rand(&x) + 1.0) / 4294967297.0;
+    v = -corpus.mean * log(u);
+    return (v < 1) ? 1 : (v > CORPUS_MAX_SIZE) ? CORPUS_MAX_SIZE : v;
+  case CORPUS_LIST:
+    return corpus.list[seq % corpus.cnt];
+  default:
+    return corpus.min;
+  }
+}
+
+/*
+ * corpus_text(size, seq)
+ * returns a malloc'ed body of exactly size bytes; seq varies the text
+ */
+char *corpus_text(unsigned size, unsigned seq) {
+  const char *w;
+  uint32_t x;
+  unsigned n;
+  unsigned len;
+  char *buf;
+  int nw;
+  int nm;
+
+  if (size > CORPUS_MAX_SIZE)
+    size = CORPUS_MAX_SIZE;
+  if ((buf = (char *)malloc(size + 1)) == NULL)
+    return NULL;
+
+  for (nw = 0; corpus_words[nw]; nw++)
+    ;
+  for (nm = 0; corpus_mb[nm]; nm++)
+    ;
+
+  x = (size * 2654435761u) ^ (seq * 40503u) ^ 0x9e3779b9u;
+  if (x == 0)
+    x = 1;
+
+  n = 0;
+  while (n < size) {
+    if (corpus.utf8 && (corpus_rand(&x) % 4 == 0))
+      w = corpus_mb[corpus_rand(&x) % nm];
+    else
+      w = corpus_words[corpus_rand(&x) % nw];
+    len = strlen(w);
+    if (n + (n ? 1 : 0) + len > size) {
+      /* pad with ASCII so no character is cut in half */
+      while (n < size)
+        buf[n++] = 'a' + corpus_rand(&x) % 26;
+      break;
+    }
+    if (n)
+      buf[n++] = ' ';
+    memcpy(buf + n, w, len);
+    n += len;
+  }
+  buf[size] = '\0';
+
+  STAT_ADD(corpus_body, size);
+
+  return buf;
+}
+
+/*
+ * corpus_write(filename, msgs, gap_ms)
+ * writes a replay file of one session with msgs generated chat messages
+ */
+int corpus_write(const char *filename, int msgs, unsigned gap_ms) {
+  char *text;
+  FILE *fh;
+  int i;
+
+  if ((fh = fopen(filename, "w")) == NULL) {
+    fprintf(stderr, "cannot open %s\n", filename);
+    return -1;
+  }
+
+  fprintf(fh, "# pjchat corpus, %i chat messages\n", msgs);
+  fprintf(fh, "0\t21\tcorpus session start\n");
+  for (i = 1; i <= msgs; i++) {
+    text = corpus_text(corpus_size(), i);
+    if (!text)
+      break;
+    fprintf(fh, "%u\t22\t%s\n", gap_ms, text);
+    free(text);
+  }
+  fprintf(fh, "%u\t23\tcorpus session stop\n", gap_ms);
+
+  fclose(fh);
+
+  return i - 1;
+}
+
+/*
+ * corpus_on_tx(tdata)
+ * module callback for outgoing requests
+ */
+static pj_status_t corpus_on_tx(pjsip_tx_data *tdata) {
+
+  if (tdata->msg && (tdata->msg->type == PJSIP_REQUEST_MSG) &&
+      !pj_stricmp2(&tdata->msg->line.req.method.name, "MESSAGE"))
+    STAT_ADD(corpus_wire, tdata->buf.cur - tdata->buf.start);
+
+  return PJ_SUCCESS;
+}
+
+/*
+ * corpus_sweep(*acc_id, min, max, factor, msgs, interval_ms, *uri, *urn)
+ * runs msgs chat messages per session for every body size from min to
+ * max (multiplied by factor) and reports throughput and latency per size
+ */
+int corpus_sweep(pjsua_acc_id *acc_id, unsigned min, unsigned max,
+                 unsigned factor, unsigned msgs, unsigned interval_ms,
+                 pj_str_t *uri, pj_str_t *urn) {
+  s_corpus_step_t step[CORPUS_MAX_STEPS];
+  s_fsm_cfg_t fcfg;
+  s_stats_t *s0;
+  s_stats_t *s1;
+  s_hist_t *h;
+  uint64_t body0;
+  uint64_t wire0;
+  uint64_t t0;
+  double dt;
+  unsigned size;
+  int utf8;
+  int cnt;
+  int i;
+
+  if ((min < 1) || (max < min) || (max > CORPUS_MAX_SIZE) || (factor < 2))
+    return -1;
+
+  s0 = (s_stats_t *)malloc(sizeof(s_stats_t));
+  s1 = (s_stats_t *)malloc(sizeof(s_stats_t));
+  h = (s_hist_t *)malloc(sizeof(s_hist_t));
+  if (!s0 || !s1 || !h) {
+    free(s0);
+    free(s1);
+    free(h);
+    return -1;
+  }
+
+  /* counts the wire bytes of every step */
+  if (pjsip_endpt_register_module(pjsua_get_pjsip_endpt(), &mod_corpus) !=
+      PJ_SUCCESS) {
+    PJ_LOG(2, (THIS_FILE, "cannot register corpus module\n"));
+    free(s0);
+    free(s1);
+    free(h);
+    return -1;
+  }
+
+  memset(&fcfg, 0, sizeof(fcfg));
+  fcfg.acc_id = *acc_id;
+  fcfg.uri = *uri;
+  fcfg.urn = *urn;
+  fcfg.msgs = msgs;
+  fcfg.interval_ms = interval_ms;
+  fcfg.cycles = 1;
+
+  utf8 = corpus.utf8;
+  cnt = 0;
+  for (size = min; (size <= max) && (cnt < CORPUS_MAX_STEPS);
+       size *= factor) {
+    memset(&corpus, 0, sizeof(corpus));
+    corpus.dist = CORPUS_FIXED;
+    corpus.min = size;
+    corpus.utf8 = utf8;
+    corpus_on = 1;
+
+    printf("\n##### size sweep: %u byte bodies #####\n", size);
+
+    /* late replies of the previous step may still arrive, so the shared
+     * counters keep running and every step reports its own deltas */
+    memcpy(s0, &stats, sizeof(s_stats_t));
+    body0 = STAT_GET(corpus_body);
+    wire0 = STAT_GET(corpus_wire);
+    t0 = stats_now_ns();
+    if (fsm_run(&fcfg) != 0)
+      break;
+    dt = (stats_now_ns() - t0) / 1e9;
+    memcpy(s1, &stats, sizeof(s_stats_t));
+
+    h->cnt = s1->rtt.cnt - s0->rtt.cnt;
+    h->sum = s1->rtt.sum - s0->rtt.sum;
+    h->max = s1->rtt.max; /* process wide, only caps the quantiles */
+    for (i = 0; i < HIST_BUCKETS; i++)
+      h->b[i] = s1->rtt.b[i] - s0->rtt.b[i];
+
+    step[cnt].size = size;
+    step[cnt].tx = s1->tx - s0->tx;
+    step[cnt].tx_fail = s1->tx_fail - s0->tx_fail;
+    step[cnt].timeout = s1->timeout - s0->timeout;
+    step[cnt].body_bs = (STAT_GET(corpus_body) - body0) / dt;
+    step[cnt].wire_bs = (STAT_GET(corpus_wire) - wire0) / dt;
+    step[cnt].p50 = hist_quantile(h, 0.50) / 1000.0;
+    step[cnt].p99 = hist_quantile(h, 0.99) / 1000.0;
+    cnt++;
+  }
+
+  if (mod_corpus.id != -1)
+    pjsip_endpt_unregister_module(pjsua_get_pjsip_endpt(), &mod_corpus);
+
+  printf("\n##### size sweep: %i sessions, %u messages each #####\n",
+         session_count(), msgs);
+  printf("%9s %8s %7s %8s %12s %12s %9s %9s\n", "size", "sent", "failed",
+         "timeout", "body B/s", "wire B/s", "p50 ms", "p99 ms");
+  for (i = 0; i < cnt; i++)
+    printf("%9u %8lu %7lu %8lu %12.0f %12.0f %9.3f %9.3f\n", step[i].size,
+           (unsigned long)step[i].tx, (unsigned long)step[i].tx_fail,
+           (unsigned long)step[i].timeout, step[i].body_bs, step[i].wire_bs,
+           step[i].p50, step[i].p99);
+
+  free(h);
+  free(s1);
+  free(s0);
+
+  return cnt;
+}
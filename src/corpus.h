@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    corpus.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief corpus.c header file (synthetic message bodies and size sweep)
+ */
+
+#ifndef CORPUS_H_INCLUDED
+#define CORPUS_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <math.h>
+
+#include "functions.h"
+
+/******************************************************************** DEFINE */
+
+#define CORPUS_MAX_SIZE (1024 * 1024)
+#define CORPUS_MAX_LIST 32
+#define CORPUS_SWEEP_FACTOR 2
+
+/* size distributions */
+#define CORPUS_FIXED 0   /* fixed:<n> */
+#define CORPUS_UNIFORM 1 /* uniform:<min>:<max> */
+#define CORPUS_EXP 2     /* exp:<mean> */
+#define CORPUS_LIST 3    /* list:<n>,<n>,... (round robin) */
+
+/******************************************************************* TYPEDEF */
+
+typedef struct corpus {
+  int dist;
+  int utf8; /* multi byte characters */
+  unsigned min;
+  unsigned max;
+  double mean;
+  int cnt;
+  unsigned list[CORPUS_MAX_LIST];
+} s_corpus_t, *p_corpus_t;
+
+/*************************************************************** PROTOTYPES */
+
+int corpus_parse(const char *spec, int utf8);
+int corpus_active(void);
+unsigned corpus_size(void);
+char *corpus_text(unsigned size, unsigned seq);
+int corpus_write(const char *filename, int msgs, unsigned gap_ms);
+int corpus_sweep(pjsua_acc_id *acc_id, unsigned min, unsigned max,
+                 unsigned factor, unsigned msgs, unsigned interval_ms,
+                 pj_str_t *uri, pj_str_t *urn);
+
+#endif // CORPUS_H_INCLUDED
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    ctl.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the control socket function definitions
+ *
+ *  A thread serves a Unix domain socket, one client at a time. Commands
+ *  change the running state machines (fsm.c) and load profile (profile.c)
+ *  in place, so traffic and registrations are not interrupted.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "ctl.h"
+#include "fsm.h"
+
+/******************************************************************* GLOBALS */
+
+static pthread_t ctl_thread;
+static char ctl_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static int ctl_fd = -1;
+static int ctl_cli = -1; /* connected client, under ctl_lock */
+static pthread_mutex_t ctl_lock = PTHREAD_MUTEX_INITIALIZER;
+static int ctl_profile = 0;
+static int ctl_quit = 0;
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * ctl_exec(line, wf)
+ * runs one command and writes the reply
+ */
+static void ctl_exec(char *line, FILE *wf) {
+  char *save;
+  char *cmd;
+  char *arg;
+  int n;
+
+  cmd = strtok_r(line, " \t\r\n", &save);
+  if (!cmd)
+    return;
+  arg = strtok_r(NULL, " \t\r\n", &save);
+
+  if (!strcmp(cmd, "set-rate")) {
+    if (!ctl_profile) {
+      fprintf(wf, CTL_ERR " set-rate needs --profile\n");
+    } else if (!arg) {
+      fprintf(wf, CTL_ERR " set-rate <starts/s>|off\n");
+    } else if (!strcmp(arg, "off")) {
+      profile_override(-1);
+      fprintf(wf, CTL_OK " following the profile\n");
+    } else {
+      profile_override(atof(arg));
+      fprintf(wf, CTL_OK " %.3f starts/s\n", atof(arg));
+    }
+  } else if (!strcmp(cmd, "set-interval")) {
+    if (!arg || ((n = atoi(arg)) < 1)) {
+      fprintf(wf, CTL_ERR " set-interval <ms>\n");
+    } else {
+      fsm_interval(n);
+      fprintf(wf, CTL_OK " %i ms\n", n);
+    }
+  } else if (!strcmp(cmd, "add-sessions")) {
+    if (!arg || ((n = atoi(arg)) < 1))
+      fprintf(wf, CTL_ERR " add-sessions <n>\n");
+    else
+      fprintf(wf, CTL_OK " %i sessions started\n", fsm_add(n));
+  } else if (!strcmp(cmd, "drain")) {
+    n = fsm_drain(arg ? atoi(arg) : 0);
+    fprintf(wf, CTL_OK " %i sessions draining\n", n);
+  } else if (!strcmp(cmd, "pause")) {
+    fsm_pause(1);
+    fprintf(wf, CTL_OK " paused\n");
+  } else if (!strcmp(cmd, "resume")) {
+    fsm_pause(0);
+    fprintf(wf, CTL_OK " resumed\n");
+  } else if (!strcmp(cmd, "dump-stats")) {
+    fsm_print(wf);
+    stats_print(wf, &stats);
+  } else if (!strcmp(cmd, "help")) {
+    fprintf(wf, "set-rate <starts/s>|off\nset-interval <ms>\n"
+                "add-sessions <n>\ndrain [<n>]\npause\nresume\ndump-stats\n");
+  } else {
+    fprintf(wf, CTL_ERR " unknown command %s\n", cmd);
+  }
+}
+
+/*
+ * ctl_reply(fd, line)
+ * runs one command and sends its reply; a client gone in the meantime
+ * must not raise SIGPIPE in the load run, returns -1 then
+ */
+static int ctl_reply(int fd, char *line) {
+  size_t len;
+  char *out;
+  FILE *wf;
+  int ret;
+
+  out = NULL;
+  len = 0;
+  if (!(wf = open_memstream(&out, &len)))
+    return -1;
+  ctl_exec(line, wf);
+  fclose(wf);
+
+  ret = ((len == 0) || (send(fd, out, len, MSG_NOSIGNAL) == (ssize_t)len))
+            ? 0
+            : -1;
+  free(out);
+
+  return ret;
+}
+
+/*
+ * ctl_main(arg)
+ * control thread, serves one client at a time until ctl_stop()
+ */
+static void *ctl_main(void *arg) {
+  static pj_thread_desc desc;
+  pj_thread_t *th;
+  char line[BUFFER_512 + 1];
+  FILE *rf;
+  int fd;
+
+  PJ_UNUSED_ARG(arg);
+
+  /* commands call into pjsua (timers) */
+  memset(desc, 0, sizeof(desc));
+  pj_thread_register("ctl", desc, &th);
+
+  while (!__atomic_load_n(&ctl_quit, __ATOMIC_ACQUIRE)) {
+    if ((fd = accept(ctl_fd, NULL, NULL)) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (!(rf = fdopen(fd, "r"))) {
+      PJ_LOG(2, (THIS_FILE, "control connection: %s\n", strerror(errno)));
+      close(fd);
+      continue;
+    }
+    pthread_mutex_lock(&ctl_lock);
+    ctl_cli = fd;
+    pthread_mutex_unlock(&ctl_lock);
+    while (!__atomic_load_n(&ctl_quit, __ATOMIC_ACQUIRE) &&
+           fgets(line, BUFFER_512, rf) && (ctl_reply(fd, line) == 0))
+      ;
+    /* ctl_stop() must not shut down a reused descriptor */
+    pthread_mutex_lock(&ctl_lock);
+    ctl_cli = -1;
+    pthread_mutex_unlock(&ctl_lock);
+    fclose(rf);
+  }
+
+  return NULL;
+}
+
+/*
+ * ctl_start(path, profile)
+ * creates the control socket at path and starts serving it; profile
+ * enables set-rate
+ */
+int ctl_start(const char *path, int profile) {
+  struct sockaddr_un sa;
+
+  if (strlen(path) >= sizeof(sa.sun_path)) {
+    PJ_LOG(2, (THIS_FILE, "control socket path too long\n"));
+    return -1;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strcpy(sa.sun_path, path);
+  unlink(path);
+
+  ctl_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if ((ctl_fd < 0) || (bind(ctl_fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) ||
+      (listen(ctl_fd, 1) != 0)) {
+    PJ_LOG(2, (THIS_FILE, "cannot listen on %s\n", path));
+    if (ctl_fd >= 0)
+      close(ctl_fd);
+    ctl_fd = -1;
+    return -1;
+  }
+
+  strcpy(ctl_path, path);
+  ctl_profile = profile;
+  ctl_quit = 0;
+  if (pthread_create(&ctl_thread, NULL, ctl_main, NULL) != 0) {
+    close(ctl_fd);
+    unlink(ctl_path);
+    ctl_fd = -1;
+    return -1;
+  }
+
+  PJ_LOG(3, (THIS_FILE, "control socket %s\n", path));
+
+  return 0;
+}
+
+/*
+ * ctl_stop()
+ * disconnects the client, removes the socket and joins the thread
+ */
+void ctl_stop(void) {
+
+  if (ctl_fd < 0)
+    return;
+
+  __atomic_store_n(&ctl_quit, 1, __ATOMIC_RELEASE);
+  shutdown(ctl_fd, SHUT_RDWR);
+  pthread_mutex_lock(&ctl_lock);
+  if (ctl_cli >= 0)
+    shutdown(ctl_cli, SHUT_RDWR);
+  pthread_mutex_unlock(&ctl_lock);
+  pthread_join(ctl_thread, NULL);
+
+  close(ctl_fd);
+  unlink(ctl_path);
+  ctl_fd = -1;
+}
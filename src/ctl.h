@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    ctl.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief ctl.c header file (runtime control socket)
+ */
+
+#ifndef CTL_H_INCLUDED
+#define CTL_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "functions.h"
+
+/******************************************************************** DEFINE */
+
+/*
+ * control protocol, one command per line, one reply line each
+ * (dump-stats and help reply with several lines)
+ *   set-rate <starts/s>|off   start rate of a load profile
+ *   set-interval <ms>         gap between chat messages
+ *   add-sessions <n>          start n retired sessions
+ *   drain [<n>]               retire n (all) sessions after their cycle
+ *   pause | resume            hold back / release new messages
+ *   dump-stats                session states, counters and latencies
+ *   help
+ */
+#define CTL_OK "ok"
+#define CTL_ERR "error:"
+
+/*************************************************************** PROTOTYPES */
+
+int ctl_start(const char *path, int profile);
+void ctl_stop(void);
+
+#endif // CTL_H_INCLUDED
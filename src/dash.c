@@ -0,0 +1,425 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    dash.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the terminal dashboard function definitions
+ *
+ *  A thread redraws one screen per DASH_REFRESH_MS on the terminal's
+ *  alternate screen: registrations, session states, target and achieved
+ *  message rate, requests in flight, reply latency, rejections per status
+ *  code and memory. It only reads the lock-free counters of stats.c, the
+ *  session table and reg.c, so message processing never waits for it.
+ *  While it runs, stdout (progress lines, pjsua log) goes to a temporary
+ *  file that is copied to the terminal when the dashboard stops. Once it
+ *  holds DASH_LOG_MAX / 2 bytes, stdout moves to a new file and the one
+ *  before the current is dropped, so writers are never cut off.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "dash.h"
+
+/******************************************************************* GLOBALS */
+
+static int dash_on = 0;
+static int dash_quit = 0;
+static pthread_t dash_thread;
+static pthread_mutex_t dash_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dash_cond = PTHREAD_COND_INITIALIZER;
+static FILE *dash_tty = NULL; /* the terminal stdout was */
+static FILE *dash_log = NULL;  /* stdout while drawing */
+static FILE *dash_prev = NULL; /* stdout before the last rotation */
+static uint64_t dash_dropped = 0; /* bytes of stdout dropped by the cap */
+static const char *dash_target = NULL;
+static char dash_last[DASH_LAST_LEN + 1];
+static s_hist_t dash_win[DASH_WINDOW]; /* reply latency snapshots */
+
+static const char *dash_states[FSM_STATES] = {
+    "registering", "idle", "starting", "chatting", "closing", "done"};
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * dash_active()
+ * returns 1 while the dashboard owns the terminal
+ */
+int dash_active(void) { return __atomic_load_n(&dash_on, __ATOMIC_ACQUIRE); }
+
+/*
+ * dash_message(*from, *body)
+ * keeps the last message of the single chat instead of printing it
+ */
+void dash_message(const pj_str_t *from, const pj_str_t *body) {
+  char *p;
+
+  pthread_mutex_lock(&dash_lock);
+  snprintf(dash_last, sizeof(dash_last), "%.*s: %.*s", (int)from->slen,
+           from->ptr, (int)body->slen, body->ptr);
+  for (p = dash_last; *p; p++) {
+    if ((*p == '\r') || (*p == '\n') || (*p == '\t'))
+      *p = ' ';
+  }
+  pthread_mutex_unlock(&dash_lock);
+}
+
+/*
+ * dash_codes(fh)
+ * prints the most frequent status codes of rejected requests
+ */
+static void dash_codes(FILE *fh) {
+  uint64_t cnt[DASH_CODES];
+  uint64_t c;
+  int code[DASH_CODES];
+  int n;
+  int i;
+  int j;
+
+  n = 0;
+  for (i = 0; i <= STATS_CODES; i++) {
+    if ((c = STAT_GET(stats.tx_code[i])) == 0)
+      continue;
+    /* insertion into the top list, smallest last */
+    if (n < DASH_CODES)
+      j = n++;
+    else if (c > cnt[DASH_CODES - 1])
+      j = DASH_CODES - 1;
+    else
+      continue;
+    for (; (j > 0) && (cnt[j - 1] < c); j--) {
+      cnt[j] = cnt[j - 1];
+      code[j] = code[j - 1];
+    }
+    cnt[j] = c;
+    code[j] = i;
+  }
+
+  fprintf(fh, " rejected     ");
+  if (n == 0)
+    fprintf(fh, " -");
+  for (i = 0; i < n; i++) {
+    if (code[i] < STATS_CODES)
+      fprintf(fh, " %i=%lu", code[i] + STATS_CODE_MIN, (unsigned long)cnt[i]);
+    else
+      fprintf(fh, " other=%lu", (unsigned long)cnt[i]);
+  }
+  fprintf(fh, "\033[K\n");
+}
+
+/*
+ * dash_draw(fh, t_s, rate, win)
+ * draws one screen; win holds the replies of the last DASH_WINDOW redraws
+ */
+static void dash_draw(FILE *fh, uint64_t t_s, double rate, p_hist_t win) {
+  p_session_t sess;
+  int state[FSM_STATES];
+  double target;
+  uint64_t now_ms;
+  int inflight;
+  int hold;
+  int acc;
+  int up;
+  int rec;
+  int st;
+  int i;
+
+  memset(state, 0, sizeof(state));
+  target = 0;
+  inflight = 0;
+  hold = 0;
+  now_ms = stats_now_ns() / 1000000;
+  for (i = 0; i < session_count(); i++) {
+    sess = session_get(i);
+    st = __atomic_load_n(&sess->state, __ATOMIC_RELAXED);
+    if ((st >= 0) && (st < FSM_STATES))
+      state[st]++;
+    if ((st == FSM_CHATTING) && sess->interval_ms)
+      target += 1000.0 / sess->interval_ms;
+    if (__atomic_load_n(&sess->tx_ns, __ATOMIC_RELAXED))
+      inflight++;
+    if (__atomic_load_n(&sess->flow.until_ms, __ATOMIC_RELAXED) > now_ms)
+      hold++;
+  }
+  acc = reg_count(&up, &rec);
+
+  fprintf(fh, "\033[H\033[7m pjchat %-52.52s %02lu:%02lu:%02lu \033[0m\033[K\n",
+          dash_target ? dash_target : "", (unsigned long)(t_s / 3600),
+          (unsigned long)(t_s / 60 % 60), (unsigned long)(t_s % 60));
+  fprintf(fh, "\033[K\n");
+  fprintf(fh, " registered    %i/%i  recovering %i\033[K\n", up, acc, rec);
+  fprintf(fh, " sessions      %i", session_count());
+  for (i = 0; i < FSM_STATES; i++) {
+    if (state[i])
+      fprintf(fh, "  %s %i", dash_states[i], state[i]);
+  }
+  fprintf(fh, "\033[K\n");
+  if (session_count() > 0)
+    fprintf(fh, " rate          target %.1f/s  achieved %.1f/s  in flight %i"
+                "\033[K\n",
+            target, rate, inflight);
+  else
+    fprintf(fh, " rate          achieved %.1f/s\033[K\n", rate);
+  if (flow_mode() != FLOW_OFF)
+    fprintf(fh, " backoff       %i sessions  deferred %lu  shed %lu\033[K\n",
+            hold, (unsigned long)STAT_GET(stats.tx_defer),
+            (unsigned long)STAT_GET(stats.tx_shed));
+  fprintf(fh, "\033[K\n");
+  fprintf(fh, " reply  %2is    p50 %.1f  p90 %.1f  p99 %.1f ms  (%lu)\033[K\n",
+          DASH_WINDOW * DASH_REFRESH_MS / 1000,
+          hist_quantile(win, 0.50) / 1000.0, hist_quantile(win, 0.90) / 1000.0,
+          hist_quantile(win, 0.99) / 1000.0, (unsigned long)win->cnt);
+  fprintf(fh, " reply  all    p50 %.1f  p90 %.1f  p99 %.1f  max %.1f ms"
+              "\033[K\n",
+          hist_quantile(&stats.rtt, 0.50) / 1000.0,
+          hist_quantile(&stats.rtt, 0.90) / 1000.0,
+          hist_quantile(&stats.rtt, 0.99) / 1000.0,
+          STAT_GET(stats.rtt.max) / 1000.0);
+  fprintf(fh, "\033[K\n");
+  fprintf(fh, " sent          %lu  received %lu  unmatched %lu\033[K\n",
+          (unsigned long)STAT_GET(stats.tx), (unsigned long)STAT_GET(stats.rx),
+          (unsigned long)STAT_GET(stats.rx_lost));
+  fprintf(fh, " errors        failed %lu  rejected %lu  timeout %lu\033[K\n",
+          (unsigned long)STAT_GET(stats.tx_fail),
+          (unsigned long)STAT_GET(stats.tx_err),
+          (unsigned long)STAT_GET(stats.timeout));
+  dash_codes(fh);
+  if (STAT_GET(stats.rx_seq))
+    fprintf(fh, " sequence      duplicate %lu  missing %lu  reordered %lu"
+                "\033[K\n",
+            (unsigned long)STAT_GET(stats.rx_dup),
+            (unsigned long)STAT_GET(stats.rx_gap),
+            (unsigned long)STAT_GET(stats.rx_reorder));
+  fprintf(fh, "\033[K\n");
+  fprintf(fh, " memory        rss %.1f MB\033[K\n", soak_rss() / 1048576.0);
+
+  pthread_mutex_lock(&dash_lock);
+  if (dash_last[0])
+    fprintf(fh, " last          %.*s\033[K\n", DASH_LAST_LEN - 14, dash_last);
+  pthread_mutex_unlock(&dash_lock);
+
+  fprintf(fh, "\033[J");
+  fflush(fh);
+}
+
+/*
+ * dash_size(fh)
+ * returns the size of a stdout file
+ */
+static uint64_t dash_size(FILE *fh) {
+  struct stat st;
+
+  return (fstat(fileno(fh), &st) == 0) ? (uint64_t)st.st_size : 0;
+}
+
+/*
+ * dash_rotate()
+ * moves stdout to a new file once the current one holds DASH_LOG_MAX / 2;
+ * dup2() switches writers at once, nothing written is lost on the way
+ */
+static void dash_rotate(void) {
+  FILE *next;
+
+  if (dash_size(dash_log) < DASH_LOG_MAX / 2)
+    return;
+
+  if (!(next = tmpfile()))
+    return;
+  if (dup2(fileno(next), STDOUT_FILENO) < 0) {
+    fclose(next);
+    return;
+  }
+
+  if (dash_prev) {
+    dash_dropped += dash_size(dash_prev);
+    fclose(dash_prev);
+  }
+  dash_prev = dash_log;
+  dash_log = next;
+}
+
+/*
+ * dash_main(arg)
+ * redraws until dash_stop()
+ */
+static void *dash_main(void *arg) {
+  struct timespec ts;
+  p_hist_t win;
+  p_hist_t cur;
+  uint64_t start;
+  uint64_t now;
+  uint64_t last;
+  uint64_t tx0;
+  uint64_t tx;
+  double rate;
+  int slot;
+  int i;
+
+  PJ_UNUSED_ARG(arg);
+
+  win = (p_hist_t)calloc(1, sizeof(s_hist_t));
+  cur = (p_hist_t)calloc(1, sizeof(s_hist_t));
+  if (!win || !cur) {
+    free(win);
+    free(cur);
+    return NULL;
+  }
+
+  start = last = stats_now_ns();
+  tx0 = STAT_GET(stats.tx);
+  for (i = 0; i < DASH_WINDOW; i++)
+    memcpy(&dash_win[i], &stats.rtt, sizeof(s_hist_t));
+
+  pthread_mutex_lock(&dash_lock);
+  for (slot = 0; !dash_quit; slot = (slot + 1) % DASH_WINDOW) {
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += DASH_REFRESH_MS / 1000;
+    ts.tv_nsec += (DASH_REFRESH_MS % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000L;
+    }
+    while (!dash_quit &&
+           (pthread_cond_timedwait(&dash_cond, &dash_lock, &ts) == 0))
+      ;
+    if (dash_quit)
+      break;
+    pthread_mutex_unlock(&dash_lock);
+
+    now = stats_now_ns();
+    tx = STAT_GET(stats.tx);
+    rate = (now > last) ? (tx - tx0) * 1e9 / (now - last) : 0;
+    last = now;
+    tx0 = tx;
+
+    /* replies since the oldest snapshot, which the current one replaces */
+    memcpy(cur, &stats.rtt, sizeof(s_hist_t));
+    win->cnt = 0;
+    win->max = cur->max; /* process wide, only caps the quantiles */
+    for (i = 0; i < HIST_BUCKETS; i++) {
+      win->b[i] = cur->b[i] - dash_win[slot].b[i];
+      win->cnt += win->b[i];
+    }
+    memcpy(&dash_win[slot], cur, sizeof(s_hist_t));
+
+    dash_draw(dash_tty, (now - start) / 1000000000, rate, win);
+    dash_rotate();
+    pthread_mutex_lock(&dash_lock);
+  }
+  pthread_mutex_unlock(&dash_lock);
+
+  free(cur);
+  free(win);
+
+  return NULL;
+}
+
+/*
+ * dash_start(target)
+ * switches the terminal to the dashboard; stdout must be a terminal
+ */
+int dash_start(const char *target) {
+  int fd;
+
+  if (!isatty(STDOUT_FILENO)) {
+    PJ_LOG(2, (THIS_FILE, "dashboard requires a terminal\n"));
+    return -1;
+  }
+
+  fflush(stdout);
+  if (((fd = dup(STDOUT_FILENO)) < 0) || !(dash_tty = fdopen(fd, "w"))) {
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  if (!(dash_log = tmpfile()) ||
+      (dup2(fileno(dash_log), STDOUT_FILENO) < 0)) {
+    if (dash_log)
+      fclose(dash_log);
+    fclose(dash_tty);
+    dash_log = dash_tty = NULL;
+    return -1;
+  }
+
+  dash_target = target;
+  dash_dropped = 0;
+  dash_last[0] = '\0';
+  dash_quit = 0;
+  /* alternate screen, no cursor */
+  fprintf(dash_tty, "\033[?1049h\033[?25l\033[H\033[2J");
+  fflush(dash_tty);
+  __atomic_store_n(&dash_on, 1, __ATOMIC_RELEASE);
+
+  if (pthread_create(&dash_thread, NULL, dash_main, NULL) != 0) {
+    __atomic_store_n(&dash_on, 0, __ATOMIC_RELEASE);
+    dash_stop();
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * dash_stop()
+ * joins the thread, restores the terminal and prints what stdout got
+ * in the meantime
+ */
+void dash_stop(void) {
+  char buf[BUFFER_2048];
+  size_t n;
+
+  if (!dash_tty)
+    return;
+
+  if (__atomic_exchange_n(&dash_on, 0, __ATOMIC_ACQ_REL)) {
+    pthread_mutex_lock(&dash_lock);
+    dash_quit = 1;
+    pthread_cond_signal(&dash_cond);
+    pthread_mutex_unlock(&dash_lock);
+    pthread_join(dash_thread, NULL);
+  }
+
+  fprintf(dash_tty, "\033[?25h\033[?1049l");
+  fflush(dash_tty);
+
+  fflush(stdout);
+  dup2(fileno(dash_tty), STDOUT_FILENO);
+  if (dash_dropped > 0)
+    printf("(%lu bytes of earlier output dropped)\n",
+           (unsigned long)dash_dropped);
+  if (dash_prev) {
+    rewind(dash_prev);
+    while ((n = fread(buf, 1, sizeof(buf), dash_prev)) > 0)
+      fwrite(buf, 1, n, stdout);
+    fclose(dash_prev);
+  }
+  rewind(dash_log);
+  while ((n = fread(buf, 1, sizeof(buf), dash_log)) > 0)
+    fwrite(buf, 1, n, stdout);
+  fflush(stdout);
+
+  fclose(dash_log);
+  fclose(dash_tty);
+  dash_log = dash_tty = dash_prev = NULL;
+}
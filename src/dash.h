@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    dash.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief dash.c header file (live terminal dashboard)
+ */
+
+#ifndef DASH_H_INCLUDED
+#define DASH_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "fsm.h"
+#include "functions.h"
+#include "reg.h"
+#include "soak.h"
+#include "stats.h"
+
+/******************************************************************** DEFINE */
+
+#define DASH_REFRESH_MS 1000 /* redraw period */
+#define DASH_WINDOW 5        /* refreshes of the windowed latency */
+#define DASH_CODES 6         /* status codes shown, most frequent first */
+#define DASH_LAST_LEN 72     /* last received message, single chat */
+
+#define DASH_LOG_MAX (4 << 20) /* stdout kept while drawing, two files */
+
+/*************************************************************** PROTOTYPES */
+
+int dash_start(const char *target);
+int dash_active(void);
+void dash_message(const pj_str_t *from, const pj_str_t *body);
+void dash_stop(void);
+
+#endif // DASH_H_INCLUDED
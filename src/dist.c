@@ -0,0 +1,563 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    dist.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the coordinator and agent function definitions
+ *
+ *  The coordinator does not touch SIP at all. Every agent says HELLO and
+ *  gets its index, which selects its SIP identity, before it registers.
+ *  Once all agents are READY, the coordinator hands each a disjoint session
+ *  range and one common wall clock start time, then merges the counters
+ *  and latency histograms the agents send back when they are done. Agents
+ *  send a heartbeat meanwhile; one that stays silent for
+ *  DIST_RCV_TIMEOUT_S is counted as lost.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "dist.h"
+
+/******************************************************************* GLOBALS */
+
+static FILE *agent_rf = NULL;
+static FILE *agent_wf = NULL;
+static pthread_mutex_t agent_lock = PTHREAD_MUTEX_INITIALIZER; /* agent_wf */
+static pj_timer_entry agent_timer;
+static int agent_alive = 0;
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * dist_now_ms()
+ * returns wall clock in milliseconds, agents on several hosts share it
+ */
+static uint64_t dist_now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * dist_read_stats(rf, st, ret)
+ * reads a STATS ... END block, returns 0 on success
+ */
+static int dist_read_stats(FILE *rf, p_stats_t st, int *ret) {
+  char line[BUFFER_512 + 1];
+  unsigned long v[9];
+  unsigned long cnt;
+  int stage;
+  int idx;
+
+  while (fgets(line, BUFFER_512, rf)) {
+    if (!strncmp(line, DIST_STATS " ", strlen(DIST_STATS " "))) {
+      if (sscanf(line + strlen(DIST_STATS " "),
+                 "%i %lu %lu %lu %lu %lu %lu %lu %lu", ret, &v[0], &v[1],
+                 &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) != 9)
+        return -1;
+      st->tx = v[0];
+      st->tx_fail = v[1];
+      st->rx = v[2];
+      st->rx_lost = v[3];
+      st->timeout = v[4];
+      st->rtt.cnt = v[5];
+      st->rtt.sum = v[6];
+      st->rtt.max = v[7];
+    } else if (!strncmp(line, DIST_HIST " ", strlen(DIST_HIST " "))) {
+      if ((sscanf(line + strlen(DIST_HIST " "), "%i %lu", &idx, &cnt) == 2) &&
+          (idx >= 0) && (idx < HIST_BUCKETS))
+        st->rtt.b[idx] = cnt;
+    } else if (!strncmp(line, DIST_MTYPE " ", strlen(DIST_MTYPE " "))) {
+      if ((sscanf(line + strlen(DIST_MTYPE " "), "%i %lu", &idx, &cnt) == 2) &&
+          (idx >= 0) && (idx <= STATS_MTYPES))
+        st->rx_mtype[idx] = cnt;
+    } else if (!strncmp(line, DIST_CODE " ", strlen(DIST_CODE " "))) {
+      if ((sscanf(line + strlen(DIST_CODE " "), "%i %lu", &idx, &cnt) == 2) &&
+          (idx >= 0) && (idx <= STATS_CODES)) {
+        st->tx_code[idx] = cnt;
+        st->tx_err += cnt;
+      }
+    } else if (!strncmp(line, DIST_SEQ " ", strlen(DIST_SEQ " "))) {
+      if (sscanf(line + strlen(DIST_SEQ " "), "%lu %lu %lu %lu %lu", &v[0],
+                 &v[1], &v[2], &v[3], &v[4]) == 5) {
+        st->rx_seq = v[0];
+        st->rx_dup = v[1];
+        st->rx_gap = v[2];
+        st->rx_reorder = v[3];
+        st->rx_late = v[4];
+      }
+    } else if (!strncmp(line, DIST_FLOW " ", strlen(DIST_FLOW " "))) {
+      if (sscanf(line + strlen(DIST_FLOW " "), "%lu %lu", &v[0], &v[1]) == 2) {
+        st->tx_defer = v[0];
+        st->tx_shed = v[1];
+      }
+    } else if (!strncmp(line, DIST_BODY " ", strlen(DIST_BODY " "))) {
+      if (sscanf(line + strlen(DIST_BODY " "), "%lu", &v[0]) == 1)
+        st->tx_body = v[0];
+    } else if (!strncmp(line, DIST_STAGE " ", strlen(DIST_STAGE " "))) {
+      if ((sscanf(line + strlen(DIST_STAGE " "), "%i %lu %lu %lu", &idx,
+                  &v[0], &v[1], &v[2]) == 4) &&
+          (idx >= 0) && (idx < STAGES)) {
+        st->stage[idx].cnt = v[0];
+        st->stage[idx].sum = v[1];
+        st->stage[idx].max = v[2];
+      }
+    } else if (!strncmp(line, DIST_STAGE_HIST " ",
+                        strlen(DIST_STAGE_HIST " "))) {
+      if ((sscanf(line + strlen(DIST_STAGE_HIST " "), "%i %i %lu", &stage,
+                  &idx, &cnt) == 3) &&
+          (stage >= 0) && (stage < STAGES) && (idx >= 0) &&
+          (idx < HIST_BUCKETS))
+        st->stage[stage].b[idx] = cnt;
+    } else if (!strncmp(line, DIST_END, strlen(DIST_END))) {
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * dist_write_stats(wf, st, ret)
+ * writes a STATS ... END block
+ */
+static void dist_write_stats(FILE *wf, const s_stats_t *st, int ret) {
+  int s;
+  int i;
+
+  fprintf(wf, DIST_STATS " %i %lu %lu %lu %lu %lu %lu %lu %lu\n", ret,
+          (unsigned long)STAT_GET(st->tx),
+          (unsigned long)STAT_GET(st->tx_fail),
+          (unsigned long)STAT_GET(st->rx),
+          (unsigned long)STAT_GET(st->rx_lost),
+          (unsigned long)STAT_GET(st->timeout),
+          (unsigned long)STAT_GET(st->rtt.cnt),
+          (unsigned long)STAT_GET(st->rtt.sum),
+          (unsigned long)STAT_GET(st->rtt.max));
+  for (i = 0; i < HIST_BUCKETS; i++) {
+    if (STAT_GET(st->rtt.b[i]))
+      fprintf(wf, DIST_HIST " %i %lu\n", i,
+              (unsigned long)STAT_GET(st->rtt.b[i]));
+  }
+  for (i = 0; i <= STATS_MTYPES; i++) {
+    if (STAT_GET(st->rx_mtype[i]))
+      fprintf(wf, DIST_MTYPE " %i %lu\n", i,
+              (unsigned long)STAT_GET(st->rx_mtype[i]));
+  }
+  for (i = 0; i <= STATS_CODES; i++) {
+    if (STAT_GET(st->tx_code[i]))
+      fprintf(wf, DIST_CODE " %i %lu\n", i,
+              (unsigned long)STAT_GET(st->tx_code[i]));
+  }
+  if (STAT_GET(st->rx_seq))
+    fprintf(wf, DIST_SEQ " %lu %lu %lu %lu %lu\n",
+            (unsigned long)STAT_GET(st->rx_seq),
+            (unsigned long)STAT_GET(st->rx_dup),
+            (unsigned long)STAT_GET(st->rx_gap),
+            (unsigned long)STAT_GET(st->rx_reorder),
+            (unsigned long)STAT_GET(st->rx_late));
+  if (STAT_GET(st->tx_defer) || STAT_GET(st->tx_shed))
+    fprintf(wf, DIST_FLOW " %lu %lu\n", (unsigned long)STAT_GET(st->tx_defer),
+            (unsigned long)STAT_GET(st->tx_shed));
+  if (STAT_GET(st->tx_body))
+    fprintf(wf, DIST_BODY " %lu\n", (unsigned long)STAT_GET(st->tx_body));
+  for (s = 0; s < STAGES; s++) {
+    if (!STAT_GET(st->stage[s].cnt))
+      continue;
+    fprintf(wf, DIST_STAGE " %i %lu %lu %lu\n", s,
+            (unsigned long)STAT_GET(st->stage[s].cnt),
+            (unsigned long)STAT_GET(st->stage[s].sum),
+            (unsigned long)STAT_GET(st->stage[s].max));
+    for (i = 0; i < HIST_BUCKETS; i++) {
+      if (STAT_GET(st->stage[s].b[i]))
+        fprintf(wf, DIST_STAGE_HIST " %i %i %lu\n", s, i,
+                (unsigned long)STAT_GET(st->stage[s].b[i]));
+    }
+  }
+  fprintf(wf, DIST_END "\n");
+  fflush(wf);
+}
+
+/*
+ * dist_open(fd, rf, wf)
+ * opens read and write streams on a connected socket; closes it and
+ * returns -1 on failure
+ */
+static int dist_open(int fd, FILE **rf, FILE **wf) {
+  int wfd;
+
+  *rf = fdopen(fd, "r");
+  wfd = *rf ? dup(fd) : -1;
+  *wf = (wfd >= 0) ? fdopen(wfd, "w") : NULL;
+  if (*wf)
+    return 0;
+
+  if (wfd >= 0)
+    close(wfd);
+  if (*rf)
+    fclose(*rf);
+  else
+    close(fd);
+  *rf = NULL;
+
+  return -1;
+}
+
+/*
+ * dist_read_line(rf, line)
+ * reads the next line that is not a heartbeat; returns NULL if the agent
+ * closed the connection or stayed silent for DIST_RCV_TIMEOUT_S
+ */
+static char *dist_read_line(FILE *rf, char *line) {
+
+  while (fgets(line, BUFFER_512, rf)) {
+    if (strncmp(line, DIST_ALIVE, strlen(DIST_ALIVE)))
+      return line;
+  }
+
+  return NULL;
+}
+
+/*
+ * dist_coordinator_run(port, agents, sessions, lead_s)
+ * distributes a run of sessions over agents and prints the merged report;
+ * returns the OR of all agent return codes
+ */
+int dist_coordinator_run(int port, int agents, int sessions, int lead_s) {
+  struct sockaddr_in sa;
+  struct timeval tv;
+  p_stats_t total;
+  p_stats_t part;
+  uint64_t start;
+  FILE *rf[DIST_MAX_AGENTS];
+  FILE *wf[DIST_MAX_AGENTS];
+  char line[BUFFER_512 + 1];
+  int agent_ret;
+  int ret;
+  int lfd;
+  int fd;
+  int base;
+  int live;
+  int cnt;
+  int pid;
+  int reg;
+  int on;
+  int i;
+  int j;
+
+  if ((agents < 1) || (agents > DIST_MAX_AGENTS) || (sessions < agents)) {
+    fprintf(stderr, "need 1..%i agents and at least one session each\n",
+            DIST_MAX_AGENTS);
+    return EXIT_FAILURE;
+  }
+
+  total = (p_stats_t)calloc(1, sizeof(s_stats_t));
+  part = (p_stats_t)calloc(1, sizeof(s_stats_t));
+  if (!total || !part) {
+    fprintf(stderr, "malloc failed\n");
+    free(total);
+    free(part);
+    return EXIT_FAILURE;
+  }
+
+  if ((lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    fprintf(stderr, "cannot create socket: %s\n", strerror(errno));
+    free(total);
+    free(part);
+    return EXIT_FAILURE;
+  }
+  on = 1;
+  setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_ANY);
+  sa.sin_port = htons(port);
+  if ((bind(lfd, (struct sockaddr *)&sa, sizeof(sa)) != 0) ||
+      (listen(lfd, agents) != 0)) {
+    fprintf(stderr, "cannot listen on port %i\n", port);
+    close(lfd);
+    free(total);
+    free(part);
+    return EXIT_FAILURE;
+  }
+
+  printf("\n##### coordinator on port %i waiting for %i agents #####\n\n",
+         port, agents);
+
+  /* a hung agent must not block the coordinator, see dist_read_line() */
+  tv.tv_sec = DIST_RCV_TIMEOUT_S;
+  tv.tv_usec = 0;
+
+  ret = ERR_NON;
+  for (i = 0; i < agents; i++) {
+    if ((fd = accept(lfd, NULL, NULL)) < 0) {
+      i--;
+      continue;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (dist_open(fd, &rf[i], &wf[i]) != 0) {
+      fprintf(stderr, "agent connection: %s\n", strerror(errno));
+      i--;
+      continue;
+    }
+    if (!dist_read_line(rf[i], line) ||
+        (sscanf(line, DIST_HELLO " %i", &pid) != 1)) {
+      fclose(rf[i]);
+      fclose(wf[i]);
+      i--;
+      continue;
+    }
+    /* the index selects the identity the agent registers with */
+    fprintf(wf[i], DIST_ID " %i\n", i);
+    fflush(wf[i]);
+    printf("agent %i connected (pid %i)\n", i, pid);
+  }
+  close(lfd);
+
+  /* agents that do not answer take no part in the run */
+  live = 0;
+  for (i = 0; i < agents; i++) {
+    reg = 0;
+    if (!dist_read_line(rf[i], line) ||
+        (sscanf(line, DIST_READY " %i", &reg) != 1)) {
+      printf("agent %i: lost before the run\n", i);
+      ret = ret | ERR_REG | ERR_TMR;
+      fclose(rf[i]);
+      fclose(wf[i]);
+      rf[i] = wf[i] = NULL;
+      continue;
+    }
+    printf("agent %i %s\n", i, reg ? "registered" : "NOT registered");
+    if (!reg)
+      ret = ret | ERR_REG;
+    live++;
+  }
+  if (live == 0) {
+    free(total);
+    free(part);
+    return ret;
+  }
+
+  /* everybody is registered, start together */
+  start = dist_now_ms() + lead_s * 1000;
+  base = 0;
+  for (i = 0, j = 0; i < agents; i++) {
+    if (!wf[i])
+      continue;
+    cnt = sessions / live + ((j++ < sessions % live) ? 1 : 0);
+    fprintf(wf[i], DIST_RUN " %i %i %i %lu %i\n", i, base, cnt,
+            (unsigned long)start, live);
+    fflush(wf[i]);
+    base += cnt;
+  }
+
+  for (i = 0; i < agents; i++) {
+    if (!rf[i])
+      continue;
+    memset(part, 0, sizeof(s_stats_t));
+    agent_ret = ERR_NON;
+    if (dist_read_stats(rf[i], part, &agent_ret) != 0) {
+      printf("agent %i: lost\n", i);
+      ret = ret | ERR_TMR;
+    } else {
+      printf("agent %i: ", i);
+      stats_print(stdout, part);
+      stats_merge(total, part);
+      ret = ret | agent_ret;
+    }
+    fclose(rf[i]);
+    fclose(wf[i]);
+  }
+
+  printf("\n##### merged report of %i agents, %i sessions #####\n", live,
+         sessions);
+  stats_print(stdout, total);
+
+  free(total);
+  free(part);
+
+  return ret;
+}
+
+/*
+ * dist_on_timer(th, e)
+ * sends a heartbeat to the coordinator and schedules the next one
+ */
+static void dist_on_timer(pj_timer_heap_t *th, pj_timer_entry *e) {
+  pj_time_val delay;
+
+  PJ_UNUSED_ARG(th);
+  PJ_UNUSED_ARG(e);
+
+  pthread_mutex_lock(&agent_lock);
+  if (!agent_alive) {
+    pthread_mutex_unlock(&agent_lock);
+    return;
+  }
+  fprintf(agent_wf, DIST_ALIVE "\n");
+  fflush(agent_wf);
+  pthread_mutex_unlock(&agent_lock);
+
+  delay.sec = DIST_ALIVE_MS / 1000;
+  delay.msec = DIST_ALIVE_MS % 1000;
+  pjsua_schedule_timer(&agent_timer, &delay);
+}
+
+/*
+ * dist_agent_join(addr, job)
+ * connects to the coordinator at host:port and gets the agent index
+ */
+int dist_agent_join(const char *addr, p_dist_job_t job) {
+  struct addrinfo hints;
+  struct addrinfo *res;
+  struct addrinfo *ai;
+  char host[BUFFER_128 + 1];
+  char line[BUFFER_512 + 1];
+  char *port;
+  int fd;
+
+  snprintf(host, BUFFER_128, "%s", addr);
+  port = strrchr(host, ':');
+  if (!port) {
+    PJ_LOG(2, (THIS_FILE, "coordinator address must be host:port\n"));
+    return -1;
+  }
+  *port++ = '\0';
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, port, &hints, &res) != 0) {
+    PJ_LOG(2, (THIS_FILE, "cannot resolve coordinator %s\n", addr));
+    return -1;
+  }
+
+  fd = -1;
+  for (ai = res; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0)
+      continue;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd < 0) {
+    PJ_LOG(2, (THIS_FILE, "cannot connect to coordinator %s\n", addr));
+    return -1;
+  }
+
+  if (dist_open(fd, &agent_rf, &agent_wf) != 0) {
+    PJ_LOG(2, (THIS_FILE, "coordinator connection: %s\n", strerror(errno)));
+    return -1;
+  }
+
+  fprintf(agent_wf, DIST_HELLO " %i\n", (int)getpid());
+  fflush(agent_wf);
+
+  memset(job, 0, sizeof(s_dist_job_t));
+  if (!fgets(line, BUFFER_512, agent_rf) ||
+      (sscanf(line, DIST_ID " %i", &job->agent) != 1)) {
+    PJ_LOG(2, (THIS_FILE, "no index from coordinator\n"));
+    fclose(agent_rf);
+    fclose(agent_wf);
+    agent_rf = agent_wf = NULL;
+    return -1;
+  }
+
+  /* the coordinator gives up on agents that stay silent */
+  agent_alive = 1;
+  pj_timer_entry_init(&agent_timer, 0, NULL, &dist_on_timer);
+  dist_on_timer(NULL, &agent_timer);
+
+  return 0;
+}
+
+/*
+ * dist_agent_ready(registered, job)
+ * reports the registration result and waits for the job
+ */
+int dist_agent_ready(int registered, p_dist_job_t job) {
+  char line[BUFFER_512 + 1];
+  unsigned long start;
+  int agent;
+
+  pthread_mutex_lock(&agent_lock);
+  fprintf(agent_wf, DIST_READY " %i\n", registered);
+  fflush(agent_wf);
+  pthread_mutex_unlock(&agent_lock);
+
+  if (!fgets(line, BUFFER_512, agent_rf) ||
+      (sscanf(line, DIST_RUN " %i %i %i %lu %i", &agent, &job->base,
+              &job->sessions, &start, &job->agents) != 5) ||
+      (agent != job->agent) || (job->agents < 1)) {
+    PJ_LOG(2, (THIS_FILE, "no job from coordinator\n"));
+    return -1;
+  }
+  job->start_ms = start;
+
+  PJ_LOG(3, (THIS_FILE, "agent %i: sessions %i..%i\n", job->agent, job->base,
+             job->base + job->sessions - 1));
+
+  return 0;
+}
+
+/*
+ * dist_agent_wait(job)
+ * sleeps until the common start time
+ */
+void dist_agent_wait(p_dist_job_t job) {
+  uint64_t now;
+
+  now = dist_now_ms();
+  if (job->start_ms > now)
+    loop_sleep(job->start_ms - now);
+}
+
+/*
+ * dist_agent_report(ret)
+ * sends the global counters and histogram to the coordinator
+ */
+int dist_agent_report(int ret) {
+
+  if (!agent_wf)
+    return -1;
+
+  pthread_mutex_lock(&agent_lock);
+  agent_alive = 0;
+  dist_write_stats(agent_wf, &stats, ret);
+  pthread_mutex_unlock(&agent_lock);
+  pjsua_cancel_timer(&agent_timer);
+
+  fclose(agent_rf);
+  fclose(agent_wf);
+  agent_rf = NULL;
+  agent_wf = NULL;
+
+  return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ *  @file    dist.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief dist.c header file (coordinator/agent load distribution)
+ */
+
+#ifndef DIST_H_INCLUDED
+#define DIST_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "functions.h"
+
+/******************************************************************** DEFINE */
+
+#define DIST_LEAD_S 2 /* start delay after the last agent is ready */
+#define DIST_MAX_AGENTS 256
+
+#define DIST_ALIVE_MS 5000    /* agent heartbeat period */
+#define DIST_RCV_TIMEOUT_S 60 /* silent agents are given up after this */
+
+/*
+ * control protocol, one line per command
+ *   agent -> coordinator  HELLO <pid>
+ *   coordinator -> agent  ID <agent>           (identity, see client_identity)
+ *   agent -> coordinator  READY <registered>
+ *   coordinator -> agent  RUN <agent> <session base> <sessions> <start ms>
+ *                         <agents>
+ *   agent -> coordinator  STATS <ret> <tx> <tx_fail> <rx> <rx_lost> <timeout>
+ *                         <cnt> <sum> <max>
+ *                         H <bucket> <count>   (non-empty buckets only)
+ *                         T <type> <count>     (received, per message type)
+ *                         C <index> <count>    (rejected, per status code)
+ *                         Q <numbered> <dup> <missing> <reordered> <late>
+ *                         B <deferred> <shed>
+ *                         Y <body bytes>
+ *                         S <stage> <cnt> <sum> <max>
+ *                         SH <stage> <bucket> <count>
+ *                         END
+ *   agent -> coordinator  ALIVE                (every DIST_ALIVE_MS, any time)
+ */
+#define DIST_HELLO "HELLO"
+#define DIST_ID "ID"
+#define DIST_READY "READY"
+#define DIST_RUN "RUN"
+#define DIST_STATS "STATS"
+#define DIST_HIST "H"
+#define DIST_MTYPE "T"
+#define DIST_CODE "C"
+#define DIST_SEQ "Q"
+#define DIST_FLOW "B"
+#define DIST_BODY "Y"
+#define DIST_STAGE "S"
+#define DIST_STAGE_HIST "SH"
+#define DIST_ALIVE "ALIVE"
+#define DIST_END "END"
+
+/******************************************************************* TYPEDEF */
+
+/* what the coordinator assigned to this agent */
+typedef struct dist_job {
+  int agent;
+  int base;
+  int sessions;
+  int agents;        /* profile rates are shared by all agents */
+  uint64_t start_ms; /* wall clock, CLOCK_REALTIME */
+} s_dist_job_t, *p_dist_job_t;
+
+/*************************************************************** PROTOTYPES */
+
+int dist_coordinator_run(int port, int agents, int sessions, int lead_s);
+int dist_agent_join(const char *addr, p_dist_job_t job);
+int dist_agent_ready(int registered, p_dist_job_t job);
+void dist_agent_wait(p_dist_job_t job);
+int dist_agent_report(int ret);
+
+#endif // DIST_H_INCLUDED
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    flow.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the backpressure function definitions
+ *
+ *  A MESSAGE answered with 486 (Busy Here) or 503 (Service Unavailable)
+ *  puts its session and its target (Request-URI) on hold: for the
+ *  Retry-After time if the response has one, otherwise for an
+ *  exponential backoff with jitter. A 2xx resets the backoff to its first
+ *  step; the hold in progress runs out, as a 2xx to a request sent before
+ *  the hold must not cut a Retry-After short. Senders ask flow_wait()
+ *  before every message and, depending on the policy, wait or shed the
+ *  message, so an overloaded service sees the load a well behaved client
+ *  would offer. The target table only grows and its holds are atomics, so
+ *  senders never take flow_lock; only rejections do.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "flow.h"
+#include "functions.h"
+
+/******************************************************************* TYPEDEF */
+
+typedef struct flow_target {
+  char uri[FLOW_URI_LEN + 1];
+  s_flow_t fl;
+  uint64_t busy;        /* 486 */
+  uint64_t unavailable; /* 503 */
+  uint64_t retry_after; /* responses with Retry-After */
+  uint64_t hold_ms;     /* longest hold */
+} s_flow_target_t, *p_flow_target_t;
+
+/******************************************************************* GLOBALS */
+
+static int flow_on = FLOW_QUEUE;
+static int flow_cnt = 0; /* targets used */
+static s_flow_t flow_chat; /* the single chat, no session table */
+static s_flow_target_t flow_tgt[FLOW_TARGETS];
+static pthread_mutex_t flow_lock = PTHREAD_MUTEX_INITIALIZER; /* writers */
+static unsigned flow_seed = 0; /* drawn on first use */
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * flow_now_ms()
+ * returns monotonic clock in milliseconds
+ */
+static uint64_t flow_now_ms(void) { return stats_now_ns() / 1000000; }
+
+/*
+ * flow_policy(name)
+ * sets the policy (queue, shed or off), returns -1 if unknown
+ */
+int flow_policy(const char *name) {
+
+  if (!strcmp(name, "queue"))
+    flow_on = FLOW_QUEUE;
+  else if (!strcmp(name, "shed"))
+    flow_on = FLOW_SHED;
+  else if (!strcmp(name, "off"))
+    flow_on = FLOW_OFF;
+  else
+    return -1;
+
+  return 0;
+}
+
+/*
+ * flow_mode()
+ * returns the policy
+ */
+int flow_mode(void) { return flow_on; }
+
+/*
+ * flow_find(target)
+ * returns the entry of a target, NULL if unknown; entries are published
+ * complete and never change their uri, so no lock is needed
+ */
+static p_flow_target_t flow_find(const pj_str_t *target) {
+  int len;
+  int cnt;
+  int i;
+
+  len = (target->slen < FLOW_URI_LEN) ? target->slen : FLOW_URI_LEN;
+  cnt = __atomic_load_n(&flow_cnt, __ATOMIC_ACQUIRE);
+  for (i = 0; i < cnt; i++) {
+    if (((int)strlen(flow_tgt[i].uri) == len) &&
+        !memcmp(flow_tgt[i].uri, target->ptr, len))
+      return &flow_tgt[i];
+  }
+
+  return NULL;
+}
+
+/*
+ * flow_target(target)
+ * returns the entry of a target, adds it if unknown; call locked
+ */
+static p_flow_target_t flow_target(const pj_str_t *target) {
+  p_flow_target_t ft;
+  int len;
+  int i;
+
+  if ((ft = flow_find(target)))
+    return ft;
+
+  /* the table is full, the last entry takes all other targets */
+  if (flow_cnt == FLOW_TARGETS)
+    return &flow_tgt[FLOW_TARGETS - 1];
+
+  len = (target->slen < FLOW_URI_LEN) ? target->slen : FLOW_URI_LEN;
+  i = flow_cnt;
+  memcpy(flow_tgt[i].uri, target->ptr, len);
+  flow_tgt[i].uri[len] = '\0';
+  __atomic_store_n(&flow_cnt, i + 1, __ATOMIC_RELEASE);
+
+  return &flow_tgt[i];
+}
+
+/*
+ * flow_hold(fl, retry_s)
+ * puts fl on hold, returns the hold time in milliseconds; call locked
+ */
+static unsigned flow_hold(p_flow_t fl, int retry_s) {
+  unsigned delay;
+  unsigned i;
+
+  if (!flow_seed)
+    flow_seed = loop_seed((unsigned)getpid() ^ (unsigned)time(NULL)) | 1;
+
+  if (retry_s > 0) {
+    delay = ((retry_s < FLOW_RETRY_MAX_S) ? retry_s : FLOW_RETRY_MAX_S) * 1000;
+  } else {
+    delay = FLOW_MIN_MS;
+    for (i = 0; (i < __atomic_load_n(&fl->fails, __ATOMIC_ACQUIRE)) &&
+                (delay < FLOW_MAX_MS);
+         i++)
+      delay *= 2;
+    if (delay > FLOW_MAX_MS)
+      delay = FLOW_MAX_MS;
+    /* half fixed, half random, so sessions do not return in lockstep */
+    delay = delay / 2 + rand_r(&flow_seed) % (delay / 2 + 1);
+  }
+
+  __atomic_add_fetch(&fl->fails, 1, __ATOMIC_ACQ_REL);
+  __atomic_store_n(&fl->until_ms, flow_now_ms() + delay, __ATOMIC_RELEASE);
+
+  return delay;
+}
+
+/*
+ * flow_reject(fl, target, status, retry_s)
+ * backs off session fl (NULL for the single chat) and its target after a
+ * 486 or 503; retry_s is the Retry-After value, 0 if there was none
+ */
+void flow_reject(p_flow_t fl, const pj_str_t *target, int status,
+                 int retry_s) {
+  p_flow_target_t ft;
+  uint64_t until;
+  unsigned delay;
+
+  if ((flow_on == FLOW_OFF) ||
+      ((status != SIP_CODE_BUSY_HERE) && (status != SIP_CODE_UNAVAILABLE)))
+    return;
+
+  pthread_mutex_lock(&flow_lock);
+  flow_hold(fl ? fl : &flow_chat, retry_s);
+  if (target && (ft = flow_target(target))) {
+    /* rejections of requests sent before the hold do not double it again,
+     * only a later Retry-After extends it */
+    until = __atomic_load_n(&ft->fl.until_ms, __ATOMIC_ACQUIRE);
+    if ((flow_now_ms() >= until) ||
+        ((retry_s > 0) && (flow_now_ms() + retry_s * 1000ULL > until))) {
+      delay = flow_hold(&ft->fl, retry_s);
+      if (delay > ft->hold_ms)
+        ft->hold_ms = delay;
+    }
+    if (status == SIP_CODE_BUSY_HERE)
+      ft->busy++;
+    else
+      ft->unavailable++;
+    if (retry_s > 0)
+      ft->retry_after++;
+  }
+  pthread_mutex_unlock(&flow_lock);
+}
+
+/*
+ * flow_accept(fl, target)
+ * a 2xx resets the backoff of session fl and its target to the first
+ * step; a hold in progress runs out
+ */
+void flow_accept(p_flow_t fl, const pj_str_t *target) {
+  p_flow_target_t ft;
+
+  if (!fl)
+    fl = &flow_chat;
+  if (__atomic_load_n(&fl->fails, __ATOMIC_ACQUIRE))
+    __atomic_store_n(&fl->fails, 0, __ATOMIC_RELEASE);
+
+  if (target && (ft = flow_find(target)) &&
+      __atomic_load_n(&ft->fl.fails, __ATOMIC_ACQUIRE))
+    __atomic_store_n(&ft->fl.fails, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * flow_wait(fl, target)
+ * returns milliseconds until session fl (NULL for the single chat) may
+ * send to target (NULL: any), 0 if now
+ */
+unsigned flow_wait(p_flow_t fl, const pj_str_t *target) {
+  p_flow_target_t ft;
+  uint64_t until;
+  uint64_t now;
+
+  if (flow_on == FLOW_OFF)
+    return 0;
+
+  until = __atomic_load_n(fl ? &fl->until_ms : &flow_chat.until_ms,
+                          __ATOMIC_ACQUIRE);
+  if (target && (ft = flow_find(target)) &&
+      (__atomic_load_n(&ft->fl.until_ms, __ATOMIC_ACQUIRE) > until))
+    until = __atomic_load_n(&ft->fl.until_ms, __ATOMIC_ACQUIRE);
+
+  now = flow_now_ms();
+
+  return (until > now) ? (unsigned)(until - now) : 0;
+}
+
+/*
+ * flow_print(fh)
+ * prints the targets that pushed back
+ */
+void flow_print(FILE *fh) {
+  int i;
+
+  pthread_mutex_lock(&flow_lock);
+  for (i = 0; i < flow_cnt; i++) {
+    fprintf(fh,
+            "backoff %s: busy=%lu unavailable=%lu retry-after=%lu "
+            "longest=%lu ms\n",
+            flow_tgt[i].uri, (unsigned long)flow_tgt[i].busy,
+            (unsigned long)flow_tgt[i].unavailable,
+            (unsigned long)flow_tgt[i].retry_after,
+            (unsigned long)flow_tgt[i].hold_ms);
+  }
+  pthread_mutex_unlock(&flow_lock);
+}
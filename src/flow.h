@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    flow.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief flow.c header file (backpressure on 486/503)
+ */
+
+#ifndef FLOW_H_INCLUDED
+#define FLOW_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <pjsua-lib/pjsua.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/******************************************************************** DEFINE */
+
+#define FLOW_MIN_MS 250      /* first backoff without Retry-After */
+#define FLOW_MAX_MS 8000     /* backoff doubles up to this */
+#define FLOW_RETRY_MAX_S 300 /* longer Retry-After values are capped */
+#define FLOW_TARGETS 32      /* targets tracked, others share the last */
+#define FLOW_URI_LEN 256
+
+/* what a sender does while its session or target backs off */
+enum {
+  FLOW_OFF = 0, /* keep the configured pace */
+  FLOW_QUEUE,   /* messages wait for the end of the backoff */
+  FLOW_SHED     /* chat messages are dropped, start and stop wait */
+};
+
+/******************************************************************* TYPEDEF */
+
+/* backoff of one session (or target) */
+typedef struct flow {
+  uint64_t until_ms; /* nothing is sent before */
+  unsigned fails;    /* consecutive 486/503 */
+} s_flow_t, *p_flow_t;
+
+/*************************************************************** PROTOTYPES */
+
+int flow_policy(const char *name);
+int flow_mode(void);
+void flow_reject(p_flow_t fl, const pj_str_t *target, int status,
+                 int retry_s);
+void flow_accept(p_flow_t fl, const pj_str_t *target);
+unsigned flow_wait(p_flow_t fl, const pj_str_t *target);
+void flow_print(FILE *fh);
+
+#endif // FLOW_H_INCLUDED
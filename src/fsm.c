@@ -0,0 +1,546 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    fsm.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the session state machine function definitions
+ *
+ *  Every session of the session table runs the chat cycle
+ *  registering -> start (21) -> Reply-To -> chat (22) ... -> stop (23)
+ *  as a state machine. Nothing blocks: transitions are triggered by the
+ *  session timer on the pjsip timer heap and by on_reg()/on_pager2(), so
+ *  the pjsua worker threads drive all sessions. Events for one session
+ *  are processed by one thread at a time; a thread finding the session
+ *  busy only leaves its event behind for the current owner.
+ *
+ *  Sessions losing the registration wait in the registering state as long
+ *  as re-registration (reg.c) is in progress and then start a new cycle.
+ *
+ *  In manual mode all sessions start retired and are (re)started one by
+ *  one with fsm_launch(), e.g. by a load profile.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "corpus.h"
+#include "fsm.h"
+#include "matrix.h"
+#include "reg.h"
+
+/******************************************************************* GLOBALS */
+
+static s_fsm_cfg_t fsm_cfg;
+static int fsm_active = 0;
+static int fsm_done_cnt = 0;
+static int fsm_start_cnt = 0;
+static int fsm_paused = 0;
+
+static const char *fsm_names[FSM_STATES] = {
+    "registering", "idle", "starting", "chatting", "closing", "done"};
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * fsm_now_ms()
+ * returns monotonic clock in milliseconds
+ */
+static uint64_t fsm_now_ms(void) { return stats_now_ns() / 1000000; }
+
+/*
+ * fsm_arm(sess, ms)
+ * (re)arms the session timer
+ */
+static void fsm_arm(p_session_t sess, unsigned ms) {
+  pj_time_val delay;
+
+  pjsua_cancel_timer(&sess->timer);
+  sess->due_ms = fsm_now_ms() + ms;
+  delay.sec = ms / 1000;
+  delay.msec = ms % 1000;
+  if (pjsua_schedule_timer(&sess->timer, &delay) != PJ_SUCCESS)
+    PJ_LOG(2, (THIS_FILE, "session %i: cannot schedule timer\n", sess->idx));
+}
+
+/*
+ * fsm_retire(sess)
+ * takes a session out of the run until fsm_launch()
+ */
+static void fsm_retire(p_session_t sess) {
+
+  pjsua_cancel_timer(&sess->timer);
+  sess->drain = 0;
+  sess->state = FSM_DONE;
+  STAT_INC(fsm_done_cnt);
+}
+
+/*
+ * fsm_end(sess)
+ * finishes a cycle, starts the next one or retires the session
+ */
+static void fsm_end(p_session_t sess) {
+
+  sess->cycle++;
+  if (__atomic_load_n(&sess->drain, __ATOMIC_ACQUIRE) ||
+      (fsm_cfg.cycles && (sess->cycle >= (int)fsm_cfg.cycles))) {
+    fsm_retire(sess);
+    return;
+  }
+
+  sess->state = FSM_IDLE;
+  fsm_arm(sess, sess->interval_ms);
+}
+
+/*
+ * fsm_send(sess, mtype)
+ * sends the next message of the chat cycle
+ */
+static void fsm_send(p_session_t sess, int mtype) {
+  char tmp[BUFFER_128 + 1];
+  char *body;
+  pj_str_t text;
+  pj_str_t rto;
+
+  if (mtype == 21) {
+    snprintf(tmp, BUFFER_128, "session %i start", sess->idx);
+    text = pj_str(tmp);
+    /* a matrix cell has its own target */
+    send_dec112_msg(&fsm_cfg.acc_id, sess, &text,
+                    sess->cell ? &sess->cell->uri : &fsm_cfg.uri,
+                    sess->cell ? &sess->cell->urn : &fsm_cfg.urn, 21);
+    return;
+  }
+
+  body = NULL;
+  if ((mtype == 22) && sess->cell && sess->cell->file) {
+    /* line of the message file, step counts from 1 */
+    text = pj_str(sess->cell->lines[sess->step - 1]);
+    sess->val = sess->cell->check[sess->step - 1];
+  } else if ((mtype == 22) && corpus_active() &&
+             (body = corpus_text(corpus_size(), sess->idx + sess->step))) {
+    text = pj_str(body);
+  } else {
+    if (mtype == 22)
+      snprintf(tmp, BUFFER_128, "session %i message %i", sess->idx,
+               sess->step);
+    else
+      snprintf(tmp, BUFFER_128, "session %i stop", sess->idx);
+    text = pj_str(tmp);
+  }
+  rto = pj_str(sess->reply);
+  send_dec112_msg(&fsm_cfg.acc_id, sess, &text, &rto, &rto, mtype);
+  free(body);
+}
+
+/*
+ * fsm_backoff(sess, mtype)
+ * returns milliseconds the next message has to wait after a 486/503
+ */
+static unsigned fsm_backoff(p_session_t sess, int mtype) {
+  pj_str_t rto;
+
+  if (mtype == 21)
+    return flow_wait(&sess->flow,
+                     sess->cell ? &sess->cell->uri : &fsm_cfg.uri);
+
+  rto = pj_str(sess->reply);
+
+  return flow_wait(&sess->flow, &rto);
+}
+
+/*
+ * fsm_step(sess, ev)
+ * applies a set of events to a session
+ */
+static void fsm_step(p_session_t sess, int ev) {
+  unsigned wait;
+
+  /* a timer cancelled while it was already firing */
+  if ((ev & FSM_EV_TIMER) && (fsm_now_ms() < sess->due_ms))
+    ev &= ~FSM_EV_TIMER;
+
+  if ((ev & FSM_EV_START) && (sess->state == FSM_DONE)) {
+    sess->state = conf->reg ? FSM_IDLE : FSM_REGISTERING;
+    sess->cycle = 0;
+    sess->drain = 0;
+    __atomic_fetch_sub(&fsm_done_cnt, 1, __ATOMIC_RELAXED);
+    STAT_INC(fsm_start_cnt);
+    fsm_arm(sess, conf->reg ? 0 : TIMEOUT_CNT * TIMEOUT_MS);
+    return;
+  }
+
+  if ((ev & FSM_EV_REG) && (sess->state != FSM_DONE)) {
+    if (!conf->reg) {
+      sess->state = FSM_REGISTERING;
+      fsm_arm(sess, TIMEOUT_CNT * TIMEOUT_MS);
+      return;
+    }
+    if (sess->state == FSM_REGISTERING) {
+      /* spread the start messages over one interval */
+      sess->state = FSM_IDLE;
+      fsm_arm(sess, (uint64_t)sess->interval_ms * sess->idx /
+                        session_count());
+      return;
+    }
+  }
+
+  switch (sess->state) {
+  case FSM_REGISTERING:
+    if ((ev & FSM_EV_TIMER) && reg_recovering(fsm_cfg.acc_id)) {
+      /* keep waiting while re-registration is in progress */
+      fsm_arm(sess, TIMEOUT_CNT * TIMEOUT_MS);
+    } else if (ev & FSM_EV_TIMER) {
+      STAT_INC(stats.timeout);
+      STAT_INC(sess->timeout);
+      fsm_end(sess);
+    }
+    break;
+  case FSM_IDLE:
+    if (!(ev & FSM_EV_TIMER))
+      break;
+    if (__atomic_load_n(&sess->drain, __ATOMIC_ACQUIRE)) {
+      fsm_retire(sess);
+      break;
+    }
+    if (__atomic_load_n(&fsm_paused, __ATOMIC_ACQUIRE)) {
+      fsm_arm(sess, sess->interval_ms);
+      break;
+    }
+    if (!conf->reg) {
+      sess->state = FSM_REGISTERING;
+      fsm_arm(sess, TIMEOUT_CNT * TIMEOUT_MS);
+      break;
+    }
+    /* the service asked for a break, the cycle starts later */
+    if ((wait = fsm_backoff(sess, 21)) > 0) {
+      STAT_INC(stats.tx_defer);
+      fsm_arm(sess, wait);
+      break;
+    }
+    /* releases the Reply-To of the previous cycle */
+    session_reset(sess);
+    sess->step = 0;
+    fsm_send(sess, 21);
+    sess->state = FSM_STARTING;
+    fsm_arm(sess, TIMEOUT_CNT * TIMEOUT_MS);
+    break;
+  case FSM_STARTING:
+    if (__atomic_load_n(&sess->reply, __ATOMIC_ACQUIRE)) {
+      sess->state = FSM_CHATTING;
+      fsm_arm(sess, sess->interval_ms);
+    } else if (ev & FSM_EV_TIMER) {
+      STAT_INC(stats.timeout);
+      STAT_INC(sess->timeout);
+      fsm_end(sess);
+    }
+    break;
+  case FSM_CHATTING:
+    if (sess->closed) {
+      fsm_end(sess);
+    } else if ((ev & FSM_EV_TIMER) &&
+               __atomic_load_n(&fsm_paused, __ATOMIC_ACQUIRE)) {
+      fsm_arm(sess, sess->interval_ms);
+    } else if ((ev & FSM_EV_TIMER) && (wait = fsm_backoff(sess, 22)) &&
+               ((flow_mode() != FLOW_SHED) ||
+                (sess->step >= (int)sess->msgs))) {
+      /* held back, the stop message is never shed */
+      STAT_INC(stats.tx_defer);
+      fsm_arm(sess, wait);
+    } else if (ev & FSM_EV_TIMER) {
+      if (sess->step < (int)sess->msgs) {
+        sess->step++;
+        if (wait > 0)
+          STAT_INC(stats.tx_shed);
+        else
+          fsm_send(sess, 22);
+        fsm_arm(sess, sess->interval_ms);
+      } else {
+        fsm_send(sess, 23);
+        sess->state = FSM_CLOSING;
+        fsm_arm(sess, sess->interval_ms);
+      }
+    }
+    break;
+  case FSM_CLOSING:
+    /* a final reply is welcome but not required */
+    if (ev & (FSM_EV_MSG | FSM_EV_TIMER))
+      fsm_end(sess);
+    break;
+  default:
+    break;
+  }
+}
+
+/*
+ * fsm_kick(sess, ev)
+ * posts events to a session and processes them unless another thread
+ * already does; safe to call from any thread
+ */
+void fsm_kick(p_session_t sess, int ev) {
+
+  if (!__atomic_load_n(&fsm_active, __ATOMIC_ACQUIRE))
+    return;
+
+  __atomic_fetch_or(&sess->ev, ev, __ATOMIC_ACQ_REL);
+  while (!__atomic_exchange_n(&sess->busy, 1, __ATOMIC_ACQUIRE)) {
+    while ((ev = __atomic_exchange_n(&sess->ev, 0, __ATOMIC_ACQ_REL)))
+      fsm_step(sess, ev);
+    __atomic_store_n(&sess->busy, 0, __ATOMIC_RELEASE);
+    /* events posted while we were releasing the session */
+    if (!__atomic_load_n(&sess->ev, __ATOMIC_ACQUIRE))
+      break;
+  }
+}
+
+/*
+ * fsm_launch(sess, msgs, interval_ms)
+ * starts one cycle on a retired session; returns -1 if it is still busy
+ */
+int fsm_launch(p_session_t sess, unsigned msgs, unsigned interval_ms) {
+
+  if ((__atomic_load_n(&sess->state, __ATOMIC_ACQUIRE) != FSM_DONE) ||
+      (interval_ms < 1))
+    return -1;
+
+  sess->msgs = msgs;
+  sess->interval_ms = interval_ms;
+  fsm_kick(sess, FSM_EV_START);
+
+  return 0;
+}
+
+/*
+ * fsm_add(cnt)
+ * launches up to cnt retired sessions; returns number launched
+ */
+int fsm_add(int cnt) {
+  p_session_t sess;
+  unsigned interval_ms;
+  int n;
+  int i;
+
+  if (!__atomic_load_n(&fsm_active, __ATOMIC_ACQUIRE))
+    return 0;
+
+  interval_ms = __atomic_load_n(&fsm_cfg.interval_ms, __ATOMIC_RELAXED);
+  n = 0;
+  for (i = 0; (i < session_count()) && (n < cnt); i++) {
+    sess = session_get(i);
+    if (!__atomic_load_n(&sess->busy, __ATOMIC_ACQUIRE) &&
+        (fsm_launch(sess, fsm_cfg.msgs, interval_ms) == 0))
+      n++;
+  }
+
+  return n;
+}
+
+/*
+ * fsm_drain(cnt)
+ * lets cnt running sessions (all if cnt < 1) retire after their current
+ * cycle; returns number of sessions marked
+ */
+int fsm_drain(int cnt) {
+  p_session_t sess;
+  int n;
+  int i;
+
+  if (!__atomic_load_n(&fsm_active, __ATOMIC_ACQUIRE))
+    return 0;
+
+  n = 0;
+  for (i = session_count() - 1; (i >= 0) && ((cnt < 1) || (n < cnt)); i--) {
+    sess = session_get(i);
+    if ((__atomic_load_n(&sess->state, __ATOMIC_ACQUIRE) == FSM_DONE) ||
+        __atomic_exchange_n(&sess->drain, 1, __ATOMIC_ACQ_REL))
+      continue;
+    n++;
+  }
+
+  return n;
+}
+
+/*
+ * fsm_pause(on)
+ * holds back new cycles and chat messages while on; replies, timeouts and
+ * closing messages still go through
+ */
+void fsm_pause(int on) { __atomic_store_n(&fsm_paused, on, __ATOMIC_RELEASE); }
+
+/*
+ * fsm_interval(ms)
+ * changes the gap between chat messages of all sessions, takes effect with
+ * the next message
+ */
+void fsm_interval(unsigned ms) {
+  int i;
+
+  if (ms < 1)
+    return;
+
+  __atomic_store_n(&fsm_cfg.interval_ms, ms, __ATOMIC_RELAXED);
+  for (i = 0; i < session_count(); i++)
+    __atomic_store_n(&session_get(i)->interval_ms, ms, __ATOMIC_RELAXED);
+}
+
+/*
+ * fsm_on_timer(th, e)
+ * session timer callback, runs in a pjsua worker thread
+ */
+static void fsm_on_timer(pj_timer_heap_t *th, pj_timer_entry *e) {
+
+  PJ_UNUSED_ARG(th);
+
+  fsm_kick((p_session_t)e->user_data, FSM_EV_TIMER);
+}
+
+/*
+ * fsm_on_reg()
+ * forwards a registration change to all sessions
+ */
+void fsm_on_reg(void) {
+  int i;
+
+  if (!__atomic_load_n(&fsm_active, __ATOMIC_ACQUIRE))
+    return;
+
+  for (i = 0; i < session_count(); i++)
+    fsm_kick(session_get(i), FSM_EV_REG);
+}
+
+/*
+ * fsm_start(cfg)
+ * puts all sessions of the session table under state machine control
+ */
+int fsm_start(p_fsm_cfg_t cfg) {
+  p_session_t sess;
+  int i;
+
+  if ((session_count() < 1) || (cfg->interval_ms < 1))
+    return -1;
+
+  memcpy(&fsm_cfg, cfg, sizeof(s_fsm_cfg_t));
+  fsm_paused = 0;
+  fsm_done_cnt = cfg->manual ? session_count() : 0;
+  fsm_start_cnt = 0;
+
+  for (i = 0; i < session_count(); i++) {
+    sess = session_get(i);
+    sess->state = cfg->manual ? FSM_DONE : FSM_REGISTERING;
+    sess->step = 0;
+    sess->cycle = 0;
+    sess->drain = 0;
+    sess->msgs = cfg->msgs;
+    sess->interval_ms = cfg->interval_ms;
+    sess->ev = 0;
+    sess->busy = 0;
+    pj_timer_entry_init(&sess->timer, 0, sess, &fsm_on_timer);
+  }
+
+  __atomic_store_n(&fsm_active, 1, __ATOMIC_RELEASE);
+  fsm_on_reg();
+
+  return 0;
+}
+
+/*
+ * fsm_stop()
+ * cancels all session timers and waits for running event handlers
+ */
+void fsm_stop(void) {
+  p_session_t sess;
+  int i;
+
+  __atomic_store_n(&fsm_active, 0, __ATOMIC_RELEASE);
+
+  for (i = 0; i < session_count(); i++) {
+    sess = session_get(i);
+    while (__atomic_load_n(&sess->busy, __ATOMIC_ACQUIRE))
+      pj_thread_sleep(1);
+    pjsua_cancel_timer(&sess->timer);
+  }
+}
+
+/*
+ * fsm_done()
+ * returns number of retired sessions
+ */
+int fsm_done(void) { return STAT_GET(fsm_done_cnt); }
+
+/*
+ * fsm_started()
+ * returns number of fsm_launch() starts carried out
+ */
+int fsm_started(void) { return STAT_GET(fsm_start_cnt); }
+
+/*
+ * fsm_print(fh)
+ * prints how many sessions are in which state
+ */
+void fsm_print(FILE *fh) {
+  int cnt[FSM_STATES];
+  int state;
+  int i;
+
+  memset(cnt, 0, sizeof(cnt));
+  for (i = 0; i < session_count(); i++) {
+    state = __atomic_load_n(&session_get(i)->state, __ATOMIC_RELAXED);
+    if ((state >= 0) && (state < FSM_STATES))
+      cnt[state]++;
+  }
+
+  for (i = 0; i < FSM_STATES; i++)
+    fprintf(fh, "%s%s=%i", i ? " " : "", fsm_names[i], cnt[i]);
+  fprintf(fh, " sent=%lu received=%lu timeout=%lu\n",
+          (unsigned long)STAT_GET(stats.tx), (unsigned long)STAT_GET(stats.rx),
+          (unsigned long)STAT_GET(stats.timeout));
+  fflush(fh);
+}
+
+/*
+ * fsm_run(cfg)
+ * runs cfg->cycles chat cycles on every session and reports progress;
+ * returns when all sessions are done
+ */
+int fsm_run(p_fsm_cfg_t cfg) {
+
+  if ((cfg->cycles < 1) || (fsm_start(cfg) != 0))
+    return -1;
+
+  printf("\n##### %i sessions, %u cycles of %u messages every %u ms #####\n\n",
+         session_count(), cfg->cycles, cfg->msgs, cfg->interval_ms);
+
+  while (fsm_done() < session_count()) {
+    loop_sleep(FSM_REPORT_MS);
+    fsm_print(stdout);
+  }
+  fsm_stop();
+
+  if (STAT_GET(stats.timeout))
+    conf->ret = conf->ret | ERR_TMR;
+
+  printf("\n");
+  stats_print(stdout, &stats);
+
+  return 0;
+}
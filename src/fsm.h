@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    fsm.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief fsm.c header file (timer driven session state machine)
+ */
+
+#ifndef FSM_H_INCLUDED
+#define FSM_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include "functions.h"
+
+/******************************************************************** DEFINE */
+
+#define FSM_MSGS 10
+#define FSM_INTERVAL_MS 1000
+#define FSM_REPORT_MS 1000
+
+/* events, several may be pending at once */
+#define FSM_EV_REG 0x01   /* registration state changed */
+#define FSM_EV_MSG 0x02   /* MESSAGE for this session received */
+#define FSM_EV_TIMER 0x04 /* session timer expired */
+#define FSM_EV_START 0x08 /* fsm_launch() */
+
+/* session states */
+enum {
+  FSM_REGISTERING = 0, /* waiting for the account to register */
+  FSM_IDLE,            /* next cycle starts when the timer expires */
+  FSM_STARTING,        /* start message (21) sent, waiting for Reply-To */
+  FSM_CHATTING,        /* sending chat messages (22) */
+  FSM_CLOSING,         /* stop message (23) sent */
+  FSM_DONE,
+  FSM_STATES
+};
+
+/******************************************************************* TYPEDEF */
+
+typedef struct fsm_cfg {
+  pjsua_acc_id acc_id;
+  pj_str_t uri;         /* target of the start message */
+  pj_str_t urn;
+  unsigned msgs;        /* chat messages per cycle */
+  unsigned interval_ms; /* gap between chat messages and cycles */
+  unsigned cycles;      /* cycles per session, 0 until fsm_stop() */
+  int manual;           /* sessions wait for fsm_launch() */
+} s_fsm_cfg_t, *p_fsm_cfg_t;
+
+/*************************************************************** PROTOTYPES */
+
+int fsm_start(p_fsm_cfg_t cfg);
+void fsm_stop(void);
+void fsm_kick(p_session_t sess, int ev);
+int fsm_launch(p_session_t sess, unsigned msgs, unsigned interval_ms);
+int fsm_add(int cnt);
+int fsm_drain(int cnt);
+void fsm_pause(int on);
+void fsm_interval(unsigned ms);
+void fsm_on_reg(void);
+int fsm_done(void);
+int fsm_started(void);
+void fsm_print(FILE *fh);
+int fsm_run(p_fsm_cfg_t cfg);
+
+#endif // FSM_H_INCLUDED
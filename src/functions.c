@@ -30,10 +30,22 @@
 
 /******************************************************************* INCLUDE */
 
+#include "calls.h"
+#include "client.h"
+#include "dash.h"
+#include "fsm.h"
 #include "functions.h"
+#include "httpd.h"
+#include "matrix.h"
+#include "proxy.h"
+#include "reg.h"
 
 /********************************************************************* CONST */
 
+/******************************************************************* GLOBALS */
+
+p_conf_t conf;
+
 /***************************************************************** FUNCTIONS */
 
 /*
@@ -45,7 +57,8 @@ void rand_str(char *dest, size_t lgth) {
   char charset[] = "0123456789"
                    "abcdefghijklmnopqrstuvwxyz"
                    "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-  srand(time(NULL));
+  if (!loop_active())
+    srand(time(NULL));
   while (lgth-- > 0) {
     index = (double)rand() / RAND_MAX * (sizeof charset - 1);
     *dest++ = charset[index];
@@ -179,44 +192,83 @@ void initConf(p_conf_t conf) {
   conf->street = NULL;
   conf->locality = NULL;
   conf->code = NULL;
+  conf->tls_ca = NULL;
+  conf->tls_cert = NULL;
+  conf->tls_key = NULL;
+  conf->tls_passwd = NULL;
+  conf->tls_ciphers = NULL;
+  conf->tls_proto = NULL;
+  conf->tls_verify = NULL;
   conf->rad = 0;
   conf->dbg = 0;
   conf->reg = 0;
   conf->req = 0;
   conf->val = 0;
   conf->xhd = 0;
+  conf->users = 0;
+  conf->prof = NULL;
+  conf->proxies = NULL;
+  conf->proxy_select = NULL;
 }
 
 /*
  * readConf(filename, pool)
- * reads YAML config file
+ * reads YAML config file; returns NULL if it cannot be read or parsed
  */
 p_conf_t readConf(char *filename, pj_pool_t *pool) {
 
   int state = 0;
-  char **datap;
-  char *radstr;
-  char *dbgstr;
+  int pkey = 0;
+  int plist = 0;
+  int depth = 0;  /* nesting of mappings and sequences */
+  int inprof = 0; /* inside the profile: block */
+  char **datap = NULL;
+  char *radstr = NULL;
+  char *dbgstr = NULL;
+  char *usersstr = NULL;
   char *tk;
 
-  FILE *fh = fopen(filename, "r");
+  FILE *fh;
 
   yaml_parser_t parser;
   yaml_token_t token;
 
+  if ((fh = fopen(filename, "r")) == NULL) {
+    fprintf(stderr, "failed to open file %s!\n", filename);
+    return NULL;
+  }
+  if (!yaml_parser_initialize(&parser)) {
+    fputs("failed to initialize parser!\n", stderr);
+    fclose(fh);
+    return NULL;
+  }
+
   conf = pj_pool_alloc(pool, (sizeof(s_conf_t)));
   initConf(conf);
 
-  if (!yaml_parser_initialize(&parser))
-    fputs("failed to initialize parser!\n", stderr);
-  if (fh == NULL)
-    fputs("failed to open file!\n", stderr);
-
   yaml_parser_set_input_file(&parser, fh);
 
   do {
-    yaml_parser_scan(&parser, &token);
+    if (!yaml_parser_scan(&parser, &token)) {
+      fprintf(stderr, "%s: %s\n", filename,
+              parser.problem ? parser.problem : "parse error");
+      yaml_parser_delete(&parser);
+      fclose(fh);
+      conf = NULL;
+      return NULL;
+    }
     switch (token.type) {
+    case YAML_BLOCK_SEQUENCE_START_TOKEN:
+    case YAML_BLOCK_MAPPING_START_TOKEN:
+    case YAML_FLOW_SEQUENCE_START_TOKEN:
+    case YAML_FLOW_MAPPING_START_TOKEN:
+      depth++;
+      break;
+    case YAML_BLOCK_END_TOKEN:
+    case YAML_FLOW_SEQUENCE_END_TOKEN:
+    case YAML_FLOW_MAPPING_END_TOKEN:
+      depth--;
+      break;
     case YAML_KEY_TOKEN:
       state = 0;
       break;
@@ -226,16 +278,36 @@ p_conf_t readConf(char *filename, pj_pool_t *pool) {
     case YAML_SCALAR_TOKEN:
       tk = (char *)token.data.scalar.value;
       if (state == 0) {
-        if (!strcmp(tk, "domain")) {
+        datap = NULL;
+        pkey = 0;
+        plist = 0;
+        /* phase keys only count below profile:, a top-level key ends it */
+        if (depth <= 1)
+          inprof = !strcmp(tk, "profile");
+        if (inprof && (depth > 1)) {
+          if ((pkey = profile_key(tk)) == 0)
+            printf("unrecognised profile key: %s\n", tk);
+          else if (!conf->prof)
+            conf->prof = pj_pool_zalloc(pool, sizeof(s_profile_t));
+        } else if (!strcmp(tk, "domain")) {
           datap = &conf->domain;
         } else if (!strcmp(tk, "user")) {
           datap = &conf->user;
+        } else if (!strcmp(tk, "users")) {
+          datap = &usersstr;
         } else if (!strcmp(tk, "passwd")) {
           datap = &conf->passwd;
         } else if (!strcmp(tk, "device")) {
           datap = &conf->device;
         } else if (!strcmp(tk, "proxy")) {
           datap = &conf->proxy;
+        } else if (!strcmp(tk, "proxies")) {
+          /* sequence of "<uri> [weight]", see proxy.c */
+          plist = 1;
+          if (!conf->proxies)
+            conf->proxies = pj_pool_zalloc(pool, sizeof(s_proxy_list_t));
+        } else if (!strcmp(tk, "proxy_select")) {
+          datap = &conf->proxy_select;
         } else if (!strcmp(tk, "lon")) {
           datap = &conf->lon;
         } else if (!strcmp(tk, "lat")) {
@@ -268,10 +340,30 @@ p_conf_t readConf(char *filename, pj_pool_t *pool) {
           datap = &conf->locality;
         } else if (!strcmp(tk, "code")) {
           datap = &conf->code;
+        } else if (!strcmp(tk, "tls_ca")) {
+          datap = &conf->tls_ca;
+        } else if (!strcmp(tk, "tls_cert")) {
+          datap = &conf->tls_cert;
+        } else if (!strcmp(tk, "tls_key")) {
+          datap = &conf->tls_key;
+        } else if (!strcmp(tk, "tls_passwd")) {
+          datap = &conf->tls_passwd;
+        } else if (!strcmp(tk, "tls_ciphers")) {
+          datap = &conf->tls_ciphers;
+        } else if (!strcmp(tk, "tls_proto")) {
+          datap = &conf->tls_proto;
+        } else if (!strcmp(tk, "tls_verify")) {
+          datap = &conf->tls_verify;
+        } else if (!strcmp(tk, "profile")) {
+          /* sequence of phases, see profile.c */
         } else {
           printf("unrecognised key: %s\n", tk);
         }
-      } else {
+      } else if (pkey) {
+        profile_set(conf->prof, pkey, tk);
+      } else if (plist) {
+        proxy_add(conf->proxies, tk);
+      } else if (datap) {
         *datap = strdup(tk);
       }
       break;
@@ -282,8 +374,12 @@ p_conf_t readConf(char *filename, pj_pool_t *pool) {
       yaml_token_delete(&token);
   } while (token.type != YAML_STREAM_END_TOKEN);
 
-  conf->rad = atoi(radstr);
-  conf->dbg = atoi(dbgstr);
+  if (radstr)
+    conf->rad = atoi(radstr);
+  if (dbgstr)
+    conf->dbg = atoi(dbgstr);
+  if (usersstr)
+    conf->users = atoi(usersstr);
 
   yaml_token_delete(&token);
   yaml_parser_delete(&parser);
@@ -313,7 +409,7 @@ char *create_vcard(long int *lgth, char *country, pj_pool_t *pool) {
            conf->locality ? conf->locality : USER_LOCALITY,
            conf->code ? conf->code : USER_CODE, country);
 
-  doc = (char *)pj_pool_alloc(pool, strlen(buf));
+  doc = (char *)pj_pool_alloc(pool, strlen(buf) + 1);
   if (doc == NULL) {
     PJ_LOG(4, (THIS_FILE, "malloc failed\n"));
     return doc;
@@ -478,28 +574,33 @@ char *create_pidflo(long int *lgth, char *lat, char *lon, int rad, char *entity,
 }
 
 /*
- * error_exit(title, status)
- * display error and exit application
+ * dec112_hdr(*msg_data, *pool, name, value)
+ * appends one header, name and value are copied to pool
  */
-void error_exit(const char *title, pj_status_t status) {
+static void dec112_hdr(pjsua_msg_data *msg_data, pj_pool_t *pool,
+                       const char *name, const char *value) {
+  pjsip_hdr *hdr;
+  pj_str_t hname;
+  pj_str_t hvalue;
 
-  pjsua_perror(THIS_FILE, title, status);
-  pjsua_destroy();
-  exit(1);
+  hname = pj_str((char *)name);
+  hvalue = pj_str((char *)value);
+  hdr = (pjsip_hdr *)pjsip_generic_string_hdr_create(pool, &hname, &hvalue);
+  pj_list_push_back(&msg_data->hdr_list, hdr);
 }
 
 /*
- * send_dec112_msg(*acc_id, *text, *uri, *surn, mtype, *pool)
- * create multipart MIME body, add DEC112 Call-Info/Geolocation header
- * and send the message
+ * dec112_msg_data(*msg_data, *pool, sess, mtype)
+ * adds the DEC112 Call-Info/Geolocation headers and the PIDF-LO part (and
+ * the vCard with mtype 21) to msg_data; mtype < 0 leaves out message type
+ * and id, as for calls; sess may be NULL to use the global call id
  */
-pj_status_t send_dec112_msg(pjsua_acc_id *acc_id, pj_str_t *text, pj_str_t *uri,
-                            pj_str_t *surn, int mtype, pj_pool_t *pool) {
-  pjsua_msg_data msg_data;
+void dec112_msg_data(pjsua_msg_data *msg_data, pj_pool_t *pool,
+                     p_session_t sess, int mtype) {
   pjsip_multipart_part *alt_part;
   pjsip_multipart_part *alt_partv;
-  pj_status_t status;
   pjsip_hdr *hdr;
+  uint64_t t0;
 
   pj_str_t type;
   pj_str_t subtype;
@@ -510,18 +611,6 @@ pj_status_t send_dec112_msg(pjsua_acc_id *acc_id, pj_str_t *text, pj_str_t *uri,
   pj_str_t subtypev;
   pj_str_t contentv;
 
-  pjsip_generic_string_hdr ci_cid;
-  pjsip_generic_string_hdr ci_did;
-  pjsip_generic_string_hdr ci_mtp;
-  pjsip_generic_string_hdr ci_mid;
-  pjsip_generic_string_hdr ci_url;
-  pjsip_generic_string_hdr ci_dei;
-  pjsip_generic_string_hdr ci_rid;
-
-  pjsip_generic_string_hdr geortghdr;
-  pjsip_generic_string_hdr geohdr;
-  pjsip_generic_string_hdr xhdr;
-
   time_t now;
   struct tm *t;
 
@@ -530,31 +619,33 @@ pj_status_t send_dec112_msg(pjsua_acc_id *acc_id, pj_str_t *text, pj_str_t *uri,
   char dei[BUFFER_512 + 1];
   char rid[BUFFER_512 + 1];
   char mid[BUFFER_512 + 1];
+  char geo[BUFFER_512 + 1];
+  char sub[BUFFER_512 + 1];
+  char seq[BUFFER_128 + 1];
+  char *cid;
+  const char *id;
 
-  pjsua_msg_data_init(&msg_data);
+  t0 = STAGE_START();
 
   /* add DEC112 Call_Info header */
-  hname = pj_str("Call-Info");
 
   // call id
-  if (conf->cid != NULL) {
-    hvalue = pj_str(conf->cid);
-    pjsip_generic_string_hdr_init(pool, &ci_cid, &hname, &hvalue);
-    pj_list_push_back(&msg_data.hdr_list, &ci_cid);
-  }
+  cid = sess ? sess->cid : conf->cid;
+  if (cid != NULL)
+    dec112_hdr(msg_data, pool, "Call-Info", cid);
 
   // devide id
-  if (conf->did != NULL) {
-    hvalue = pj_str(conf->did);
-    pjsip_generic_string_hdr_init(pool, &ci_did, &hname, &hvalue);
-    pj_list_push_back(&msg_data.hdr_list, &ci_did);
-  }
-
-  // url
-  if (conf->url != NULL) {
-    hvalue = pj_str(conf->url);
-    pjsip_generic_string_hdr_init(pool, &ci_url, &hname, &hvalue);
-    pj_list_push_back(&msg_data.hdr_list, &ci_url);
+  if (conf->did != NULL)
+    dec112_hdr(msg_data, pool, "Call-Info", conf->did);
+
+  // url, our own vCard in by-reference mode
+  id = sess ? sess->key : conf->device;
+  if (httpd_active()) {
+    httpd_ref(sub, BUFFER_512, HTTPD_VCARD, id);
+    strncat(sub, ";purpose=" DEC112_SUBINF, BUFFER_512 - strlen(sub));
+    dec112_hdr(msg_data, pool, "Call-Info", sub);
+  } else if (conf->url != NULL) {
+    dec112_hdr(msg_data, pool, "Call-Info", conf->url);
   }
 
   // rid
@@ -563,70 +654,65 @@ pj_status_t send_dec112_msg(pjsua_acc_id *acc_id, pj_str_t *text, pj_str_t *uri,
         rid, BUFFER_512,
         "<urn:dec112:uid:regid:%s:service.dec112.at>;purpose=" DEC112_REGID,
         conf->rid);
-    hvalue = pj_str(rid);
-
-    pjsip_generic_string_hdr_init(pool, &ci_rid, &hname, &hvalue);
-    pj_list_push_back(&msg_data.hdr_list, &ci_rid);
+    dec112_hdr(msg_data, pool, "Call-Info", rid);
   }
 
   // did
   if (conf->dei != NULL) {
     snprintf(dei, BUFFER_512, "<%s>;purpose=" DEC112_DID, conf->dei);
-    hvalue = pj_str(dei);
-
-    pjsip_generic_string_hdr_init(pool, &ci_dei, &hname, &hvalue);
-    pj_list_push_back(&msg_data.hdr_list, &ci_dei);
+    dec112_hdr(msg_data, pool, "Call-Info", dei);
   }
 
-  // message type
-  snprintf(
-      mtp, BUFFER_512,
-      "<urn:dec112:uid:msgtype:%i:service.dec112.at>;purpose=" DEC112_MSGTYP,
-      mtype);
-  hvalue = pj_str(mtp);
-
-  pjsip_generic_string_hdr_init(pool, &ci_mtp, &hname, &hvalue);
-  pj_list_push_back(&msg_data.hdr_list, &ci_mtp);
-
-  // message id
-  now = time(NULL);
-  t = localtime(&now);
+  if (mtype >= 0) {
+    // message type
+    snprintf(
+        mtp, BUFFER_512,
+        "<urn:dec112:uid:msgtype:%i:service.dec112.at>;purpose=" DEC112_MSGTYP,
+        mtype);
+    dec112_hdr(msg_data, pool, "Call-Info", mtp);
 
-  strftime(tmp, BUFFER_128, "%Y%m%d%H%M", t);
-  snprintf(mid, BUFFER_512,
-           "<urn:dec112:uid:msgid:%s:service.dec112.at>;purpose=" DEC112_MSGID,
-           tmp);
-  hvalue = pj_str(mid);
+    // message id
+    now = time(NULL);
+    t = localtime(&now);
 
-  pjsip_generic_string_hdr_init(pool, &ci_mid, &hname, &hvalue);
-  pj_list_push_back(&msg_data.hdr_list, &ci_mid);
+    strftime(tmp, BUFFER_128, "%Y%m%d%H%M", t);
+    snprintf(
+        mid, BUFFER_512,
+        "<urn:dec112:uid:msgid:%s:service.dec112.at>;purpose=" DEC112_MSGID,
+        tmp);
+    dec112_hdr(msg_data, pool, "Call-Info", mid);
+
+    // sequence number within the session
+    snprintf(seq, BUFFER_128, "%lu",
+             (unsigned long)seq_next(sess ? &sess->seq : NULL));
+    dec112_hdr(msg_data, pool, SEQ_HDR, seq);
+  }
 
   /* add Geolocation-Routing header */
-  hname = pj_str("Geolocation-Routing");
-  hvalue = pj_str("yes");
-
-  pjsip_generic_string_hdr_init(pool, &geortghdr, &hname, &hvalue);
-  pj_list_push_back(&msg_data.hdr_list, &geortghdr);
+  dec112_hdr(msg_data, pool, "Geolocation-Routing", "yes");
 
   /* add Geolocation header */
-  hname = pj_str("Geolocation");
-  hvalue = pj_str("<cid:DebhEr9UuGigk4nr@dec112.app>");
-
-  pjsip_generic_string_hdr_init(pool, &geohdr, &hname, &hvalue);
-  pj_list_push_back(&msg_data.hdr_list, &geohdr);
+  if (httpd_active()) {
+    httpd_ref(geo, BUFFER_512, HTTPD_LOCATION, id);
+    dec112_hdr(msg_data, pool, "Geolocation", geo);
+  } else {
+    dec112_hdr(msg_data, pool, "Geolocation",
+               "<cid:DebhEr9UuGigk4nr@dec112.app>");
+  }
 
   /* add X-DEC112 header */
-  if (conf->xhd == 1) {
-    hname = pj_str(DEC112_XHDR_N);
-    hvalue = pj_str(DEC112_XHDR_V);
+  if (conf->xhd == 1)
+    dec112_hdr(msg_data, pool, DEC112_XHDR_N, DEC112_XHDR_V);
 
-    pjsip_generic_string_hdr_init(pool, &xhdr, &hname, &hvalue);
-    pj_list_push_back(&msg_data.hdr_list, &xhdr);
-  }
+  STAGE_STOP(STAGE_HEADERS, t0);
+
+  /* by reference, the text is the only body */
+  if (httpd_active())
+    return;
 
   /* add multipart MIME body */
-  msg_data.multipart_ctype.type = pj_str("multipart");
-  msg_data.multipart_ctype.subtype = pj_str("mixed");
+  msg_data->multipart_ctype.type = pj_str("multipart");
+  msg_data->multipart_ctype.subtype = pj_str("mixed");
 
   /* create pidf-lo */
   alt_part = NULL;
@@ -638,12 +724,15 @@ pj_status_t send_dec112_msg(pjsua_acc_id *acc_id, pj_str_t *text, pj_str_t *uri,
   hname = pj_str("Content-ID");
   hvalue = pj_str("<DebhEr9UuGigk4nr@dec112.app>");
 
+  t0 = STAGE_START();
   content.ptr = create_pidflo(&content.slen, conf->lat, conf->lon, conf->rad,
                               conf->uri, pool);
+  STAGE_STOP(STAGE_PIDFLO, t0);
 
   alt_part->body = pjsip_msg_body_create(pool, &type, &subtype, &content);
+  STAT_ADD(stats.tx_body, content.slen);
 
-  pj_list_push_back(&msg_data.multipart_parts, alt_part);
+  pj_list_push_back(&msg_data->multipart_parts, alt_part);
 
   hdr = (pjsip_hdr *)pjsip_generic_string_hdr_create(pool, &hname, &hvalue);
   pj_list_push_back(&alt_part->hdr, hdr);
@@ -656,24 +745,75 @@ pj_status_t send_dec112_msg(pjsua_acc_id *acc_id, pj_str_t *text, pj_str_t *uri,
     typev = pj_str("application");
     subtypev = pj_str("addCallSub+xml");
 
-    contentv.ptr = create_vcard(&contentv.slen, conf->country, pool);
+    t0 = STAGE_START();
+    contentv.ptr = create_vcard(
+        &contentv.slen,
+        (sess && sess->cell) ? sess->cell->country : conf->country, pool);
+    STAGE_STOP(STAGE_VCARD, t0);
 
     alt_partv->body = pjsip_msg_body_create(pool, &typev, &subtypev, &contentv);
+    STAT_ADD(stats.tx_body, contentv.slen);
+
+    pj_list_push_back(&msg_data->multipart_parts, alt_partv);
+  }
+}
+
+/*
+ * send_dec112_msg(*acc_id, sess, *text, *uri, *surn, mtype)
+ * create multipart MIME body, add DEC112 Call-Info/Geolocation header
+ * and send the message; sess may be NULL to use the global call id
+ */
+pj_status_t send_dec112_msg(pjsua_acc_id *acc_id, p_session_t sess,
+                            pj_str_t *text, pj_str_t *uri, pj_str_t *surn,
+                            int mtype) {
+  pjsua_msg_data msg_data;
+  pj_pool_t *pool;
+  pj_status_t status;
+  unsigned wait;
+  uint64_t t0;
 
-    pj_list_push_back(&msg_data.multipart_parts, alt_partv);
+  /* the single chat waits out a backoff, sessions are held by fsm.c */
+  if (!sess && (wait = flow_wait(NULL, uri)) > 0) {
+    STAT_INC(stats.tx_defer);
+    loop_sleep(wait);
   }
+
+  /* scratch pool, pjsua_im_send() clones everything it keeps */
+  pool = pjsua_pool_create("msg", BUFFER_2048, BUFFER_2048);
+  if (!pool)
+    return PJ_ENOMEM;
+
+  pjsua_msg_data_init(&msg_data);
+  STAT_ADD(stats.tx_body, text->slen);
+  dec112_msg_data(&msg_data, pool, sess, mtype);
+
   /* send message */
   msg_data.target_uri = *surn;
 
   PJ_LOG(2, (THIS_FILE, "MESSAGE '%.*s' sending", text->slen, text->ptr));
-  status = pjsua_im_send(*acc_id, uri, NULL, text, &msg_data, NULL);
+  if (sess) {
+    /* the reply may arrive before pjsua_im_send() returns */
+    __atomic_store_n(&sess->tx_ns, stats_now_ns(), __ATOMIC_RELEASE);
+    sess->tx++;
+  }
+  t0 = STAGE_START();
+  status = pjsua_im_send(*acc_id, uri, NULL, text, &msg_data, sess);
+  STAGE_STOP(STAGE_SEND, t0);
+  STAT_INC(stats.tx);
 
   if (status != PJ_SUCCESS) {
+    STAT_INC(stats.tx_fail);
+    if (sess) {
+      sess->tx_ns = 0;
+      sess->fail++;
+    }
     pj_strtrim(text);
     PJ_LOG(2,
            (THIS_FILE, "MESSAGE '%.*s' sending failed", text->slen, text->ptr));
   }
 
+  pj_pool_release(pool);
+
   return status;
 }
 
@@ -709,6 +849,8 @@ void on_call_state(pjsua_call_id call_id, pjsip_event *e) {
 
   PJ_LOG(3, (THIS_FILE, "dialog %d state=%.*s", call_id,
              (int)ci.state_text.slen, ci.state_text.ptr));
+
+  calls_on_state(call_id);
 }
 
 /*
@@ -722,7 +864,8 @@ void on_call_media_state(pjsua_call_id call_id) {
 
   PJ_LOG(3, (THIS_FILE, "media state changed\n"));
 
-  if (ci.media_status == PJSUA_CALL_MEDIA_ACTIVE) {
+  /* load calls stay off the conference bridge */
+  if ((ci.media_status == PJSUA_CALL_MEDIA_ACTIVE) && !calls_active()) {
     // When media is active, connect call to sound device.
     pjsua_conf_connect(ci.conf_slot, 0);
     pjsua_conf_connect(0, ci.conf_slot);
@@ -746,6 +889,73 @@ void on_reg(pjsua_call_id call_id) {
     PJ_LOG(3, (THIS_FILE, "registration failed\n"));
     conf->reg = 0;
   }
+
+  proxy_on_reg(info.status);
+  reg_update(call_id, info.status);
+  fsm_on_reg();
+  client_on_reg(conf->reg);
+}
+
+/*
+ * on_session_pager(sess, *body, *ci, *rdata)
+ * handles a MESSAGE request that belongs to one of the load sessions
+ */
+static void on_session_pager(p_session_t sess, const pj_str_t *body,
+                             const s_callinfo_t *ci, pjsip_rx_data *rdata) {
+  pjsip_generic_string_hdr *hdr;
+  pj_str_t hdr_name;
+  pj_str_t msg_content;
+  uint64_t tx_ns;
+  uint64_t t0;
+  char *expected;
+  char *rto;
+
+  tx_ns = __atomic_exchange_n(&sess->tx_ns, 0, __ATOMIC_ACQ_REL);
+  if (tx_ns)
+    hist_record(&stats.rtt, (stats_now_ns() - tx_ns) / 1000);
+  if (tx_ns && sess->cell)
+    hist_record(&sess->cell->rtt, (stats_now_ns() - tx_ns) / 1000);
+  sess->rx++;
+
+  if (sess->val == 1) {
+    t0 = STAGE_START();
+    msg_content = pj_str(conf->eval);
+    if (pj_strncmp(body, &msg_content, msg_content.slen) != 0) {
+      conf->ret = conf->ret | ERR_VAL;
+      if (sess->cell)
+        STAT_INC(sess->cell->mismatch);
+      PJ_LOG(3, (THIS_FILE, "session %i validation missmatch", sess->idx));
+    }
+    sess->val = 0;
+    STAGE_STOP(STAGE_VALIDATE, t0);
+  }
+
+  /* only the first response carries the Reply-To we need */
+  if (!__atomic_load_n(&sess->reply, __ATOMIC_ACQUIRE)) {
+    hdr_name = pj_str("Reply-To");
+    hdr = (pjsip_generic_string_hdr *)pjsip_msg_find_hdr_by_name(
+        rdata->msg_info.msg, &hdr_name, NULL);
+    rto = hdr ? (char *)malloc((int)hdr->hvalue.slen * sizeof(char) + 1)
+              : NULL;
+    if (rto) {
+      memset(rto, 0, (int)hdr->hvalue.slen + 1);
+      memcpy(rto, hdr->hvalue.ptr, (int)hdr->hvalue.slen);
+      /* two responses may race here, the first one wins */
+      expected = NULL;
+      if (!__atomic_compare_exchange_n(&sess->reply, &expected, rto, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        free(rto);
+    }
+  }
+
+  /* remote close */
+  if (ci->mtype == CALLINFO_MSGTYPE_CLOSE)
+    sess->closed = 1;
+
+  __atomic_store_n(&sess->req, 1, __ATOMIC_RELEASE);
+
+  client_on_message(sess, body, ci->mtype);
+  fsm_kick(sess, FSM_EV_MSG);
 }
 
 /*
@@ -767,23 +977,50 @@ void on_pager2(pjsua_call_id call_id, const pj_str_t *from,
   pjsip_generic_string_hdr *hdr;
   pj_str_t hdr_name;
   pj_str_t msg_content;
+  s_callinfo_t ci;
+  uint64_t t0;
 
-  char tmp[BUFFER_512 + 1];
   char *rto = NULL;
-  char *cid = NULL;
+
+  p_session_t sess;
+
+  STAT_INC(stats.rx);
+
+  /* one pass over the Call-Info headers, values stay in rdata */
+  t0 = STAGE_START();
+  callinfo_parse(rdata->msg_info.msg, &ci);
+  STAGE_STOP(STAGE_CALLINFO, t0);
+  STAT_INC(stats.rx_mtype[((ci.mtype >= 0) && (ci.mtype < STATS_MTYPES))
+                              ? ci.mtype
+                              : STATS_MTYPES]);
+
+  sess = (ci.cid.slen > 0) ? session_find(ci.cid.ptr, ci.cid.slen) : NULL;
+  if (sess || (session_count() == 0))
+    seq_receive(sess ? &sess->seq : NULL, ci.seq);
+  if (sess) {
+    on_session_pager(sess, body, &ci, rdata);
+    return;
+  } else if (session_count() > 0) {
+    STAT_INC(stats.rx_lost);
+  }
 
   PJ_LOG(2, (THIS_FILE, "request received."));
   PJ_LOG(3, (THIS_FILE, "MESSAGE received \n%s\n", rdata->msg_info.msg_buf));
 
   conf->req = 1;
 
-  printf("\033[0;31m\n"); // set the text to the color red
-  printf("\n%.*s:", (int)from->slen, from->ptr);
-  printf("\n%.*s\n", (int)body->slen, body->ptr);
-  printf("\033[0m\n"); // resets the text to default color
-  fflush(stdout);
+  if (dash_active()) {
+    dash_message(from, body);
+  } else {
+    printf("\033[0;31m\n"); // set the text to the color red
+    printf("\n%.*s:", (int)from->slen, from->ptr);
+    printf("\n%.*s\n", (int)body->slen, body->ptr);
+    printf("\033[0m\n"); // resets the text to default color
+    fflush(stdout);
+  }
 
   if (conf->val == 1) {
+    t0 = STAGE_START();
     msg_content = pj_str(conf->eval);
     if (pj_strncmp(body, &msg_content, msg_content.slen) != 0) {
       conf->ret = conf->ret | ERR_VAL;
@@ -793,51 +1030,73 @@ void on_pager2(pjsua_call_id call_id, const pj_str_t *from,
       PJ_LOG(4, (THIS_FILE, "MESSAGE expected \n%s\n", msg_content));
     }
     conf->val = 0;
+    STAGE_STOP(STAGE_VALIDATE, t0);
   }
 
-  /* get Reply-To header */
+  /* get Reply-To header, main() keeps using the first one */
   hdr_name = pj_str("Reply-To");
   hdr = (pjsip_generic_string_hdr *)pjsip_msg_find_hdr_by_name(
       rdata->msg_info.msg, &hdr_name, NULL);
-  if (hdr) {
+  if (hdr && !conf->reply) {
     rto = (char *)malloc((int)hdr->hvalue.slen * sizeof(char) + 1);
     memset(rto, 0, (int)hdr->hvalue.slen + 1);
     memcpy(rto, hdr->hvalue.ptr, (int)hdr->hvalue.slen);
     PJ_LOG(3, (THIS_FILE, "Reply-To \n%s\n\n", rto));
     conf->reply = rto;
-  } else {
-    conf->reply = NULL;
   }
 
-  /* get Call-Info header */
-  hdr_name = pj_str("Call-Info");
-  hdr = (pjsip_generic_string_hdr *)pjsip_msg_find_hdr_by_name(
-      rdata->msg_info.msg, &hdr_name, NULL);
-  if (hdr) {
-    do {
-      snprintf(tmp, BUFFER_512, "%.*s", (int)hdr->hvalue.slen, hdr->hvalue.ptr);
-      if (strstr(tmp, DEC112_CALLID)) {
-        cid = (char *)malloc((int)hdr->hvalue.slen * sizeof(char) + 1);
-        memset(cid, 0, (int)hdr->hvalue.slen + 1);
-        memcpy(cid, hdr->hvalue.ptr, (int)hdr->hvalue.slen);
-        PJ_LOG(3, (THIS_FILE, DEC112_CALLID " \n%s\n\n", cid));
-        free(cid);
-      } else if (strstr(tmp, DEC112_MSGTYP)) {
-        cid = (char *)malloc((int)hdr->hvalue.slen * sizeof(char) + 1);
-        memset(cid, 0, (int)hdr->hvalue.slen + 1);
-        memcpy(cid, hdr->hvalue.ptr, (int)hdr->hvalue.slen);
-        PJ_LOG(3, (THIS_FILE, DEC112_MSGTYP " \n%s\n\n", cid));
-        if (strstr(cid, DEC112_MSGTYP_19)) {
-          conf->reg = 0;
-        }
-        free(cid);
-      }
+  if (ci.cid.slen > 0)
+    PJ_LOG(3, (THIS_FILE, DEC112_CALLID " \n%.*s\n\n", (int)ci.cid.slen,
+               ci.cid.ptr));
+  if (ci.mtype >= 0)
+    PJ_LOG(3, (THIS_FILE, DEC112_MSGTYP " \n%i\n\n", ci.mtype));
+  if (ci.mid.slen > 0)
+    PJ_LOG(4, (THIS_FILE, DEC112_MSGID " \n%.*s\n\n", (int)ci.mid.slen,
+               ci.mid.ptr));
+  if (ci.mtype == CALLINFO_MSGTYPE_CLOSE) {
+    conf->reg = 0;
+  }
+}
 
-      PJ_LOG(4, (THIS_FILE, "Call-Info \n%.*s\n\n", hdr->hvalue.slen,
-                 hdr->hvalue.ptr));
+/*
+ * on_pager_status2(call_id, *to, *body, *user_data, status, *reason,
+ *                  *tdata, *rdata, acc_id)
+ * callback called by the library with the final response to a MESSAGE
+ */
+void on_pager_status2(pjsua_call_id call_id, const pj_str_t *to,
+                      const pj_str_t *body, void *user_data,
+                      pjsip_status_code status, const pj_str_t *reason,
+                      pjsip_tx_data *tdata, pjsip_rx_data *rdata,
+                      pjsua_acc_id acc_id) {
+  pjsip_retry_after_hdr *ra;
+  p_session_t sess;
 
-      hdr = (pjsip_generic_string_hdr *)pjsip_msg_find_hdr_by_name(
-          rdata->msg_info.msg, &hdr_name, hdr->next);
-    } while (hdr);
+  PJ_UNUSED_ARG(call_id);
+  PJ_UNUSED_ARG(body);
+  PJ_UNUSED_ARG(tdata);
+
+  /* the session of a load mode, NULL for the single chat */
+  sess = (p_session_t)user_data;
+
+  /* MESSAGE timeouts through a proxy trigger its failover */
+  proxy_on_message(acc_id, status);
+
+  if ((status >= SIP_CODE_OK) && (status <= SIP_CODE_OK_END)) {
+    flow_accept(sess ? &sess->flow : NULL, to);
+    return;
   }
+
+  STAT_INC(stats.tx_err);
+  stats_count_code(status);
+  if (sess)
+    STAT_INC(sess->err);
+  PJ_LOG(3, (THIS_FILE, "MESSAGE rejected with %i %.*s", status,
+             (int)reason->slen, reason->ptr));
+
+  /* busy or overloaded, no response (timeout) has no Retry-After */
+  ra = rdata ? (pjsip_retry_after_hdr *)pjsip_msg_find_hdr(
+                   rdata->msg_info.msg, PJSIP_H_RETRY_AFTER, NULL)
+             : NULL;
+  flow_reject(sess ? &sess->flow : NULL, to, status, ra ? ra->ivalue : 0);
+  client_on_status(sess, status);
 }
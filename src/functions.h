@@ -44,6 +44,13 @@
 #include <unistd.h>
 #include <yaml.h>
 
+#include "callinfo.h"
+#include "loop.h"
+#include "profile.h"
+#include "proxy.h"
+#include "session.h"
+#include "stats.h"
+
 /******************************************************************** DEFINE */
 
 #define THIS_FILE "pjchat"
@@ -55,6 +62,7 @@
 #define SIP_CODE_OK 200
 #define SIP_CODE_OK_END 299
 #define SIP_CODE_BUSY_HERE 486
+#define SIP_CODE_UNAVAILABLE 503
 #define SIP_INTERNAL_ERROR 500
 
 #define SIP_PORT 5060
@@ -78,8 +86,6 @@
 #define DEC112_XHDR_N "X-DEC112-Test"
 #define DEC112_XHDR_V "True"
 
-#define DEC112_MSGTYP_19 "msgtype:19"
-
 #define USER_SURNAME "Dow"
 #define USER_GIVEN "John"
 #define USER_PHONE "0012345555555"
@@ -114,11 +120,12 @@
 
 #define STOP_MESSAGE "%s %s (Phone: %s) has ended the emergency chat at %s."
 
-#define ERR_NON 0x00;
-#define ERR_TMR 0x01;
-#define ERR_REG 0x02;
-#define ERR_MSG 0x04;
-#define ERR_VAL 0x08;
+#define ERR_NON 0x00
+#define ERR_TMR 0x01
+#define ERR_REG 0x02
+#define ERR_MSG 0x04
+#define ERR_VAL 0x08
+#define ERR_MEM 0x10
 
 /******************************************************************* TYPEDEF */
 
@@ -150,18 +157,29 @@ typedef struct conf {
   char *street;
   char *locality;
   char *code;
+  char *tls_ca;      /* CA list file (PEM) */
+  char *tls_cert;    /* client certificate file (PEM) */
+  char *tls_key;     /* client private key file (PEM) */
+  char *tls_passwd;  /* private key password */
+  char *tls_ciphers; /* cipher list, ':' or ',' separated */
+  char *tls_proto;   /* 1.0, 1.1, 1.2 or 1.3, default all */
+  char *tls_verify;  /* 1 verifies the server certificate */
   int rad;
   int dbg;
   int reg;
   int req;
   int val;
   int xhd;
+  int users; /* identities counted up from user, 0: user only */
   u_int8_t ret;
+  p_profile_t prof; /* load profile, NULL if not configured */
+  p_proxy_list_t proxies; /* proxies: list, NULL if not configured */
+  char *proxy_select;     /* round-robin, weighted or hash */
 } s_conf_t, *p_conf_t;
 
 /****************************************************************** GLOBALS */
 
-p_conf_t conf;
+extern p_conf_t conf;
 
 /*************************************************************** PROTOTYPES */
 
@@ -176,9 +194,11 @@ p_conf_t readConf(char *filename, pj_pool_t *pool);
 char *create_vcard(long int *lgth, char *country, pj_pool_t *pool);
 char *create_pidflo(long int *lgth, char *lat, char *lon, int rad, char *entity,
                     pj_pool_t *pool);
-void error_exit(const char *title, pj_status_t status);
-pj_status_t send_dec112_msg(pjsua_acc_id *acc_id, pj_str_t *text, pj_str_t *uri,
-                            pj_str_t *surn, int mtype, pj_pool_t *pool);
+void dec112_msg_data(pjsua_msg_data *msg_data, pj_pool_t *pool,
+                     p_session_t sess, int mtype);
+pj_status_t send_dec112_msg(pjsua_acc_id *acc_id, p_session_t sess,
+                            pj_str_t *text, pj_str_t *uri, pj_str_t *surn,
+                            int mtype);
 void on_incoming_call(pjsua_acc_id acc_id, pjsua_call_id call_id,
                       pjsip_rx_data *rdata);
 void on_call_state(pjsua_call_id call_id, pjsip_event *e);
@@ -187,5 +207,10 @@ void on_reg(pjsua_call_id call_id);
 void on_pager2(pjsua_call_id call_id, const pj_str_t *from, const pj_str_t *to,
                const pj_str_t *contact, const pj_str_t *mime_type,
                const pj_str_t *body, pjsip_rx_data *rdata, pjsua_acc_id acc_id);
+void on_pager_status2(pjsua_call_id call_id, const pj_str_t *to,
+                      const pj_str_t *body, void *user_data,
+                      pjsip_status_code status, const pj_str_t *reason,
+                      pjsip_tx_data *tdata, pjsip_rx_data *rdata,
+                      pjsua_acc_id acc_id);
 
 #endif // FUNCTIONS_H_INCLUDED
\ No newline at end of file
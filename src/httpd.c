@@ -0,0 +1,380 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    httpd.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the embedded HTTP server
+ *
+ *  In by-reference mode MESSAGE requests carry no PIDF-LO or vCard body;
+ *  the Geolocation and SubscriberInfo Call-Info headers point to
+ *  <base>/location/<id> and <base>/vcard/<id> instead, id being the
+ *  device id or the key of a load session. Both documents are rendered
+ *  once from the configuration and served from that cache by one thread
+ *  with poll(); HTTP/1.1 keep-alive, GET and HEAD only.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "httpd.h"
+
+/******************************************************************* TYPEDEF */
+
+typedef struct httpd_cli {
+  int fd;
+  size_t len;
+  char buf[BUFFER_2048 + 1];
+} s_httpd_cli_t, *p_httpd_cli_t;
+
+/******************************************************************* GLOBALS */
+
+static pthread_t httpd_thread;
+static int httpd_fd = -1;
+static int httpd_quit = 0;
+static char httpd_base[BUFFER_512 + 1]; /* scheme, host and port */
+static char httpd_path[BUFFER_512 + 1]; /* path prefix of the base url */
+static char *httpd_pidf;
+static char *httpd_vcard;
+static long httpd_pidf_len;
+static long httpd_vcard_len;
+static s_httpd_cli_t httpd_cli[HTTPD_CLIENTS];
+static s_httpd_stats_t httpd_st;
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * httpd_known(id, len)
+ * returns 1 if id is the device id or the key of a session
+ */
+static int httpd_known(const char *id, int len) {
+
+  if (conf->device && ((int)strlen(conf->device) == len) &&
+      !memcmp(conf->device, id, len))
+    return 1;
+
+  return session_find(id, len) != NULL;
+}
+
+/*
+ * httpd_keep(hdrs)
+ * returns 1 unless the request asks to close the connection
+ */
+static int httpd_keep(const char *hdrs) {
+  const char *p;
+
+  if (!strncmp(hdrs, "HTTP/1.0", 8))
+    return 0;
+  for (p = strchr(hdrs, '\n'); p; p = strchr(p, '\n')) {
+    p++;
+    if (!strncasecmp(p, "Connection:", 11)) {
+      for (p += 11; *p == ' '; p++)
+        ;
+      return strncasecmp(p, "close", 5) != 0;
+    }
+  }
+
+  return 1;
+}
+
+/*
+ * httpd_reply(fd, code, type, body, len, head)
+ * writes a complete response, no body for HEAD requests
+ */
+static void httpd_reply(int fd, int code, const char *type, const char *body,
+                        long len, int head) {
+  char hdr[BUFFER_512 + 1];
+  int n;
+
+  n = snprintf(hdr, BUFFER_512,
+               "HTTP/1.1 %i %s\r\nContent-Type: %s\r\n"
+               "Content-Length: %li\r\nCache-Control: max-age=60\r\n\r\n",
+               code, (code == 200) ? "OK" : (code == 404) ? "Not Found"
+                                                          : "Bad Request",
+               type, len);
+  if (send(fd, hdr, n, MSG_NOSIGNAL) < 0)
+    return;
+  if (!head && (len > 0))
+    send(fd, body, len, MSG_NOSIGNAL);
+  STAT_ADD(httpd_st.bytes, n + (head ? 0 : len));
+}
+
+/*
+ * httpd_request(fd, req)
+ * answers one request, returns 1 if the connection stays open
+ */
+static int httpd_request(int fd, char *req) {
+  char *target;
+  char *end;
+  char *id;
+  int head;
+  int plen;
+
+  head = !strncmp(req, "HEAD ", 5);
+  if (strncmp(req, "GET ", 4) && !head) {
+    STAT_INC(httpd_st.bad);
+    httpd_reply(fd, 400, "text/plain", NULL, 0, 0);
+    return 0;
+  }
+
+  target = req + (head ? 5 : 4);
+  if (!(end = strchr(target, ' '))) {
+    STAT_INC(httpd_st.bad);
+    httpd_reply(fd, 400, "text/plain", NULL, 0, 0);
+    return 0;
+  }
+  *end = '\0';
+
+  plen = strlen(httpd_path);
+  if (strncmp(target, httpd_path, plen)) {
+    STAT_INC(httpd_st.not_found);
+    httpd_reply(fd, 404, "text/plain", NULL, 0, head);
+  } else if (!strncmp(target + plen, HTTPD_LOCATION, strlen(HTTPD_LOCATION)) &&
+             (id = target + plen + strlen(HTTPD_LOCATION)) &&
+             httpd_known(id, strlen(id))) {
+    STAT_INC(httpd_st.location);
+    httpd_reply(fd, 200, HTTPD_PIDF_TYPE, httpd_pidf, httpd_pidf_len, head);
+  } else if (!strncmp(target + plen, HTTPD_VCARD, strlen(HTTPD_VCARD)) &&
+             (id = target + plen + strlen(HTTPD_VCARD)) &&
+             httpd_known(id, strlen(id))) {
+    STAT_INC(httpd_st.vcard);
+    httpd_reply(fd, 200, HTTPD_VCARD_TYPE, httpd_vcard, httpd_vcard_len, head);
+  } else {
+    STAT_INC(httpd_st.not_found);
+    httpd_reply(fd, 404, "text/plain", NULL, 0, head);
+  }
+
+  return httpd_keep(end + 1);
+}
+
+/*
+ * httpd_read(cli)
+ * reads from a client and answers complete requests; returns -1 once the
+ * connection is done
+ */
+static int httpd_read(p_httpd_cli_t cli) {
+  char *eoh;
+  size_t used;
+  ssize_t n;
+
+  n = recv(cli->fd, cli->buf + cli->len, BUFFER_2048 - cli->len, 0);
+  if (n <= 0)
+    return -1;
+  cli->len += n;
+  cli->buf[cli->len] = '\0';
+
+  /* pipelined requests are answered in order */
+  while ((eoh = strstr(cli->buf, "\r\n\r\n"))) {
+    *eoh = '\0';
+    used = eoh + 4 - cli->buf;
+    if (!httpd_request(cli->fd, cli->buf))
+      return -1;
+    cli->len -= used;
+    memmove(cli->buf, cli->buf + used, cli->len + 1);
+  }
+
+  if (cli->len == BUFFER_2048) {
+    STAT_INC(httpd_st.bad);
+    httpd_reply(cli->fd, 400, "text/plain", NULL, 0, 0);
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * httpd_main(arg)
+ * server thread, polls the listening socket and all clients
+ */
+static void *httpd_main(void *arg) {
+  static pj_thread_desc desc;
+  struct pollfd pfd[HTTPD_CLIENTS + 1];
+  pj_thread_t *th;
+  int fd;
+  int i;
+
+  PJ_UNUSED_ARG(arg);
+
+  memset(desc, 0, sizeof(desc));
+  pj_thread_register("httpd", desc, &th);
+
+  for (i = 0; i < HTTPD_CLIENTS; i++)
+    httpd_cli[i].fd = -1;
+
+  while (!__atomic_load_n(&httpd_quit, __ATOMIC_ACQUIRE)) {
+    pfd[0].fd = httpd_fd;
+    pfd[0].events = POLLIN;
+    for (i = 0; i < HTTPD_CLIENTS; i++) {
+      pfd[i + 1].fd = httpd_cli[i].fd;
+      pfd[i + 1].events = POLLIN;
+    }
+    if (poll(pfd, HTTPD_CLIENTS + 1, HTTPD_POLL_MS) <= 0)
+      continue;
+
+    for (i = 0; i < HTTPD_CLIENTS; i++) {
+      if (!(pfd[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+        continue;
+      if (httpd_read(&httpd_cli[i]) < 0) {
+        close(httpd_cli[i].fd);
+        httpd_cli[i].fd = -1;
+      }
+    }
+
+    if ((pfd[0].revents & POLLIN) &&
+        ((fd = accept(httpd_fd, NULL, NULL)) >= 0)) {
+      for (i = 0; (i < HTTPD_CLIENTS) && (httpd_cli[i].fd >= 0); i++)
+        ;
+      if (i == HTTPD_CLIENTS) {
+        close(fd); /* busy, the client retries */
+        continue;
+      }
+      httpd_cli[i].fd = fd;
+      httpd_cli[i].len = 0;
+    }
+  }
+
+  for (i = 0; i < HTTPD_CLIENTS; i++) {
+    if (httpd_cli[i].fd >= 0)
+      close(httpd_cli[i].fd);
+  }
+
+  return NULL;
+}
+
+/*
+ * httpd_start(base, offset, pool)
+ * renders the documents and serves them on the port of base + offset;
+ * base is http://<host>[:<port>][/<path>] as seen by the PSAP
+ */
+int httpd_start(const char *base, int offset, pj_pool_t *pool) {
+  struct sockaddr_in sa;
+  const char *host;
+  const char *path;
+  const char *colon;
+  int port;
+  int on;
+
+  if (strncmp(base, "http://", 7)) {
+    PJ_LOG(2, (THIS_FILE, "by-reference url must start with http://\n"));
+    return -1;
+  }
+  host = base + 7;
+  if (!(path = strchr(host, '/')))
+    path = host + strlen(host);
+  colon = memchr(host, ':', path - host);
+  port = (colon ? atoi(colon + 1) : HTTPD_PORT) + offset;
+  if ((port < 1) || (port > 65535) ||
+      ((colon ? colon : path) - host >= BUFFER_512 - 16) ||
+      (strlen(path) >= BUFFER_512)) {
+    PJ_LOG(2, (THIS_FILE, "invalid by-reference url %s\n", base));
+    return -1;
+  }
+  snprintf(httpd_base, BUFFER_512, "http://%.*s:%i",
+           (int)((colon ? colon : path) - host), host, port);
+  snprintf(httpd_path, BUFFER_512, "%s", path);
+  if (httpd_path[0] && (httpd_path[strlen(httpd_path) - 1] == '/'))
+    httpd_path[strlen(httpd_path) - 1] = '\0';
+
+  /* the cache, same documents the by-value bodies carry */
+  httpd_pidf = create_pidflo(&httpd_pidf_len, conf->lat, conf->lon, conf->rad,
+                             conf->uri, pool);
+  httpd_vcard = create_vcard(&httpd_vcard_len, conf->country, pool);
+  if (!httpd_pidf || !httpd_vcard)
+    return -1;
+
+  httpd_fd = socket(AF_INET, SOCK_STREAM, 0);
+  on = 1;
+  setsockopt(httpd_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_ANY);
+  sa.sin_port = htons(port);
+  if ((httpd_fd < 0) ||
+      (bind(httpd_fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) ||
+      (listen(httpd_fd, HTTPD_CLIENTS) != 0)) {
+    PJ_LOG(2, (THIS_FILE, "cannot listen on port %i\n", port));
+    if (httpd_fd >= 0)
+      close(httpd_fd);
+    httpd_fd = -1;
+    return -1;
+  }
+
+  httpd_quit = 0;
+  memset(&httpd_st, 0, sizeof(httpd_st));
+  if (pthread_create(&httpd_thread, NULL, httpd_main, NULL) != 0) {
+    close(httpd_fd);
+    httpd_fd = -1;
+    return -1;
+  }
+
+  PJ_LOG(3, (THIS_FILE, "serving location and vCard at %s%s\n", httpd_base,
+             httpd_path));
+
+  return 0;
+}
+
+/*
+ * httpd_active()
+ * returns 1 in by-reference mode
+ */
+int httpd_active(void) { return httpd_fd >= 0; }
+
+/*
+ * httpd_ref(buf, len, res, id)
+ * writes <url> of resource res (HTTPD_LOCATION, HTTPD_VCARD) for id
+ */
+int httpd_ref(char *buf, size_t len, const char *res, const char *id) {
+
+  return snprintf(buf, len, "<%s%s%s%s>", httpd_base, httpd_path, res, id);
+}
+
+/*
+ * httpd_stop()
+ * stops the server thread and closes all connections
+ */
+void httpd_stop(void) {
+
+  if (httpd_fd < 0)
+    return;
+
+  __atomic_store_n(&httpd_quit, 1, __ATOMIC_RELEASE);
+  pthread_join(httpd_thread, NULL);
+  close(httpd_fd);
+  httpd_fd = -1;
+}
+
+/*
+ * httpd_print(fh)
+ * prints the dereference counters
+ */
+void httpd_print(FILE *fh) {
+
+  fprintf(fh,
+          "\n##### by reference: location=%lu vcard=%lu not-found=%lu "
+          "bad=%lu bytes=%lu #####\n",
+          (unsigned long)STAT_GET(httpd_st.location),
+          (unsigned long)STAT_GET(httpd_st.vcard),
+          (unsigned long)STAT_GET(httpd_st.not_found),
+          (unsigned long)STAT_GET(httpd_st.bad),
+          (unsigned long)STAT_GET(httpd_st.bytes));
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    httpd.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief httpd.c header file (location and vCard by reference)
+ */
+
+#ifndef HTTPD_H_INCLUDED
+#define HTTPD_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <strings.h>
+#include <sys/socket.h>
+
+#include "functions.h"
+
+/******************************************************************** DEFINE */
+
+#define HTTPD_PORT 80
+#define HTTPD_CLIENTS 64  /* connections served at the same time */
+#define HTTPD_POLL_MS 200 /* httpd_stop() latency */
+
+/* resources, followed by the device id or session key */
+#define HTTPD_LOCATION "/location/"
+#define HTTPD_VCARD "/vcard/"
+
+#define HTTPD_PIDF_TYPE "application/pidf+xml"
+#define HTTPD_VCARD_TYPE "application/addCallSub+xml"
+
+/******************************************************************* TYPEDEF */
+
+/* dereference counters */
+typedef struct httpd_stats {
+  uint64_t location;  /* PIDF-LO served */
+  uint64_t vcard;     /* vCards served */
+  uint64_t not_found; /* unknown resource or id */
+  uint64_t bad;       /* malformed or oversized requests */
+  uint64_t bytes;     /* response bytes */
+} s_httpd_stats_t, *p_httpd_stats_t;
+
+/*************************************************************** PROTOTYPES */
+
+int httpd_start(const char *base, int offset, pj_pool_t *pool);
+int httpd_active(void);
+int httpd_ref(char *buf, size_t len, const char *res, const char *id);
+void httpd_stop(void);
+void httpd_print(FILE *fh);
+
+#endif // HTTPD_H_INCLUDED
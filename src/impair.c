@@ -0,0 +1,703 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    impair.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the network impairment relay
+ *
+ *  The account uses the relay on 127.0.0.1 as outbound proxy; the relay
+ *  forwards every SIP message to the configured proxy and back, after the
+ *  delay, jitter, loss, duplication, stalls and resets of an impairment
+ *  profile. TCP streams are split into messages (Content-Length), so the
+ *  profile applies per message as it does for UDP datagrams. The Route
+ *  header pointing to the relay is removed on the way out; the proxy sees
+ *  the relay as the client, pjsua learns that address from Via received
+ *  and rport. One thread with poll(), no privileges or kernel queueing
+ *  disciplines required.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "impair.h"
+
+/******************************************************************* TYPEDEF */
+
+/* a client and its socket towards the target */
+typedef struct impair_flow {
+  int cfd;                /* TCP client connection, -1 for UDP */
+  int ufd;                /* socket towards the target, -1 if unused */
+  struct sockaddr_in cli; /* UDP client address */
+  unsigned gen;           /* drops messages queued before a reset */
+  uint64_t last[2];       /* due time of the last message (TCP order) */
+  uint64_t stall[2];      /* direction stalled until */
+  size_t len[2];          /* bytes in the TCP framing buffers */
+  char *buf[2];
+} s_impair_flow_t, *p_impair_flow_t;
+
+/* a message waiting for its due time */
+typedef struct impair_msg {
+  struct impair_msg *next;
+  uint64_t due; /* microseconds, stats_now_ns() clock */
+  int flow;
+  unsigned gen;
+  int dir;
+  size_t len;
+  char *data;
+} s_impair_msg_t, *p_impair_msg_t;
+
+/******************************************************************* GLOBALS */
+
+static const char *impair_names[] = {"lan", "dsl", "3g", "edge", "flaky",
+                                     NULL};
+static const s_impair_prof_t impair_named[] = {
+    {1, 1, 0, 0, 0, 0, 0},           /* lan */
+    {15, 5, 0.1, 0, 0, 0, 0},        /* dsl */
+    {100, 40, 1, 0.5, 0.5, 1500, 0}, /* 3g */
+    {300, 150, 3, 1, 2, 3000, 0.1},  /* edge */
+    {80, 60, 5, 2, 5, 5000, 1}};     /* flaky */
+
+static pthread_t impair_thread;
+static int impair_fd = -1;
+static int impair_quit = 0;
+static int impair_tcp;
+static struct sockaddr_storage impair_dst;
+static socklen_t impair_dst_len;
+static char impair_relay[BUFFER_128 + 1]; /* relay URI for the account */
+static char impair_route[BUFFER_128 + 1]; /* host:port of the relay */
+static unsigned impair_seed;
+static s_impair_prof_t impair_prof;
+static s_impair_flow_t impair_flow[IMPAIR_FLOWS];
+static p_impair_msg_t impair_queue;
+static s_impair_stats_t impair_st;
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * impair_profile(prof, spec)
+ * parses <name>[,<key>=<value>...] or <key>=<value>[,...]; keys are
+ * delay, jitter, loss, dup, stall (<%>[:<ms>]) and reset
+ */
+int impair_profile(p_impair_prof_t prof, const char *spec) {
+  char tmp[BUFFER_512 + 1];
+  char *tok;
+  char *val;
+  char *save;
+  int i;
+
+  memset(prof, 0, sizeof(s_impair_prof_t));
+  snprintf(tmp, BUFFER_512, "%s", spec);
+
+  for (tok = strtok_r(tmp, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+    if (!(val = strchr(tok, '='))) {
+      for (i = 0; impair_names[i] && strcmp(tok, impair_names[i]); i++)
+        ;
+      if (!impair_names[i]) {
+        PJ_LOG(2, (THIS_FILE, "unknown impairment profile %s\n", tok));
+        return -1;
+      }
+      memcpy(prof, &impair_named[i], sizeof(s_impair_prof_t));
+      continue;
+    }
+    *val++ = '\0';
+    if (!strcmp(tok, "delay"))
+      prof->delay_ms = atoi(val);
+    else if (!strcmp(tok, "jitter"))
+      prof->jitter_ms = atoi(val);
+    else if (!strcmp(tok, "loss"))
+      prof->loss = atof(val);
+    else if (!strcmp(tok, "dup"))
+      prof->dup = atof(val);
+    else if (!strcmp(tok, "stall"))
+      sscanf(val, "%lf:%u", &prof->stall, &prof->stall_ms);
+    else if (!strcmp(tok, "reset"))
+      prof->reset = atof(val);
+    else {
+      PJ_LOG(2, (THIS_FILE, "unknown impairment %s\n", tok));
+      return -1;
+    }
+  }
+
+  if ((prof->stall > 0) && (prof->stall_ms == 0))
+    prof->stall_ms = 1000;
+
+  return 0;
+}
+
+/*
+ * impair_hit(pct)
+ * returns 1 with a probability of pct percent
+ */
+static int impair_hit(double pct) {
+
+  if (pct <= 0)
+    return 0;
+
+  return rand_r(&impair_seed) * 100.0 / ((double)RAND_MAX + 1) < pct;
+}
+
+/*
+ * impair_close(f, rst)
+ * closes a flow, with a TCP reset if rst is set
+ */
+static void impair_close(p_impair_flow_t f, int rst) {
+  struct linger lg;
+  unsigned gen;
+
+  lg.l_onoff = 1;
+  lg.l_linger = 0;
+  if (rst && (f->cfd >= 0))
+    setsockopt(f->cfd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+  if (rst && (f->ufd >= 0))
+    setsockopt(f->ufd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+  if (f->cfd >= 0)
+    close(f->cfd);
+  if (f->ufd >= 0)
+    close(f->ufd);
+  free(f->buf[IMPAIR_UP]);
+  free(f->buf[IMPAIR_DOWN]);
+  gen = f->gen + 1;
+  memset(f, 0, sizeof(s_impair_flow_t));
+  f->cfd = -1;
+  f->ufd = -1;
+  f->gen = gen;
+}
+
+/*
+ * impair_strip(buf, len)
+ * removes the Route header of the relay; returns the new length
+ */
+static size_t impair_strip(char *buf, size_t len) {
+  size_t rlen;
+  char *ls;
+  char *le;
+  char *p;
+
+  rlen = strlen(impair_route);
+  for (ls = memchr(buf, '\n', len); ls; ls = le) {
+    ls++;
+    if (!(le = memchr(ls, '\n', buf + len - ls)) || (le - ls <= 2))
+      break; /* end of the header */
+    if (strncasecmp(ls, "Route:", 6))
+      continue;
+    for (p = ls + 6; p + rlen <= le; p++) {
+      if (!memcmp(p, impair_route, rlen)) {
+        memmove(ls, le + 1, buf + len - (le + 1));
+        return len - (le + 1 - ls);
+      }
+    }
+  }
+
+  return len;
+}
+
+/*
+ * impair_frame(buf, len)
+ * returns the length of the first complete message of a TCP stream, 0 if
+ * incomplete, -1 if it can never fit; buf is '\0' terminated
+ */
+static long impair_frame(const char *buf, size_t len) {
+  const char *eoh;
+  const char *p;
+  long clen;
+  size_t n;
+
+  /* keep-alive CRLFs */
+  for (n = 0; (n < len) && ((buf[n] == '\r') || (buf[n] == '\n')); n++)
+    ;
+  if (n > 0)
+    return n;
+
+  if (!(eoh = strstr(buf, "\r\n\r\n")))
+    return (len >= IMPAIR_BUF) ? -1 : 0;
+
+  clen = 0;
+  for (p = strchr(buf, '\n'); p && (p < eoh); p = strchr(p, '\n')) {
+    p++;
+    if (!strncasecmp(p, "Content-Length:", 15))
+      clen = strtol(p + 15, NULL, 10);
+    else if (!strncasecmp(p, "l:", 2))
+      clen = strtol(p + 2, NULL, 10);
+  }
+
+  n = eoh + 4 - buf;
+  if ((clen < 0) || (n + clen > IMPAIR_BUF))
+    return -1;
+
+  return (n + clen <= len) ? (long)(n + clen) : 0;
+}
+
+/*
+ * impair_queue_msg(idx, dir, data, len, due)
+ * inserts a copy of a message, ordered by due time
+ */
+static void impair_queue_msg(int idx, int dir, const char *data, size_t len,
+                             uint64_t due) {
+  p_impair_msg_t *pm;
+  p_impair_msg_t m;
+
+  if (!(m = (p_impair_msg_t)malloc(sizeof(s_impair_msg_t) + len)))
+    return;
+  m->due = due;
+  m->flow = idx;
+  m->gen = impair_flow[idx].gen;
+  m->dir = dir;
+  m->len = len;
+  m->data = (char *)(m + 1);
+  memcpy(m->data, data, len);
+
+  for (pm = &impair_queue; *pm && ((*pm)->due <= due); pm = &(*pm)->next)
+    ;
+  m->next = *pm;
+  *pm = m;
+}
+
+/*
+ * impair_push(idx, dir, data, len)
+ * applies the profile to a message and queues it; returns -1 if the flow
+ * was reset
+ */
+static int impair_push(int idx, int dir, const char *data, size_t len) {
+  p_impair_flow_t f;
+  uint64_t now;
+  uint64_t due;
+
+  f = &impair_flow[idx];
+  now = stats_now_ns() / 1000;
+
+  if (impair_tcp && impair_hit(impair_prof.reset)) {
+    STAT_INC(impair_st.resets);
+    impair_close(f, 1);
+    return -1;
+  }
+
+  due = now + impair_prof.delay_ms * 1000;
+  if (impair_prof.jitter_ms)
+    due += rand_r(&impair_seed) % (impair_prof.jitter_ms * 1000 + 1);
+
+  if (impair_hit(impair_prof.loss)) {
+    STAT_INC(impair_st.lost);
+    if (!impair_tcp)
+      return 0;
+    due += IMPAIR_RTO_MS * 1000;
+  }
+
+  if ((f->stall[dir] < now) && impair_hit(impair_prof.stall)) {
+    STAT_INC(impair_st.stalls);
+    f->stall[dir] = now + impair_prof.stall_ms * 1000;
+  }
+  if (due < f->stall[dir])
+    due = f->stall[dir];
+
+  /* a byte stream keeps its order */
+  if (impair_tcp && (due < f->last[dir]))
+    due = f->last[dir];
+  f->last[dir] = due;
+
+  hist_record(&impair_st.delay, due - now);
+  impair_queue_msg(idx, dir, data, len, due);
+
+  if (!impair_tcp && impair_hit(impair_prof.dup)) {
+    STAT_INC(impair_st.dups);
+    impair_queue_msg(idx, dir, data, len, due);
+  }
+
+  return 0;
+}
+
+/*
+ * impair_flush(now)
+ * sends all messages that are due
+ */
+static void impair_flush(uint64_t now) {
+  p_impair_flow_t f;
+  p_impair_msg_t m;
+
+  while (impair_queue && (impair_queue->due <= now)) {
+    m = impair_queue;
+    impair_queue = m->next;
+    f = &impair_flow[m->flow];
+
+    if ((m->gen == f->gen) && (f->ufd >= 0)) {
+      if (m->dir == IMPAIR_UP)
+        send(f->ufd, m->data, m->len, MSG_NOSIGNAL);
+      else if (impair_tcp)
+        send(f->cfd, m->data, m->len, MSG_NOSIGNAL);
+      else
+        sendto(impair_fd, m->data, m->len, 0, (struct sockaddr *)&f->cli,
+               sizeof(f->cli));
+      STAT_INC(impair_st.msgs);
+      STAT_ADD(impair_st.bytes, m->len);
+    }
+    free(m);
+  }
+}
+
+/*
+ * impair_connect(type)
+ * returns a socket connected to the target, -1 on failure
+ */
+static int impair_connect(int type) {
+  int fd;
+
+  fd = socket(impair_dst.ss_family, type, 0);
+  if (fd < 0)
+    return -1;
+  if (connect(fd, (struct sockaddr *)&impair_dst, impair_dst_len) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/*
+ * impair_accept()
+ * opens a flow for a new TCP client
+ */
+static void impair_accept(void) {
+  p_impair_flow_t f;
+  int fd;
+  int i;
+
+  if ((fd = accept(impair_fd, NULL, NULL)) < 0)
+    return;
+
+  for (i = 0; (i < IMPAIR_FLOWS) && (impair_flow[i].ufd >= 0); i++)
+    ;
+  if (i == IMPAIR_FLOWS) {
+    STAT_INC(impair_st.refused);
+    close(fd);
+    return;
+  }
+
+  f = &impair_flow[i];
+  f->cfd = fd;
+  f->buf[IMPAIR_UP] = (char *)malloc(IMPAIR_BUF + 1);
+  f->buf[IMPAIR_DOWN] = (char *)malloc(IMPAIR_BUF + 1);
+  if (!f->buf[IMPAIR_UP] || !f->buf[IMPAIR_DOWN] ||
+      ((f->ufd = impair_connect(SOCK_STREAM)) < 0)) {
+    STAT_INC(impair_st.refused);
+    impair_close(f, 0);
+    return;
+  }
+  STAT_INC(impair_st.flows);
+}
+
+/*
+ * impair_read_tcp(idx, dir)
+ * reads from one side of a TCP flow and queues complete messages
+ */
+static void impair_read_tcp(int idx, int dir) {
+  p_impair_flow_t f;
+  char *buf;
+  ssize_t n;
+  long m;
+
+  f = &impair_flow[idx];
+  buf = f->buf[dir];
+  n = recv((dir == IMPAIR_UP) ? f->cfd : f->ufd, buf + f->len[dir],
+           IMPAIR_BUF - f->len[dir], 0);
+  if (n <= 0) {
+    impair_close(f, 0);
+    return;
+  }
+  f->len[dir] += n;
+  buf[f->len[dir]] = '\0';
+
+  while ((m = impair_frame(buf, f->len[dir])) > 0) {
+    if (impair_push(idx, dir, buf,
+                    (dir == IMPAIR_UP) ? impair_strip(buf, m) : (size_t)m) < 0)
+      return;
+    f->len[dir] -= m;
+    memmove(buf, buf + m, f->len[dir] + 1);
+  }
+
+  if (m < 0)
+    impair_close(f, 1);
+}
+
+/*
+ * impair_read_udp(idx)
+ * reads a datagram, from a client (idx < 0) or from the target
+ */
+static void impair_read_udp(int idx) {
+  struct sockaddr_in sa;
+  socklen_t slen;
+  char buf[IMPAIR_BUF];
+  ssize_t n;
+  int i;
+
+  if (idx >= 0) {
+    if ((n = recv(impair_flow[idx].ufd, buf, IMPAIR_BUF, 0)) > 0)
+      impair_push(idx, IMPAIR_DOWN, buf, n);
+    return;
+  }
+
+  slen = sizeof(sa);
+  n = recvfrom(impair_fd, buf, IMPAIR_BUF, 0, (struct sockaddr *)&sa, &slen);
+  if (n <= 0)
+    return;
+
+  for (i = 0; i < IMPAIR_FLOWS; i++) {
+    if ((impair_flow[i].ufd >= 0) &&
+        (impair_flow[i].cli.sin_addr.s_addr == sa.sin_addr.s_addr) &&
+        (impair_flow[i].cli.sin_port == sa.sin_port))
+      break;
+  }
+  if (i == IMPAIR_FLOWS) {
+    for (i = 0; (i < IMPAIR_FLOWS) && (impair_flow[i].ufd >= 0); i++)
+      ;
+    if ((i == IMPAIR_FLOWS) ||
+        ((impair_flow[i].ufd = impair_connect(SOCK_DGRAM)) < 0)) {
+      STAT_INC(impair_st.refused);
+      return;
+    }
+    memcpy(&impair_flow[i].cli, &sa, sizeof(sa));
+    STAT_INC(impair_st.flows);
+  }
+
+  impair_push(i, IMPAIR_UP, buf, impair_strip(buf, n));
+}
+
+/*
+ * impair_main(arg)
+ * relay thread, polls the listening socket and all flows and sends what
+ * is due
+ */
+static void *impair_main(void *arg) {
+  static pj_thread_desc desc;
+  struct pollfd pfd[2 * IMPAIR_FLOWS + 1];
+  int who[2 * IMPAIR_FLOWS + 1];
+  pj_thread_t *th;
+  uint64_t now;
+  int wait;
+  int cnt;
+  int i;
+
+  PJ_UNUSED_ARG(arg);
+
+  memset(desc, 0, sizeof(desc));
+  pj_thread_register("impair", desc, &th);
+
+  while (!__atomic_load_n(&impair_quit, __ATOMIC_ACQUIRE)) {
+    /* who: flow index * 2 + direction read, -1 for the listener */
+    pfd[0].fd = impair_fd;
+    pfd[0].events = POLLIN;
+    who[0] = -1;
+    cnt = 1;
+    for (i = 0; i < IMPAIR_FLOWS; i++) {
+      if (impair_flow[i].ufd < 0)
+        continue;
+      pfd[cnt].fd = impair_flow[i].ufd;
+      pfd[cnt].events = POLLIN;
+      who[cnt++] = i * 2 + IMPAIR_DOWN;
+      if (impair_flow[i].cfd < 0)
+        continue;
+      pfd[cnt].fd = impair_flow[i].cfd;
+      pfd[cnt].events = POLLIN;
+      who[cnt++] = i * 2 + IMPAIR_UP;
+    }
+
+    now = stats_now_ns() / 1000;
+    wait = IMPAIR_POLL_MS;
+    if (impair_queue && (impair_queue->due <= now))
+      wait = 0;
+    else if (impair_queue && (impair_queue->due - now < wait * 1000))
+      wait = (impair_queue->due - now + 999) / 1000;
+
+    if (poll(pfd, cnt, wait) > 0) {
+      for (i = 0; i < cnt; i++) {
+        if (!(pfd[i].revents & (POLLIN | POLLHUP | POLLERR)))
+          continue;
+        if (who[i] < 0)
+          impair_tcp ? impair_accept() : impair_read_udp(-1);
+        else if (impair_flow[who[i] / 2].ufd < 0)
+          continue; /* reset while reading the other side */
+        else if (impair_tcp)
+          impair_read_tcp(who[i] / 2, who[i] % 2);
+        else
+          impair_read_udp(who[i] / 2);
+      }
+    }
+
+    impair_flush(stats_now_ns() / 1000);
+  }
+
+  return NULL;
+}
+
+/*
+ * impair_start(target, port, prof)
+ * relays between 127.0.0.1:port and the proxy URI target; udp and tcp
+ */
+int impair_start(const char *target, int port, const s_impair_prof_t *prof) {
+  struct addrinfo hints;
+  struct addrinfo *res;
+  struct sockaddr_in sa;
+  char host[BUFFER_128 + 1];
+  char tport[BUFFER_128 + 1];
+  const char *p;
+  size_t n;
+  int on;
+  int i;
+
+  /* sip:<host>[:<port>][;transport=<udp|tcp>] */
+  if (!target || strncmp(target, "sip:", 4)) {
+    PJ_LOG(2, (THIS_FILE, "impairment relay needs a sip: proxy URI\n"));
+    return -1;
+  }
+  p = target + 4;
+  n = strcspn(p, ":;>");
+  if ((n == 0) || (n >= BUFFER_128))
+    return -1;
+  memcpy(host, p, n);
+  host[n] = '\0';
+  if (p[n] == ':')
+    snprintf(tport, BUFFER_128, "%.*s", (int)strcspn(p + n + 1, ";>"),
+             p + n + 1);
+  else
+    snprintf(tport, BUFFER_128, "%i", SIP_PORT);
+
+  impair_tcp = 0;
+  for (p = strchr(target, ';'); p; p = strchr(p + 1, ';')) {
+    if (strncasecmp(p, ";transport=", 11))
+      continue;
+    if (!strncasecmp(p + 11, "tcp", 3))
+      impair_tcp = 1;
+    else if (strncasecmp(p + 11, "udp", 3)) {
+      PJ_LOG(2, (THIS_FILE, "impairment relay supports udp and tcp only\n"));
+      return -1;
+    }
+  }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = impair_tcp ? SOCK_STREAM : SOCK_DGRAM;
+  if (getaddrinfo(host, tport, &hints, &res) != 0) {
+    PJ_LOG(2, (THIS_FILE, "cannot resolve %s\n", host));
+    return -1;
+  }
+  memcpy(&impair_dst, res->ai_addr, res->ai_addrlen);
+  impair_dst_len = res->ai_addrlen;
+  freeaddrinfo(res);
+
+  impair_fd = socket(AF_INET, impair_tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+  on = 1;
+  setsockopt(impair_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sa.sin_port = htons(port);
+  if ((impair_fd < 0) ||
+      (bind(impair_fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) ||
+      (impair_tcp && (listen(impair_fd, IMPAIR_FLOWS) != 0))) {
+    PJ_LOG(2, (THIS_FILE, "cannot listen on port %i\n", port));
+    if (impair_fd >= 0)
+      close(impair_fd);
+    impair_fd = -1;
+    return -1;
+  }
+
+  snprintf(impair_route, BUFFER_128, "127.0.0.1:%i", port);
+  snprintf(impair_relay, BUFFER_128, "sip:127.0.0.1:%i;transport=%s;lr", port,
+           impair_tcp ? "tcp" : "udp");
+  memcpy(&impair_prof, prof, sizeof(s_impair_prof_t));
+  impair_seed = loop_seed((unsigned)getpid() ^ (unsigned)time(NULL));
+  for (i = 0; i < IMPAIR_FLOWS; i++) {
+    impair_flow[i].cfd = -1;
+    impair_flow[i].ufd = -1;
+  }
+  impair_queue = NULL;
+  impair_quit = 0;
+  memset(&impair_st, 0, sizeof(impair_st));
+  if (pthread_create(&impair_thread, NULL, impair_main, NULL) != 0) {
+    close(impair_fd);
+    impair_fd = -1;
+    return -1;
+  }
+
+  PJ_LOG(3, (THIS_FILE,
+             "relaying %s via %s: delay=%ums jitter=%ums loss=%.1f%% "
+             "dup=%.1f%% stall=%.1f%%:%ums reset=%.1f%%\n",
+             target, impair_relay, prof->delay_ms, prof->jitter_ms, prof->loss,
+             prof->dup, prof->stall, prof->stall_ms, prof->reset));
+
+  return 0;
+}
+
+/*
+ * impair_uri()
+ * returns the relay URI, NULL if the relay is not running
+ */
+const char *impair_uri(void) {
+
+  return (impair_fd >= 0) ? impair_relay : NULL;
+}
+
+/*
+ * impair_stop()
+ * stops the relay thread, closes all flows and drops what is queued
+ */
+void impair_stop(void) {
+  p_impair_msg_t m;
+  int i;
+
+  if (impair_fd < 0)
+    return;
+
+  __atomic_store_n(&impair_quit, 1, __ATOMIC_RELEASE);
+  pthread_join(impair_thread, NULL);
+
+  for (i = 0; i < IMPAIR_FLOWS; i++) {
+    if (impair_flow[i].ufd >= 0)
+      impair_close(&impair_flow[i], 0);
+  }
+  while ((m = impair_queue)) {
+    impair_queue = m->next;
+    free(m);
+  }
+  close(impair_fd);
+  impair_fd = -1;
+}
+
+/*
+ * impair_print(fh)
+ * prints the relay counters and the delay it added per message
+ */
+void impair_print(FILE *fh) {
+
+  fprintf(fh,
+          "\n##### impairment relay: relayed=%lu bytes=%lu lost=%lu dup=%lu "
+          "stalls=%lu resets=%lu flows=%lu refused=%lu #####\n",
+          (unsigned long)STAT_GET(impair_st.msgs),
+          (unsigned long)STAT_GET(impair_st.bytes),
+          (unsigned long)STAT_GET(impair_st.lost),
+          (unsigned long)STAT_GET(impair_st.dups),
+          (unsigned long)STAT_GET(impair_st.stalls),
+          (unsigned long)STAT_GET(impair_st.resets),
+          (unsigned long)STAT_GET(impair_st.flows),
+          (unsigned long)STAT_GET(impair_st.refused));
+  hist_print(fh, "added", &impair_st.delay);
+}
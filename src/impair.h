@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    impair.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief impair.c header file (network impairment relay)
+ */
+
+#ifndef IMPAIR_H_INCLUDED
+#define IMPAIR_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <strings.h>
+#include <sys/socket.h>
+
+#include "functions.h"
+
+/******************************************************************** DEFINE */
+
+#define IMPAIR_PORT 5070  /* loopback port of the relay */
+#define IMPAIR_FLOWS 32   /* client flows relayed at the same time */
+#define IMPAIR_BUF 65536  /* largest SIP message relayed */
+#define IMPAIR_POLL_MS 50 /* impair_stop() latency */
+#define IMPAIR_RTO_MS 200 /* TCP retransmission, stands in for a loss */
+
+/* directions of a flow */
+#define IMPAIR_UP 0   /* client -> target */
+#define IMPAIR_DOWN 1 /* target -> client */
+
+/******************************************************************* TYPEDEF */
+
+/* applied to every message, in both directions */
+typedef struct impair_prof {
+  unsigned delay_ms;  /* one-way delay */
+  unsigned jitter_ms; /* uniform 0..jitter_ms on top */
+  double loss;        /* % dropped (UDP) or retransmitted (TCP) */
+  double dup;         /* % duplicated (UDP) */
+  double stall;       /* % stalling the direction for stall_ms */
+  unsigned stall_ms;  /* length of a stall */
+  double reset;       /* % resetting the connection (TCP) */
+} s_impair_prof_t, *p_impair_prof_t;
+
+/* relay counters */
+typedef struct impair_stats {
+  uint64_t msgs;    /* messages relayed */
+  uint64_t bytes;   /* bytes relayed */
+  uint64_t lost;    /* dropped or retransmitted */
+  uint64_t dups;    /* duplicated */
+  uint64_t stalls;  /* stalls started */
+  uint64_t resets;  /* connections reset */
+  uint64_t flows;   /* flows opened */
+  uint64_t refused; /* no flow slot or target unreachable */
+  s_hist_t delay;   /* delay added per message */
+} s_impair_stats_t, *p_impair_stats_t;
+
+/*************************************************************** PROTOTYPES */
+
+int impair_profile(p_impair_prof_t prof, const char *spec);
+int impair_start(const char *target, int port, const s_impair_prof_t *prof);
+const char *impair_uri(void);
+void impair_stop(void);
+void impair_print(FILE *fh);
+
+#endif // IMPAIR_H_INCLUDED
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    loop.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the deterministic event loop
+ *
+ *  With --deterministic pjsua runs without worker threads (SIP and media
+ *  share one ioqueue) and every wait of the main thread becomes a loop
+ *  over pjsua_handle_events(), so timers, received messages and the
+ *  session state machines all run on the main thread, one at a time.
+ *  pj_rand(), rand() and the re-registration jitter are seeded with the
+ *  given seed instead of the time, so call ids, session keys and backoff
+ *  delays repeat from run to run. Options that start threads of their own
+ *  calling into pjsua (control socket, HTTP server, dashboard, impairment
+ *  relay) are rejected in this mode.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "loop.h"
+#include "stats.h"
+
+/******************************************************************* GLOBALS */
+
+static int loop_on;
+static unsigned loop_rng;
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * loop_config(cfg, media_cfg)
+ * removes all pjsua worker threads, called before pjsua_init()
+ */
+void loop_config(pjsua_config *cfg, pjsua_media_config *media_cfg) {
+
+  cfg->thread_cnt = 0;
+  media_cfg->has_ioqueue = PJ_FALSE;
+  media_cfg->thread_cnt = 0;
+}
+
+/*
+ * loop_init(seed)
+ * enables the deterministic mode, called after pjsua_init()
+ */
+void loop_init(unsigned seed) {
+
+  loop_on = 1;
+  loop_rng = seed;
+  pj_srand(seed);
+  srand(seed);
+}
+
+/*
+ * loop_active()
+ * returns 1 in deterministic mode
+ */
+int loop_active(void) { return loop_on; }
+
+/*
+ * loop_seed(seed)
+ * returns the configured seed in deterministic mode, otherwise seed
+ */
+unsigned loop_seed(unsigned seed) { return loop_on ? loop_rng : seed; }
+
+/*
+ * loop_sleep(ms)
+ * waits ms milliseconds; drives pjsua in deterministic mode
+ */
+void loop_sleep(unsigned ms) {
+  uint64_t now;
+  uint64_t end;
+
+  if (!loop_on) {
+    pj_thread_sleep(ms);
+    return;
+  }
+
+  now = stats_now_ns() / 1000000;
+  end = now + ms;
+  do {
+    pjsua_handle_events(end - now);
+    now = stats_now_ns() / 1000000;
+  } while (now < end);
+}
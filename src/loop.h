@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    loop.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief loop.c header file (single-threaded deterministic mode)
+ */
+
+#ifndef LOOP_H_INCLUDED
+#define LOOP_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <pjsua-lib/pjsua.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*************************************************************** PROTOTYPES */
+
+void loop_config(pjsua_config *cfg, pjsua_media_config *media_cfg);
+void loop_init(unsigned seed);
+int loop_active(void);
+unsigned loop_seed(unsigned seed);
+void loop_sleep(unsigned ms);
+
+#endif // LOOP_H_INCLUDED
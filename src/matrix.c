@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    matrix.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the test matrix function definitions
+ *
+ *  -r, -u, -c and -t take comma separated lists; every combination of
+ *  target, service URN, country and message file is one cell. Each cell
+ *  is a session of the session table and runs one chat cycle (start 21,
+ *  the lines of its message file or -n generated messages as 22, stop 23)
+ *  driven by the session state machine (fsm.c), all over the one shared
+ *  registration. Cells run at the same time, --sessions limits how many.
+ *  At the end one table lists the result of every cell.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "matrix.h"
+
+/******************************************************************* GLOBALS */
+
+static p_matrix_cell_t matrix_cells = NULL;
+static int matrix_cnt = 0;
+static int matrix_dim[4]; /* targets, URNs, countries, files */
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * matrix_split(list, out, pool)
+ * splits a comma separated list into pool copies; returns number of
+ * entries, one NULL entry for an empty list, -1 if there are too many
+ */
+static int matrix_split(const char *list, char **out, pj_pool_t *pool) {
+  const char *p;
+  size_t n;
+  int cnt;
+
+  if (!list || !*list) {
+    out[0] = NULL;
+    return 1;
+  }
+
+  cnt = 0;
+  for (p = list; *p; p += (p[n] == ',') ? n + 1 : n) {
+    n = strcspn(p, ",");
+    if (n == 0)
+      continue;
+    if (cnt == MATRIX_LIST_MAX)
+      return -1;
+    out[cnt] = (char *)pj_pool_alloc(pool, n + 1);
+    memcpy(out[cnt], p, n);
+    out[cnt][n] = '\0';
+    cnt++;
+  }
+
+  return cnt;
+}
+
+/*
+ * matrix_load(cell, pool)
+ * reads the message file of a cell; a line ending in '*' asks to validate
+ * the reply, as in the single chat
+ */
+static int matrix_load(p_matrix_cell_t cell, pj_pool_t *pool) {
+  char **lines;
+  char **ltmp;
+  int *check;
+  int *ctmp;
+  char *line;
+  size_t size;
+  ssize_t n;
+  FILE *fh;
+  int ret;
+  int cnt;
+  int max;
+
+  if ((fh = fopen(cell->file, "r")) == NULL) {
+    PJ_LOG(2, (THIS_FILE, "Error opening file: %s\n", cell->file));
+    return -1;
+  }
+
+  /* grown on the heap, the cell keeps pool copies */
+  lines = NULL;
+  check = NULL;
+  line = NULL;
+  size = 0;
+  cnt = 0;
+  max = 0;
+  ret = 0;
+  while ((n = getline(&line, &size, fh)) > 0) {
+    while ((n > 0) && ((line[n - 1] == '\n') || (line[n - 1] == '\r')))
+      line[--n] = '\0';
+    if (n < 2)
+      continue;
+    if (cnt == max) {
+      max = max ? max * 2 : 16;
+      ltmp = (char **)realloc(lines, max * sizeof(char *));
+      if (ltmp)
+        lines = ltmp;
+      ctmp = (int *)realloc(check, max * sizeof(int));
+      if (ctmp)
+        check = ctmp;
+      if (!ltmp || !ctmp) {
+        ret = -1;
+        break;
+      }
+    }
+    check[cnt] = (line[n - 1] == '*');
+    if (line[n - 1] == '*')
+      line[--n] = '\0';
+    lines[cnt] = (char *)pj_pool_alloc(pool, n + 1);
+    memcpy(lines[cnt], line, n + 1);
+    cnt++;
+  }
+  free(line);
+  fclose(fh);
+
+  if ((ret == 0) && (cnt > 0)) {
+    cell->lines = (char **)pj_pool_alloc(pool, cnt * sizeof(char *));
+    cell->check = (int *)pj_pool_alloc(pool, cnt * sizeof(int));
+    memcpy(cell->lines, lines, cnt * sizeof(char *));
+    memcpy(cell->check, check, cnt * sizeof(int));
+    cell->nlines = cnt;
+  }
+  free(lines);
+  free(check);
+  if (ret != 0)
+    PJ_LOG(2, (THIS_FILE, "malloc failed reading %s\n", cell->file));
+
+  return ret;
+}
+
+/*
+ * matrix_create(uris, urns, countries, files, pool)
+ * builds the cells of all combinations; returns number of cells, -1 on
+ * error
+ */
+int matrix_create(const char *uris, const char *urns, const char *countries,
+                  const char *files, pj_pool_t *pool) {
+  char *uri[MATRIX_LIST_MAX];
+  char *urn[MATRIX_LIST_MAX];
+  char *cty[MATRIX_LIST_MAX];
+  char *fil[MATRIX_LIST_MAX];
+  p_matrix_cell_t cell;
+  int a, b, c, d;
+  int i;
+
+  matrix_dim[0] = matrix_split(uris, uri, pool);
+  matrix_dim[1] = matrix_split(urns, urn, pool);
+  matrix_dim[2] = matrix_split(countries, cty, pool);
+  matrix_dim[3] = matrix_split(files, fil, pool);
+  for (i = 0; i < 4; i++) {
+    if (matrix_dim[i] < 1) {
+      PJ_LOG(2, (THIS_FILE, "more than %i list entries\n", MATRIX_LIST_MAX));
+      return -1;
+    }
+  }
+  for (a = 0; a < matrix_dim[0]; a++) {
+    if (!uri[a] || (pjsua_verify_url(uri[a]) != PJ_SUCCESS)) {
+      PJ_LOG(2, (THIS_FILE, "invalid URL %s\n", uri[a] ? uri[a] : ""));
+      return -1;
+    }
+  }
+
+  matrix_cnt = matrix_dim[0] * matrix_dim[1] * matrix_dim[2] * matrix_dim[3];
+  matrix_cells = (p_matrix_cell_t)pj_pool_zalloc(
+      pool, matrix_cnt * sizeof(s_matrix_cell_t));
+  if (!matrix_cells)
+    return -1;
+
+  /* target major, the message files vary fastest */
+  cell = matrix_cells;
+  for (a = 0; a < matrix_dim[0]; a++)
+    for (b = 0; b < matrix_dim[1]; b++)
+      for (c = 0; c < matrix_dim[2]; c++)
+        for (d = 0; d < matrix_dim[3]; d++, cell++) {
+          cell->uri = pj_str(uri[a]);
+          cell->urn = pj_str(urn[b] ? urn[b] : "");
+          cell->country = cty[c] ? cty[c] : "AT";
+          cell->file = fil[d];
+          /* cells of one file share its lines */
+          if (cell->file && (a + b + c > 0)) {
+            cell->lines = matrix_cells[d].lines;
+            cell->check = matrix_cells[d].check;
+            cell->nlines = matrix_cells[d].nlines;
+          } else if (cell->file && (matrix_load(cell, pool) != 0)) {
+            return -1;
+          }
+        }
+
+  return matrix_cnt;
+}
+
+/*
+ * matrix_result(cell, sess)
+ * returns the verdict of a finished cell
+ */
+static const char *matrix_result(p_matrix_cell_t cell, p_session_t sess) {
+
+  if (sess->fail > 0)
+    return "failed";
+  if (sess->err > 0)
+    return "rejected";
+  if (!sess->reply)
+    return "no-reply";
+  if (sess->timeout > 0)
+    return "timeout";
+  /* every chat message needs its reply, a checked line its validation */
+  if ((sess->rx < cell->expect) || sess->val)
+    return "missing";
+  if (cell->mismatch > 0)
+    return "mismatch";
+
+  return "pass";
+}
+
+/*
+ * matrix_print(fh, elapsed_ms)
+ * prints one line per cell and the number of cells passed
+ */
+static int matrix_print(FILE *fh, uint64_t elapsed_ms) {
+  p_matrix_cell_t cell;
+  p_session_t sess;
+  const char *res;
+  int pass;
+  int i;
+
+  fprintf(fh, "\n%5s %-8s %5s %5s %5s %5s %5s %5s %9s %9s  %s\n", "cell",
+          "result", "sent", "recv", "fail", "rej", "tmo", "val", "p50 ms",
+          "p99 ms", "target urn country file");
+
+  pass = 0;
+  for (i = 0; i < matrix_cnt; i++) {
+    cell = &matrix_cells[i];
+    sess = session_get(i);
+    res = matrix_result(cell, sess);
+    if (!strcmp(res, "pass"))
+      pass++;
+    fprintf(fh,
+            "%5i %-8s %5lu %5lu %5lu %5lu %5lu %5lu %9.3f %9.3f  %.*s %.*s "
+            "%s %s\n",
+            i, res, (unsigned long)sess->tx, (unsigned long)sess->rx,
+            (unsigned long)sess->fail, (unsigned long)sess->err,
+            (unsigned long)sess->timeout, (unsigned long)cell->mismatch,
+            hist_quantile(&cell->rtt, 0.50) / 1000.0,
+            hist_quantile(&cell->rtt, 0.99) / 1000.0, (int)cell->uri.slen,
+            cell->uri.ptr, (int)(cell->urn.slen ? cell->urn.slen : 1),
+            cell->urn.slen ? cell->urn.ptr : "-", cell->country,
+            cell->file ? cell->file : "-");
+  }
+
+  fprintf(fh, "\n##### matrix: %i of %i cells passed in %.1f s #####\n",
+          pass, matrix_cnt, elapsed_ms / 1000.0);
+
+  return pass;
+}
+
+/*
+ * matrix_run(*acc_id, cfg)
+ * runs all cells of the matrix, returns number of cells failed
+ */
+int matrix_run(pjsua_acc_id *acc_id, p_matrix_cfg_t cfg) {
+  p_matrix_cell_t cell;
+  s_fsm_cfg_t fcfg;
+  uint64_t start;
+  int next;
+  int i;
+
+  if ((matrix_cnt < 1) || (session_count() != matrix_cnt))
+    return -1;
+
+  for (i = 0; i < matrix_cnt; i++)
+    session_get(i)->cell = &matrix_cells[i];
+
+  /* every cell is started once by hand */
+  memset(&fcfg, 0, sizeof(fcfg));
+  fcfg.acc_id = *acc_id;
+  fcfg.uri = matrix_cells[0].uri;
+  fcfg.urn = matrix_cells[0].urn;
+  fcfg.msgs = cfg->msgs;
+  fcfg.interval_ms = cfg->interval_ms;
+  fcfg.cycles = 1;
+  fcfg.manual = 1;
+  if (fsm_start(&fcfg) != 0)
+    return -1;
+
+  printf("\n##### matrix: %i targets x %i urns x %i countries x %i files = "
+         "%i cells, %i at a time #####\n\n",
+         matrix_dim[0], matrix_dim[1], matrix_dim[2], matrix_dim[3],
+         matrix_cnt, (cfg->parallel > 0) ? cfg->parallel : matrix_cnt);
+
+  start = stats_now_ns() / 1000000;
+  next = 0;
+  for (;;) {
+    /* not yet launched cells count as done */
+    while ((next < matrix_cnt) &&
+           ((cfg->parallel < 1) ||
+            (matrix_cnt - fsm_done() < cfg->parallel))) {
+      cell = &matrix_cells[next];
+      cell->expect = 1 + (cell->file ? cell->nlines : cfg->msgs);
+      fsm_launch(session_get(next), cell->file ? cell->nlines : cfg->msgs,
+                 cfg->interval_ms);
+      next++;
+    }
+    if ((next == matrix_cnt) && (fsm_done() == matrix_cnt))
+      break;
+
+    loop_sleep(FSM_REPORT_MS);
+    printf("matrix t=%lus started=%i running=%i sent=%lu received=%lu\n",
+           (unsigned long)(stats_now_ns() / 1000000 - start) / 1000, next,
+           matrix_cnt - fsm_done(), (unsigned long)STAT_GET(stats.tx),
+           (unsigned long)STAT_GET(stats.rx));
+    fflush(stdout);
+  }
+  fsm_stop();
+
+  i = matrix_cnt - matrix_print(stdout, stats_now_ns() / 1000000 - start);
+  stats_print(stdout, &stats);
+
+  if (i > 0)
+    conf->ret = conf->ret | ERR_MSG;
+
+  return i;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    matrix.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief matrix.c header file (parallel test matrix)
+ */
+
+#ifndef MATRIX_H_INCLUDED
+#define MATRIX_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include "fsm.h"
+#include "functions.h"
+
+/******************************************************************** DEFINE */
+
+#define MATRIX_LIST_MAX 32 /* entries per list */
+
+/******************************************************************* TYPEDEF */
+
+/* one combination of target, service URN, country and message file */
+typedef struct matrix_cell {
+  pj_str_t uri;
+  pj_str_t urn;      /* empty without -u */
+  char *country;     /* vCard country */
+  char *file;        /* message file, NULL for generated texts */
+  char **lines;      /* texts of the message file */
+  int *check;        /* validate the reply to line i ('*') */
+  int nlines;        /* lines of the message file */
+  uint64_t expect;   /* replies needed to pass: start and chat messages */
+  uint64_t mismatch; /* replies failing validation */
+  s_hist_t rtt;      /* request sent -> reply MESSAGE received */
+} s_matrix_cell_t, *p_matrix_cell_t;
+
+typedef struct matrix_cfg {
+  unsigned msgs;        /* chat messages without a message file */
+  unsigned interval_ms; /* gap between chat messages */
+  int parallel;         /* cells running at once, 0 for all */
+} s_matrix_cfg_t, *p_matrix_cfg_t;
+
+/*************************************************************** PROTOTYPES */
+
+int matrix_create(const char *uris, const char *urns, const char *countries,
+                  const char *files, pj_pool_t *pool);
+int matrix_run(pjsua_acc_id *acc_id, p_matrix_cfg_t cfg);
+
+#endif // MATRIX_H_INCLUDED
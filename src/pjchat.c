@@ -30,116 +30,370 @@
 
 /******************************************************************* INCLUDE */
 
+#include "calls.h"
+#include "client.h"
+#include "corpus.h"
+#include "dist.h"
+#include "fsm.h"
 #include "functions.h"
+#include "shard.h"
+#include "trace.h"
+
+/********************************************************************* CONST */
+
+enum {
+  OPT_TRACE = 0x100,
+  OPT_TRACE_SIZE,
+  OPT_EXPORT,
+  OPT_FORMAT,
+  OPT_OUTPUT,
+  OPT_REPLAY,
+  OPT_SESSIONS,
+  OPT_SPEED,
+  OPT_SOAK,
+  OPT_SOAK_SAMPLE,
+  OPT_SOAK_LIMIT,
+  OPT_COORDINATOR,
+  OPT_AGENTS,
+  OPT_AGENT,
+  OPT_LEAD,
+  OPT_PROCS,
+  OPT_THREADS,
+  OPT_PROFILE,
+  OPT_SIZE,
+  OPT_UTF8,
+  OPT_SWEEP,
+  OPT_CORPUS,
+  OPT_TLS_BENCH,
+  OPT_BACKOFF,
+  OPT_RECOVER,
+  OPT_CONTROL,
+  OPT_STREAM,
+  OPT_INFLIGHT,
+  OPT_STAGES,
+  OPT_DETERMINISTIC,
+  OPT_BY_REFERENCE,
+  OPT_CAPACITY,
+  OPT_CAPACITY_WINDOW,
+  OPT_IMPAIR,
+  OPT_IMPAIR_PORT,
+  OPT_MATRIX,
+  OPT_CALLS,
+  OPT_CALLS_DURATION,
+  OPT_HOLD,
+  OPT_DASHBOARD,
+  OPT_BACKPRESSURE,
+};
+
+static const struct option long_opts[] = {
+    {"trace", required_argument, NULL, OPT_TRACE},
+    {"trace-size", required_argument, NULL, OPT_TRACE_SIZE},
+    {"export", required_argument, NULL, OPT_EXPORT},
+    {"format", required_argument, NULL, OPT_FORMAT},
+    {"output", required_argument, NULL, OPT_OUTPUT},
+    {"replay", required_argument, NULL, OPT_REPLAY},
+    {"sessions", required_argument, NULL, OPT_SESSIONS},
+    {"speed", required_argument, NULL, OPT_SPEED},
+    {"soak", required_argument, NULL, OPT_SOAK},
+    {"soak-sample", required_argument, NULL, OPT_SOAK_SAMPLE},
+    {"soak-limit", required_argument, NULL, OPT_SOAK_LIMIT},
+    {"coordinator", required_argument, NULL, OPT_COORDINATOR},
+    {"agents", required_argument, NULL, OPT_AGENTS},
+    {"agent", required_argument, NULL, OPT_AGENT},
+    {"lead", required_argument, NULL, OPT_LEAD},
+    {"procs", required_argument, NULL, OPT_PROCS},
+    {"threads", required_argument, NULL, OPT_THREADS},
+    {"profile", no_argument, NULL, OPT_PROFILE},
+    {"size", required_argument, NULL, OPT_SIZE},
+    {"utf8", no_argument, NULL, OPT_UTF8},
+    {"sweep", required_argument, NULL, OPT_SWEEP},
+    {"corpus", required_argument, NULL, OPT_CORPUS},
+    {"tls-bench", required_argument, NULL, OPT_TLS_BENCH},
+    {"backoff", required_argument, NULL, OPT_BACKOFF},
+    {"recover", required_argument, NULL, OPT_RECOVER},
+    {"control", required_argument, NULL, OPT_CONTROL},
+    {"stream", required_argument, NULL, OPT_STREAM},
+    {"inflight", required_argument, NULL, OPT_INFLIGHT},
+    {"stages", no_argument, NULL, OPT_STAGES},
+    {"deterministic", required_argument, NULL, OPT_DETERMINISTIC},
+    {"by-reference", required_argument, NULL, OPT_BY_REFERENCE},
+    {"capacity", required_argument, NULL, OPT_CAPACITY},
+    {"capacity-window", required_argument, NULL, OPT_CAPACITY_WINDOW},
+    {"impair", required_argument, NULL, OPT_IMPAIR},
+    {"impair-port", required_argument, NULL, OPT_IMPAIR_PORT},
+    {"matrix", no_argument, NULL, OPT_MATRIX},
+    {"calls", required_argument, NULL, OPT_CALLS},
+    {"calls-duration", required_argument, NULL, OPT_CALLS_DURATION},
+    {"hold", required_argument, NULL, OPT_HOLD},
+    {"dashboard", no_argument, NULL, OPT_DASHBOARD},
+    {"backpressure", required_argument, NULL, OPT_BACKPRESSURE},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}};
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * usage()
+ * prints command line help
+ */
+static void usage(void) {
+  printf("%s -r <sip-uri> [-u <service-urn>] [-f <yaml-cfg>] "
+         "[-t <msg file>] [-n <number> -i <intervall>] "
+         "[-a] ... auto message [-s] ... tls [-x] ...test header\n"
+         "\t[--trace <file> [--trace-size <MB>]] ... binary SIP trace\n"
+         "\t[--replay <file> [--sessions <n>] [--speed <x>]] ... replay "
+         "(speed 0 = max)\n"
+         "\t[--soak <minutes> [--soak-sample <s>] [--soak-limit <KB/h>]] "
+         "... memory soak test\n"
+         "\t[--sessions <n> [-n <number> -i <intervall>]] ... concurrent "
+         "chats\n"
+         "\t[--profile [--sessions <n>]] ... load profile of the config "
+         "file\n"
+         "\t[--size <dist> [--utf8]] ... generated chat messages\n"
+         "\t[--sweep <min>:<max>[:<factor>]] ... body size sweep\n"
+         "\t[--capacity <p99 ms>[:<timeout %%>[:<error %%>]] "
+         "[--capacity-window <s>]] ... capacity search\n"
+         "\t[--agent <host:port>] ... run as agent of a coordinator\n"
+         "\t[--procs <n>] ... shard sessions over n worker processes\n"
+         "\t[--threads <n>] ... pjsua worker threads\n"
+         "\t[--backoff <min ms>:<max ms>] [--recover <s>] ... "
+         "re-registration\n"
+         "\t[--control <socket>] ... runtime control socket\n"
+         "\t[--stream <file|-> [--sessions <n>] [--inflight <n>]] ... "
+         "messages from a pipe\n"
+         "\t[--stages] ... time per pipeline stage\n"
+         "\t[--deterministic <seed>] ... single-threaded, seeded event "
+         "loop\n"
+         "\t[--by-reference <http://host:port>] ... location and vCard "
+         "served over HTTP\n"
+         "\t[--impair <profile> [--impair-port <port>]] ... impaired "
+         "network via a local relay\n"
+         "\t[--matrix [--sessions <n>]] ... all combinations of comma "
+         "separated -r, -u, -c\n"
+         "\t\tand -t lists at once\n"
+         "\t[--calls <calls/s> [--calls-duration <s>] [--hold <dist>] "
+         "[--sessions <n>]] ...\n"
+         "\t\tINVITE call-setup rate, null media\n"
+         "\t[--dashboard] ... live terminal dashboard\n"
+         "\t[--backpressure queue|shed|off] ... on 486/503 and Retry-After "
+         "(default queue)\n"
+         "%s --coordinator <port> --agents <n> --sessions <n> [--lead <s>]\n"
+         "%s --export <trace> [--format text|pcap|replay] [--output <file>]\n"
+         "%s --corpus <file> --size <dist> [--utf8] [-n <number>] "
+         "[-i <intervall>]\n"
+         "%s --tls-bench <n> [-f <yaml-cfg>] ... TLS handshake benchmark\n",
+         THIS_FILE, THIS_FILE, THIS_FILE, THIS_FILE, THIS_FILE);
+}
 
 /********************************************************************** MAIN */
 
 int main(int argc, char *argv[]) {
-  pjsua_acc_id acc_id;
-  pj_status_t status;
-  pjsua_transport_config tcfg;
-  pjsua_transport_id transport_id = -1;
-  pjsua_logging_config log_cfg;
-  pjsua_acc_config acc_cfg;
-  pjsua_config cfg;
-  pj_str_t uri;
-  pj_str_t text;
-  pj_str_t urn;
-  pj_pool_t *pool;
+  s_client_run_t run;
 
-  int i;
-  int len;
   int opt;
   int ret;
-  int aflg;
-  int sflg;
-  int mflg;
-  int tflg;
-  int xflg;
-  int cnt;
-  int arg_mi;
-  int arg_mn;
-  int nRet;
-
-  char *txt;
-  char *rnd;
-  char *res;
-  char *api;
-  char *arg_uri;
-  char *arg_urn;
-  char *arg_cfg;
-  char *arg_cnt;
-  char *arg_txt;
-  char *buffer;
-  char **gptr = malloc(sizeof(char *));
-  char tmp[BUFFER_512 + 1];
-  char tmptime[BUFFER_128 + 1];
-
-  size_t bufsize = 32;
-  size_t characters;
-  size_t *t = malloc(0);
-
-  time_t ltime;
-  struct tm *info;
+  int arg_fmt;
+  int arg_crd;
+  int arg_agn;
+  int arg_lead;
+  int utfflg;
+
+  char *arg_exp;
+  char *arg_out;
+  char *arg_siz;
+  char *arg_crp;
+  char trcname[BUFFER_512 + 1];
+  char ctlname[BUFFER_512 + 1];
 
   FILE *fd;
 
-  *gptr = NULL;
-  ret = 0;
-  aflg = 0;
-  sflg = 0;
-  mflg = 0;
-  tflg = 0;
-  xflg = 0;
-  arg_mi = 0;
-  arg_mn = 0;
-
-  arg_uri = NULL;
-  arg_urn = NULL;
-  arg_cfg = NULL;
-  arg_cnt = NULL;
-  arg_txt = NULL;
-
-  while ((opt = getopt(argc, argv, "asxhc:r:u:f:n:i:t:")) != -1) {
+  utfflg = 0;
+  arg_exp = NULL;
+  arg_out = NULL;
+  arg_siz = NULL;
+  arg_crp = NULL;
+  arg_fmt = TRACE_FMT_TEXT;
+  arg_crd = 0;
+  arg_agn = 0;
+  arg_lead = DIST_LEAD_S;
+  client_run_default(&run);
+
+  while ((opt = getopt_long(argc, argv, "asxhc:r:u:f:n:i:t:", long_opts,
+                            NULL)) != -1) {
     switch (opt) {
     case 'r':
-      arg_uri = optarg;
+      run.uri = optarg;
       break;
     case 'u':
-      arg_urn = optarg;
+      run.urn = optarg;
       break;
     case 'f':
-      arg_cfg = optarg;
+      run.cfg = optarg;
       break;
     case 'n':
-      arg_mn = atoi(optarg);
+      run.msgs = atoi(optarg);
       break;
     case 'i':
-      arg_mi = atoi(optarg);
+      run.interval_s = atoi(optarg);
       break;
     case 'a':
-      aflg = 1;
+      run.automsg = 1;
       break;
     case 's':
-      sflg = 1;
+      run.tls = 1;
       break;
     case 'x':
-      xflg = 1;
+      run.xhdr = 1;
       break;
     case 't':
-      arg_txt = optarg;
-      tflg = 1;
+      run.txt = optarg;
       break;
     case 'h':
-      printf("%s -r <sip-uri> [-u <service-urn>] [-f <yaml-cfg>] "
-             "[-t <msg file>] [-n <number> -i <intervall>] "
-             "[-a] ... auto message [-s] ... tls [-x] ...test header\n",
-             THIS_FILE);
+      usage();
       return 0;
       break;
     case 'c':
-      arg_cnt = optarg;
-      mflg = 1;
+      run.country = optarg;
+      break;
+    case OPT_TRACE:
+      run.trace = optarg;
+      break;
+    case OPT_TRACE_SIZE:
+      run.trace_mb = atoi(optarg);
+      break;
+    case OPT_EXPORT:
+      arg_exp = optarg;
+      break;
+    case OPT_FORMAT:
+      if (!strcmp(optarg, "pcap"))
+        arg_fmt = TRACE_FMT_PCAP;
+      else if (!strcmp(optarg, "replay"))
+        arg_fmt = TRACE_FMT_REPLAY;
+      else
+        arg_fmt = TRACE_FMT_TEXT;
+      break;
+    case OPT_OUTPUT:
+      arg_out = optarg;
+      break;
+    case OPT_REPLAY:
+      run.replay = optarg;
+      break;
+    case OPT_SESSIONS:
+      run.sessions = atoi(optarg);
+      run.sessions_set = 1;
+      break;
+    case OPT_SPEED:
+      run.speed = atof(optarg);
+      break;
+    case OPT_SOAK:
+      run.soak.duration_s = atoi(optarg) * 60;
+      break;
+    case OPT_SOAK_SAMPLE:
+      run.soak.sample_s = atoi(optarg);
+      break;
+    case OPT_SOAK_LIMIT:
+      run.soak.limit_kb_h = atoi(optarg);
+      break;
+    case OPT_COORDINATOR:
+      arg_crd = atoi(optarg);
+      break;
+    case OPT_AGENTS:
+      arg_agn = atoi(optarg);
+      break;
+    case OPT_AGENT:
+      run.agent = optarg;
+      break;
+    case OPT_LEAD:
+      arg_lead = atoi(optarg);
+      break;
+    case OPT_PROCS:
+      run.procs = atoi(optarg);
+      break;
+    case OPT_THREADS:
+      run.threads = atoi(optarg);
+      break;
+    case OPT_PROFILE:
+      run.profile = 1;
+      break;
+    case OPT_SIZE:
+      arg_siz = optarg;
+      break;
+    case OPT_UTF8:
+      utfflg = 1;
+      break;
+    case OPT_SWEEP:
+      run.sweep = optarg;
+      break;
+    case OPT_CORPUS:
+      arg_crp = optarg;
+      break;
+    case OPT_TLS_BENCH:
+      run.tls_bench = atoi(optarg);
+      break;
+    case OPT_BACKOFF:
+      if (sscanf(optarg, "%u:%u", &run.reg.min_ms, &run.reg.max_ms) < 1) {
+        usage();
+        return 0;
+      }
+      break;
+    case OPT_RECOVER:
+      run.reg.recover_s = atoi(optarg);
+      break;
+    case OPT_CONTROL:
+      run.control = optarg;
+      break;
+    case OPT_STREAM:
+      run.stream = optarg;
+      break;
+    case OPT_INFLIGHT:
+      run.inflight = atoi(optarg);
+      break;
+    case OPT_STAGES:
+      stats_stages = 1;
+      break;
+    case OPT_DETERMINISTIC:
+      run.seed = strtoul(optarg, NULL, 0);
+      run.deterministic = 1;
+      break;
+    case OPT_BY_REFERENCE:
+      run.reference = optarg;
+      break;
+    case OPT_CAPACITY:
+      sscanf(optarg, "%lf:%lf:%lf", &run.cap.p99_ms, &run.cap.timeout_pct,
+             &run.cap.error_pct);
+      break;
+    case OPT_CAPACITY_WINDOW:
+      run.cap.window_s = atoi(optarg);
+      break;
+    case OPT_IMPAIR:
+      run.impair = optarg;
+      break;
+    case OPT_IMPAIR_PORT:
+      run.impair_port = atoi(optarg);
+      break;
+    case OPT_MATRIX:
+      run.matrix = 1;
+      break;
+    case OPT_CALLS:
+      run.calls.cps = atof(optarg);
+      break;
+    case OPT_CALLS_DURATION:
+      run.calls.duration_s = atoi(optarg);
+      break;
+    case OPT_HOLD:
+      if (calls_hold_parse(&run.calls, optarg) != 0) {
+        usage();
+        return 0;
+      }
+      break;
+    case OPT_DASHBOARD:
+      run.dashboard = 1;
+      break;
+    case OPT_BACKPRESSURE:
+      if (flow_policy(optarg) != 0) {
+        usage();
+        return 0;
+      }
       break;
     case '?':
       return 0;
@@ -147,372 +401,113 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  if (arg_uri == NULL) {
-    printf("%s -r <sip-uri> [-u <service-urn>] [-f <yaml-cfg>] "
-           "[-t <msg file>] [-n <number> -i <intervall>] "
-           "[-a] ... auto message [-s] ... tls [-x] ...test header\n",
-           THIS_FILE);
+  /* offline trace conversion, no SIP stack required */
+  if (arg_exp) {
+    ret = trace_export(arg_exp, arg_out, arg_fmt);
+    if (ret < 0)
+      return EXIT_FAILURE;
+    fprintf(stderr, "%i records exported\n", ret);
     return 0;
   }
 
-  if (((arg_mn == 0) && (arg_mi > 0)) || ((arg_mi == 0) && (arg_mn > 0))) {
-    printf("%s -r <sip-uri> [-u <service-urn>] [-f <yaml-cfg>] "
-           "[-t <msg file>] [-n <number> -i <intervall>] "
-           "[-a] ... auto message [-s] ... tls [-x] ...test header\n",
-           THIS_FILE);
+  if (arg_siz && (corpus_parse(arg_siz, utfflg) != 0)) {
+    usage();
     return 0;
   }
 
-  if (tflg == 1) {
-    if ((fd = fopen(arg_txt, "r")) == NULL) {
-      printf("Error opening file: %s\n", arg_txt);
+  /* offline corpus generation */
+  if (arg_crp) {
+    if (!arg_siz) {
+      usage();
       return 0;
     }
+    ret = corpus_write(arg_crp, (run.msgs > 0) ? run.msgs : FSM_MSGS,
+                       (run.interval_s > 0) ? run.interval_s * 1000
+                                            : FSM_INTERVAL_MS);
+    if (ret < 0)
+      return EXIT_FAILURE;
+    fprintf(stderr, "%i messages written\n", ret);
+    return 0;
   }
 
-  /* create pjsua first! */
-  status = pjsua_create();
-  if (status != PJ_SUCCESS)
-    error_exit("error in pjsua_create()", status);
-  /* create pjsua pool */
-  pool = pjsua_pool_create("psip", BACKEND_POOL_INITIAL_SIZE,
-                           BACKEND_POOL_INCREMENT);
-  if (!pool)
-    error_exit("error in pjsua_create()", -1);
-
-  if (arg_cfg) {
-    conf = readConf(arg_cfg, pool);
-    PJ_LOG(3, (THIS_FILE, "reading config from %s\n", arg_cfg));
-  } else {
-    conf = readConf(CFG_FILE, pool);
-    PJ_LOG(3, (THIS_FILE, "reading config from %s\n", arg_cfg));
+  /* coordinator only distributes, no SIP stack required */
+  if (arg_crd > 0) {
+    return dist_coordinator_run(arg_crd, arg_agn, run.sessions, arg_lead);
   }
-  conf->xhd = xflg;
-  conf->reply = NULL;
-  conf->ret = ERR_NON;
 
-  /* if argument is specified, it's got to be a valid SIP URL */
-  if (arg_uri) {
-    status = pjsua_verify_url(arg_uri);
-    if (status != PJ_SUCCESS)
-      error_exit("invalid URL in argv", status);
+  /* agents run one of the session based modes */
+  if (run.agent && !run.replay && (run.soak.duration_s == 0) &&
+      !run.sessions_set && !run.profile && !run.sweep) {
+    usage();
+    return 0;
   }
 
-  if (arg_cnt) {
-    conf->country = arg_cnt;
-  } else {
-    conf->country = "AT";
+  if ((run.uri == NULL) && (run.tls_bench == 0)) {
+    usage();
+    return 0;
   }
 
-  /* init pjsua */
-  pjsua_config_default(&cfg);
-  cfg.cb.on_incoming_call = &on_incoming_call;
-  cfg.cb.on_call_media_state = &on_call_media_state;
-  cfg.cb.on_call_state = &on_call_state;
-  cfg.cb.on_pager2 = &on_pager2;
-  cfg.cb.on_reg_state = &on_reg;
-
-  pjsua_logging_config_default(&log_cfg);
-  log_cfg.console_level = conf->dbg;
-
-  status = pjsua_init(&cfg, &log_cfg, NULL);
-  if (status != PJ_SUCCESS)
-    error_exit("error in pjsua_init()", status);
-
-  pjsua_transport_config_default(&tcfg);
-
-  if (sflg == 1) {
-    /* add TLS transport. */
-    tcfg.port = SIP_PORT + 1;
-    status = pjsua_transport_create(PJSIP_TRANSPORT_TLS, &tcfg, &transport_id);
-    if (status != PJ_SUCCESS)
-      error_exit("error creating transport", status);
-  } else {
-    /* add TCP transport. */
-    // tcfg.port = SIP_PORT;
-    status = pjsua_transport_create(PJSIP_TRANSPORT_TCP, &tcfg, &transport_id);
-    if (status != PJ_SUCCESS)
-      error_exit("error creating transport", status);
+  /* the interactive chat blocks on stdin, nothing would drive pjsua, and
+   * the dashboard would hide its prompt */
+  if ((run.deterministic || run.dashboard) && !run.automsg && !run.txt &&
+      !run.replay && !run.stream && (run.soak.duration_s == 0) &&
+      !run.sessions_set && !run.profile && !run.sweep && !run.matrix &&
+      (run.calls.cps <= 0)) {
+    usage();
+    return 0;
   }
 
-  /* initialization is done, now start pjsua */
-  status = pjsua_start();
-  if (status != PJ_SUCCESS)
-    error_exit("error starting pjsua", status);
-
-  /* create unique call id */
-  rnd = (char *)malloc((36 + 1) * sizeof(char));
-  if (rnd == NULL)
-    error_exit("malloc failed", -1);
-  rand_str(rnd, 36);
-  snprintf(
-      tmp, BUFFER_512,
-      "<urn:dec112:uid:callid:%s:service.dec112.at>;purpose=" DEC112_CALLID,
-      rnd);
-  conf->cid = (char *)pj_pool_alloc(pool, strlen(tmp) * sizeof(char) + 1);
-  if (conf->cid == NULL)
-    error_exit("malloc failed", -1);
-  memset(conf->cid, 0, strlen(tmp) + 1);
-  memcpy(conf->cid, tmp, strlen(tmp));
-  free(rnd);
-
-  PJ_LOG(3, (THIS_FILE, DEC112_CALLID " \n%s", conf->cid));
-
-  /* create unique device id N*/
-  snprintf(
-      tmp, BUFFER_512,
-      "<urn:dec112:uid:deviceid:%s:service.dec112.at>;purpose=" DEC112_DEVID,
-      conf->device);
-  conf->did = (char *)pj_pool_alloc(pool, strlen(tmp) * sizeof(char) + 1);
-  if (conf->did == NULL)
-    error_exit("malloc failed", -1);
-  memset(conf->did, 0, strlen(tmp) + 1);
-  memcpy(conf->did, tmp, strlen(tmp));
-
-  PJ_LOG(3, (THIS_FILE, DEC112_DEVID " \n%s", conf->did));
-
-  /* create sip uri */
-  len = strlen("sip:") + strlen(conf->user) + strlen("@") +
-        strlen(conf->domain) + 1;
-  conf->uri = (char *)pj_pool_alloc(pool, len * sizeof(char));
-  if (conf->uri == NULL)
-    error_exit("malloc failed", -1);
-  snprintf(conf->uri, len, "sip:%s@%s", conf->user, conf->domain);
-
-  PJ_LOG(3, (THIS_FILE, "dec112 SIP URI \n%s", conf->uri));
-
-  /* create id derference url */
-  api = url_encode(conf->api);
-  res = replace_str(conf->ref, "${device_id}", conf->device);
-  res = replace_str(res, "${api_key}", api);
-  snprintf(tmp, BUFFER_512, "<%s>;purpose=" DEC112_SUBINF, res);
-  conf->url = (char *)pj_pool_alloc(pool, strlen(tmp) + 1);
-  if (conf->url == NULL)
-    error_exit("malloc failed", -1);
-  memset(conf->url, 0, strlen(tmp) + 1);
-  memcpy(conf->url, tmp, strlen(tmp));
-  free(res);
-  free(api);
-
-  PJ_LOG(3, (THIS_FILE, "dec112-SubscriberInfo \n%s", conf->url));
-
-  /* register to SIP server by creating SIP account. */
-  pjsua_acc_config_default(&acc_cfg);
-  acc_cfg.id = pj_str(conf->uri);
-  acc_cfg.proxy_cnt = 1;
-  acc_cfg.proxy[0] = pj_str(conf->proxy);
-  acc_cfg.reg_uri = pj_str(conf->proxy);
-  acc_cfg.cred_count = 1;
-  acc_cfg.cred_info[0].realm = pj_str(conf->domain);
-  acc_cfg.cred_info[0].scheme = pj_str("digest");
-  acc_cfg.cred_info[0].username = pj_str(conf->user);
-  acc_cfg.cred_info[0].data_type = PJSIP_CRED_DATA_PLAIN_PASSWD;
-  acc_cfg.cred_info[0].data = pj_str(conf->passwd);
-
-  status = pjsua_acc_add(&acc_cfg, PJ_TRUE, &acc_id);
-  if (status != PJ_SUCCESS)
-    error_exit("error adding account", status);
-
-  /* if URL is specified, send first message */
-  txt = NULL;
-  if (arg_uri) {
-    uri = pj_str(arg_uri);
-    if (mflg == 0) {
-      text = pj_str((char *)"Ping");
-    } else {
-      // 02/24/2020, 10:26:01 PM
-      time(&ltime);
-      info = localtime(&ltime);
-      strftime(tmptime, BUFFER_128, "%m/%d/%Y, %I:%M:%S %p", info);
-      snprintf(tmp, BUFFER_512, START_MESSAGE,
-               conf->surname ? conf->surname : USER_SURNAME,
-               conf->given ? conf->given : USER_GIVEN,
-               conf->phone ? conf->phone : USER_PHONE, tmptime, conf->lat,
-               conf->lon);
-      txt = (char *)pj_pool_alloc(pool, strlen(tmp) * sizeof(char) + 1);
-      if (txt == NULL)
-        error_exit("malloc failed", -1);
-      memset(txt, 0, strlen(tmp) + 1);
-      memcpy(txt, tmp, strlen(tmp));
-      text.ptr = txt;
-      text.slen = strlen(txt);
-    }
-
-    /* if urn is specified, use urn */
-    if (arg_urn) {
-      urn = pj_str(arg_urn);
-    } else {
-      urn.ptr = NULL;
-      urn.slen = 0;
-    }
-    /* wait for registration or timeout*/
-    cnt = 0;
-    while ((cnt < TIMEOUT_CNT) && (conf->reg == 0)) {
-      pj_thread_sleep(TIMEOUT_MS);
-      cnt++;
-    }
-
-    if (cnt == TIMEOUT_CNT) {
-      PJ_LOG(2, (THIS_FILE, "timeout on registration request\n"));
-    }
+  /* control socket, HTTP server, dashboard and impairment relay run their
+   * own threads and call into pjsua, the single event loop would not be
+   * single anymore */
+  if (run.deterministic &&
+      (run.control || run.reference || run.dashboard || run.impair)) {
+    usage();
+    return 0;
+  }
 
-    if (conf->reg == 0) {
-      conf->ret = conf->ret | ERR_REG;
+  if (((run.msgs == 0) && (run.interval_s > 0)) ||
+      ((run.interval_s == 0) && (run.msgs > 0))) {
+    usage();
+    return 0;
+  }
 
-      PJ_LOG(2, (THIS_FILE, "Registration failed.\n"));
+  /* in matrix mode -t is a list, matrix_create() opens the files */
+  if (run.txt && !run.matrix) {
+    if ((fd = fopen(run.txt, "r")) == NULL) {
+      printf("Error opening file: %s\n", run.txt);
+      return 0;
     }
+    fclose(fd);
   }
 
-  if (conf->reg == 1) {
-    /* send first message */
-    if (tflg == 0) {
-      conf->val = 1;
-    }
-    conf->req = 0;
-    status = send_dec112_msg(&acc_id, &text, &uri, &urn, 21, pool);
-    /* wait for first response message or timeout */
-    cnt = 0;
-    while ((cnt < TIMEOUT_CNT) && (!conf->reply)) {
-      pj_thread_sleep(TIMEOUT_MS);
-      cnt++;
+  if (run.procs > 1) {
+    /* sharding needs one of the session based modes */
+    if (!run.replay && (run.soak.duration_s == 0) && !run.sessions_set &&
+        !run.profile && !run.sweep) {
+      usage();
+      return 0;
     }
-
-    if (cnt == TIMEOUT_CNT) {
-      PJ_LOG(2, (THIS_FILE, "timeout on first request message\n"));
+    /* fork before pjsua exists, every worker gets its own stack */
+    ret = shard_spawn(run.procs, run.sessions, &run.shard);
+    if (ret < 0)
+      return EXIT_FAILURE;
+    if (ret == 0)
+      return shard_wait(&run.shard);
+    run.base = run.shard.base;
+    run.sessions = run.shard.sessions;
+    run.seed += run.shard.idx;
+    if (run.trace) {
+      snprintf(trcname, BUFFER_512, "%s.%i", run.trace, run.shard.idx);
+      run.trace = trcname;
     }
-
-    if (!conf->reply) {
-      conf->ret = conf->ret | ERR_MSG;
-
-      PJ_LOG(2, (THIS_FILE, "Reply-To header missing.\n"));
-
-    } else {
-      uri = pj_str(conf->reply);
-      urn = pj_str(conf->reply);
-
-      if ((aflg == 1) && (tflg == 0)) {
-        if (arg_mn > 1) {
-          for (i = 2; i <= arg_mn; i++) {
-            pj_thread_sleep(arg_mi * 1000);
-            printf("\t#### %i -> %s ####\n", i, text.ptr);
-            conf->req = 0;
-            status = send_dec112_msg(&acc_id, &text, &uri, &urn, 22, pool);
-            PJ_LOG(3, (THIS_FILE, "message sent with status %i\n", status));
-          }
-          pj_thread_sleep(arg_mi * 1000);
-        }
-        conf->req = 0;
-        status = send_dec112_msg(&acc_id, &text, &uri, &urn, 23, pool);
-
-        PJ_LOG(2, (THIS_FILE, "exiting with (%i) ...\n", status));
-      } else if ((aflg == 0) && (tflg == 1)) {
-        if ((fd = fopen(arg_txt, "r")) == NULL) {
-          PJ_LOG(2, (THIS_FILE, "Error opening file: %s\n", arg_txt));
-          return EXIT_FAILURE;
-        }
-        while ((nRet = getline(gptr, t, fd)) > 0) {
-          text.ptr = *gptr;
-          text.slen = strlen(*gptr);
-          PJ_LOG(4, (THIS_FILE, "message from file: %.*s\n", text.slen, text.ptr));
-          if (text.slen > 2) {
-            if (text.ptr[text.slen - 2] == '*') {
-              conf->val = 1;
-              text.ptr[text.slen - 2] = ' ';
-            }
-            printf("\t#### -> %.*s\n", (int)text.slen, text.ptr);
-            conf->req = 0;
-            status = send_dec112_msg(&acc_id, &text, &uri, &urn, 22, pool);
-            PJ_LOG(3, (THIS_FILE, "message sent with status %i\n", status));
-            cnt = 0;
-            while ((cnt < TIMEOUT_CNT) && (!conf->req)) {
-              pj_thread_sleep(TIMEOUT_MS);
-              cnt++;
-            }
-            if (cnt == TIMEOUT_CNT) {
-              conf->ret = conf->ret | ERR_TMR;
-              PJ_LOG(3, (THIS_FILE, "timeout on remote message request\n"));
-            }
-          }
-        }
-
-        fclose(fd);
-
-        time(&ltime);
-        info = localtime(&ltime);
-        strftime(tmptime, BUFFER_128, "%m/%d/%Y, %I:%M:%S %p", info);
-        snprintf(tmp, BUFFER_512, STOP_MESSAGE,
-                 conf->surname ? conf->surname : USER_SURNAME,
-                 conf->given ? conf->given : USER_GIVEN,
-                 conf->phone ? conf->phone : USER_PHONE, tmptime);
-        txt = (char *)pj_pool_alloc(pool, strlen(tmp) * sizeof(char) + 1);
-        if (txt == NULL)
-          error_exit("malloc failed", -1);
-        memset(txt, 0, strlen(tmp) + 1);
-        memcpy(txt, tmp, strlen(tmp));
-        text.ptr = txt;
-        text.slen = strlen(txt);
-
-        status = send_dec112_msg(&acc_id, &text, &uri, &urn, 23, pool);
-        PJ_LOG(3, (THIS_FILE, "message sent with status %i\n", status));
-
-      } else {
-        printf("\n##### Type messages followed by RETURN or use 'exit' to "
-               "unregister #####\n\n");
-        fflush(stdout);
-
-        /* wait until user sends "exit" to quit. */
-        for (;;) {
-          buffer = (char *)malloc(bufsize * sizeof(char));
-          characters = getline(&buffer, &bufsize, stdin);
-
-          PJ_LOG(3, (THIS_FILE, "sending %i characters ... \n", characters));
-
-          if (conf->reg == 0) {
-
-            PJ_LOG(2, (THIS_FILE, "remote close ... exiting ...\n"));
-
-            break;
-          }
-          text = pj_str(buffer);
-          if (strstr(buffer, "exit")) {
-            if (mflg != 0) {
-              // 02/24/2020, 10:26:01 PM
-              time(&ltime);
-              info = localtime(&ltime);
-              strftime(tmptime, BUFFER_128, "%m/%d/%Y, %I:%M:%S %p", info);
-              snprintf(tmp, BUFFER_512, STOP_MESSAGE,
-                       conf->surname ? conf->surname : USER_SURNAME,
-                       conf->given ? conf->given : USER_GIVEN,
-                       conf->phone ? conf->phone : USER_PHONE, tmptime);
-              txt = (char *)pj_pool_alloc(pool, strlen(tmp) * sizeof(char) + 1);
-              if (txt == NULL)
-                error_exit("malloc failed", -1);
-              memset(txt, 0, strlen(tmp) + 1);
-              memcpy(txt, tmp, strlen(tmp));
-              text.ptr = txt;
-              text.slen = strlen(txt);
-            }
-
-            status = send_dec112_msg(&acc_id, &text, &uri, &urn, 23, pool);
-
-            PJ_LOG(2, (THIS_FILE, "exiting with (%i) ...\n", status));
-
-            break;
-          } else {
-            status = send_dec112_msg(&acc_id, &text, &uri, &urn, 22, pool);
-          }
-        }
-      }
+    if (run.control) {
+      snprintf(ctlname, BUFFER_512, "%s.%i", run.control, run.shard.idx);
+      run.control = ctlname;
     }
   }
 
-  ret = conf->ret;
-
-  /* destroy pjsua */
-  free(buffer);
-  free(conf->reply);
-  pj_pool_release(pool);
-  pjsua_destroy();
+  ret = client_run(&run);
 
-  return ret;
+  return (ret < 0) ? EXIT_FAILURE : ret;
 }
@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    profile.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the load profile function definitions
+ *
+ *  A load profile is a list of phases read from the config file. Each
+ *  phase defines how many new chats start per second over its duration
+ *  (hold, ramp, step or spike) and how many messages at which interval
+ *  each new chat sends. New chats are started on free slots of the
+ *  session table through the session state machine (fsm.c); target and
+ *  achieved start and message rates are reported side by side.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "fsm.h"
+#include "profile.h"
+
+/******************************************************************* GLOBALS */
+
+static const char *profile_types[] = {"hold", "ramp", "step", "spike", NULL};
+
+static const char *profile_keys[] = {
+    "", "phase", "duration", "rate", "from", "to",
+    "steps", "sessions", "msgs", "interval", NULL};
+
+/* start rate set at runtime in 1/1000 per second, -1 follows the profile */
+static int64_t profile_ovr = -1;
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * profile_key(key)
+ * returns the PROFILE_KEY_* of a config key or 0
+ */
+int profile_key(const char *key) {
+  int i;
+
+  for (i = 1; profile_keys[i]; i++) {
+    if (!strcmp(key, profile_keys[i]))
+      return i;
+  }
+
+  return 0;
+}
+
+/*
+ * profile_set(prof, key, val)
+ * stores a config value; "phase" starts a new phase and must come first
+ */
+int profile_set(p_profile_t prof, int key, const char *val) {
+  p_phase_t ph;
+  int i;
+
+  if (key == PROFILE_KEY_PHASE) {
+    if (prof->cnt >= PROFILE_MAX_PHASES) {
+      printf("too many profile phases, %s ignored\n", val);
+      return -1;
+    }
+    for (i = 0; profile_types[i]; i++) {
+      if (!strcmp(val, profile_types[i]))
+        break;
+    }
+    if (!profile_types[i]) {
+      printf("unrecognised profile phase: %s\n", val);
+      return -1;
+    }
+    ph = &prof->phase[prof->cnt++];
+    memset(ph, 0, sizeof(s_phase_t));
+    ph->type = i;
+    return 0;
+  }
+
+  if (prof->cnt == 0)
+    return -1;
+  ph = &prof->phase[prof->cnt - 1];
+
+  switch (key) {
+  case PROFILE_KEY_DURATION:
+    ph->duration_s = atof(val);
+    break;
+  case PROFILE_KEY_RATE:
+    ph->rate = atof(val);
+    break;
+  case PROFILE_KEY_FROM:
+    ph->from = atof(val);
+    break;
+  case PROFILE_KEY_TO:
+    ph->to = atof(val);
+    break;
+  case PROFILE_KEY_STEPS:
+    ph->steps = atoi(val);
+    break;
+  case PROFILE_KEY_SESSIONS:
+    ph->sessions = atoi(val);
+    break;
+  case PROFILE_KEY_MSGS:
+    ph->msgs = atoi(val);
+    break;
+  case PROFILE_KEY_INTERVAL:
+    ph->interval_s = atof(val);
+    break;
+  default:
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * profile_rate(ph, t)
+ * returns the target start rate t seconds into a phase
+ */
+static double profile_rate(p_phase_t ph, double t) {
+  int n;
+
+  switch (ph->type) {
+  case PROFILE_RAMP:
+    return ph->from + (ph->to - ph->from) * t / ph->duration_s;
+  case PROFILE_STEP:
+    if (ph->steps < 2)
+      return ph->to;
+    n = (int)(t * ph->steps / ph->duration_s);
+    if (n >= ph->steps)
+      n = ph->steps - 1;
+    return ph->from + (ph->to - ph->from) * n / (ph->steps - 1);
+  case PROFILE_SPIKE:
+    return ph->sessions / ph->duration_s;
+  default:
+    return ph->rate;
+  }
+}
+
+/*
+ * profile_override(rate)
+ * replaces the start rate of all phases, rate < 0 returns to the profile
+ */
+void profile_override(double rate) {
+
+  __atomic_store_n(&profile_ovr, (rate < 0) ? -1 : (int64_t)(rate * 1000),
+                   __ATOMIC_RELEASE);
+}
+
+/*
+ * profile_free(cursor)
+ * returns the next retired session after cursor or NULL
+ */
+static p_session_t profile_free(int *cursor) {
+  p_session_t sess;
+  int n;
+
+  for (n = 0; n < session_count(); n++) {
+    sess = session_get(*cursor);
+    *cursor = (*cursor + 1) % session_count();
+    if ((__atomic_load_n(&sess->state, __ATOMIC_ACQUIRE) == FSM_DONE) &&
+        !__atomic_load_n(&sess->busy, __ATOMIC_ACQUIRE))
+      return sess;
+  }
+
+  return NULL;
+}
+
+/*
+ * profile_msg_rate()
+ * returns the message rate all chatting sessions aim at
+ */
+static double profile_msg_rate(void) {
+  p_session_t sess;
+  double rate;
+  int i;
+
+  rate = 0;
+  for (i = 0; i < session_count(); i++) {
+    sess = session_get(i);
+    if (__atomic_load_n(&sess->state, __ATOMIC_RELAXED) == FSM_CHATTING)
+      rate += 1000.0 / sess->interval_ms;
+  }
+
+  return rate;
+}
+
+/*
+ * profile_run(*acc_id, prof, scale, msgs, interval_ms, *uri, *urn)
+ * runs all phases of a profile; scale multiplies all start rates (to
+ * share a profile between processes), msgs and interval_ms are used when
+ * a phase does not set its own
+ */
+int profile_run(pjsua_acc_id *acc_id, p_profile_t prof, double scale,
+                unsigned msgs, unsigned interval_ms, pj_str_t *uri,
+                pj_str_t *urn) {
+  s_fsm_cfg_t fcfg;
+  p_phase_t ph;
+  p_session_t sess;
+  uint64_t phase_start;
+  uint64_t end;
+  uint64_t now;
+  uint64_t last;
+  uint64_t next_report;
+  uint64_t rep_t;
+  uint64_t rep_tx;
+  uint64_t tx0;
+  int64_t ovr;
+  double owed;
+  double rate;
+  double dt;
+  double win;
+  double tgt_starts;
+  double tgt_msgs;
+  double rep_starts;
+  double rep_msgs;
+  unsigned ph_msgs;
+  unsigned ph_int;
+  int rep_started;
+  int started0;
+  int starved;
+  int cursor;
+  int i;
+
+  memset(&fcfg, 0, sizeof(fcfg));
+  fcfg.acc_id = *acc_id;
+  fcfg.uri = *uri;
+  fcfg.urn = *urn;
+  fcfg.msgs = msgs;
+  fcfg.interval_ms = interval_ms;
+  fcfg.cycles = 1;
+  fcfg.manual = 1;
+  if ((prof->cnt < 1) || (fsm_start(&fcfg) != 0))
+    return -1;
+
+  printf("\n##### load profile: %i phases on %i session slots #####\n\n",
+         prof->cnt, session_count());
+
+  cursor = 0;
+  for (i = 0; i < prof->cnt; i++) {
+    ph = &prof->phase[i];
+    if ((ph->duration_s <= 0) ||
+        ((ph->type == PROFILE_STEP) && (ph->steps < 1)))
+      continue;
+    ph_msgs = ph->msgs ? ph->msgs : msgs;
+    ph_int = (ph->interval_s > 0) ? ph->interval_s * 1000 : interval_ms;
+
+    phase_start = stats_now_ns() / 1000000;
+    end = phase_start + (uint64_t)(ph->duration_s * 1000);
+    last = phase_start;
+    next_report = phase_start + PROFILE_REPORT_MS;
+    owed = 0;
+    tgt_starts = 0;
+    tgt_msgs = 0;
+    starved = 0;
+    started0 = fsm_started();
+    tx0 = STAT_GET(stats.tx);
+    rep_t = phase_start;
+    rep_started = started0;
+    rep_tx = tx0;
+    rep_starts = 0;
+    rep_msgs = 0;
+
+    do {
+      loop_sleep(PROFILE_TICK_MS);
+      now = stats_now_ns() / 1000000;
+      if (now > end)
+        now = end;
+      dt = (now - last) / 1000.0;
+      last = now;
+
+      ovr = __atomic_load_n(&profile_ovr, __ATOMIC_ACQUIRE);
+      if (ovr >= 0)
+        rate = ovr / 1000.0;
+      else
+        rate = profile_rate(ph, (now - phase_start) / 1000.0) * scale;
+      owed += rate * dt;
+      tgt_starts += rate * dt;
+      tgt_msgs += profile_msg_rate() * dt;
+      while (owed >= 1.0) {
+        owed -= 1.0;
+        sess = profile_free(&cursor);
+        if (!sess || (fsm_launch(sess, ph_msgs, ph_int) != 0))
+          starved++;
+      }
+
+      if ((now >= next_report) || (now == end)) {
+        win = (now - rep_t) / 1000.0;
+        if (win > 0) {
+          printf("profile %i/%i %-5s t=%4.0fs starts %7.1f/%7.1f/s msgs "
+                 "%8.1f/%8.1f/s active=%i starved=%i\n",
+                 i + 1, prof->cnt, profile_types[ph->type],
+                 (now - phase_start) / 1000.0, (tgt_starts - rep_starts) / win,
+                 (fsm_started() - rep_started) / win,
+                 (tgt_msgs - rep_msgs) / win,
+                 (STAT_GET(stats.tx) - rep_tx) / win,
+                 session_count() - fsm_done(), starved);
+          fflush(stdout);
+        }
+        rep_t = now;
+        rep_started = fsm_started();
+        rep_tx = STAT_GET(stats.tx);
+        rep_starts = tgt_starts;
+        rep_msgs = tgt_msgs;
+        next_report += PROFILE_REPORT_MS;
+      }
+    } while (now < end);
+
+    printf("\n##### phase %i %s %.0fs: starts target %.0f achieved %i, "
+           "msgs/s target %.1f achieved %.1f, starved %i #####\n\n",
+           i + 1, profile_types[ph->type], ph->duration_s, tgt_starts,
+           fsm_started() - started0, tgt_msgs / ph->duration_s,
+           (STAT_GET(stats.tx) - tx0) / ph->duration_s, starved);
+  }
+
+  /* let the last chats finish */
+  while (fsm_done() < session_count()) {
+    loop_sleep(PROFILE_REPORT_MS);
+    fsm_print(stdout);
+  }
+  fsm_stop();
+
+  if (STAT_GET(stats.timeout))
+    conf->ret = conf->ret | ERR_TMR;
+
+  stats_print(stdout, &stats);
+
+  return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    profile.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief profile.c header file (load profiles)
+ */
+
+#ifndef PROFILE_H_INCLUDED
+#define PROFILE_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <pjsua-lib/pjsua.h>
+
+/******************************************************************** DEFINE */
+
+#define PROFILE_MAX_PHASES 32
+#define PROFILE_SESSIONS 1024 /* session slots unless --sessions is given */
+#define PROFILE_TICK_MS 100
+#define PROFILE_REPORT_MS 1000
+
+/* phase types */
+#define PROFILE_HOLD 0  /* constant start rate */
+#define PROFILE_RAMP 1  /* start rate linear from -> to */
+#define PROFILE_STEP 2  /* start rate from -> to in steps */
+#define PROFILE_SPIKE 3 /* sessions starts within duration */
+
+/* config keys */
+#define PROFILE_KEY_PHASE 1
+#define PROFILE_KEY_DURATION 2
+#define PROFILE_KEY_RATE 3
+#define PROFILE_KEY_FROM 4
+#define PROFILE_KEY_TO 5
+#define PROFILE_KEY_STEPS 6
+#define PROFILE_KEY_SESSIONS 7
+#define PROFILE_KEY_MSGS 8
+#define PROFILE_KEY_INTERVAL 9
+
+/******************************************************************* TYPEDEF */
+
+/* one phase of the profile, rates in session starts per second */
+typedef struct phase {
+  int type;
+  double duration_s;
+  double rate;
+  double from;
+  double to;
+  int steps;
+  int sessions;
+  unsigned msgs;     /* chat messages of each new session, 0 default */
+  double interval_s; /* gap between its messages, 0 default */
+} s_phase_t, *p_phase_t;
+
+typedef struct profile {
+  int cnt;
+  s_phase_t phase[PROFILE_MAX_PHASES];
+} s_profile_t, *p_profile_t;
+
+/*************************************************************** PROTOTYPES */
+
+int profile_key(const char *key);
+int profile_set(p_profile_t prof, int key, const char *val);
+void profile_override(double rate);
+int profile_run(pjsua_acc_id *acc_id, p_profile_t prof, double scale,
+                unsigned msgs, unsigned interval_ms, pj_str_t *uri,
+                pj_str_t *urn);
+
+#endif // PROFILE_H_INCLUDED
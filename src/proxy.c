@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    proxy.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the proxy selection function definitions
+ *
+ *  The config may list several edge proxies (proxies:). Every process runs
+ *  one account, so the worker or agent index picks the first proxy, round
+ *  robin, weighted or by a hash of the account's user. When
+ *  re-registration (reg.c) keeps failing, or MESSAGE requests through the
+ *  proxy time out several times in a row, the account moves on to the next
+ *  proxy. Without any proxy the account registers with the domain
+ *  directly. Counters and latencies are attributed to the proxy in use
+ *  when they change.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "functions.h"
+#include "impair.h"
+#include "proxy.h"
+
+/******************************************************************* GLOBALS */
+
+static p_proxy_list_t proxy_list = NULL;
+static int proxy_cur = 0;
+static s_stats_t proxy_snap; /* global counters when proxy_cur took over */
+static unsigned proxy_timeouts = 0; /* MESSAGE timeouts in a row */
+static pthread_mutex_t proxy_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *proxy_modes[] = {"round-robin", "weighted", "hash", NULL};
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * proxy_add(pl, val)
+ * adds a config entry "<uri> [weight]"
+ */
+int proxy_add(p_proxy_list_t pl, const char *val) {
+  p_proxy_t p;
+  size_t n;
+
+  if (pl->cnt >= PROXY_MAX) {
+    printf("too many proxies, %s ignored\n", val);
+    return -1;
+  }
+
+  n = strcspn(val, " \t");
+  if ((n == 0) || (n > PROXY_URI_LEN)) {
+    printf("invalid proxy: %s\n", val);
+    return -1;
+  }
+
+  p = &pl->p[pl->cnt++];
+  memset(p, 0, sizeof(s_proxy_t));
+  memcpy(p->uri, val, n);
+  p->weight = (val[n] != '\0') ? atoi(val + n) : 1;
+  if (p->weight < 1)
+    p->weight = 1;
+
+  return 0;
+}
+
+/*
+ * proxy_hash(str)
+ * FNV-1a
+ */
+static uint32_t proxy_hash(const char *str) {
+  uint32_t h = 2166136261u;
+
+  while (*str) {
+    h ^= (unsigned char)*str++;
+    h *= 16777619u;
+  }
+
+  return h;
+}
+
+/*
+ * proxy_init(idx, pool)
+ * picks the first proxy of account idx; returns its index, -1 if the
+ * config has no (valid) proxy
+ */
+int proxy_init(int idx, pj_pool_t *pool) {
+  unsigned total;
+  unsigned r;
+  int mode;
+  int i;
+
+  if (!conf->proxies) {
+    /* single proxy: key */
+    conf->proxies = pj_pool_zalloc(pool, sizeof(s_proxy_list_t));
+    if (conf->proxy)
+      proxy_add(conf->proxies, conf->proxy);
+  }
+  proxy_list = NULL;
+  proxy_cur = 0;
+  if (conf->proxies->cnt == 0) {
+    PJ_LOG(2, (THIS_FILE, "no proxy configured, registering with %s\n",
+               conf->domain));
+    return -1;
+  }
+  proxy_list = conf->proxies;
+  if (idx < 0)
+    idx = 0;
+
+  mode = PROXY_ROUND_ROBIN;
+  for (i = 0; conf->proxy_select && proxy_modes[i]; i++) {
+    if (!strcmp(conf->proxy_select, proxy_modes[i]))
+      mode = i;
+  }
+
+  switch (mode) {
+  case PROXY_WEIGHTED:
+    total = 0;
+    for (i = 0; i < proxy_list->cnt; i++)
+      total += proxy_list->p[i].weight;
+    r = idx % total;
+    for (i = 0; r >= proxy_list->p[i].weight; i++)
+      r -= proxy_list->p[i].weight;
+    proxy_cur = i;
+    break;
+  case PROXY_HASH:
+    /* the identity of this worker or agent, see client_identity() */
+    proxy_cur = proxy_hash(conf->user ? conf->user : "") % proxy_list->cnt;
+    break;
+  default:
+    proxy_cur = idx % proxy_list->cnt;
+    break;
+  }
+
+  memcpy(&proxy_snap, &stats, sizeof(s_stats_t));
+
+  if (proxy_list->cnt > 1)
+    PJ_LOG(3, (THIS_FILE, "proxy %i of %i: %s\n", proxy_cur, proxy_list->cnt,
+               proxy_list->p[proxy_cur].uri));
+
+  return proxy_cur;
+}
+
+/*
+ * proxy_uri()
+ * returns the proxy currently in use
+ */
+const char *proxy_uri(void) {
+
+  if (!proxy_list)
+    return conf->proxy;
+
+  return proxy_list->p[proxy_cur].uri;
+}
+
+/*
+ * proxy_account()
+ * moves what changed since the last call to the current proxy
+ */
+static void proxy_account(void) {
+  p_stats_t st;
+  s_stats_t now;
+  int i;
+
+  if (!proxy_list)
+    return;
+
+  st = &proxy_list->p[proxy_cur].st;
+  memcpy(&now, &stats, sizeof(s_stats_t));
+
+  st->tx += now.tx - proxy_snap.tx;
+  st->tx_fail += now.tx_fail - proxy_snap.tx_fail;
+  st->tx_err += now.tx_err - proxy_snap.tx_err;
+  st->rx += now.rx - proxy_snap.rx;
+  st->rx_lost += now.rx_lost - proxy_snap.rx_lost;
+  st->timeout += now.timeout - proxy_snap.timeout;
+  st->rtt.cnt += now.rtt.cnt - proxy_snap.rtt.cnt;
+  st->rtt.sum += now.rtt.sum - proxy_snap.rtt.sum;
+  for (i = 0; i < HIST_BUCKETS; i++)
+    st->rtt.b[i] += now.rtt.b[i] - proxy_snap.rtt.b[i];
+  /* the maximum is process wide, good enough for a single proxy */
+  if ((now.rtt.max > proxy_snap.rtt.max) && (now.rtt.max > st->rtt.max))
+    st->rtt.max = now.rtt.max;
+
+  memcpy(&proxy_snap, &now, sizeof(s_stats_t));
+}
+
+/*
+ * proxy_on_reg(status)
+ * counts a registration result for the current proxy
+ */
+void proxy_on_reg(int status) {
+
+  if (!proxy_list)
+    return;
+
+  if ((status >= SIP_CODE_OK) && (status <= SIP_CODE_OK_END))
+    STAT_INC(proxy_list->p[proxy_cur].reg_ok);
+  else if (status > SIP_CODE_OK_END)
+    STAT_INC(proxy_list->p[proxy_cur].reg_fail);
+}
+
+/*
+ * proxy_failover(acc_id)
+ * moves the account to the next proxy; returns 1 if it did, the account
+ * change sends the REGISTER
+ */
+static int proxy_failover(pjsua_acc_id acc_id) {
+  pjsua_acc_config cfg;
+  pj_status_t status;
+  pj_pool_t *pool;
+
+  /* the impairment relay forwards to the first proxy only */
+  if (!proxy_list || (proxy_list->cnt < 2) || impair_uri())
+    return 0;
+
+  /* registration retry and MESSAGE timeouts may both give up at once */
+  if (pthread_mutex_trylock(&proxy_lock) != 0)
+    return 0;
+
+  /* the copy of the account config only lives until pjsua has its own */
+  pool = pjsua_pool_create("proxy", BUFFER_2048, BUFFER_2048);
+  if (!pool || (pjsua_acc_get_config(acc_id, pool, &cfg) != PJ_SUCCESS)) {
+    if (pool)
+      pj_pool_release(pool);
+    pthread_mutex_unlock(&proxy_lock);
+    return 0;
+  }
+
+  proxy_account();
+  proxy_list->p[proxy_cur].failovers++;
+  proxy_cur = (proxy_cur + 1) % proxy_list->cnt;
+  __atomic_store_n(&proxy_timeouts, 0, __ATOMIC_RELEASE);
+
+  cfg.proxy_cnt = 1;
+  cfg.proxy[0] = pj_str(proxy_list->p[proxy_cur].uri);
+  cfg.reg_uri = pj_str(proxy_list->p[proxy_cur].uri);
+  status = pjsua_acc_modify(acc_id, &cfg);
+  pj_pool_release(pool);
+  pthread_mutex_unlock(&proxy_lock);
+
+  PJ_LOG(2, (THIS_FILE, "account %i: failover to %s (%i)\n", acc_id,
+             proxy_list->p[proxy_cur].uri, status));
+
+  return (status == PJ_SUCCESS) ? 1 : 0;
+}
+
+/*
+ * proxy_on_retry(acc_id, attempts)
+ * moves the account to the next proxy after repeated registration
+ * failures; returns 1 if it did
+ */
+int proxy_on_retry(pjsua_acc_id acc_id, unsigned attempts) {
+
+  if ((attempts < PROXY_FAILOVER_ATTEMPTS) ||
+      (attempts % PROXY_FAILOVER_ATTEMPTS))
+    return 0;
+
+  return proxy_failover(acc_id);
+}
+
+/*
+ * proxy_on_message(acc_id, status)
+ * final response to a MESSAGE; a proxy that lets several requests in a
+ * row time out (408, also sent by pjsip itself) is given up
+ */
+void proxy_on_message(pjsua_acc_id acc_id, int status) {
+
+  if (!proxy_list)
+    return;
+
+  if (status != PJSIP_SC_REQUEST_TIMEOUT) {
+    __atomic_store_n(&proxy_timeouts, 0, __ATOMIC_RELEASE);
+    return;
+  }
+
+  if (__atomic_add_fetch(&proxy_timeouts, 1, __ATOMIC_ACQ_REL) ==
+      PROXY_FAILOVER_TIMEOUTS) {
+    PJ_LOG(2, (THIS_FILE, "%i MESSAGE timeouts through %s\n",
+               PROXY_FAILOVER_TIMEOUTS, proxy_list->p[proxy_cur].uri));
+    proxy_failover(acc_id);
+  }
+}
+
+/*
+ * proxy_close()
+ * attributes the remaining counters, call once the run is over
+ */
+void proxy_close(void) { proxy_account(); }
+
+/*
+ * proxy_copy(dst, max)
+ * copies the proxy list; returns number of proxies copied
+ */
+int proxy_copy(p_proxy_t dst, int max) {
+  int cnt;
+
+  if (!proxy_list)
+    return 0;
+
+  cnt = (proxy_list->cnt < max) ? proxy_list->cnt : max;
+  memcpy(dst, proxy_list->p, cnt * sizeof(s_proxy_t));
+
+  return cnt;
+}
+
+/*
+ * proxy_print(fh, p, cnt)
+ * prints registrations and traffic per proxy
+ */
+void proxy_print(FILE *fh, const s_proxy_t *p, int cnt) {
+  int i;
+
+  for (i = 0; i < cnt; i++) {
+    fprintf(fh, "proxy %i %s: registrations=%u failed=%u failovers=%u\n", i,
+            p[i].uri, p[i].reg_ok, p[i].reg_fail, p[i].failovers);
+    stats_print(fh, &p[i].st);
+  }
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    proxy.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief proxy.c header file (proxy selection, failover and metrics)
+ */
+
+#ifndef PROXY_H_INCLUDED
+#define PROXY_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <pjsua-lib/pjsua.h>
+#include <pthread.h>
+
+#include "stats.h"
+
+/******************************************************************** DEFINE */
+
+#define PROXY_MAX 16
+#define PROXY_URI_LEN 128
+#define PROXY_FAILOVER_ATTEMPTS 2 /* failed retries before the next proxy */
+#define PROXY_FAILOVER_TIMEOUTS 3 /* MESSAGE timeouts in a row, same */
+
+/* selection of the first proxy of an account */
+#define PROXY_ROUND_ROBIN 0 /* worker index modulo proxies */
+#define PROXY_WEIGHTED 1    /* worker index over the summed weights */
+#define PROXY_HASH 2        /* hash of the account's user */
+
+/******************************************************************* TYPEDEF */
+
+/* self-contained, workers copy it into the shared segment */
+typedef struct proxy {
+  char uri[PROXY_URI_LEN + 1];
+  unsigned weight;
+  unsigned reg_ok;    /* successful registrations through it */
+  unsigned reg_fail;  /* failed registrations */
+  unsigned failovers; /* times it was given up */
+  s_stats_t st;       /* traffic while it was in use */
+} s_proxy_t, *p_proxy_t;
+
+typedef struct proxy_list {
+  int cnt;
+  s_proxy_t p[PROXY_MAX];
+} s_proxy_list_t, *p_proxy_list_t;
+
+/*************************************************************** PROTOTYPES */
+
+int proxy_add(p_proxy_list_t pl, const char *val);
+int proxy_init(int idx, pj_pool_t *pool);
+const char *proxy_uri(void);
+void proxy_on_reg(int status);
+int proxy_on_retry(pjsua_acc_id acc_id, unsigned attempts);
+void proxy_on_message(pjsua_acc_id acc_id, int status);
+void proxy_close(void);
+int proxy_copy(p_proxy_t dst, int max);
+void proxy_print(FILE *fh, const s_proxy_t *p, int cnt);
+
+#endif // PROXY_H_INCLUDED
@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    reg.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the re-registration function definitions
+ *
+ *  pjsua's own retry (fixed interval) is disabled. A failed registration
+ *  or a lost connection to the proxy starts an outage: REGISTER is retried
+ *  with exponential backoff and equal jitter until it succeeds or the
+ *  outage exceeds the recovery limit. Sessions wait in the registering
+ *  state meanwhile and resume with a new chat cycle (fsm.c). The time from
+ *  losing to regaining the registration is recorded per account.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "fsm.h"
+#include "reg.h"
+#include "tls.h"
+
+/******************************************************************* GLOBALS */
+
+static s_reg_cfg_t reg_cfg = {REG_BACKOFF_MIN_MS, REG_BACKOFF_MAX_MS,
+                              REG_RECOVER_S};
+static s_reg_acc_t reg_acc[PJSUA_MAX_ACC];
+static pthread_mutex_t reg_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned reg_seed = 1;
+static int reg_active = 0;
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * reg_backoff(attempts)
+ * returns the delay before the next attempt in milliseconds
+ */
+static unsigned reg_backoff(unsigned attempts) {
+  unsigned delay;
+  unsigned i;
+
+  delay = reg_cfg.min_ms;
+  for (i = 0; (i < attempts) && (delay < reg_cfg.max_ms); i++)
+    delay *= 2;
+  if (delay > reg_cfg.max_ms)
+    delay = reg_cfg.max_ms;
+
+  /* half fixed, half random, so agents do not retry in lockstep */
+  return delay / 2 + rand_r(&reg_seed) % (delay / 2 + 1);
+}
+
+/*
+ * reg_on_timer(th, e)
+ * sends the next REGISTER of an outage
+ */
+static void reg_on_timer(pj_timer_heap_t *th, pj_timer_entry *e) {
+  p_reg_acc_t ra;
+  pjsua_acc_id acc_id;
+  unsigned attempts;
+
+  PJ_UNUSED_ARG(th);
+
+  ra = (p_reg_acc_t)e->user_data;
+  acc_id = (pjsua_acc_id)(ra - reg_acc);
+
+  pthread_mutex_lock(&reg_lock);
+  if (!reg_active || !ra->recovering) {
+    pthread_mutex_unlock(&reg_lock);
+    return;
+  }
+  attempts = ++ra->attempts;
+  ra->retries++;
+  pthread_mutex_unlock(&reg_lock);
+
+  PJ_LOG(3, (THIS_FILE, "account %i: registration attempt %u\n", acc_id,
+             attempts));
+
+  /* next proxy after repeated failures, the account change re-registers */
+  if (proxy_on_retry(acc_id, attempts))
+    return;
+
+  /* may report the result through on_reg() right away, so no lock here */
+  if (pjsua_acc_set_registration(acc_id, PJ_TRUE) != PJ_SUCCESS)
+    reg_update(acc_id, PJSIP_SC_SERVICE_UNAVAILABLE);
+}
+
+/*
+ * reg_down(ra, acc_id)
+ * starts or continues an outage; called with reg_lock held
+ */
+static void reg_down(p_reg_acc_t ra, pjsua_acc_id acc_id) {
+  pj_time_val delay;
+  unsigned ms;
+  uint64_t now;
+
+  now = stats_now_ns();
+
+  if (!ra->recovering) {
+    ra->recovering = 1;
+    ra->lost = ra->up;
+    ra->attempts = 0;
+    ra->down_ns = now;
+    if (ra->lost) {
+      ra->outages++;
+      PJ_LOG(2, (THIS_FILE, "account %i: registration lost\n", acc_id));
+    }
+  } else if (now - ra->down_ns > (uint64_t)reg_cfg.recover_s * 1000000000) {
+    ra->recovering = 0;
+    ra->given_up++;
+    conf->ret = conf->ret | ERR_REG;
+    PJ_LOG(2, (THIS_FILE, "account %i: not registered after %u s, giving up\n",
+               acc_id, reg_cfg.recover_s));
+    return;
+  }
+  ra->up = 0;
+
+  ms = reg_backoff(ra->attempts);
+  delay.sec = ms / 1000;
+  delay.msec = ms % 1000;
+  pjsua_cancel_timer(&ra->timer);
+  if (pjsua_schedule_timer(&ra->timer, &delay) != PJ_SUCCESS)
+    PJ_LOG(2, (THIS_FILE, "account %i: cannot schedule retry\n", acc_id));
+}
+
+/*
+ * reg_init(cfg)
+ * sets backoff and recovery limit, enables re-registration
+ */
+void reg_init(p_reg_cfg_t cfg) {
+  int i;
+
+  if (cfg->min_ms > 0)
+    reg_cfg.min_ms = cfg->min_ms;
+  if (cfg->max_ms > 0)
+    reg_cfg.max_ms = cfg->max_ms;
+  if (reg_cfg.max_ms < reg_cfg.min_ms)
+    reg_cfg.max_ms = reg_cfg.min_ms;
+  if (cfg->recover_s > 0)
+    reg_cfg.recover_s = cfg->recover_s;
+
+  memset(reg_acc, 0, sizeof(reg_acc));
+  for (i = 0; i < PJSUA_MAX_ACC; i++)
+    pj_timer_entry_init(&reg_acc[i].timer, 0, &reg_acc[i], &reg_on_timer);
+
+  reg_seed = loop_seed((unsigned)getpid() ^ (unsigned)time(NULL));
+  __atomic_store_n(&reg_active, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * reg_account(acc_cfg)
+ * hands retries of an account over to this module
+ */
+void reg_account(pjsua_acc_config *acc_cfg) {
+
+  acc_cfg->reg_retry_interval = 0;
+  acc_cfg->reg_first_retry_interval = 0;
+}
+
+/*
+ * reg_update(acc_id, status)
+ * tracks the registration state of an account, called from on_reg()
+ */
+void reg_update(pjsua_acc_id acc_id, int status) {
+  p_reg_acc_t ra;
+  uint64_t us;
+
+  if (!__atomic_load_n(&reg_active, __ATOMIC_ACQUIRE) || (acc_id < 0) ||
+      (acc_id >= PJSUA_MAX_ACC))
+    return;
+
+  ra = &reg_acc[acc_id];
+  pthread_mutex_lock(&reg_lock);
+  ra->used = 1;
+  if ((status >= SIP_CODE_OK) && (status <= SIP_CODE_OK_END)) {
+    if (ra->recovering) {
+      pjsua_cancel_timer(&ra->timer);
+      ra->recovering = 0;
+      if (ra->lost) {
+        us = (stats_now_ns() - ra->down_ns) / 1000;
+        hist_record(&ra->recovery, us);
+        ra->recovered++;
+        PJ_LOG(2, (THIS_FILE, "account %i: recovered after %.3f s (%u)\n",
+                   acc_id, us / 1000000.0, ra->attempts));
+      }
+    }
+    ra->up = 1;
+  } else if (status > SIP_CODE_OK_END) {
+    reg_down(ra, acc_id);
+  }
+  pthread_mutex_unlock(&reg_lock);
+}
+
+/*
+ * reg_recovering(acc_id)
+ * returns 1 while retries for the account are pending
+ */
+int reg_recovering(pjsua_acc_id acc_id) {
+
+  if ((acc_id < 0) || (acc_id >= PJSUA_MAX_ACC))
+    return 0;
+
+  return __atomic_load_n(&reg_acc[acc_id].recovering, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * reg_on_reg_state2(acc_id, info)
+ * remembers the transport the account registered over
+ */
+void reg_on_reg_state2(pjsua_acc_id acc_id, pjsua_reg_info *info) {
+  pjsip_regc_info ri;
+
+  if ((acc_id < 0) || (acc_id >= PJSUA_MAX_ACC) || !info->regc ||
+      (pjsip_regc_get_info(info->regc, &ri) != PJ_SUCCESS))
+    return;
+
+  pthread_mutex_lock(&reg_lock);
+  reg_acc[acc_id].tp = ri.transport;
+  pthread_mutex_unlock(&reg_lock);
+}
+
+/*
+ * reg_on_transport_state(tp, state, info)
+ * a closed connection takes the registrations made over it with it, those
+ * accounts start an outage
+ */
+void reg_on_transport_state(pjsip_transport *tp, pjsip_transport_state state,
+                            const pjsip_transport_state_info *info) {
+  int lost;
+  int i;
+
+  tls_on_transport_state(tp, state, info);
+
+  if (!__atomic_load_n(&reg_active, __ATOMIC_ACQUIRE) ||
+      (state != PJSIP_TP_STATE_DISCONNECTED) ||
+      !(tp->flag & PJSIP_TRANSPORT_RELIABLE))
+    return;
+
+  lost = 0;
+  pthread_mutex_lock(&reg_lock);
+  for (i = 0; i < PJSUA_MAX_ACC; i++) {
+    if (reg_acc[i].used && reg_acc[i].up && (reg_acc[i].tp == tp)) {
+      reg_acc[i].tp = NULL;
+      reg_down(&reg_acc[i], i);
+      lost = 1;
+    }
+  }
+  pthread_mutex_unlock(&reg_lock);
+
+  if (lost) {
+    conf->reg = 0;
+    fsm_on_reg();
+  }
+}
+
+/*
+ * reg_stop()
+ * cancels pending retries, before the account is removed
+ */
+void reg_stop(void) {
+  int i;
+
+  pthread_mutex_lock(&reg_lock);
+  __atomic_store_n(&reg_active, 0, __ATOMIC_RELEASE);
+  for (i = 0; i < PJSUA_MAX_ACC; i++) {
+    if (reg_acc[i].used)
+      pjsua_cancel_timer(&reg_acc[i].timer);
+  }
+  pthread_mutex_unlock(&reg_lock);
+}
+
+/*
+ * reg_count(*up, *recovering)
+ * returns number of accounts seen so far, without taking the lock
+ */
+int reg_count(int *up, int *recovering) {
+  int cnt;
+  int i;
+
+  cnt = 0;
+  *up = 0;
+  *recovering = 0;
+  for (i = 0; i < PJSUA_MAX_ACC; i++) {
+    if (!__atomic_load_n(&reg_acc[i].used, __ATOMIC_RELAXED))
+      continue;
+    cnt++;
+    *up += __atomic_load_n(&reg_acc[i].up, __ATOMIC_RELAXED);
+    *recovering += __atomic_load_n(&reg_acc[i].recovering, __ATOMIC_RELAXED);
+  }
+
+  return cnt;
+}
+
+/*
+ * reg_print(fh)
+ * prints outages and time to recovery of every account that had any
+ */
+void reg_print(FILE *fh) {
+  p_reg_acc_t ra;
+  int i;
+
+  for (i = 0; i < PJSUA_MAX_ACC; i++) {
+    ra = &reg_acc[i];
+    if (!ra->used || (!ra->outages && !ra->retries))
+      continue;
+    fprintf(fh, "account %i: outages=%u recovered=%u failed=%u attempts=%u\n",
+            i, ra->outages, ra->recovered, ra->given_up, ra->retries);
+    hist_print(fh, "recovery", &ra->recovery);
+  }
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    reg.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief reg.c header file (re-registration and recovery time)
+ */
+
+#ifndef REG_H_INCLUDED
+#define REG_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <pthread.h>
+
+#include "functions.h"
+#include "stats.h"
+
+/******************************************************************** DEFINE */
+
+#define REG_BACKOFF_MIN_MS 500   /* first retry */
+#define REG_BACKOFF_MAX_MS 30000 /* backoff doubles up to this */
+#define REG_RECOVER_S 120        /* give up an outage after this */
+
+/******************************************************************* TYPEDEF */
+
+typedef struct reg_cfg {
+  unsigned min_ms;
+  unsigned max_ms;
+  unsigned recover_s;
+} s_reg_cfg_t, *p_reg_cfg_t;
+
+/* one per account, indexed by pjsua_acc_id */
+typedef struct reg_acc {
+  int used;
+  int up;            /* registered */
+  int recovering;    /* retries pending */
+  int lost;          /* was registered before the current retries */
+  unsigned attempts; /* retries of the current outage */
+  uint64_t down_ns;  /* first failure of the current outage */
+  unsigned outages;
+  unsigned recovered;
+  unsigned given_up;
+  unsigned retries;  /* over all outages */
+  s_hist_t recovery; /* time to recovery */
+  pjsip_transport *tp; /* of the last REGISTER, compared only */
+  pj_timer_entry timer;
+} s_reg_acc_t, *p_reg_acc_t;
+
+/*************************************************************** PROTOTYPES */
+
+void reg_init(p_reg_cfg_t cfg);
+void reg_account(pjsua_acc_config *acc_cfg);
+void reg_update(pjsua_acc_id acc_id, int status);
+int reg_recovering(pjsua_acc_id acc_id);
+void reg_on_reg_state2(pjsua_acc_id acc_id, pjsua_reg_info *info);
+void reg_on_transport_state(pjsip_transport *tp, pjsip_transport_state state,
+                            const pjsip_transport_state_info *info);
+void reg_stop(void);
+int reg_count(int *up, int *recovering);
+void reg_print(FILE *fh);
+
+#endif // REG_H_INCLUDED
@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    replay.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the session replay function definitions
+ *
+ *  A replay file holds one outgoing MESSAGE per line:
+ *  <gap in ms> TAB <msgtype> TAB <text>, with \n, \r, \t and \\ escaped.
+ *  Lines starting with '#' are ignored. Such a file is written by
+ *  "--export <trace> --format replay".
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "replay.h"
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * replay_unescape(dst, src, len)
+ * copies src to dst resolving escape sequences, returns new length
+ */
+static int replay_unescape(char *dst, const char *src, int len) {
+  int i;
+  int n;
+
+  for (i = 0, n = 0; i < len; i++) {
+    if ((src[i] == '\\') && (i + 1 < len)) {
+      i++;
+      switch (src[i]) {
+      case 'n':
+        dst[n++] = '\n';
+        break;
+      case 'r':
+        dst[n++] = '\r';
+        break;
+      case 't':
+        dst[n++] = '\t';
+        break;
+      default:
+        dst[n++] = src[i];
+        break;
+      }
+    } else {
+      dst[n++] = src[i];
+    }
+  }
+  dst[n] = '\0';
+
+  return n;
+}
+
+/*
+ * replay_load(filename, pool)
+ * reads a replay file into pool memory
+ */
+p_replay_t replay_load(const char *filename, pj_pool_t *pool) {
+  p_replay_evt_t evt;
+  p_replay_t rp;
+  size_t size;
+  ssize_t len;
+  char *line;
+  char *p;
+  int cnt;
+  FILE *fh;
+
+  if ((fh = fopen(filename, "r")) == NULL) {
+    PJ_LOG(2, (THIS_FILE, "Error opening file: %s\n", filename));
+    return NULL;
+  }
+
+  line = NULL;
+  size = 0;
+  cnt = 0;
+  while ((len = getline(&line, &size, fh)) > 0) {
+    if ((line[0] != '#') && (line[0] != '\n'))
+      cnt++;
+  }
+
+  rp = (p_replay_t)pj_pool_zalloc(pool, sizeof(s_replay_t));
+  rp->evt =
+      (p_replay_evt_t)pj_pool_zalloc(pool, cnt * sizeof(s_replay_evt_t));
+
+  rewind(fh);
+  while ((rp->cnt < cnt) && ((len = getline(&line, &size, fh)) > 0)) {
+    if ((line[0] == '#') || (line[0] == '\n'))
+      continue;
+    while ((len > 0) && ((line[len - 1] == '\n') || (line[len - 1] == '\r')))
+      line[--len] = '\0';
+
+    evt = &rp->evt[rp->cnt];
+    evt->gap_ms = strtoul(line, &p, 10);
+    if (*p != '\t')
+      continue;
+    evt->mtype = strtol(p + 1, &p, 10);
+    if (*p != '\t')
+      continue;
+    p++;
+
+    evt->text.ptr = (char *)pj_pool_alloc(pool, len - (p - line) + 1);
+    evt->text.slen = replay_unescape(evt->text.ptr, p, len - (p - line));
+    rp->cnt++;
+  }
+
+  free(line);
+  fclose(fh);
+
+  PJ_LOG(3, (THIS_FILE, "%i replay events loaded from %s\n", rp->cnt,
+             filename));
+
+  return rp;
+}
+
+/*
+ * replay_wait(pred, timeout_ms)
+ * polls the session table until all open sessions satisfy pred
+ */
+static int replay_wait(int (*pred)(p_session_t), uint64_t timeout_ms) {
+  uint64_t start;
+  int pending;
+  int i;
+
+  start = stats_now_ns() / 1000000;
+  do {
+    pending = 0;
+    for (i = 0; i < session_count(); i++) {
+      if (!session_get(i)->closed && !pred(session_get(i)))
+        pending++;
+    }
+    if (pending == 0)
+      break;
+    loop_sleep(REPLAY_POLL_MS);
+  } while (stats_now_ns() / 1000000 - start < timeout_ms);
+
+  return pending;
+}
+
+static int has_reply(p_session_t sess) {
+  return __atomic_load_n(&sess->reply, __ATOMIC_ACQUIRE) != NULL;
+}
+
+static int is_answered(p_session_t sess) {
+  return __atomic_load_n(&sess->tx_ns, __ATOMIC_ACQUIRE) == 0;
+}
+
+/*
+ * replay_run(*acc_id, rp, speed, *uri, *urn)
+ * replays all events on every session of the session table; speed scales
+ * the recorded gaps (1.0 real time, 10.0 ten times faster, 0 no gaps)
+ */
+int replay_run(pjsua_acc_id *acc_id, p_replay_t rp, double speed,
+               pj_str_t *uri, pj_str_t *urn) {
+  p_replay_evt_t evt;
+  p_session_t sess;
+  pj_status_t status;
+  pj_str_t text;
+  pj_str_t rto;
+  uint64_t start;
+  uint64_t due;
+  uint64_t now;
+  uint64_t target;
+  int skipped;
+  int sent;
+  int i;
+  int j;
+
+  skipped = 0;
+  sent = 0;
+  due = 0;
+  start = stats_now_ns() / 1000000;
+
+  for (i = 0; i < rp->cnt; i++) {
+    evt = &rp->evt[i];
+    due += evt->gap_ms;
+
+    /* absolute schedule, a late event does not delay the following ones */
+    if (speed > 0) {
+      target = start + (uint64_t)(due / speed);
+      now = stats_now_ns() / 1000000;
+      if (target > now)
+        loop_sleep(target - now);
+    }
+
+    printf("\t#### %i/%i msgtype %i -> %.*s ####\n", i + 1, rp->cnt,
+           evt->mtype, (int)evt->text.slen, evt->text.ptr);
+
+    for (j = 0; j < session_count(); j++) {
+      sess = session_get(j);
+      text = evt->text;
+
+      if (evt->mtype == 21) {
+        session_reset(sess);
+        status = send_dec112_msg(acc_id, sess, &text, uri, urn, 21);
+      } else if (sess->reply && !sess->closed) {
+        rto = pj_str(sess->reply);
+        status = send_dec112_msg(acc_id, sess, &text, &rto, &rto, evt->mtype);
+      } else {
+        skipped++;
+        continue;
+      }
+      if (status == PJ_SUCCESS)
+        sent++;
+    }
+
+    /* chat messages need the Reply-To of the start message */
+    if ((evt->mtype == 21) &&
+        (replay_wait(has_reply, TIMEOUT_CNT * TIMEOUT_MS) > 0)) {
+      conf->ret = conf->ret | ERR_MSG;
+      PJ_LOG(2, (THIS_FILE, "Reply-To header missing.\n"));
+    }
+  }
+
+  /* collect outstanding replies */
+  if (replay_wait(is_answered, TIMEOUT_CNT * TIMEOUT_MS) > 0)
+    conf->ret = conf->ret | ERR_TMR;
+  for (j = 0; j < session_count(); j++) {
+    if (!is_answered(session_get(j))) {
+      STAT_INC(stats.timeout);
+      STAT_INC(session_get(j)->timeout);
+    }
+  }
+
+  if (speed > 0)
+    printf("\n##### replay of %i events on %i sessions at %.1fx: %i sent, "
+           "%i skipped #####\n",
+           rp->cnt, session_count(), speed, sent, skipped);
+  else
+    printf("\n##### replay of %i events on %i sessions at max speed: %i "
+           "sent, %i skipped #####\n",
+           rp->cnt, session_count(), sent, skipped);
+  stats_print(stdout, &stats);
+
+  return sent;
+}
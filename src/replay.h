@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ *  @file    replay.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief replay.c header file (session trace replay)
+ */
+
+#ifndef REPLAY_H_INCLUDED
+#define REPLAY_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include "functions.h"
+
+/******************************************************************** DEFINE */
+
+#define REPLAY_POLL_MS 10
+
+/******************************************************************* TYPEDEF */
+
+/* one outgoing MESSAGE of the recorded session */
+typedef struct replay_evt {
+  uint32_t gap_ms; /* time since the previous event */
+  int mtype;       /* 21, 22 or 23 */
+  pj_str_t text;
+} s_replay_evt_t, *p_replay_evt_t;
+
+typedef struct replay {
+  int cnt;
+  p_replay_evt_t evt;
+} s_replay_t, *p_replay_t;
+
+/*************************************************************** PROTOTYPES */
+
+p_replay_t replay_load(const char *filename, pj_pool_t *pool);
+int replay_run(pjsua_acc_id *acc_id, p_replay_t rp, double speed,
+               pj_str_t *uri, pj_str_t *urn);
+
+#endif // REPLAY_H_INCLUDED
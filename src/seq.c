@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    seq.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the sequence number function definitions
+ *
+ *  Every MESSAGE carries the number of the message within its session in
+ *  the X-DEC112-Seq header. Numbers received in the same header (echoed
+ *  or counted by the responder) are kept in a bitmap of the last
+ *  SEQ_WINDOW numbers below the highest one, which tells duplicates,
+ *  gaps and messages that arrived out of order apart. Each window has its
+ *  own spin flag, so sessions never wait for each other.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "functions.h"
+#include "seq.h"
+
+/******************************************************************* GLOBALS */
+
+static s_seq_t seq_chat; /* the single chat, no session table */
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * seq_next(sq)
+ * returns the number of the next message sent, NULL for the single chat
+ */
+uint64_t seq_next(p_seq_t sq) {
+
+  return __atomic_add_fetch(sq ? &sq->tx : &seq_chat.tx, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * seq_bit(sq, n)
+ * returns the window word of number n, sets *mask to its bit
+ */
+static uint64_t *seq_bit(p_seq_t sq, uint64_t n, uint64_t *mask) {
+
+  *mask = 1ULL << (n % 64);
+  return &sq->win[(n % SEQ_WINDOW) / 64];
+}
+
+/*
+ * seq_lock(sq)
+ * takes the window of one session, held for a few instructions only
+ */
+static void seq_lock(p_seq_t sq) {
+
+  while (__atomic_exchange_n(&sq->busy, 1, __ATOMIC_ACQUIRE))
+    while (__atomic_load_n(&sq->busy, __ATOMIC_RELAXED))
+      ;
+}
+
+/*
+ * seq_unlock(sq)
+ * releases the window of one session
+ */
+static void seq_unlock(p_seq_t sq) {
+
+  __atomic_store_n(&sq->busy, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * seq_receive(sq, n)
+ * classifies received number n, 0 if the message had none; NULL for the
+ * single chat
+ */
+void seq_receive(p_seq_t sq, uint64_t n) {
+  uint64_t *w;
+  uint64_t mask;
+  uint64_t i;
+
+  if (!sq)
+    sq = &seq_chat;
+
+  seq_lock(sq);
+  if (n == 0) {
+    sq->none++;
+  } else if (n > sq->hi) {
+    /* slide the window, numbers in between are missing so far */
+    if (n - sq->hi >= SEQ_WINDOW) {
+      memset(sq->win, 0, sizeof(sq->win));
+    } else {
+      for (i = sq->hi + 1; i < n; i++) {
+        w = seq_bit(sq, i, &mask);
+        *w &= ~mask;
+      }
+    }
+    w = seq_bit(sq, n, &mask);
+    *w |= mask;
+    sq->gap += n - sq->hi - 1;
+    STAT_ADD(stats.rx_gap, n - sq->hi - 1);
+    sq->hi = n;
+    sq->rx++;
+  } else if (sq->hi - n >= SEQ_WINDOW) {
+    sq->late++;
+    sq->rx++;
+    STAT_INC(stats.rx_late);
+  } else {
+    w = seq_bit(sq, n, &mask);
+    if (*w & mask) {
+      sq->dup++;
+      STAT_INC(stats.rx_dup);
+    } else {
+      *w |= mask;
+      sq->reorder++;
+      sq->gap--;
+      sq->rx++;
+      STAT_INC(stats.rx_reorder);
+      __atomic_fetch_sub(&stats.rx_gap, 1, __ATOMIC_RELAXED);
+    }
+  }
+  seq_unlock(sq);
+
+  if (n > 0)
+    STAT_INC(stats.rx_seq);
+}
+
+/*
+ * seq_line(fh, name, idx, sq)
+ * prints the counters of one session
+ */
+static void seq_line(FILE *fh, const char *name, int idx, p_seq_t sq) {
+
+  fprintf(fh,
+          "%s %i: sent=%lu received=%lu unnumbered=%lu duplicate=%lu "
+          "missing=%lu reordered=%lu late=%lu\n",
+          name, idx, (unsigned long)sq->tx, (unsigned long)sq->rx,
+          (unsigned long)sq->none, (unsigned long)sq->dup,
+          (unsigned long)sq->gap, (unsigned long)sq->reorder,
+          (unsigned long)sq->late);
+}
+
+/*
+ * seq_print(fh)
+ * prints the single chat's numbers or the sessions that saw duplicates,
+ * gaps or reordering
+ */
+void seq_print(FILE *fh) {
+  p_seq_t sq;
+  int cnt;
+  int i;
+
+  if (session_count() == 0) {
+    seq_lock(&seq_chat);
+    if (seq_chat.rx || seq_chat.none)
+      seq_line(fh, "sequence chat", 0, &seq_chat);
+    seq_unlock(&seq_chat);
+    return;
+  }
+
+  cnt = 0;
+  for (i = 0; i < session_count(); i++) {
+    sq = &session_get(i)->seq;
+    seq_lock(sq);
+    if ((sq->dup || sq->gap || sq->reorder || sq->late) &&
+        (cnt++ < SEQ_PRINT_MAX))
+      seq_line(fh, "sequence session", session_get(i)->idx, sq);
+    seq_unlock(sq);
+  }
+  if (cnt > SEQ_PRINT_MAX)
+    fprintf(fh, "sequence: %i more sessions\n", cnt - SEQ_PRINT_MAX);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    seq.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief seq.c header file (message sequence numbers)
+ */
+
+#ifndef SEQ_H_INCLUDED
+#define SEQ_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <stdint.h>
+#include <stdio.h>
+
+/******************************************************************** DEFINE */
+
+#define SEQ_HDR "X-DEC112-Seq"
+#define SEQ_WINDOW 256 /* received numbers kept below the highest */
+#define SEQ_WORDS (SEQ_WINDOW / 64)
+#define SEQ_PRINT_MAX 20 /* sessions listed by seq_print() */
+
+/******************************************************************* TYPEDEF */
+
+/* numbers sent and received by one session (or the single chat) */
+typedef struct seq {
+  uint64_t tx;             /* last number sent */
+  uint64_t hi;             /* highest number received */
+  uint64_t win[SEQ_WORDS]; /* bit n % SEQ_WINDOW: n received, n > hi - 256 */
+  uint64_t rx;             /* numbered messages received */
+  uint64_t none;           /* received without a number */
+  uint64_t dup;            /* number received before */
+  uint64_t gap;            /* numbers below hi not received (yet) */
+  uint64_t reorder;        /* received below hi, filled a gap */
+  uint64_t late;           /* below the window, not classified */
+  int busy;                /* window is being updated, see seq_receive() */
+} s_seq_t, *p_seq_t;
+
+/*************************************************************** PROTOTYPES */
+
+uint64_t seq_next(p_seq_t sq);
+void seq_receive(p_seq_t sq, uint64_t n);
+void seq_print(FILE *fh);
+
+#endif // SEQ_H_INCLUDED
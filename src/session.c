@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    session.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the session table function definitions
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "functions.h"
+
+/******************************************************************* GLOBALS */
+
+static p_session_t sessions = NULL;
+static int session_base = 0;
+static int session_cnt = 0;
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * session_table_create(base, cnt, pool)
+ * allocates cnt sessions, each with its own dec112-CallId; the session
+ * index plus base is encoded in the last 8 characters of the key so that a
+ * lookup never has to search and distributed agents use disjoint ids
+ */
+int session_table_create(int base, int cnt, pj_pool_t *pool) {
+  char charset[] = "0123456789"
+                   "abcdefghijklmnopqrstuvwxyz"
+                   "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  char tmp[BUFFER_512 + 1];
+  p_session_t sess;
+  int i;
+  int j;
+
+  sessions = (p_session_t)pj_pool_zalloc(pool, cnt * sizeof(s_session_t));
+  if (sessions == NULL)
+    return -1;
+
+  for (i = 0; i < cnt; i++) {
+    sess = &sessions[i];
+    sess->idx = i;
+    for (j = 0; j < SESSION_KEY_LEN - 8; j++)
+      sess->key[j] = charset[pj_rand() % (sizeof(charset) - 1)];
+    snprintf(&sess->key[SESSION_KEY_LEN - 8], 9, "%08x", base + i);
+
+    snprintf(
+        tmp, BUFFER_512,
+        "<urn:dec112:uid:callid:%s:service.dec112.at>;purpose=" DEC112_CALLID,
+        sess->key);
+    sess->cid = (char *)pj_pool_alloc(pool, strlen(tmp) + 1);
+    if (sess->cid == NULL)
+      return -1;
+    memcpy(sess->cid, tmp, strlen(tmp) + 1);
+  }
+
+  session_base = base;
+  session_cnt = cnt;
+
+  return 0;
+}
+
+/*
+ * session_table_destroy()
+ * resets every session and forgets the table; call it before the pool the
+ * table lives in is released
+ */
+void session_table_destroy(void) {
+  int i;
+
+  for (i = 0; i < session_cnt; i++)
+    session_reset(&sessions[i]);
+  session_cnt = 0;
+  session_base = 0;
+  sessions = NULL;
+}
+
+/*
+ * session_count()
+ * returns number of sessions in the table
+ */
+int session_count(void) { return session_cnt; }
+
+/*
+ * session_get(idx)
+ * returns session idx or NULL
+ */
+p_session_t session_get(int idx) {
+
+  if ((idx < 0) || (idx >= session_cnt))
+    return NULL;
+
+  return &sessions[idx];
+}
+
+/*
+ * session_find(key, len)
+ * returns the session owning a call id key or NULL
+ */
+p_session_t session_find(const char *key, int len) {
+  unsigned long idx;
+  char hex[9];
+
+  if ((len != SESSION_KEY_LEN) || (session_cnt == 0))
+    return NULL;
+
+  memcpy(hex, key + SESSION_KEY_LEN - 8, 8);
+  hex[8] = '\0';
+  idx = strtoul(hex, NULL, 16) - session_base;
+  if (idx >= (unsigned long)session_cnt)
+    return NULL;
+  if (memcmp(sessions[idx].key, key, SESSION_KEY_LEN) != 0)
+    return NULL;
+
+  return &sessions[idx];
+}
+
+/*
+ * session_reset(sess)
+ * forgets the Reply-To of a session so it can be started again
+ */
+void session_reset(p_session_t sess) {
+  char *reply;
+
+  reply = __atomic_exchange_n(&sess->reply, NULL, __ATOMIC_ACQ_REL);
+  free(reply);
+  sess->req = 0;
+  sess->val = 0;
+  sess->closed = 0;
+  sess->tx_ns = 0;
+}
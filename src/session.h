@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ *  @file    session.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief session.c header file (chat sessions sharing one account)
+ */
+
+#ifndef SESSION_H_INCLUDED
+#define SESSION_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <pjsua-lib/pjsua.h>
+#include <stdint.h>
+
+#include "flow.h"
+#include "seq.h"
+
+/******************************************************************** DEFINE */
+
+#define SESSION_KEY_LEN 36
+
+/******************************************************************* TYPEDEF */
+
+struct matrix_cell;
+
+/*
+ * one emergency chat, identified towards the service by its dec112-CallId;
+ * replies are routed back to the session by the same id
+ */
+typedef struct session {
+  int idx;
+  char key[SESSION_KEY_LEN + 1]; /* random part of the call id */
+  char *cid;                     /* Call-Info header value */
+  char *reply;                   /* Reply-To of the first response */
+  int req;                       /* set when a MESSAGE was received */
+  int val;                       /* validate the next received body */
+  int closed;                    /* remote close (msgtype 19) received */
+  uint64_t tx_ns;                /* last request waiting for a reply */
+  uint64_t tx;
+  uint64_t rx;
+  uint64_t fail;
+  uint64_t err;                  /* MESSAGE rejected (non-2xx) */
+  uint64_t timeout;              /* requests given up without a reply */
+  int state;                     /* fsm.c state machine */
+  int step;                      /* chat messages sent in this cycle */
+  int cycle;                     /* completed chat cycles */
+  int drain;                     /* retire after the current cycle */
+  unsigned msgs;                 /* chat messages per cycle */
+  unsigned interval_ms;          /* gap between chat messages */
+  int ev;                        /* pending fsm events */
+  int busy;                      /* fsm events are being processed */
+  uint64_t due_ms;               /* expiry of the armed timer */
+  pj_timer_entry timer;
+  struct matrix_cell *cell;      /* target and texts in matrix mode */
+  s_seq_t seq;                   /* sequence numbers sent and received */
+  s_flow_t flow;                 /* backoff after 486/503 */
+} s_session_t, *p_session_t;
+
+/*************************************************************** PROTOTYPES */
+
+int session_table_create(int base, int cnt, pj_pool_t *pool);
+void session_table_destroy(void);
+int session_count(void);
+p_session_t session_get(int idx);
+p_session_t session_find(const char *key, int len);
+void session_reset(p_session_t sess);
+
+#endif // SESSION_H_INCLUDED
@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    shard.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the multi-process sharding function definitions
+ *
+ *  pjsua is a per-process singleton. To use all cores, the launcher forks
+ *  the workers before pjsua_create(); each worker is pinned to one CPU,
+ *  owns a slice of the sessions and copies its counters and histograms
+ *  into a shared anonymous mapping every second. The parent merges them
+ *  into a progress line while the run is live and into the final report
+ *  when all workers have exited.
+ */
+
+/******************************************************************* INCLUDE */
+
+#define _GNU_SOURCE
+#include "shard.h"
+
+/******************************************************************* GLOBALS */
+
+static p_shard_t shard_self = NULL; /* this worker, for the timer */
+static pj_timer_entry shard_timer;
+/* one publisher at a time, the timer may still run during shard_report() */
+static pthread_mutex_t shard_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * shard_pin(idx)
+ * binds the calling process to CPU idx (modulo online CPUs)
+ */
+static void shard_pin(int idx) {
+  cpu_set_t set;
+  long ncpu;
+
+  ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  if (ncpu < 1)
+    return;
+
+  CPU_ZERO(&set);
+  CPU_SET(idx % ncpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0)
+    fprintf(stderr, "worker %i: cannot pin to cpu %li\n", idx, idx % ncpu);
+}
+
+/*
+ * shard_spawn(procs, sessions, sh)
+ * forks procs workers; returns 1 in a worker (sh describes its slice),
+ * 0 in the parent and -1 on error
+ */
+int shard_spawn(int procs, int sessions, p_shard_t sh) {
+  pid_t pid;
+  int base;
+  int cnt;
+  int i;
+
+  memset(sh, 0, sizeof(s_shard_t));
+  sh->idx = -1;
+  sh->procs = procs;
+
+  if ((procs < 1) || (procs > SHARD_MAX_PROCS) || (sessions < procs)) {
+    fprintf(stderr, "need 1..%i workers and at least one session each\n",
+            SHARD_MAX_PROCS);
+    return -1;
+  }
+
+  sh->slot = mmap(NULL, procs * sizeof(s_shard_slot_t),
+                  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (sh->slot == MAP_FAILED) {
+    sh->slot = NULL;
+    fprintf(stderr, "cannot map shared stats segment\n");
+    return -1;
+  }
+
+  /* do not duplicate buffered output into the workers */
+  fflush(stdout);
+  fflush(stderr);
+
+  base = 0;
+  for (i = 0; i < procs; i++) {
+    cnt = sessions / procs + ((i < sessions % procs) ? 1 : 0);
+    pid = fork();
+    if (pid < 0) {
+      fprintf(stderr, "fork of worker %i failed\n", i);
+      sh->procs = i;
+      return (i > 0) ? 0 : -1;
+    }
+    if (pid == 0) {
+      sh->idx = i;
+      sh->base = base;
+      sh->sessions = cnt;
+      sh->slot[i].pid = getpid();
+      shard_pin(i);
+      return 1;
+    }
+    sh->slot[i].pid = pid;
+    base += cnt;
+  }
+
+  return 0;
+}
+
+/*
+ * shard_publish(sh)
+ * copies the counters of this worker into its slot, call with shard_lock
+ * held
+ */
+static void shard_publish(p_shard_t sh) {
+  p_shard_slot_t s;
+
+  s = &sh->slot[sh->idx];
+  __atomic_add_fetch(&s->gen, 1, __ATOMIC_ACQ_REL);
+  memcpy(&s->st, &stats, sizeof(s_stats_t));
+  s->pcnt = proxy_copy(s->px, PROXY_MAX);
+  __atomic_add_fetch(&s->gen, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * shard_on_timer(th, e)
+ * publishes and schedules the next publish
+ */
+static void shard_on_timer(pj_timer_heap_t *th, pj_timer_entry *e) {
+  pj_time_val delay;
+
+  PJ_UNUSED_ARG(th);
+  PJ_UNUSED_ARG(e);
+
+  pthread_mutex_lock(&shard_lock);
+  if (shard_self) {
+    shard_publish(shard_self);
+    delay.sec = SHARD_PUBLISH_MS / 1000;
+    delay.msec = SHARD_PUBLISH_MS % 1000;
+    pjsua_schedule_timer(&shard_timer, &delay);
+  }
+  pthread_mutex_unlock(&shard_lock);
+}
+
+/*
+ * shard_start(sh)
+ * publishes the counters of this worker periodically; needs pjsua
+ */
+void shard_start(p_shard_t sh) {
+
+  if (!sh->slot || (sh->idx < 0))
+    return;
+
+  pthread_mutex_lock(&shard_lock);
+  shard_self = sh;
+  pthread_mutex_unlock(&shard_lock);
+  pj_timer_entry_init(&shard_timer, 0, NULL, &shard_on_timer);
+  shard_on_timer(NULL, &shard_timer);
+}
+
+/*
+ * shard_report(sh, ret)
+ * publishes the final counters of this worker to the parent
+ */
+void shard_report(p_shard_t sh, int ret) {
+  p_shard_slot_t s;
+
+  if (!sh->slot || (sh->idx < 0))
+    return;
+
+  /* a callback already running finishes before we publish */
+  pthread_mutex_lock(&shard_lock);
+  if (shard_self) {
+    shard_self = NULL;
+    pjsua_cancel_timer(&shard_timer);
+  }
+  s = &sh->slot[sh->idx];
+  shard_publish(sh);
+  s->ret = ret;
+  __atomic_store_n(&s->done, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&shard_lock);
+}
+
+/*
+ * shard_read(s, st)
+ * copies the counters of a live worker; returns -1 if every copy was torn
+ * by a concurrent publish
+ */
+static int shard_read(p_shard_slot_t s, p_stats_t st) {
+  unsigned gen;
+  int i;
+
+  for (i = 0; i < SHARD_READ_TRIES; i++) {
+    gen = __atomic_load_n(&s->gen, __ATOMIC_ACQUIRE);
+    if (gen & 1)
+      continue;
+    memcpy(st, &s->st, sizeof(s_stats_t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&s->gen, __ATOMIC_RELAXED) == gen)
+      return 0;
+  }
+
+  return -1;
+}
+
+/*
+ * shard_progress(sh, start, running)
+ * prints the merged counters of all workers published so far
+ */
+static void shard_progress(p_shard_t sh, uint64_t start, int running) {
+  p_stats_t total;
+  p_stats_t part;
+  int i;
+
+  total = (p_stats_t)calloc(1, sizeof(s_stats_t));
+  part = (p_stats_t)calloc(1, sizeof(s_stats_t));
+  if (!total || !part) {
+    free(total);
+    free(part);
+    return;
+  }
+
+  for (i = 0; i < sh->procs; i++)
+    if (shard_read(&sh->slot[i], part) == 0)
+      stats_merge(total, part);
+
+  printf("workers t=%lus running=%i sent=%lu received=%lu failed=%lu "
+         "timeout=%lu p99=%luus\n",
+         (unsigned long)((stats_now_ns() - start) / 1000000000), running,
+         (unsigned long)total->tx, (unsigned long)total->rx,
+         (unsigned long)(total->tx_fail + total->tx_err),
+         (unsigned long)total->timeout,
+         (unsigned long)hist_quantile(&total->rtt, 0.99));
+  fflush(stdout);
+
+  free(total);
+  free(part);
+}
+
+/*
+ * shard_wait(sh)
+ * waits for all workers, prints per worker and merged results;
+ * returns the OR of all worker return codes
+ */
+int shard_wait(p_shard_t sh) {
+  p_stats_t total;
+  p_proxy_t px;
+  p_shard_slot_t s;
+  char gone[SHARD_MAX_PROCS];
+  uint64_t start;
+  pid_t pid;
+  int running;
+  int status;
+  int pcnt;
+  int ret;
+  int i;
+  int j;
+
+  ret = ERR_NON;
+  memset(gone, 0, sizeof(gone));
+  running = sh->procs;
+  start = stats_now_ns();
+  for (;;) {
+    for (i = 0; i < sh->procs; i++) {
+      if (gone[i])
+        continue;
+      status = 0;
+      pid = waitpid(sh->slot[i].pid, &status, WNOHANG);
+      if ((pid == 0) || ((pid < 0) && (errno == EINTR)))
+        continue;
+      gone[i] = 1;
+      running--;
+      if (WIFEXITED(status))
+        ret = ret | WEXITSTATUS(status);
+      else
+        ret = ret | ERR_TMR;
+    }
+    if (running == 0)
+      break;
+    usleep(SHARD_PUBLISH_MS * 1000);
+    shard_progress(sh, start, running);
+  }
+
+  total = (p_stats_t)calloc(1, sizeof(s_stats_t));
+  px = (p_proxy_t)calloc(PROXY_MAX, sizeof(s_proxy_t));
+  if (!total || !px) {
+    fprintf(stderr, "malloc failed, no merged report\n");
+    free(total);
+    free(px);
+    munmap(sh->slot, sh->procs * sizeof(s_shard_slot_t));
+    sh->slot = NULL;
+    return ret | ERR_MEM;
+  }
+  pcnt = 0;
+  for (i = 0; i < sh->procs; i++) {
+    s = &sh->slot[i];
+    if (!__atomic_load_n(&s->done, __ATOMIC_ACQUIRE)) {
+      printf("worker %i (pid %i): no result\n", i, s->pid);
+      ret = ret | ERR_TMR;
+      continue;
+    }
+    printf("worker %i (pid %i): ", i, s->pid);
+    stats_print(stdout, &s->st);
+    stats_merge(total, &s->st);
+    ret = ret | s->ret;
+    /* all workers read the same config, proxies line up by index */
+    for (j = 0; j < s->pcnt; j++) {
+      memcpy(px[j].uri, s->px[j].uri, sizeof(px[j].uri));
+      px[j].reg_ok += s->px[j].reg_ok;
+      px[j].reg_fail += s->px[j].reg_fail;
+      px[j].failovers += s->px[j].failovers;
+      stats_merge(&px[j].st, &s->px[j].st);
+    }
+    if (s->pcnt > pcnt)
+      pcnt = s->pcnt;
+  }
+
+  printf("\n##### merged report of %i workers #####\n", sh->procs);
+  stats_print(stdout, total);
+  if (pcnt > 1) {
+    printf("\n##### merged report per proxy #####\n");
+    proxy_print(stdout, px, pcnt);
+  }
+
+  free(total);
+  free(px);
+  munmap(sh->slot, sh->procs * sizeof(s_shard_slot_t));
+  sh->slot = NULL;
+
+  return ret;
+}
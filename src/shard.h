@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    shard.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief shard.c header file (multi-process sharding)
+ */
+
+#ifndef SHARD_H_INCLUDED
+#define SHARD_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "functions.h"
+
+/******************************************************************** DEFINE */
+
+#define SHARD_MAX_PROCS 256
+#define SHARD_PUBLISH_MS 1000 /* workers publish, the parent prints */
+#define SHARD_READ_TRIES 8    /* retries of a snapshot torn by a publish */
+
+/******************************************************************* TYPEDEF */
+
+/* one slot per worker in the shared segment, written by the worker only */
+typedef struct shard_slot {
+  int pid;
+  int ret;
+  int done;     /* set after the final publish */
+  unsigned gen; /* odd while st and px are being written */
+  s_stats_t st;
+  int pcnt; /* proxies used by the worker */
+  s_proxy_t px[PROXY_MAX];
+} s_shard_slot_t, *p_shard_slot_t;
+
+typedef struct shard {
+  int idx; /* worker index, -1 in the parent */
+  int procs;
+  int base; /* first global session index of this worker */
+  int sessions;
+  p_shard_slot_t slot; /* shared segment, procs entries */
+} s_shard_t, *p_shard_t;
+
+/*************************************************************** PROTOTYPES */
+
+int shard_spawn(int procs, int sessions, p_shard_t sh);
+void shard_start(p_shard_t sh);
+void shard_report(p_shard_t sh, int ret);
+int shard_wait(p_shard_t sh);
+
+#endif // SHARD_H_INCLUDED
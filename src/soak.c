@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    soak.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the soak test function definitions
+ *
+ *  All sessions of the session table chat in cycles (start 21, msgs chat
+ *  messages 22, stop 23) for the configured duration, driven by the session
+ *  state machine (fsm.c). Memory is sampled
+ *  periodically; after a warm-up period the growth rate is estimated by a
+ *  least squares fit and compared against the configured limit.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "soak.h"
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * soak_rss()
+ * returns resident set size of the process in bytes
+ */
+uint64_t soak_rss(void) {
+  unsigned long size;
+  unsigned long rss;
+  FILE *fh;
+
+  if ((fh = fopen("/proc/self/statm", "r")) == NULL)
+    return 0;
+  if (fscanf(fh, "%lu %lu", &size, &rss) != 2)
+    rss = 0;
+  fclose(fh);
+
+  return (uint64_t)rss * sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * soak_slope(smp, cnt, pool)
+ * least squares growth of rss (or pool) in KB per hour
+ */
+static double soak_slope(p_soak_sample_t smp, int cnt, int pool) {
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  double x;
+  double y;
+  double d;
+  int i;
+
+  for (i = 0; i < cnt; i++) {
+    x = smp[i].t_ms / 3600000.0;
+    y = (pool ? smp[i].pool : smp[i].rss) / 1024.0;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+
+  d = cnt * sxx - sx * sx;
+  if (d == 0)
+    return 0;
+
+  return (cnt * sxy - sx * sy) / d;
+}
+
+/*
+ * soak_run(*acc_id, cfg, *uri, *urn)
+ * runs the soak test, returns 0 if memory growth stayed within the limit
+ */
+int soak_run(pjsua_acc_id *acc_id, p_soak_cfg_t cfg, pj_str_t *uri,
+             pj_str_t *urn) {
+  p_soak_sample_t smp;
+  s_fsm_cfg_t fcfg;
+  uint64_t start;
+  uint64_t now;
+  uint64_t next_sample;
+  uint64_t end;
+  double rss_slope;
+  double pool_slope;
+  int max;
+  int cnt;
+  int warm;
+  int nsess;
+
+  nsess = session_count();
+  max = cfg->duration_s / cfg->sample_s + 2;
+  smp = (p_soak_sample_t)calloc(max, sizeof(s_soak_sample_t));
+  if (!smp)
+    return -1;
+
+  /* sessions cycle until fsm_stop() */
+  memset(&fcfg, 0, sizeof(fcfg));
+  fcfg.acc_id = *acc_id;
+  fcfg.uri = *uri;
+  fcfg.urn = *urn;
+  fcfg.msgs = cfg->msgs;
+  fcfg.interval_ms = cfg->interval_s * 1000;
+  fcfg.cycles = 0;
+
+  printf("\n##### soak test: %i sessions, %u s, sample every %u s, "
+         "limit %u KB/h #####\n\n",
+         nsess, cfg->duration_s, cfg->sample_s, cfg->limit_kb_h);
+
+  cnt = 0;
+  start = stats_now_ns() / 1000000;
+  next_sample = start;
+  end = start + (uint64_t)cfg->duration_s * 1000;
+  if (fsm_start(&fcfg) != 0) {
+    free(smp);
+    return -1;
+  }
+
+  for (;;) {
+    now = stats_now_ns() / 1000000;
+
+    if (now >= next_sample) {
+      if (cnt < max) {
+        smp[cnt].t_ms = now - start;
+        smp[cnt].rss = soak_rss();
+        smp[cnt].pool = cfg->pool ? pj_pool_get_used_size(cfg->pool) : 0;
+        printf("soak t=%lus rss=%luKB pool=%luB per-session=%ldB sent=%lu "
+               "received=%lu timeout=%lu\n",
+               (unsigned long)(smp[cnt].t_ms / 1000),
+               (unsigned long)(smp[cnt].rss / 1024),
+               (unsigned long)smp[cnt].pool,
+               (long)((int64_t)(smp[cnt].rss - smp[0].rss) / nsess),
+               (unsigned long)STAT_GET(stats.tx),
+               (unsigned long)STAT_GET(stats.rx),
+               (unsigned long)STAT_GET(stats.timeout));
+        fflush(stdout);
+        cnt++;
+      }
+      next_sample += cfg->sample_s * 1000;
+    }
+
+    if (now >= end)
+      break;
+
+    now = stats_now_ns() / 1000000;
+    if (next_sample > now)
+      loop_sleep(((next_sample < end) ? next_sample : end) - now);
+  }
+  fsm_stop();
+
+  /* steady state only, pools and caches fill up during warm-up */
+  warm = cnt / SOAK_WARMUP_DIV;
+  if (cnt - warm < SOAK_MIN_SAMPLES) {
+    printf("\n##### soak test: too few samples for a growth estimate #####\n");
+  } else {
+    rss_slope = soak_slope(&smp[warm], cnt - warm, 0);
+    pool_slope = soak_slope(&smp[warm], cnt - warm, 1);
+    printf("\n##### soak test: rss %+.1f KB/h, pool %+.1f KB/h "
+           "(%i steady-state samples) #####\n",
+           rss_slope, pool_slope, cnt - warm);
+    if ((rss_slope > cfg->limit_kb_h) || (pool_slope > cfg->limit_kb_h)) {
+      conf->ret = conf->ret | ERR_MEM;
+      printf("##### soak test FAILED: growth exceeds %u KB/h #####\n",
+             cfg->limit_kb_h);
+    }
+  }
+  stats_print(stdout, &stats);
+
+  free(smp);
+
+  return (conf->ret & ERR_MEM) ? 1 : 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ *  @file    soak.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief soak.c header file (long running memory soak test)
+ */
+
+#ifndef SOAK_H_INCLUDED
+#define SOAK_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include "fsm.h"
+#include "functions.h"
+
+/******************************************************************** DEFINE */
+
+#define SOAK_SAMPLE_S 60
+#define SOAK_LIMIT_KB_H 1024
+#define SOAK_MSGS 10
+#define SOAK_INTERVAL_S 1
+#define SOAK_WARMUP_DIV 4 /* first quarter of the samples is warm-up */
+#define SOAK_MIN_SAMPLES 3
+
+/******************************************************************* TYPEDEF */
+
+typedef struct soak_cfg {
+  unsigned duration_s; /* total run time */
+  unsigned interval_s; /* gap between chat messages */
+  unsigned msgs;       /* chat messages before a session is restarted */
+  unsigned sample_s;   /* memory sampling period */
+  unsigned limit_kb_h; /* allowed steady-state growth */
+  pj_pool_t *pool;     /* application pool to account */
+} s_soak_cfg_t, *p_soak_cfg_t;
+
+typedef struct soak_sample {
+  uint64_t t_ms;
+  uint64_t rss;
+  uint64_t pool;
+} s_soak_sample_t, *p_soak_sample_t;
+
+/*************************************************************** PROTOTYPES */
+
+uint64_t soak_rss(void);
+int soak_run(pjsua_acc_id *acc_id, p_soak_cfg_t cfg, pj_str_t *uri,
+             pj_str_t *urn);
+
+#endif // SOAK_H_INCLUDED
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ *  @file    stats.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds counter and histogram function definitions
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "stats.h"
+
+/******************************************************************* GLOBALS */
+
+s_stats_t stats;
+int stats_stages;
+
+static const char *stage_names[STAGES] = {
+    "config", "headers", "pidf-lo", "vcard", "send", "call-info", "validate"};
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * stats_now_ns()
+ * returns monotonic clock in nanoseconds
+ */
+uint64_t stats_now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * hist_index(v)
+ * maps a value to its log-linear bucket
+ */
+static int hist_index(uint64_t v) {
+  int msb;
+  int idx;
+
+  if (v < HIST_SUB_CNT)
+    return (int)v;
+
+  msb = 63 - __builtin_clzll(v);
+  idx = (msb - HIST_SUB_BITS + 1) * HIST_SUB_CNT +
+        (int)((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB_CNT - 1));
+
+  return (idx < HIST_BUCKETS) ? idx : HIST_BUCKETS - 1;
+}
+
+/*
+ * hist_value(idx)
+ * returns the upper bound of a bucket
+ */
+static uint64_t hist_value(int idx) {
+  int msb;
+  uint64_t sub;
+
+  if (idx < HIST_SUB_CNT)
+    return idx;
+
+  msb = idx / HIST_SUB_CNT + HIST_SUB_BITS - 1;
+  sub = idx % HIST_SUB_CNT;
+
+  return ((HIST_SUB_CNT + sub + 1) << (msb - HIST_SUB_BITS)) - 1;
+}
+
+/*
+ * hist_record(h, us)
+ * adds a sample; safe to call from any thread
+ */
+void hist_record(p_hist_t h, uint64_t us) {
+  uint64_t max;
+
+  STAT_INC(h->b[hist_index(us)]);
+  STAT_INC(h->cnt);
+  STAT_ADD(h->sum, us);
+
+  max = STAT_GET(h->max);
+  while ((us > max) && !__atomic_compare_exchange_n(&h->max, &max, us, 1,
+                                                     __ATOMIC_RELAXED,
+                                                     __ATOMIC_RELAXED))
+    ;
+}
+
+/*
+ * hist_quantile(h, q)
+ * returns the value at quantile q (0.0 .. 1.0)
+ */
+uint64_t hist_quantile(const s_hist_t *h, double q) {
+  uint64_t cnt;
+  uint64_t rank;
+  uint64_t acc;
+  int i;
+
+  cnt = STAT_GET(h->cnt);
+  if (cnt == 0)
+    return 0;
+
+  rank = (uint64_t)(q * cnt + 0.5);
+  if (rank < 1)
+    rank = 1;
+
+  acc = 0;
+  for (i = 0; i < HIST_BUCKETS; i++) {
+    acc += STAT_GET(h->b[i]);
+    if (acc >= rank)
+      return (hist_value(i) < h->max) ? hist_value(i) : h->max;
+  }
+
+  return h->max;
+}
+
+/*
+ * hist_merge(dst, src)
+ * adds all samples of src to dst
+ */
+void hist_merge(p_hist_t dst, const s_hist_t *src) {
+  int i;
+
+  for (i = 0; i < HIST_BUCKETS; i++)
+    dst->b[i] += src->b[i];
+  dst->cnt += src->cnt;
+  dst->sum += src->sum;
+  if (src->max > dst->max)
+    dst->max = src->max;
+}
+
+/*
+ * hist_print(fh, name, h)
+ * prints count, mean and quantiles in milliseconds
+ */
+void hist_print(FILE *fh, const char *name, const s_hist_t *h) {
+
+  if (h->cnt == 0) {
+    fprintf(fh, "%-10s n=0\n", name);
+    return;
+  }
+
+  fprintf(fh,
+          "%-10s n=%lu mean=%.3f p50=%.3f p90=%.3f p99=%.3f p999=%.3f "
+          "max=%.3f ms\n",
+          name, (unsigned long)h->cnt, (double)h->sum / h->cnt / 1000.0,
+          hist_quantile(h, 0.50) / 1000.0, hist_quantile(h, 0.90) / 1000.0,
+          hist_quantile(h, 0.99) / 1000.0, hist_quantile(h, 0.999) / 1000.0,
+          h->max / 1000.0);
+}
+
+/*
+ * stats_merge(dst, src)
+ * adds counters and histograms of src to dst
+ */
+void stats_merge(p_stats_t dst, const s_stats_t *src) {
+  int i;
+
+  dst->tx += src->tx;
+  dst->tx_fail += src->tx_fail;
+  dst->tx_err += src->tx_err;
+  dst->rx += src->rx;
+  dst->rx_lost += src->rx_lost;
+  dst->timeout += src->timeout;
+  dst->tx_body += src->tx_body;
+  dst->rx_seq += src->rx_seq;
+  dst->rx_dup += src->rx_dup;
+  dst->rx_gap += src->rx_gap;
+  dst->rx_reorder += src->rx_reorder;
+  dst->rx_late += src->rx_late;
+  dst->tx_defer += src->tx_defer;
+  dst->tx_shed += src->tx_shed;
+  hist_merge(&dst->rtt, &src->rtt);
+  for (i = 0; i <= STATS_MTYPES; i++)
+    dst->rx_mtype[i] += src->rx_mtype[i];
+  for (i = 0; i <= STATS_CODES; i++)
+    dst->tx_code[i] += src->tx_code[i];
+  for (i = 0; i < STAGES; i++)
+    hist_merge(&dst->stage[i], &src->stage[i]);
+}
+
+/*
+ * stats_count_code(status)
+ * counts a final non-2xx response to a MESSAGE
+ */
+void stats_count_code(int status) {
+
+  status -= STATS_CODE_MIN;
+  STAT_INC(stats.tx_code[((status >= 0) && (status < STATS_CODES))
+                             ? status
+                             : STATS_CODES]);
+}
+
+/*
+ * stats_print_codes(fh, st)
+ * prints the status codes of rejected MESSAGE requests
+ */
+static void stats_print_codes(FILE *fh, const s_stats_t *st) {
+  uint64_t cnt;
+  int any;
+  int i;
+
+  any = 0;
+  for (i = 0; i <= STATS_CODES; i++) {
+    if ((cnt = STAT_GET(st->tx_code[i])) == 0)
+      continue;
+    if (!any)
+      fprintf(fh, "rejected  ");
+    if (i < STATS_CODES)
+      fprintf(fh, " %i=%lu", i + STATS_CODE_MIN, (unsigned long)cnt);
+    else
+      fprintf(fh, " other=%lu", (unsigned long)cnt);
+    any = 1;
+  }
+  if (any)
+    fprintf(fh, "\n");
+}
+
+/*
+ * stats_print_mtype(fh, st)
+ * prints the received message types that occurred
+ */
+static void stats_print_mtype(FILE *fh, const s_stats_t *st) {
+  uint64_t cnt;
+  int any;
+  int i;
+
+  any = 0;
+  for (i = 0; i <= STATS_MTYPES; i++) {
+    if ((cnt = STAT_GET(st->rx_mtype[i])) == 0)
+      continue;
+    if (!any)
+      fprintf(fh, "msgtype   ");
+    if (i < STATS_MTYPES)
+      fprintf(fh, " %i=%lu", i, (unsigned long)cnt);
+    else
+      fprintf(fh, " other=%lu", (unsigned long)cnt);
+    any = 1;
+  }
+  if (any)
+    fprintf(fh, "\n");
+}
+
+/*
+ * stats_print(fh, st)
+ * prints counters and reply latency
+ */
+void stats_print(FILE *fh, const s_stats_t *st) {
+
+  fprintf(fh,
+          "sent=%lu failed=%lu rejected=%lu received=%lu unmatched=%lu "
+          "timeout=%lu body=%luB\n",
+          (unsigned long)STAT_GET(st->tx),
+          (unsigned long)STAT_GET(st->tx_fail),
+          (unsigned long)STAT_GET(st->tx_err),
+          (unsigned long)STAT_GET(st->rx),
+          (unsigned long)STAT_GET(st->rx_lost),
+          (unsigned long)STAT_GET(st->timeout),
+          (unsigned long)STAT_GET(st->tx_body));
+  if (STAT_GET(st->rx_seq))
+    fprintf(fh,
+            "sequence   numbered=%lu duplicate=%lu missing=%lu reordered=%lu "
+            "late=%lu\n",
+            (unsigned long)STAT_GET(st->rx_seq),
+            (unsigned long)STAT_GET(st->rx_dup),
+            (unsigned long)STAT_GET(st->rx_gap),
+            (unsigned long)STAT_GET(st->rx_reorder),
+            (unsigned long)STAT_GET(st->rx_late));
+  if (STAT_GET(st->tx_defer) || STAT_GET(st->tx_shed))
+    fprintf(fh, "backoff    deferred=%lu shed=%lu\n",
+            (unsigned long)STAT_GET(st->tx_defer),
+            (unsigned long)STAT_GET(st->tx_shed));
+  hist_print(fh, "reply", &st->rtt);
+  stats_print_codes(fh, st);
+  stats_print_mtype(fh, st);
+  stats_print_stages(fh, st);
+}
+
+/*
+ * stats_print_stages(fh, st)
+ * prints time per pipeline stage in microseconds, if stages were timed
+ */
+void stats_print_stages(FILE *fh, const s_stats_t *st) {
+  const s_hist_t *h;
+  int i;
+
+  for (i = 0; i < STAGES; i++) {
+    h = &st->stage[i];
+    if (STAT_GET(h->cnt) == 0)
+      continue;
+    fprintf(fh,
+            "%-10s n=%lu mean=%.2f p50=%.2f p99=%.2f max=%.2f total=%.1f "
+            "us\n",
+            stage_names[i], (unsigned long)h->cnt,
+            (double)h->sum / h->cnt / 1000.0, hist_quantile(h, 0.50) / 1000.0,
+            hist_quantile(h, 0.99) / 1000.0, h->max / 1000.0,
+            h->sum / 1000.0);
+  }
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ *  @file    stats.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief stats.c header file (counters and latency histograms)
+ */
+
+#ifndef STATS_H_INCLUDED
+#define STATS_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/******************************************************************** DEFINE */
+
+/* log-linear buckets: 16 linear sub buckets per power of two (~6% error) */
+#define HIST_SUB_BITS 4
+#define HIST_SUB_CNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (40 * HIST_SUB_CNT)
+
+/* received DEC112 message types 0..STATS_MTYPES-1, one slot for others */
+#define STATS_MTYPES 32
+
+/* final non-2xx responses STATS_CODE_MIN..699, one slot for others */
+#define STATS_CODE_MIN 300
+#define STATS_CODES 400
+
+#define STAT_INC(f) __atomic_fetch_add(&(f), 1, __ATOMIC_RELAXED)
+#define STAT_ADD(f, v) __atomic_fetch_add(&(f), (v), __ATOMIC_RELAXED)
+#define STAT_GET(f) __atomic_load_n(&(f), __ATOMIC_RELAXED)
+
+/* per-stage timers (--stages), no clock read when disabled */
+#define STAGE_START() (stats_stages ? stats_now_ns() : 0)
+#define STAGE_STOP(s, t)                                                       \
+  do {                                                                         \
+    if (t)                                                                     \
+      hist_record(&stats.stage[(s)], stats_now_ns() - (t));                   \
+  } while (0)
+
+/* pipeline stages */
+enum {
+  STAGE_CONFIG = 0, /* call id, device id, uri and url in main() */
+  STAGE_HEADERS,    /* Call-Info, Geolocation and test headers */
+  STAGE_PIDFLO,     /* create_pidflo() */
+  STAGE_VCARD,      /* create_vcard() */
+  STAGE_SEND,       /* pjsua_im_send() */
+  STAGE_CALLINFO,   /* Call-Info parsing of a received MESSAGE */
+  STAGE_VALIDATE,   /* received body compared with the eval text */
+  STAGES
+};
+
+/******************************************************************* TYPEDEF */
+
+/* latency histogram, values in microseconds */
+typedef struct hist {
+  uint64_t cnt;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t b[HIST_BUCKETS];
+} s_hist_t, *p_hist_t;
+
+/* process wide counters, updated lock-free from the pjsua callbacks */
+typedef struct stats {
+  uint64_t tx;      /* MESSAGE requests handed to pjsua */
+  uint64_t tx_fail; /* pjsua_im_send() errors */
+  uint64_t tx_err;  /* MESSAGE answered with a final non-2xx response */
+  uint64_t rx;      /* MESSAGE requests received */
+  uint64_t rx_lost; /* received, but no matching session */
+  uint64_t timeout; /* no reply within TIMEOUT_CNT */
+  uint64_t tx_body; /* bytes of text and body parts handed to pjsua */
+  uint64_t rx_seq;     /* received with a sequence number */
+  uint64_t rx_dup;     /* sequence number received before */
+  uint64_t rx_gap;     /* sequence numbers not received (yet) */
+  uint64_t rx_reorder; /* received after a higher number */
+  uint64_t rx_late;    /* too far behind to tell */
+  uint64_t tx_defer;   /* message held back by a backoff */
+  uint64_t tx_shed;    /* message dropped by a backoff */
+  s_hist_t rtt;     /* request sent -> reply MESSAGE received */
+  uint64_t rx_mtype[STATS_MTYPES + 1]; /* received per message type */
+  uint64_t tx_code[STATS_CODES + 1];   /* rejected per status code */
+  s_hist_t stage[STAGES]; /* time per pipeline stage in nanoseconds */
+} s_stats_t, *p_stats_t;
+
+/****************************************************************** GLOBALS */
+
+extern s_stats_t stats;
+extern int stats_stages;
+
+/*************************************************************** PROTOTYPES */
+
+uint64_t stats_now_ns(void);
+void hist_record(p_hist_t h, uint64_t us);
+uint64_t hist_quantile(const s_hist_t *h, double q);
+void hist_merge(p_hist_t dst, const s_hist_t *src);
+void hist_print(FILE *fh, const char *name, const s_hist_t *h);
+void stats_merge(p_stats_t dst, const s_stats_t *src);
+void stats_count_code(int status);
+void stats_print(FILE *fh, const s_stats_t *st);
+void stats_print_stages(FILE *fh, const s_stats_t *st);
+
+#endif // STATS_H_INCLUDED
@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    stream.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the streaming function definitions
+ *
+ *  An upstream process writes chat messages, one per line, to stdin or a
+ *  FIFO; a line may start with a session number and a tab. All sessions
+ *  are started first, then input is read in large blocks and every line
+ *  goes to its session, or to the next session without an outstanding
+ *  request. A session takes one request at a time and at most inflight
+ *  requests wait for a reply; beyond that no more input is read, the pipe
+ *  fills up and the writer blocks.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "stream.h"
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * stream_idle(sess)
+ * returns 1 if a session can take the next message; a session backing
+ * off after a 486/503 cannot, so the input waits
+ */
+static int stream_idle(p_session_t sess) {
+  pj_str_t rto;
+  char *reply;
+
+  if (!(reply = __atomic_load_n(&sess->reply, __ATOMIC_ACQUIRE)) ||
+      sess->closed || __atomic_load_n(&sess->tx_ns, __ATOMIC_ACQUIRE))
+    return 0;
+  rto = pj_str(reply);
+
+  return flow_wait(&sess->flow, &rto) == 0;
+}
+
+/*
+ * stream_expire(timeout_ns)
+ * gives up on requests older than timeout_ns; returns number expired
+ */
+static int stream_expire(uint64_t timeout_ns) {
+  p_session_t sess;
+  uint64_t tx_ns;
+  uint64_t now;
+  int cnt;
+  int i;
+
+  now = stats_now_ns();
+  cnt = 0;
+  for (i = 0; i < session_count(); i++) {
+    sess = session_get(i);
+    tx_ns = __atomic_load_n(&sess->tx_ns, __ATOMIC_ACQUIRE);
+    if (tx_ns && (now - tx_ns > timeout_ns) &&
+        __atomic_compare_exchange_n(&sess->tx_ns, &tx_ns, 0, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      STAT_INC(stats.timeout);
+      STAT_INC(sess->timeout);
+      cnt++;
+    }
+  }
+
+  return cnt;
+}
+
+/*
+ * stream_target(line, cursor, text)
+ * picks the session of a line and points text at the message; returns
+ * NULL if the session cannot take it yet, *text.slen < 0 for a bad tag
+ */
+static p_session_t stream_target(char *line, int *cursor, pj_str_t *text) {
+  p_session_t sess;
+  char *p;
+  long idx;
+  int n;
+
+  idx = strtol(line, &p, 10);
+  if ((p != line) && (*p == '\t')) {
+    text->ptr = p + 1;
+    text->slen = strlen(p + 1);
+    if ((idx < 0) || (idx >= session_count())) {
+      text->slen = -1;
+      return NULL;
+    }
+    sess = session_get(idx);
+    return stream_idle(sess) ? sess : NULL;
+  }
+
+  text->ptr = line;
+  text->slen = strlen(line);
+  for (n = 0; n < session_count(); n++) {
+    sess = session_get(*cursor);
+    *cursor = (*cursor + 1) % session_count();
+    if (stream_idle(sess))
+      return sess;
+  }
+
+  return NULL;
+}
+
+/*
+ * stream_wait(timeout_ms)
+ * polls until no open session is waiting for a reply
+ */
+static void stream_wait(uint64_t timeout_ms) {
+  uint64_t start;
+  p_session_t sess;
+  int pending;
+  int i;
+
+  start = stats_now_ns() / 1000000;
+  do {
+    pending = 0;
+    for (i = 0; i < session_count(); i++) {
+      sess = session_get(i);
+      if (!sess->closed && __atomic_load_n(&sess->tx_ns, __ATOMIC_ACQUIRE))
+        pending++;
+    }
+    if (pending == 0)
+      break;
+    loop_sleep(STREAM_POLL_MS);
+  } while (stats_now_ns() / 1000000 - start < timeout_ms);
+}
+
+/*
+ * stream_run(*acc_id, path, inflight, *uri, *urn)
+ * starts all sessions and sends every line read from path ("-" is stdin)
+ * as chat message; returns number of messages sent
+ */
+int stream_run(pjsua_acc_id *acc_id, const char *path, int inflight,
+               pj_str_t *uri, pj_str_t *urn) {
+  struct pollfd pfd;
+  p_session_t sess;
+  pj_str_t text;
+  pj_str_t rto;
+  uint64_t timeout_ns;
+  uint64_t start;
+  uint64_t now;
+  uint64_t next_report;
+  uint64_t stall_ms;
+  uint64_t rtt0;
+  char tmp[BUFFER_128 + 1];
+  char *buf;
+  char *line;
+  char *eol;
+  size_t len;
+  ssize_t n;
+  long lines;
+  long sent;
+  long bad;
+  long done;
+  int cursor;
+  int eof;
+  int skip;
+  int fd;
+  int i;
+
+  if (!strcmp(path, "-"))
+    fd = STDIN_FILENO;
+  else if ((fd = open(path, O_RDONLY)) < 0) {
+    PJ_LOG(2, (THIS_FILE, "Error opening file: %s\n", path));
+    return -1;
+  }
+  buf = (char *)malloc(STREAM_BUF + 1);
+  if (!buf) {
+    PJ_LOG(1, (THIS_FILE, "malloc failed\n"));
+    if (fd != STDIN_FILENO)
+      close(fd);
+    return -1;
+  }
+  if ((inflight < 1) || (inflight > session_count()))
+    inflight = session_count();
+
+  /* every session needs the Reply-To of its start message */
+  for (i = 0; i < session_count(); i++) {
+    sess = session_get(i);
+    session_reset(sess);
+    snprintf(tmp, BUFFER_128, "session %i start", sess->idx);
+    text = pj_str(tmp);
+    send_dec112_msg(acc_id, sess, &text, uri, urn, 21);
+  }
+  stream_wait(TIMEOUT_CNT * TIMEOUT_MS);
+  timeout_ns = (uint64_t)TIMEOUT_CNT * TIMEOUT_MS * 1000000;
+  if (stream_expire(0) > 0) {
+    conf->ret = conf->ret | ERR_MSG;
+    PJ_LOG(2, (THIS_FILE, "Reply-To header missing.\n"));
+  }
+
+  printf("\n##### streaming %s to %i sessions, %i in flight #####\n\n",
+         path, session_count(), inflight);
+
+  len = 0;
+  lines = 0;
+  sent = 0;
+  bad = 0;
+  done = 0;
+  cursor = 0;
+  eof = 0;
+  skip = 0;
+  stall_ms = 0;
+  rtt0 = STAT_GET(stats.rtt.cnt);
+  start = stats_now_ns() / 1000000;
+  next_report = start + STREAM_REPORT_MS;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+
+  for (;;) {
+    now = stats_now_ns() / 1000000;
+    if (now >= next_report) {
+      done += stream_expire(timeout_ns);
+      printf("stream t=%lus lines=%li sent=%li in-flight=%li stalled=%.1fs "
+             "received=%lu timeout=%lu\n",
+             (unsigned long)((now - start) / 1000), lines, sent,
+             sent - done - (long)(STAT_GET(stats.rtt.cnt) - rtt0),
+             stall_ms / 1000.0, (unsigned long)STAT_GET(stats.rx),
+             (unsigned long)STAT_GET(stats.timeout));
+      fflush(stdout);
+      next_report += STREAM_REPORT_MS;
+    }
+
+    eol = memchr(buf, '\n', len);
+    if (!eol && eof && (len > 0))
+      eol = buf + len; /* last line without newline */
+    if (!eol && eof)
+      break;
+
+    if (!eol) {
+      /* batch read, whatever the writer has queued */
+      if (len == STREAM_BUF) {
+        len = 0; /* overlong line, dropped up to its newline */
+        skip = 1;
+        bad++;
+        continue;
+      }
+      if (poll(&pfd, 1, STREAM_POLL_MS) <= 0)
+        continue;
+      n = read(fd, buf + len, STREAM_BUF - len);
+      if (n <= 0) {
+        eof = 1;
+        continue;
+      }
+      len += n;
+      if (skip) {
+        /* rest of the overlong line, the next one starts after it */
+        eol = memchr(buf, '\n', len);
+        if (!eol) {
+          len = 0;
+          continue;
+        }
+        eol++;
+        len -= eol - buf;
+        memmove(buf, eol, len);
+        skip = 0;
+      }
+      continue;
+    }
+
+    /* backpressure, the input waits until replies come in */
+    if (sent - done - (long)(STAT_GET(stats.rtt.cnt) - rtt0) >= inflight) {
+      loop_sleep(STREAM_STALL_MS);
+      stall_ms += STREAM_STALL_MS;
+      continue;
+    }
+
+    line = buf;
+    *eol = '\0';
+    if ((eol > line) && (eol[-1] == '\r'))
+      eol[-1] = '\0';
+    sess = (*line != '\0') ? stream_target(line, &cursor, &text) : NULL;
+    if ((*line != '\0') && !sess && (text.slen >= 0)) {
+      /* its session is still busy */
+      loop_sleep(STREAM_STALL_MS);
+      stall_ms += STREAM_STALL_MS;
+      *eol = '\n';
+      continue;
+    }
+    if (sess) {
+      rto = pj_str(sess->reply);
+      if (send_dec112_msg(acc_id, sess, &text, &rto, &rto, 22) == PJ_SUCCESS)
+        sent++;
+    } else if (*line != '\0') {
+      bad++;
+    }
+    lines++;
+
+    /* consume the line */
+    if (eol < buf + len)
+      eol++;
+    len -= eol - buf;
+    memmove(buf, eol, len);
+  }
+
+  free(buf);
+  if (fd != STDIN_FILENO)
+    close(fd);
+
+  stream_wait(TIMEOUT_CNT * TIMEOUT_MS);
+  if (stream_expire(0) > 0)
+    conf->ret = conf->ret | ERR_TMR;
+
+  for (i = 0; i < session_count(); i++) {
+    sess = session_get(i);
+    if (!sess->reply || sess->closed)
+      continue;
+    snprintf(tmp, BUFFER_128, "session %i stop", sess->idx);
+    text = pj_str(tmp);
+    rto = pj_str(sess->reply);
+    send_dec112_msg(acc_id, sess, &text, &rto, &rto, 23);
+  }
+
+  printf("\n##### stream of %li lines: %li sent, %li bad, "
+         "stalled %.1fs #####\n",
+         lines, sent, bad, stall_ms / 1000.0);
+  stats_print(stdout, &stats);
+
+  return sent;
+}
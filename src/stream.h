@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    stream.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief stream.c header file (messages streamed from stdin or a FIFO)
+ */
+
+#ifndef STREAM_H_INCLUDED
+#define STREAM_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <fcntl.h>
+#include <poll.h>
+
+#include "functions.h"
+
+/******************************************************************** DEFINE */
+
+#define STREAM_BUF (64 * 1024) /* read size, also the longest line */
+#define STREAM_INFLIGHT 64     /* requests waiting for a reply */
+#define STREAM_POLL_MS 10
+#define STREAM_STALL_MS 1
+#define STREAM_REPORT_MS 1000
+
+/*************************************************************** PROTOTYPES */
+
+int stream_run(pjsua_acc_id *acc_id, const char *path, int inflight,
+               pj_str_t *uri, pj_str_t *urn);
+
+#endif // STREAM_H_INCLUDED
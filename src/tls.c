@@ -0,0 +1,625 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    tls.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the TLS settings and benchmark function definitions
+ *
+ *  tls_apply() maps the tls_* config keys onto the pjsip TLS transport.
+ *  Every real pjsip TLS connection is timed from the first message queued
+ *  on it (TCP connect and handshake start) until the transport reports it
+ *  established. pjsip runs the handshake on its ioqueue threads and offers
+ *  no client side session cache, so CPU time and resumption are measured
+ *  separately by tls_bench(): it connects to the proxy with the same CA,
+ *  certificate, cipher and protocol settings, runs full handshakes and then
+ *  handshakes offering the cached session (ticket or session id), and
+ *  reports latency and CPU time.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "tls.h"
+
+/******************************************************************* GLOBALS */
+
+static s_tls_conn_t tls_conn[TLS_CONN_MAX];
+static s_tls_stats_t tls_stats;
+static pthread_mutex_t tls_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pj_status_t tls_on_tx(pjsip_tx_data *tdata);
+
+/* notes when the first message is queued on a new TLS connection */
+static pjsip_module mod_tls = {
+    NULL,
+    NULL,                                  /* prev, next */
+    {"mod-pjchat-tls", 14},                /* name */
+    -1,                                    /* id */
+    PJSIP_MOD_PRIORITY_TRANSPORT_LAYER - 1, /* priority */
+    NULL,                                  /* load() */
+    NULL,                                  /* start() */
+    NULL,                                  /* stop() */
+    NULL,                                  /* unload() */
+    NULL,                                  /* on_rx_request() */
+    NULL,                                  /* on_rx_response() */
+    &tls_on_tx,                            /* on_tx_request() */
+    &tls_on_tx,                            /* on_tx_response() */
+    NULL,                                  /* on_tsx_state() */
+};
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * tls_proto(name)
+ * maps a tls_proto config value to the pj_ssl_sock protocol bits
+ */
+static unsigned tls_proto(const char *name) {
+
+  if (!name)
+    return PJ_SSL_SOCK_PROTO_DEFAULT;
+  if (!strcmp(name, "1.0"))
+    return PJ_SSL_SOCK_PROTO_TLS1;
+  if (!strcmp(name, "1.1"))
+    return PJ_SSL_SOCK_PROTO_TLS1_1;
+  if (!strcmp(name, "1.2"))
+    return PJ_SSL_SOCK_PROTO_TLS1_2;
+  if (!strcmp(name, "1.3"))
+    return PJ_SSL_SOCK_PROTO_TLS1_3;
+
+  PJ_LOG(2, (THIS_FILE, "unknown tls_proto %s, using default\n", name));
+
+  return PJ_SSL_SOCK_PROTO_DEFAULT;
+}
+
+/*
+ * tls_apply(ts, pool)
+ * fills the pjsip TLS settings from the config
+ */
+void tls_apply(pjsip_tls_setting *ts, pj_pool_t *pool) {
+  pj_ssl_cipher id;
+  char *list;
+  char *name;
+  char *save;
+
+  if (conf->tls_ca)
+    ts->ca_list_file = pj_str(conf->tls_ca);
+  if (conf->tls_cert)
+    ts->cert_file = pj_str(conf->tls_cert);
+  if (conf->tls_key)
+    ts->privkey_file = pj_str(conf->tls_key);
+  if (conf->tls_passwd)
+    ts->password = pj_str(conf->tls_passwd);
+  if (conf->tls_verify)
+    ts->verify_server = atoi(conf->tls_verify) ? PJ_TRUE : PJ_FALSE;
+  ts->proto = tls_proto(conf->tls_proto);
+
+  if (!conf->tls_ciphers)
+    return;
+
+  /* OpenSSL style names, separated by ':' or ',' */
+  ts->ciphers = pj_pool_calloc(pool, TLS_MAX_CIPHERS, sizeof(pj_ssl_cipher));
+  ts->ciphers_num = 0;
+  list = strdup(conf->tls_ciphers);
+  for (name = strtok_r(list, ":,", &save);
+       name && (ts->ciphers_num < TLS_MAX_CIPHERS);
+       name = strtok_r(NULL, ":,", &save)) {
+    id = pj_ssl_cipher_id(name);
+    if (id == PJ_TLS_UNKNOWN_CIPHER) {
+      PJ_LOG(2, (THIS_FILE, "cipher %s not supported, ignored\n", name));
+      continue;
+    }
+    ts->ciphers[ts->ciphers_num++] = id;
+  }
+  free(list);
+}
+
+/*
+ * tls_find(tp, add)
+ * returns the slot of tp, a free one if add; called with tls_lock held
+ */
+static p_tls_conn_t tls_find(pjsip_transport *tp, int add) {
+  p_tls_conn_t c;
+  int i;
+
+  c = NULL;
+  for (i = 0; i < TLS_CONN_MAX; i++) {
+    if (tls_conn[i].tp == tp)
+      return &tls_conn[i];
+    if (!c && !tls_conn[i].tp)
+      c = &tls_conn[i];
+  }
+  if (!add || !c)
+    return NULL;
+
+  c->tp = tp;
+  c->t0_ns = 0;
+
+  return c;
+}
+
+/*
+ * tls_on_tx(tdata)
+ * starts the clock of a TLS connection with its first message
+ */
+static pj_status_t tls_on_tx(pjsip_tx_data *tdata) {
+  pjsip_transport *tp;
+  p_tls_conn_t c;
+
+  tp = tdata->tp_info.transport;
+  if (!tp || !(tp->flag & PJSIP_TRANSPORT_SECURE))
+    return PJ_SUCCESS;
+
+  pthread_mutex_lock(&tls_lock);
+  if (!tls_find(tp, 0) && (c = tls_find(tp, 1)))
+    c->t0_ns = stats_now_ns();
+  pthread_mutex_unlock(&tls_lock);
+
+  return PJ_SUCCESS;
+}
+
+/*
+ * tls_start()
+ * times the pjsip TLS connections; call after pjsua_init()
+ */
+int tls_start(void) {
+
+  memset(&tls_stats, 0, sizeof(tls_stats));
+  memset(tls_conn, 0, sizeof(tls_conn));
+  if (mod_tls.id != -1)
+    return 0;
+
+  return (pjsip_endpt_register_module(pjsua_get_pjsip_endpt(), &mod_tls) ==
+          PJ_SUCCESS)
+             ? 0
+             : -1;
+}
+
+/*
+ * tls_connected(tp)
+ * records the setup time of an established connection
+ */
+static void tls_connected(pjsip_transport *tp) {
+  p_tls_conn_t c;
+  uint64_t us;
+
+  us = 0;
+  pthread_mutex_lock(&tls_lock);
+  c = tls_find(tp, 0);
+  if (c && c->t0_ns) {
+    us = (stats_now_ns() - c->t0_ns) / 1000;
+    hist_record(&tls_stats.setup, us);
+    c->t0_ns = 0;
+  } else {
+    /* opened by the peer or before the module was registered */
+    tls_find(tp, 1);
+    tls_stats.untimed++;
+  }
+  tls_stats.connected++;
+  pthread_mutex_unlock(&tls_lock);
+
+  if (us)
+    PJ_LOG(3, (THIS_FILE, "TLS connection %s established after %.3f ms\n",
+               tp->obj_name, us / 1000.0));
+}
+
+/*
+ * tls_closed(tp)
+ * forgets a closed connection, its transport may be reused
+ */
+static void tls_closed(pjsip_transport *tp) {
+  p_tls_conn_t c;
+
+  pthread_mutex_lock(&tls_lock);
+  if ((c = tls_find(tp, 0))) {
+    c->tp = NULL;
+    tls_stats.closed++;
+  }
+  pthread_mutex_unlock(&tls_lock);
+}
+
+/*
+ * tls_print(fh)
+ * prints connection count and setup times of the pjsip TLS connections
+ */
+void tls_print(FILE *fh) {
+
+  if (mod_tls.id == -1)
+    return;
+
+  pthread_mutex_lock(&tls_lock);
+  fprintf(fh, "tls connections: established=%lu untimed=%lu closed=%lu\n",
+          (unsigned long)tls_stats.connected,
+          (unsigned long)tls_stats.untimed, (unsigned long)tls_stats.closed);
+  hist_print(fh, "tls-setup", &tls_stats.setup);
+  pthread_mutex_unlock(&tls_lock);
+}
+
+/*
+ * tls_on_transport_state(tp, state, info)
+ * logs what was negotiated whenever a TLS connection comes up or goes down
+ */
+void tls_on_transport_state(pjsip_transport *tp, pjsip_transport_state state,
+                            const pjsip_transport_state_info *info) {
+  pjsip_tls_state_info *ti;
+  pj_ssl_sock_info *si;
+  const char *verify[8];
+  unsigned cnt;
+
+  if (!(tp->flag & PJSIP_TRANSPORT_SECURE))
+    return;
+
+  if ((state == PJSIP_TP_STATE_DISCONNECTED) ||
+      (state == PJSIP_TP_STATE_DESTROY)) {
+    if (state == PJSIP_TP_STATE_DISCONNECTED)
+      PJ_LOG(2, (THIS_FILE, "TLS connection %s closed (%i)\n", tp->obj_name,
+                 info ? info->status : 0));
+    tls_closed(tp);
+    return;
+  }
+
+  if ((state != PJSIP_TP_STATE_CONNECTED) || !info || !info->ext_info)
+    return;
+
+  ti = (pjsip_tls_state_info *)info->ext_info;
+  si = ti->ssl_sock_info;
+  if (!si || !si->established)
+    return;
+  tls_connected(tp);
+
+  PJ_LOG(3, (THIS_FILE, "TLS connection %s: cipher %s, proto 0x%x\n",
+             tp->obj_name, pj_ssl_cipher_name(si->cipher), si->proto));
+
+  if (si->verify_status != 0) {
+    cnt = PJ_ARRAY_SIZE(verify);
+    pj_ssl_cert_get_verify_status_strings(si->verify_status, verify, &cnt);
+    while (cnt > 0)
+      PJ_LOG(2, (THIS_FILE, "TLS verify: %s\n", verify[--cnt]));
+  }
+}
+
+/*
+ * tls_cpu_us()
+ * returns CPU time of the calling thread in microseconds
+ */
+static uint64_t tls_cpu_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * tls_target(host, hlen, port, plen)
+ * takes host and port from the proxy URI of the config
+ */
+static int tls_target(char *host, size_t hlen, char *port, size_t plen) {
+  const char *p;
+  size_t n;
+
+  if (!conf->proxy)
+    return -1;
+
+  p = conf->proxy;
+  if (!strncmp(p, "sips:", 5))
+    p += 5;
+  else if (!strncmp(p, "sip:", 4))
+    p += 4;
+
+  n = strcspn(p, ":;>");
+  if ((n == 0) || (n >= hlen))
+    return -1;
+  memcpy(host, p, n);
+  host[n] = '\0';
+
+  if (p[n] == ':')
+    snprintf(port, plen, "%.*s", (int)strcspn(p + n + 1, ";>"), p + n + 1);
+  else
+    snprintf(port, plen, "%i", TLS_PORT);
+
+  return 0;
+}
+
+/*
+ * tls_connect(res)
+ * opens a TCP connection to the first address that accepts
+ */
+static int tls_connect(struct addrinfo *res) {
+  struct addrinfo *ai;
+  int fd;
+
+  for (ai = res; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0)
+      continue;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      return fd;
+    close(fd);
+  }
+
+  return -1;
+}
+
+/*
+ * tls_new_session(ssl, sess)
+ * keeps the most recent session (TLS 1.3 ticket) for resumption
+ */
+static int tls_new_session(SSL *ssl, SSL_SESSION *sess) {
+  p_tls_bench_t tb;
+
+  tb = (p_tls_bench_t)SSL_get_app_data(ssl);
+  if (tb->cache)
+    SSL_SESSION_free(tb->cache);
+  tb->cache = sess;
+  tb->tickets++;
+
+  /* we keep the reference */
+  return 1;
+}
+
+/*
+ * tls_tickets(ssl, fd, tb, tickets)
+ * TLS 1.3 tickets follow the handshake and are single use; reads until a
+ * new one arrived or TLS_TICKET_WAIT_MS passed
+ */
+static void tls_tickets(SSL *ssl, int fd, p_tls_bench_t tb, int tickets) {
+  struct pollfd pfd;
+  uint64_t end;
+  uint64_t now;
+  char byte;
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  end = stats_now_ns() / 1000000 + TLS_TICKET_WAIT_MS;
+  while (tb->tickets == tickets) {
+    now = stats_now_ns() / 1000000;
+    if ((now >= end) || (poll(&pfd, 1, end - now) <= 0))
+      break;
+    if ((SSL_peek(ssl, &byte, 1) <= 0) &&
+        (SSL_get_error(ssl, 0) != SSL_ERROR_WANT_READ))
+      break;
+  }
+  ERR_clear_error();
+}
+
+/*
+ * tls_ctx(void)
+ * creates a client context with the configured TLS settings
+ */
+static SSL_CTX *tls_ctx(void) {
+  SSL_CTX *ctx;
+  char suites[BUFFER_512 + 1];
+  char ciphers[BUFFER_512 + 1];
+  char *list;
+  char *name;
+  char *save;
+  char *c;
+
+  ctx = SSL_CTX_new(TLS_client_method());
+  if (!ctx)
+    return NULL;
+
+  switch (tls_proto(conf->tls_proto)) {
+  case PJ_SSL_SOCK_PROTO_TLS1:
+    SSL_CTX_set_min_proto_version(ctx, TLS1_VERSION);
+    SSL_CTX_set_max_proto_version(ctx, TLS1_VERSION);
+    break;
+  case PJ_SSL_SOCK_PROTO_TLS1_1:
+    SSL_CTX_set_min_proto_version(ctx, TLS1_1_VERSION);
+    SSL_CTX_set_max_proto_version(ctx, TLS1_1_VERSION);
+    break;
+  case PJ_SSL_SOCK_PROTO_TLS1_2:
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    break;
+  case PJ_SSL_SOCK_PROTO_TLS1_3:
+    SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION);
+    SSL_CTX_set_max_proto_version(ctx, TLS1_3_VERSION);
+    break;
+  default:
+    break;
+  }
+
+  if (conf->tls_ciphers) {
+    /* TLS 1.3 suites (TLS_*) and older ciphers are configured separately */
+    list = strdup(conf->tls_ciphers);
+    suites[0] = '\0';
+    ciphers[0] = '\0';
+    for (name = strtok_r(list, ":,", &save); name;
+         name = strtok_r(NULL, ":,", &save)) {
+      c = strncmp(name, "TLS_", 4) ? ciphers : suites;
+      if (strlen(c) + strlen(name) + 2 > BUFFER_512)
+        continue;
+      if (*c)
+        strcat(c, ":");
+      strcat(c, name);
+    }
+    free(list);
+    if (*ciphers && !SSL_CTX_set_cipher_list(ctx, ciphers))
+      PJ_LOG(2, (THIS_FILE, "no usable cipher in %s\n", ciphers));
+    if (*suites && !SSL_CTX_set_ciphersuites(ctx, suites))
+      PJ_LOG(2, (THIS_FILE, "no usable cipher suite in %s\n", suites));
+  }
+
+  if (conf->tls_ca && !SSL_CTX_load_verify_locations(ctx, conf->tls_ca, NULL))
+    PJ_LOG(2, (THIS_FILE, "cannot load CA list %s\n", conf->tls_ca));
+  if (conf->tls_passwd)
+    SSL_CTX_set_default_passwd_cb_userdata(ctx, conf->tls_passwd);
+  if (conf->tls_cert &&
+      !SSL_CTX_use_certificate_chain_file(ctx, conf->tls_cert))
+    PJ_LOG(2, (THIS_FILE, "cannot load certificate %s\n", conf->tls_cert));
+  if (conf->tls_key &&
+      !SSL_CTX_use_PrivateKey_file(ctx, conf->tls_key, SSL_FILETYPE_PEM))
+    PJ_LOG(2, (THIS_FILE, "cannot load private key %s\n", conf->tls_key));
+  SSL_CTX_set_verify(ctx,
+                     (conf->tls_verify && atoi(conf->tls_verify))
+                         ? SSL_VERIFY_PEER
+                         : SSL_VERIFY_NONE,
+                     NULL);
+
+  /* the client cache is ours, see tls_new_session() */
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT |
+                                          SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(ctx, tls_new_session);
+
+  ERR_clear_error();
+
+  return ctx;
+}
+
+/*
+ * tls_handshake(ctx, res, host, resume, tb)
+ * one connection with one handshake, offers the cached session if resume
+ */
+static int tls_handshake(SSL_CTX *ctx, struct addrinfo *res, const char *host,
+                         int resume, p_tls_bench_t tb) {
+  uint64_t t0;
+  uint64_t t1;
+  uint64_t c0;
+  uint64_t c1;
+  SSL *ssl;
+  int tickets;
+  int reused;
+  int fd;
+
+  t0 = stats_now_ns();
+  if ((fd = tls_connect(res)) < 0)
+    return -1;
+  t1 = stats_now_ns();
+  hist_record(&tb->tcp, (t1 - t0) / 1000);
+
+  ssl = SSL_new(ctx);
+  SSL_set_fd(ssl, fd);
+  SSL_set_app_data(ssl, tb);
+  SSL_set_tlsext_host_name(ssl, host);
+  if (resume && tb->cache) {
+    SSL_set_session(ssl, tb->cache);
+    tb->offered++;
+  }
+
+  tickets = tb->tickets;
+  c0 = tls_cpu_us();
+  t0 = stats_now_ns();
+  if (SSL_connect(ssl) != 1) {
+    ERR_clear_error();
+    SSL_free(ssl);
+    close(fd);
+    return -1;
+  }
+  t1 = stats_now_ns();
+  c1 = tls_cpu_us();
+
+  reused = SSL_session_reused(ssl);
+  hist_record(reused ? &tb->resumed : &tb->full, (t1 - t0) / 1000);
+  hist_record(reused ? &tb->cpu_res : &tb->cpu_full, c1 - c0);
+
+  if (SSL_version(ssl) >= TLS1_3_VERSION)
+    tls_tickets(ssl, fd, tb, tickets);
+
+  PJ_LOG(4, (THIS_FILE, "%s %s%s\n", SSL_get_version(ssl),
+             SSL_get_cipher_name(ssl), reused ? " resumed" : ""));
+
+  SSL_shutdown(ssl);
+  SSL_free(ssl);
+  close(fd);
+
+  return reused;
+}
+
+/*
+ * tls_bench(cnt)
+ * runs cnt full and cnt resumed handshakes against the configured proxy;
+ * returns ERR_TMR if a connection or handshake failed
+ */
+int tls_bench(int cnt) {
+  struct addrinfo hints;
+  struct addrinfo *res;
+  p_tls_bench_t tb;
+  SSL_CTX *ctx;
+  char host[BUFFER_128 + 1];
+  char port[BUFFER_128 + 1];
+  int reused;
+  int ret;
+  int i;
+
+  if (tls_target(host, BUFFER_128, port, BUFFER_128) != 0) {
+    PJ_LOG(2, (THIS_FILE, "no proxy host in config\n"));
+    return ERR_REG;
+  }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, port, &hints, &res) != 0) {
+    PJ_LOG(2, (THIS_FILE, "cannot resolve %s\n", host));
+    return ERR_REG;
+  }
+
+  if (!(ctx = tls_ctx())) {
+    freeaddrinfo(res);
+    return ERR_REG;
+  }
+
+  tb = (p_tls_bench_t)calloc(1, sizeof(s_tls_bench_t));
+  if (!tb) {
+    SSL_CTX_free(ctx);
+    freeaddrinfo(res);
+    return ERR_MEM;
+  }
+  reused = 0;
+
+  printf("\n##### TLS handshake benchmark %s:%s, %i handshakes each #####\n\n",
+         host, port, cnt);
+
+  for (i = 0; i < cnt; i++) {
+    if (tls_handshake(ctx, res, host, 0, tb) < 0)
+      tb->failed++;
+  }
+  for (i = 0; i < cnt; i++) {
+    ret = tls_handshake(ctx, res, host, 1, tb);
+    if (ret < 0)
+      tb->failed++;
+    else
+      reused += ret;
+  }
+
+  hist_print(stdout, "tcp", &tb->tcp);
+  hist_print(stdout, "full", &tb->full);
+  hist_print(stdout, "resumed", &tb->resumed);
+  hist_print(stdout, "cpu-full", &tb->cpu_full);
+  hist_print(stdout, "cpu-res", &tb->cpu_res);
+  printf("resumed %i of %i offered sessions, %i failed\n", reused,
+         tb->offered, tb->failed);
+
+  ret = tb->failed ? ERR_TMR : ERR_NON;
+
+  if (tb->cache)
+    SSL_SESSION_free(tb->cache);
+  SSL_CTX_free(ctx);
+  freeaddrinfo(res);
+  free(tb);
+
+  return ret;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/**
+ *  @file    tls.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief tls.c header file (TLS settings, connection timing and handshake
+ *         benchmark)
+ */
+
+#ifndef TLS_H_INCLUDED
+#define TLS_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "functions.h"
+#include "stats.h"
+
+/******************************************************************** DEFINE */
+
+#define TLS_PORT 5061          /* proxy port if the proxy URI has none */
+#define TLS_TICKET_WAIT_MS 200 /* TLS 1.3 tickets arrive after Finished */
+#define TLS_MAX_CIPHERS 64
+#define TLS_CONN_MAX 64 /* pjsip TLS connections tracked at once */
+
+/******************************************************************* TYPEDEF */
+
+/* a pjsip TLS connection, from its first message until it is closed */
+typedef struct tls_conn {
+  pjsip_transport *tp;
+  uint64_t t0_ns; /* first message queued, 0 once established */
+} s_tls_conn_t, *p_tls_conn_t;
+
+/* pjsip TLS connections of the run */
+typedef struct tls_stats {
+  s_hist_t setup;     /* first message -> TLS established, microseconds */
+  uint64_t connected; /* connections established */
+  uint64_t untimed;   /* established before a message was queued */
+  uint64_t closed;
+} s_tls_stats_t, *p_tls_stats_t;
+
+/* handshake benchmark results, values in microseconds */
+typedef struct tls_bench {
+  s_hist_t tcp;       /* TCP connect */
+  s_hist_t full;      /* full handshake latency */
+  s_hist_t resumed;   /* abbreviated handshake latency */
+  s_hist_t cpu_full;  /* thread CPU time of a full handshake */
+  s_hist_t cpu_res;   /* thread CPU time of an abbreviated handshake */
+  SSL_SESSION *cache; /* last session or ticket the server issued */
+  int tickets;        /* sessions received */
+  int offered;        /* handshakes that offered a session */
+  int failed;
+} s_tls_bench_t, *p_tls_bench_t;
+
+/*************************************************************** PROTOTYPES */
+
+void tls_apply(pjsip_tls_setting *ts, pj_pool_t *pool);
+int tls_start(void);
+void tls_print(FILE *fh);
+void tls_on_transport_state(pjsip_transport *tp, pjsip_transport_state state,
+                            const pjsip_transport_state_info *info);
+int tls_bench(int cnt);
+
+#endif // TLS_H_INCLUDED
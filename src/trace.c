@@ -0,0 +1,548 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * requires: libpjproject
+ */
+
+/**
+ *  @file    trace.c
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief this file holds the SIP wire trace module and exporter
+ *
+ *  Every SIP message passing the transport layer is appended to a
+ *  memory-mapped file. Writers reserve space with a single atomic add and
+ *  commit the record by storing its length last, so the pjsip worker
+ *  threads never block on each other or on the disk.
+ */
+
+/******************************************************************* INCLUDE */
+
+#include "trace.h"
+
+#define THIS_FILE "trace"
+
+/******************************************************************* GLOBALS */
+
+static int trc_fd = -1;
+static size_t trc_size = 0;
+static uint8_t *trc_base = NULL;
+static p_trace_file_hdr_t trc_hdr = NULL;
+
+static pj_bool_t trace_on_rx_msg(pjsip_rx_data *rdata);
+static pj_status_t trace_on_tx_msg(pjsip_tx_data *tdata);
+
+/* sits right below the transport layer, i.e. sees the printed tx buffer */
+static pjsip_module mod_trace = {
+    NULL,
+    NULL,                                  /* prev, next */
+    {"mod-pjchat-trace", 16},              /* name */
+    -1,                                    /* id */
+    PJSIP_MOD_PRIORITY_TRANSPORT_LAYER - 1, /* priority */
+    NULL,                                  /* load() */
+    NULL,                                  /* start() */
+    NULL,                                  /* stop() */
+    NULL,                                  /* unload() */
+    &trace_on_rx_msg,                      /* on_rx_request() */
+    &trace_on_rx_msg,                      /* on_rx_response() */
+    &trace_on_tx_msg,                      /* on_tx_request() */
+    &trace_on_tx_msg,                      /* on_tx_response() */
+    NULL,                                  /* on_tsx_state() */
+};
+
+/***************************************************************** FUNCTIONS */
+
+/*
+ * trace_now_ns()
+ * returns wall clock time in nanoseconds
+ */
+static uint64_t trace_now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * trace_addr(addr, raw, port)
+ * copies address and port of a socket address, returns 4, 6 or 0
+ */
+static uint8_t trace_addr(const pj_sockaddr *addr, uint8_t *raw,
+                          uint16_t *port) {
+  unsigned len;
+
+  len = pj_sockaddr_get_addr_len(addr);
+  if ((len != 4) && (len != 16))
+    return 0;
+
+  memcpy(raw, pj_sockaddr_get_addr(addr), len);
+  *port = pj_sockaddr_get_port(addr);
+
+  return (len == 4) ? 4 : 6;
+}
+
+/*
+ * trace_append(dir, tp, src, dst, msg, msg_len)
+ * reserves space for and commits a single record
+ */
+static void trace_append(uint8_t dir, pjsip_transport *tp,
+                         const pj_sockaddr *src, const pj_sockaddr *dst,
+                         const char *msg, size_t msg_len) {
+  p_trace_rec_t rec;
+  uint64_t need;
+  uint64_t off;
+  uint8_t saf;
+  uint8_t daf;
+
+  if (!trc_hdr || !msg || (msg_len == 0))
+    return;
+
+  need = TRACE_ALIGN(sizeof(s_trace_rec_t) + msg_len);
+  off = __atomic_fetch_add(&trc_hdr->used, need, __ATOMIC_RELAXED);
+  if (off + need > trc_hdr->capacity) {
+    __atomic_fetch_add(&trc_hdr->dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  rec = (p_trace_rec_t)(trc_base + TRACE_HDR_LEN + off);
+  rec->msg_len = (uint32_t)msg_len;
+  rec->ts_ns = trace_now_ns();
+  rec->dir = dir;
+  rec->tp = tp ? (uint8_t)tp->key.type : 0;
+  rec->sport = 0;
+  rec->dport = 0;
+  saf = src ? trace_addr(src, rec->saddr, &rec->sport) : 0;
+  daf = dst ? trace_addr(dst, rec->daddr, &rec->dport) : 0;
+  rec->af = saf ? saf : daf;
+  memcpy((uint8_t *)rec + sizeof(s_trace_rec_t), msg, msg_len);
+
+  /* commit */
+  __atomic_store_n(&rec->len, (uint32_t)need, __ATOMIC_RELEASE);
+}
+
+/*
+ * trace_on_rx_msg(rdata)
+ * module callback for incoming requests and responses
+ */
+static pj_bool_t trace_on_rx_msg(pjsip_rx_data *rdata) {
+
+  trace_append(TRACE_DIR_RX, rdata->tp_info.transport,
+               &rdata->pkt_info.src_addr,
+               rdata->tp_info.transport
+                   ? &rdata->tp_info.transport->local_addr
+                   : NULL,
+               rdata->msg_info.msg_buf, rdata->msg_info.len);
+
+  /* never consume the message */
+  return PJ_FALSE;
+}
+
+/*
+ * trace_on_tx_msg(tdata)
+ * module callback for outgoing requests and responses
+ */
+static pj_status_t trace_on_tx_msg(pjsip_tx_data *tdata) {
+
+  trace_append(TRACE_DIR_TX, tdata->tp_info.transport,
+               tdata->tp_info.transport
+                   ? &tdata->tp_info.transport->local_addr
+                   : NULL,
+               &tdata->tp_info.dst_addr, tdata->buf.start,
+               tdata->buf.cur - tdata->buf.start);
+
+  return PJ_SUCCESS;
+}
+
+/*
+ * trace_open(filename, capacity)
+ * creates a sparse trace file of capacity bytes and maps it
+ */
+int trace_open(const char *filename, size_t capacity) {
+
+  trc_size = TRACE_HDR_LEN + capacity;
+
+  trc_fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (trc_fd < 0) {
+    PJ_LOG(2, (THIS_FILE, "cannot open trace file %s\n", filename));
+    return -1;
+  }
+
+  if (ftruncate(trc_fd, trc_size) != 0) {
+    PJ_LOG(2, (THIS_FILE, "cannot size trace file %s\n", filename));
+    close(trc_fd);
+    trc_fd = -1;
+    return -1;
+  }
+
+  trc_base =
+      mmap(NULL, trc_size, PROT_READ | PROT_WRITE, MAP_SHARED, trc_fd, 0);
+  if (trc_base == MAP_FAILED) {
+    PJ_LOG(2, (THIS_FILE, "cannot map trace file %s\n", filename));
+    trc_base = NULL;
+    close(trc_fd);
+    trc_fd = -1;
+    return -1;
+  }
+
+  trc_hdr = (p_trace_file_hdr_t)trc_base;
+  trc_hdr->version = TRACE_VERSION;
+  trc_hdr->hdr_len = TRACE_HDR_LEN;
+  trc_hdr->capacity = capacity;
+  trc_hdr->used = 0;
+  trc_hdr->dropped = 0;
+  trc_hdr->start_ns = trace_now_ns();
+  __atomic_store_n(&trc_hdr->magic, TRACE_MAGIC, __ATOMIC_RELEASE);
+
+  PJ_LOG(3, (THIS_FILE, "tracing to %s (%lu bytes)\n", filename,
+             (unsigned long)capacity));
+
+  return 0;
+}
+
+/*
+ * trace_start(endpt)
+ * registers the trace module with the pjsip endpoint
+ */
+pj_status_t trace_start(pjsip_endpoint *endpt) {
+
+  if (!trc_hdr)
+    return PJ_EINVAL;
+
+  return pjsip_endpt_register_module(endpt, &mod_trace);
+}
+
+/*
+ * trace_close()
+ * unmaps the trace and truncates the file to the used size
+ */
+void trace_close(void) {
+  uint64_t used;
+  uint64_t dropped;
+
+  if (!trc_hdr)
+    return;
+
+  if (mod_trace.id != -1)
+    pjsip_endpt_unregister_module(pjsua_get_pjsip_endpt(), &mod_trace);
+
+  used = __atomic_load_n(&trc_hdr->used, __ATOMIC_ACQUIRE);
+  if (used > trc_hdr->capacity)
+    used = trc_hdr->capacity;
+  trc_hdr->used = used;
+  dropped = trc_hdr->dropped;
+
+  msync(trc_base, trc_size, MS_ASYNC);
+  munmap(trc_base, trc_size);
+  if (ftruncate(trc_fd, TRACE_HDR_LEN + used) != 0)
+    PJ_LOG(2, (THIS_FILE, "cannot truncate trace file\n"));
+  close(trc_fd);
+
+  PJ_LOG(3, (THIS_FILE, "trace closed, %lu bytes, %lu records dropped\n",
+             (unsigned long)used, (unsigned long)dropped));
+
+  trc_hdr = NULL;
+  trc_base = NULL;
+  trc_fd = -1;
+}
+
+/*
+ * put16(p, v) / put32(p, v)
+ * stores a value in network byte order
+ */
+static uint8_t *put16(uint8_t *p, uint16_t v) {
+  *p++ = v >> 8;
+  *p++ = v & 0xff;
+  return p;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v) {
+  p = put16(p, v >> 16);
+  return put16(p, v & 0xffff);
+}
+
+/*
+ * ip_checksum(p, len)
+ * internet checksum of an IPv4 header
+ */
+static uint16_t ip_checksum(const uint8_t *p, size_t len) {
+  uint32_t sum = 0;
+  size_t i;
+
+  for (i = 0; i + 1 < len; i += 2)
+    sum += (p[i] << 8) | p[i + 1];
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+
+  return (uint16_t)~sum;
+}
+
+/*
+ * export_pcap_rec(fh, rec, msg)
+ * writes one record as raw IP/UDP packet; stream transports are framed as
+ * UDP as well, so that every SIP message decodes on its own
+ */
+static void export_pcap_rec(FILE *fh, p_trace_rec_t rec, const uint8_t *msg) {
+  uint8_t hdr[16 + 40 + 8];
+  uint32_t rh[4];
+  uint8_t *p;
+  size_t iplen;
+  size_t caplen;
+  uint32_t payload;
+
+  iplen = (rec->af == 6) ? 40 : 20;
+  payload = rec->msg_len;
+  if (payload > PCAP_SNAPLEN - iplen - 8)
+    payload = PCAP_SNAPLEN - iplen - 8;
+  caplen = iplen + 8 + payload;
+
+  /* record header, host byte order like the global header */
+  rh[0] = rec->ts_ns / 1000000000ULL;
+  rh[1] = rec->ts_ns % 1000000000ULL;
+  rh[2] = caplen;
+  rh[3] = caplen;
+  memcpy(hdr, rh, sizeof(rh));
+  p = hdr + sizeof(rh);
+
+  if (rec->af == 6) {
+    p = put32(p, 0x60000000);
+    p = put16(p, 8 + payload);
+    *p++ = 17; /* UDP */
+    *p++ = 64;
+    memcpy(p, rec->saddr, 16);
+    memcpy(p + 16, rec->daddr, 16);
+    p += 32;
+  } else {
+    uint8_t *ip = p;
+    p = put16(p, 0x4500);
+    p = put16(p, caplen);
+    p = put32(p, 0x00004000); /* id 0, DF */
+    *p++ = 64;
+    *p++ = 17; /* UDP */
+    p = put16(p, 0);
+    memcpy(p, rec->saddr, 4);
+    memcpy(p + 4, rec->daddr, 4);
+    p += 8;
+    put16(ip + 10, ip_checksum(ip, 20));
+  }
+
+  p = put16(p, rec->sport);
+  p = put16(p, rec->dport);
+  p = put16(p, 8 + payload);
+  p = put16(p, 0);
+
+  fwrite(hdr, 1, p - hdr, fh);
+  fwrite(msg, 1, payload, fh);
+}
+
+/*
+ * export_text_rec(fh, rec, msg)
+ * writes one record as readable text
+ */
+static void export_text_rec(FILE *fh, p_trace_rec_t rec, const uint8_t *msg) {
+  char src[64];
+  char dst[64];
+  int af;
+
+  af = (rec->af == 6) ? AF_INET6 : AF_INET;
+  if (!inet_ntop(af, rec->saddr, src, sizeof(src)))
+    strcpy(src, "?");
+  if (!inet_ntop(af, rec->daddr, dst, sizeof(dst)))
+    strcpy(dst, "?");
+
+  fprintf(fh, "%lu.%09lu %s %s %s:%u -> %s:%u (%u bytes)\n",
+          (unsigned long)(rec->ts_ns / 1000000000ULL),
+          (unsigned long)(rec->ts_ns % 1000000000ULL),
+          (rec->dir == TRACE_DIR_TX) ? "TX" : "RX",
+          pjsip_transport_get_type_name((pjsip_transport_type_e)rec->tp), src,
+          rec->sport, dst, rec->dport, rec->msg_len);
+  fwrite(msg, 1, rec->msg_len, fh);
+  fputs("\n--end msg--\n", fh);
+}
+
+/*
+ * trace_memfind(buf, len, str)
+ * returns the first occurrence of str in a not terminated buffer or NULL
+ */
+static const uint8_t *trace_memfind(const uint8_t *buf, size_t len,
+                                    const char *str) {
+  size_t slen;
+  size_t i;
+
+  slen = strlen(str);
+  for (i = 0; i + slen <= len; i++) {
+    if (memcmp(buf + i, str, slen) == 0)
+      return buf + i;
+  }
+
+  return NULL;
+}
+
+/*
+ * export_replay_rec(fh, rec, msg, prev_ns)
+ * writes an outgoing MESSAGE as replay line (gap, msgtype, text/plain part)
+ */
+static int export_replay_rec(FILE *fh, p_trace_rec_t rec, const uint8_t *msg,
+                             uint64_t *prev_ns) {
+  const uint8_t *end;
+  const uint8_t *p;
+  const uint8_t *txt;
+  uint64_t gap;
+  int mtype;
+
+  end = msg + rec->msg_len;
+  if ((rec->dir != TRACE_DIR_TX) || (rec->msg_len < 8) ||
+      memcmp(msg, "MESSAGE ", 8))
+    return 0;
+
+  mtype = 22;
+  p = trace_memfind(msg, rec->msg_len, "msgtype:");
+  if (p)
+    mtype = atoi((const char *)p + 8);
+
+  p = trace_memfind(msg, rec->msg_len, "Content-Type: text/plain");
+  if (!p)
+    return 0;
+  p = trace_memfind(p, end - p, "\r\n\r\n");
+  if (!p)
+    return 0;
+  txt = p + 4;
+  p = trace_memfind(txt, end - txt, "\r\n--");
+  if (!p)
+    p = end;
+
+  gap = *prev_ns ? (rec->ts_ns - *prev_ns) / 1000000 : 0;
+  *prev_ns = rec->ts_ns;
+
+  fprintf(fh, "%lu\t%i\t", (unsigned long)gap, mtype);
+  for (; txt < p; txt++) {
+    switch (*txt) {
+    case '\n':
+      fputs("\\n", fh);
+      break;
+    case '\r':
+      fputs("\\r", fh);
+      break;
+    case '\t':
+      fputs("\\t", fh);
+      break;
+    case '\\':
+      fputs("\\\\", fh);
+      break;
+    default:
+      fputc(*txt, fh);
+      break;
+    }
+  }
+  fputc('\n', fh);
+
+  return 1;
+}
+
+/*
+ * trace_export(in, out, fmt)
+ * converts a binary trace to text, pcap or a replay file, returns number
+ * of records written
+ */
+int trace_export(const char *in, const char *out, int fmt) {
+  p_trace_file_hdr_t hdr;
+  p_trace_rec_t rec;
+  struct stat st;
+  uint8_t *base;
+  uint64_t off;
+  uint64_t used;
+  uint64_t prev_ns;
+  int fd;
+  int cnt;
+  FILE *fh;
+
+  fd = open(in, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "cannot open trace file %s\n", in);
+    return -1;
+  }
+  if ((fstat(fd, &st) != 0) || (st.st_size < TRACE_HDR_LEN)) {
+    fprintf(stderr, "invalid trace file %s\n", in);
+    close(fd);
+    return -1;
+  }
+
+  base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "cannot map trace file %s\n", in);
+    return -1;
+  }
+
+  hdr = (p_trace_file_hdr_t)base;
+  if ((hdr->magic != TRACE_MAGIC) || (hdr->version != TRACE_VERSION)) {
+    fprintf(stderr, "invalid trace file %s\n", in);
+    munmap(base, st.st_size);
+    return -1;
+  }
+
+  fh = (out && strcmp(out, "-")) ? fopen(out, "w") : stdout;
+  if (fh == NULL) {
+    fprintf(stderr, "cannot open output file %s\n", out);
+    munmap(base, st.st_size);
+    return -1;
+  }
+
+  if (fmt == TRACE_FMT_PCAP) {
+    uint32_t ghdr[6] = {PCAP_MAGIC, 2 | (4 << 16), 0, 0, PCAP_SNAPLEN,
+                        PCAP_LINKTYPE_RAW};
+    fwrite(ghdr, 1, sizeof(ghdr), fh);
+  }
+
+  /* used may still be larger than the file if the writer crashed */
+  used = hdr->used;
+  if (used > (uint64_t)st.st_size - hdr->hdr_len)
+    used = st.st_size - hdr->hdr_len;
+
+  cnt = 0;
+  off = 0;
+  prev_ns = 0;
+  while (off + sizeof(s_trace_rec_t) <= used) {
+    rec = (p_trace_rec_t)(base + hdr->hdr_len + off);
+    if ((rec->len == 0) || (off + rec->len > used))
+      break;
+    if (fmt == TRACE_FMT_PCAP) {
+      export_pcap_rec(fh, rec, (uint8_t *)rec + sizeof(s_trace_rec_t));
+      cnt++;
+    } else if (fmt == TRACE_FMT_REPLAY) {
+      cnt += export_replay_rec(fh, rec, (uint8_t *)rec + sizeof(s_trace_rec_t),
+                               &prev_ns);
+    } else {
+      export_text_rec(fh, rec, (uint8_t *)rec + sizeof(s_trace_rec_t));
+      cnt++;
+    }
+    off += rec->len;
+  }
+
+  if (hdr->dropped)
+    fprintf(stderr, "%lu records were dropped during capture\n",
+            (unsigned long)hdr->dropped);
+
+  if (fh != stdout)
+    fclose(fh);
+  munmap(base, st.st_size);
+
+  return cnt;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2020  <Wolfgang Kampichler>
+ *
+ * This file is part of pjchat
+ *
+ * pjchat is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pjchat is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ *  @file    trace.h
+ *  @author  Wolfgang Kampichler (DEC112 2.0)
+ *  @date    10-2026
+ *  @version 1.0
+ *
+ *  @brief trace.c header file (binary SIP wire trace)
+ */
+
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+/******************************************************************* INCLUDE */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <pjsua-lib/pjsua.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/******************************************************************** DEFINE */
+
+#define TRACE_MAGIC 0x31434a50 /* "PJC1" little endian */
+#define TRACE_VERSION 1
+#define TRACE_HDR_LEN 64
+#define TRACE_ALIGN(x) (((x) + 7) & ~((uint64_t)7))
+#define TRACE_DEFAULT_MB 256
+
+#define TRACE_DIR_RX 0
+#define TRACE_DIR_TX 1
+
+#define TRACE_FMT_TEXT 0
+#define TRACE_FMT_PCAP 1
+#define TRACE_FMT_REPLAY 2
+
+#define PCAP_MAGIC 0xa1b23c4d /* nanosecond resolution */
+#define PCAP_LINKTYPE_RAW 101
+#define PCAP_SNAPLEN 65535
+
+/******************************************************************* TYPEDEF */
+
+/* file header, lives in the first TRACE_HDR_LEN bytes of the mapping */
+typedef struct trace_file_hdr {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t hdr_len;
+  uint64_t capacity; /* bytes available for records */
+  uint64_t used;     /* bytes reserved by writers */
+  uint64_t dropped;  /* records that did not fit */
+  uint64_t start_ns; /* CLOCK_REALTIME at trace_open() */
+} s_trace_file_hdr_t, *p_trace_file_hdr_t;
+
+/* record header, followed by msg_len bytes of raw SIP message */
+typedef struct trace_rec {
+  uint32_t len; /* aligned record length, written last (0 = incomplete) */
+  uint32_t msg_len;
+  uint64_t ts_ns;
+  uint8_t dir;
+  uint8_t tp; /* pjsip_transport_type_e */
+  uint8_t af; /* 4 or 6 */
+  uint8_t pad;
+  uint16_t sport;
+  uint16_t dport;
+  uint8_t saddr[16];
+  uint8_t daddr[16];
+} s_trace_rec_t, *p_trace_rec_t;
+
+/*************************************************************** PROTOTYPES */
+
+int trace_open(const char *filename, size_t capacity);
+pj_status_t trace_start(pjsip_endpoint *endpt);
+void trace_close(void);
+int trace_export(const char *in, const char *out, int fmt);
+
+#endif // TRACE_H_INCLUDED